@@ -3,8 +3,13 @@
 
 #include "common.h"
 
-#define MAX_CHANNEL	 (16)
+#define MAX_CHANNEL	 (17)
 #define MAX_SEQUENCE (16)
+/* internal channels, ADC1 only */
+#define ADC_CHANNEL_TEMPERATURE (16)
+#define ADC_CHANNEL_VREFINT		(17)
+/* number of entries in channel indexed results */
+#define ADC_CHANNEL_COUNT (MAX_CHANNEL + 1)
 
 /*
 how many clock cycles to sample a channel, in adc clock cycles
@@ -28,16 +33,117 @@ From the reference manual page 237
 */
 typedef enum
 {
-	ADC_end_of_conversion = 0x02,
-	ADC_regular_start	  = 0x10,
+	ADC_analog_watchdog			   = 0x01,
+	ADC_end_of_conversion		   = 0x02,
+	ADC_injected_end_of_conversion = 0x04,
+	ADC_injected_started		   = 0x08,
+	ADC_regular_start			   = 0x10,
 } ADC_flag_t;
 
+/* the injected group has its own sequence of upto 4 channels, with a result register for each */
+#define MAX_INJECTED_SEQUENCE (4)
+
+/*
+What starts a conversion of the injected group
+From the reference manual page 241, JEXTSEL bits
+*/
+typedef enum
+{
+	ADC_injected_trigger_TIM1_TRGO,
+	ADC_injected_trigger_TIM1_CC4,
+	ADC_injected_trigger_TIM2_TRGO,
+	ADC_injected_trigger_TIM2_CC1,
+	ADC_injected_trigger_TIM3_CC4,
+	ADC_injected_trigger_TIM4_TRGO,
+	ADC_injected_trigger_EXTI15,
+	ADC_injected_trigger_software // ? started by ADC_injected_start
+} ADC_INJECTED_TRIGGER_t;
+
+/* how many conversions are averaged for each measurement of the sampling time tuning */
+#define ADC_TUNE_REPEATS (8)
+
+/*
+What starts a conversion of the regular group
+From the reference manual page 241, EXTSEL bits
+*/
+typedef enum
+{
+	ADC_trigger_TIM1_CC1,
+	ADC_trigger_TIM1_CC2,
+	ADC_trigger_TIM1_CC3,
+	ADC_trigger_TIM2_CC2,
+	ADC_trigger_TIM3_TRGO,
+	ADC_trigger_TIM4_CC4,
+	ADC_trigger_EXTI11,
+	ADC_trigger_software // ? started by ADC_start
+} ADC_REGULAR_TRIGGER_t;
+
+/* pass as the channel to watch all the channels of the regular sequence */
+#define ADC_WATCHDOG_ALL_CHANNELS (0xFF)
+/* results are 12 bit, so are the watchdog thresholds */
+#define ADC_MAX_VALUE (0x0FFF)
+
+/**
+ * @brief Callback called from the ADC interrupt
+ *
+ */
+typedef void (*ADC_callback_t)();
+
+/**
+ * @brief Callback called from the DMA interrupt for every completed sequence
+ *
+ * @param results the sequence results, valid until the callback returns in ADC_mode_loop
+ * @param count_channels sequence length
+ * @param timestamp CPU cycle count at the start of the sequence, see utils_get_cycles
+ */
+typedef void (*ADC_frame_callback_t)(const uint16_t * results, uint8_t count_channels, uint32_t timestamp);
+
 typedef enum
 {
 	ADC_mode_single, // ? This mode means just sampling all channels once, and waiting for this function be called again
-	ADC_mode_loop	 // ? This mode means the ADC will loop on all channels untill stopped
+	ADC_mode_loop	 // ? This mode means the ADC will loop on all channels untill stopped, read the results with ADC_read_snapshot
 } ADC_mode_t;
 
+/*
+A precomputed regular sequence, holding the register images so switching between sequences is a handful of stores
+build it once with ADC_profile_build, and switch to it with ADC_profile_apply
+*/
+typedef struct
+{
+	uint32_t sqr1;
+	uint32_t sqr2;
+	uint32_t sqr3;
+	uint32_t smpr1;
+	uint32_t smpr2;
+	uint32_t smpr1_mask;		// which SMPR1 bits belong to the profile channels
+	uint32_t smpr2_mask;		// which SMPR2 bits belong to the profile channels
+	uint16_t conversion_cycles; // ADC clock cycles to convert the whole sequence
+	uint8_t	 count_channels;	// sequence length, also the DMA length of a single sequence
+	uint8_t	 channels[MAX_SEQUENCE];
+} ADC_profile_t, *pADC_profile_t;
+
+/*
+Dual ADC modes, ADC1 is the master and ADC2 follows it.
+The results are packed in 32 bits, ADC1 in the lower half and ADC2 in the upper half
+*/
+typedef enum
+{
+	ADC_dual_simultaneous, // ? Each ADC samples its own sequence, both sample at the exact same instant
+	ADC_dual_interleaved   // ? Both ADCs sample the same channel 7 adc clock cycles apart, double the rate of a single ADC
+} ADC_dual_mode_t;
+
+/*
+Oversampling configuration for ADC_mode_loop.
+Every sample of a channel is accumulated, repeated channels in the sequence and consecutive sequences alike,
+after frames sequences the sum of each channel is shifted right by shift and published.
+example: a channel that is sampled once per sequence with frames = 16 and shift = 2 gives a 14-bit result
+*/
+typedef struct
+{
+	uint8_t frames; // how many full sequences are accumulated for each result, the decimation ratio
+	uint8_t shift;	// right shift applied to the accumulated sum
+} ADC_oversampling_t;
+
 /* it is possible to provide ADC_DEFAULT_SAMPLING_TIME which is one of the sampling values */
 #ifndef ADC_DEFAULT_SAMPLING_TIME
 #define ADC_DEFAULT_SAMPLING_TIME (ADC_SAMPLING_13_5)
@@ -68,6 +174,25 @@ bool ADC_init(uint8_t * channels, uint8_t count_channels, uint16_t * output);
  */
 bool ADC_init_ex(uint8_t * channels, ADC_SAMPLING_TIME_t * channels_sampling_time, uint8_t count_channels, uint16_t * output);
 
+/**
+ * @brief This function inits ADC1 and ADC2 together, with a single 32 bit DMA stream
+ *
+ * @param mode which dual mode to use
+ * @param channels_adc1 channels ADC1 samples, array of upto 16 channels
+ * @param channels_adc2 channels ADC2 samples, channels_adc2[i] is sampled with channels_adc1[i], not used in interleaved mode
+ * @param count_channels number of channels in each sequence
+ * @param output where to store the incoming data, ADC1 result in the lower half, ADC2 in the upper half
+ * @return true init successfull
+ * @return false init not successfull
+ *
+ * @remarks In simultaneous mode the same channel can't be sampled by both ADCs at the same slot, paired channels
+ * 			should have the same sampling time, ADC_DEFAULT_SAMPLING_TIME is used.
+ * 			In interleaved mode only channels_adc1[0] is used and the sampling time is ADC_SAMPLING_1_5,
+ * 			the count_channels passed to ADC_start is how many 32 bit results (two samples each) make a sequence
+ * @remark This function replaces ADC_init, only one of them can be used
+ */
+bool ADC_init_dual(ADC_dual_mode_t mode, uint8_t * channels_adc1, uint8_t * channels_adc2, uint8_t count_channels, uint32_t * output);
+
 /**
  * @brief This function returns the flag value for the selected flag
  *
@@ -91,15 +216,244 @@ periph_ptr_t ADC_get_data_register();
  * @brief This function will start the ADC
  *
  * @param mode which mode to use
+ * @param count_channels how many channels are in the sequence
+ *
+ * @remark In ADC_mode_single the results are written to the output given in the init.
+ * 		   In ADC_mode_loop the DMA runs in circular mode on an internal double buffer, and the output is not written,
+ * 		   use ADC_read_snapshot to get the latest full sequence
  */
 void ADC_start(ADC_mode_t mode, uint8_t count_channels);
 
+/**
+ * @brief This function starts the ADC, and calls the callback for every completed sequence
+ *
+ * @param mode which mode to use
+ * @param count_channels how many channels are in the sequence
+ * @param callback function to call from the DMA interrupt
+ * @return true the ADC started
+ * @return false the ADC isn't initialized, it is in dual mode, or the parameters are invalid
+ *
+ * @remark The DMA and ADC flags are handled in the interrupt, nothing has to be polled.
+ * 		   In ADC_mode_single the timestamp is taken when the conversion is started, in ADC_mode_loop it is the start time
+ * 		   plus the sequence number times the conversion time of a sequence, so consecutive timestamps are exactly one
+ * 		   sequence apart whatever the interrupt latency
+ */
+bool ADC_start_async(ADC_mode_t mode, uint8_t count_channels, ADC_frame_callback_t callback);
+
+/**
+ * @brief This function starts the ADC, converting the sequence once on each trigger
+ *
+ * @param trigger what starts each sequence, not ADC_trigger_software
+ * @param output where to store the results, the DMA loops over it
+ * @param count length of output, usually a multiple of the sequence length
+ * @param callback function to call from the DMA interrupt each time output was filled, can be NULL
+ * @return true the ADC waits for the trigger
+ * @return false the ADC isn't initialized, it is in dual mode, or the DMA can't be set up
+ *
+ * @remark The sequence from the init or the last applied profile is converted. Stop it with ADC_stop
+ */
+bool ADC_start_triggered(ADC_REGULAR_TRIGGER_t trigger, uint16_t * output, uint16_t count, ADC_callback_t callback);
+
+/**
+ * @brief This function computes the register images of a sequence, without touching the ADC
+ *
+ * @param profile profile object
+ * @param channels which channels to sample, array of upto 16 channels, channels can be repeated
+ * @param channels_sampling_time sampling time of each channel, NULL for the tuned sampling times
+ * @param count_channels number of channels to sample
+ * @return true build successfull
+ * @return false invalid parameters
+ */
+bool ADC_profile_build(ADC_profile_t * profile, const uint8_t * channels, const ADC_SAMPLING_TIME_t * channels_sampling_time, uint8_t count_channels);
+
+/**
+ * @brief This function returns how long a conversion with the given sampling time takes
+ *
+ * @param sampling_time sampling time of the channel
+ * @return uint16_t ADC clock cycles, including the 12.5 cycles of the conversion, 0 for an invalid sampling time
+ */
+uint16_t ADC_get_conversion_cycles(ADC_SAMPLING_TIME_t sampling_time);
+
+/**
+ * @brief This function switches the regular sequence of ADC1 to the given profile
+ *
+ * @param profile profile object, must stay valid while it is applied
+ * @return true switch successfull
+ * @return false ADC not initialized, in a dual mode, an invalid profile, or the running oversampling can overflow with it
+ *
+ * @remarks Call it between sequences, for example after a ADC_mode_single sequence completed.
+ * 			In ADC_mode_loop the ADC and DMA are restarted, since the DMA length changes with the sequence, the frame
+ * 			callback of ADC_start_async is kept and the timestamps restart from the switch.
+ * 			The following ADC_start calls should use the profile count_channels
+ */
+bool ADC_profile_apply(const ADC_profile_t * profile);
+
+/**
+ * @brief This function returns the profile the regular sequence currently uses
+ *
+ * @return const ADC_profile_t* the profile, NULL before the ADC is initialized
+ */
+const ADC_profile_t * ADC_profile_get_active();
+
+/**
+ * @brief This function copies the last complete sequence of ADC_mode_loop, without stopping the ADC
+ *
+ * @param output where to copy the data, must have room for count_channels values
+ * @return uint32_t sequence number of the copied data, increases by one for every complete sequence, 0 if no sequence is ready yet
+ *
+ * @remark This function never blocks the ADC or disables interrupts, incase the DMA completes a new sequence while copying
+ * 		   the copy is retried, so the output is always a consistent snapshot of a single sequence.
+ * 		   Can be called from any number of readers, but not from an interrupt with higher priority than the DMA channel 1 interrupt
+ */
+uint32_t ADC_read_snapshot(uint16_t * output);
+
+/**
+ * @brief This function is the same as ADC_read_snapshot, for the dual modes
+ *
+ * @param output where to copy the data, must have room for count_channels values
+ * @return uint32_t sequence number of the copied data, 0 if no sequence is ready yet or the ADC is not in a dual mode
+ */
+uint32_t ADC_read_snapshot_dual(uint32_t * output);
+
+/**
+ * @brief This function will enable or disable the oversampling of ADC_mode_loop
+ *
+ * @param config oversampling configuration, NULL or frames = 0 to disable
+ * @return true config successfull
+ * @return false invalid config, the ADC is not initialized, or a result of the sequence can overflow 16 bits:
+ * 				 frames * repeats of a channel * ADC_MAX_VALUE >> shift must fit
+ *
+ * @remark The accumulation runs in the DMA interrupt, and costs one addition per sequence slot and one shift per channel
+ * 		   for every decimated result. Changing the config restarts the accumulation
+ */
+bool ADC_set_oversampling(const ADC_oversampling_t * config);
+
+/**
+ * @brief This function copies the last decimated results, without stopping the ADC
+ *
+ * @param output where to copy the data, indexed by the ADC channel number, must have room for ADC_CHANNEL_COUNT values
+ * @return uint32_t result number, increases by one for every decimated result, 0 if no result is ready yet
+ *
+ * @remark Channels that are not in the sequence are written as 0. Same rules as ADC_read_snapshot apply
+ */
+uint32_t ADC_read_oversampled(uint16_t * output);
+
 /**
  * @brief This function will stop the ADC
  *
  */
 void ADC_stop();
 
+/**
+ * @brief This function stops the ADC and releases it and its DMA channel, so it can be initialized again
+ *
+ * @remarks The injected group, the watchdog and the tuned sampling times are kept
+ */
+void ADC_de_init();
+
+/**
+ * @brief This function inits the injected group of ADC1
+ *
+ * @param channels which channels to sample, upto MAX_INJECTED_SEQUENCE channels
+ * @param channels_sampling_time sampling time of each channel, NULL for the tuned sampling times
+ * @param count_channels number of channels to sample
+ * @param trigger what starts the injected conversions
+ * @return true init successfull
+ * @return false init not successfull
+ *
+ * @remarks The injected group interrupts the regular sequence, which resumes after it without losing
+ * 			data, the DMA is not involved, results are read directly with ADC_injected_read.
+ * 			The sampling time is shared with the regular group, a channel in both groups uses the last set value.
+ * 			Can be used with or without ADC_init, in any order
+ */
+bool ADC_injected_init(const uint8_t * channels, const ADC_SAMPLING_TIME_t * channels_sampling_time, uint8_t count_channels, ADC_INJECTED_TRIGGER_t trigger);
+
+/**
+ * @brief This function starts a conversion of the injected group, when the trigger is ADC_injected_trigger_software
+ *
+ */
+void ADC_injected_start();
+
+/**
+ * @brief This function returns the last result of the injected group
+ *
+ * @param index index of the channel in the injected sequence
+ * @return uint16_t the result, 0 for invalid index
+ */
+uint16_t ADC_injected_read(uint8_t index);
+
+/**
+ * @brief This function will set the callback called at the end of every injected group conversion
+ *
+ * @param callback function to call from the ADC interrupt, NULL to disable the interrupt
+ */
+void ADC_injected_set_callback(ADC_callback_t callback);
+
+/**
+ * @brief This function arms the analog watchdog, the callback is called when a watched value leaves the window
+ *
+ * @param channel which channel to watch, ADC_WATCHDOG_ALL_CHANNELS for every channel of the regular sequence
+ * @param low lowest value inside the window
+ * @param high highest value inside the window
+ * @param callback function to call from the ADC interrupt, can be NULL to only wake the CPU
+ * @return true armed successfully
+ * @return false invalid parameters
+ *
+ * @remarks The watchdog is one shot: it disarms itself before calling the callback, so a value that stays
+ * 			outside the window doesn't flood the CPU with interrupts. Re-arm it with the new position when done.
+ * 			Only the regular sequence is watched, the conversions themselves keep running, so with ADC_mode_loop
+ * 			the main loop can sleep with __WFI() until a pot moves.
+ * 			With ADC_WATCHDOG_ALL_CHANNELS all channels share one window, fitting gates and pedals that rest at the same level
+ */
+bool ADC_watchdog_arm(uint8_t channel, uint16_t low, uint16_t high, ADC_callback_t callback);
+
+/**
+ * @brief This function arms the analog watchdog on a single channel, with a window centered at the given value
+ *
+ * @param channel which channel to watch
+ * @param value center of the window, usually the last reading of the channel
+ * @param deadband how far the value may move on each side before the callback is called
+ * @param callback function to call from the ADC interrupt
+ * @return true armed successfully
+ * @return false invalid parameters
+ *
+ * @remarks The window is clamped to the ADC range, see ADC_watchdog_arm
+ */
+bool ADC_watchdog_arm_around(uint8_t channel, uint16_t value, uint16_t deadband, ADC_callback_t callback);
+
+/**
+ * @brief This function disarms the analog watchdog
+ *
+ */
+void ADC_watchdog_disarm();
+
+/**
+ * @brief This function finds the shortest sampling time of each channel that settles from a different voltage
+ *
+ * @param channels which channels to tune
+ * @param count_channels how many channels
+ * @param tolerance largest error from the fully settled value, in ADC counts
+ * @param results the tuned sampling time of each channel, can be NULL
+ * @return true tuning done
+ * @return false invalid parameters, or the injected group is in use
+ *
+ * @remarks Each measurement converts Vrefint right before the channel, so the sampling capacitor starts at about 1.2V.
+ * 			The baseline is the channel at 239.5 cycles, every shorter time within tolerance of it settled.
+ * 			A channel that rests close to 1.2V hides its settling error, tune with the controls away from the middle.
+ * 			The results are kept and used whenever the sampling times are NULL, see ADC_get_tuned_sampling_time.
+ * 			This blocks for about count_channels * 20 conversions of ADC_TUNE_REPEATS repeats,
+ * 			call it before starting the regular group, the sampling times of the channels are restored after
+ */
+bool ADC_tune_sampling_times(const uint8_t * channels, uint8_t count_channels, uint16_t tolerance, ADC_SAMPLING_TIME_t * results);
+
+/**
+ * @brief This function returns the tuned sampling time of a channel
+ *
+ * @param channel which channel
+ * @return ADC_SAMPLING_TIME_t the tuned sampling time, ADC_DEFAULT_SAMPLING_TIME if it wasn't tuned
+ */
+ADC_SAMPLING_TIME_t ADC_get_tuned_sampling_time(uint8_t channel);
+
 /**
  * @brief This function inits global variables in the ADC module
  *
@@ -0,0 +1,210 @@
+#ifndef __BUS_H__
+#define __BUS_H__
+
+#include "common.h"
+#include "GPIO.h"
+#include "I2C.h"
+#include "SPI.h"
+
+#define BUS_MAX_BUSES	(4)
+#define BUS_MAX_DEVICES (8)
+/* transactions waiting or running, per bus */
+#define BUS_QUEUE_SIZE (8)
+/* chip select pin of a device without one, such as an I2C device */
+#define BUS_NO_CS (0xFF)
+#define BUS_NO_DEADLINE (0)
+
+typedef enum
+{
+	BUS_PRIORITY_HIGH, // such as a DAC update
+	BUS_PRIORITY_NORMAL,
+	BUS_PRIORITY_LOW, // such as a display refresh
+	BUS_PRIORITY_COUNT
+} BUS_PRIORITY_t;
+
+typedef struct
+{
+	uint32_t	max_frequency;
+	SPI_MODE_t	mode;	   // SPI only
+	bool		lsb_first; // SPI only
+	uint8_t		address;   // I2C only, 7 bit address
+	GPIO_PORT_t cs_port;
+	uint8_t		cs_pin;	   // active low, BUS_NO_CS for none
+	uint16_t	max_chunk; // bytes per chunk of a split transaction, 0 to never split
+} BUS_device_config_t;
+
+/*
+A transaction writes tx_length bytes and then reads rx_length bytes, either length can be 0.
+With has_reg, reg is written first: a register address, or the control byte of a display. A chunk that keeps the chip
+select of the chunk before it continues the same command and doesn't write it. A chunk that starts a new command, on I2C
+or after the chip select was released, writes it again: a register address is advanced by the offset of the chunk, as the
+device would have, and with reg_fixed the same byte is written. With full_duplex (SPI only) rx gets the bytes clocked in
+while tx is sent, and rx_length must be tx_length
+*/
+typedef struct
+{
+	const uint8_t * tx;
+	uint8_t *		rx;
+	uint16_t		tx_length;
+	uint16_t		rx_length;
+	uint8_t			reg;
+	bool			has_reg;
+	bool			reg_fixed; // reg is a control byte, not a register address
+	bool			full_duplex;
+} BUS_transfer_t;
+
+/**
+ * @brief Called when a transaction is done, from the interrupt of the bus
+ *
+ * @param device device index
+ * @param success false if the backend failed the transaction
+ * @param context the context of BUS_submit
+ */
+typedef void (*BUS_callback_t)(uint8_t device, bool success, void * context);
+
+/**
+ * @brief Sets the clock and mode of the bus for a device, called when the next transaction is for another device
+ *
+ * @param id backend id
+ * @param device the device config
+ * @return true bus ready for the device
+ * @return false the device can't be served, its transaction fails
+ */
+typedef bool (*BUS_configure_t)(uint8_t id, const BUS_device_config_t * device);
+
+/**
+ * @brief Starts a transfer, the backend calls BUS_transfer_done when it is over
+ *
+ * @param id backend id
+ * @param device the device config
+ * @param transfer what to transfer, a whole transaction or a chunk of it
+ * @return true transfer started
+ * @return false the transfer failed to start
+ */
+typedef bool (*BUS_start_t)(uint8_t id, const BUS_device_config_t * device, const BUS_transfer_t * transfer);
+
+typedef struct
+{
+	BUS_configure_t configure; // can be NULL
+	BUS_start_t		start;
+	uint8_t			id;
+} BUS_backend_t;
+
+typedef struct
+{
+	uint32_t transactions;
+	uint32_t failed;
+	uint32_t deadline_missed; // transactions done after their deadline
+	uint32_t chunks;
+	uint32_t last_latency; // CPU cycles from BUS_submit to the end of the last transaction
+	uint32_t max_latency;
+	uint32_t max_wait; // CPU cycles from BUS_submit to the start of the first chunk, at the worst moment
+} BUS_device_stats_t;
+
+typedef struct
+{
+	uint32_t dropped;	  // transactions refused because the queue was full
+	uint32_t preemptions; // split transactions that gave the bus to another transaction between chunks
+	uint16_t depth;		  // transactions waiting or running
+	uint16_t max_depth;
+} BUS_stats_t;
+
+/**
+ * @brief This function adds a bus
+ *
+ * @param backend how to transfer on the bus
+ * @return int8_t bus index, -1 if there are too many buses
+ */
+int8_t BUS_add(const BUS_backend_t * backend);
+
+/**
+ * @brief This function adds an initialized SPI port as a bus
+ *
+ * @param port the port, from SPI_init
+ * @return int8_t bus index, -1 if the port is not initialized or there are too many buses
+ *
+ * @remarks The bus owns the port from now on, SPI_transfer must not be called on it
+ */
+int8_t BUS_add_spi(SPI_t port);
+
+/**
+ * @brief This function adds an initialized I2C port as a bus
+ *
+ * @param port the port, from I2C_init
+ * @return int8_t bus index, -1 if the port is not initialized or there are too many buses
+ *
+ * @remarks The bus owns the port from now on. A transaction is a write, a repeated start and a read to the device
+ * 			address, the clock of the port is shared by all the devices. A chunk is a transaction of its own on the bus
+ */
+int8_t BUS_add_i2c(I2C_t port);
+
+/**
+ * @brief This function adds a device on a bus, and inits its chip select pin
+ *
+ * @param bus bus index
+ * @param config device config, copied
+ * @return int8_t device index, -1 if the config is invalid, the pin is reserved or there are too many devices
+ */
+int8_t BUS_add_device(uint8_t bus, const BUS_device_config_t * config);
+
+/**
+ * @brief This function queues a transaction
+ *
+ * @param device device index
+ * @param transfer what to transfer, copied. The buffers must stay valid until the callback
+ * @param priority a higher priority transaction always goes first
+ * @param deadline CPU cycles from now, BUS_NO_DEADLINE for none
+ * @param callback called when the transaction is done, can be NULL
+ * @param context passed to the callback
+ * @return true transaction queued
+ * @return false invalid transaction, or the queue of the bus is full
+ *
+ * @remarks The next transaction is the one of the highest priority, then of the earliest deadline, then the oldest one.
+ * 			A transaction of a device with max_chunk is split, and between its chunks a more urgent transaction takes
+ * 			the bus: the chip select is released, and taken again to resume. Only devices that accept that, such as the
+ * 			data stream of a display, should set max_chunk. Everything after the first chunk runs from the interrupt
+ * 			that ends each chunk
+ */
+bool BUS_submit(uint8_t device, const BUS_transfer_t * transfer, BUS_PRIORITY_t priority, uint32_t deadline, BUS_callback_t callback,
+				void * context);
+
+/**
+ * @brief This function is called by the backend when a transfer is over, from its interrupt
+ *
+ * @param bus bus index
+ * @param success false if the transfer failed
+ */
+void BUS_transfer_done(uint8_t bus, bool success);
+
+/**
+ * @brief This function checks if a bus has nothing to do
+ *
+ * @param bus bus index
+ * @return true no transaction is waiting or running
+ * @return false busy
+ */
+bool BUS_is_idle(uint8_t bus);
+
+/**
+ * @brief This function returns the counters of a device
+ *
+ * @param device device index
+ * @param stats output, a copy of the counters
+ */
+void BUS_get_device_stats(uint8_t device, BUS_device_stats_t * stats);
+
+/**
+ * @brief This function returns the counters of a bus
+ *
+ * @param bus bus index
+ * @param stats output, a copy of the counters
+ */
+void BUS_get_stats(uint8_t bus, BUS_stats_t * stats);
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void BUS_startup();
+
+#endif /*__BUS_H__*/
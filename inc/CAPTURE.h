@@ -0,0 +1,123 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include "common.h"
+#include "GPIO.h"
+#include "TIM.h"
+
+/*
+Logic capture of a port: the DMA channel of a timer update reads the IDR of the port once per period into a ring of
+samples, and CAPTURE_read_events turns the new samples into the changes of the watched pins.
+
+Timing: sample n is taken n + 1 periods after CAPTURE_start, a fixed delay after its update plus the jitter of the
+transfers of other DMA channels that go first, about 70ns per transfer. The time of an event is its sample number, exact
+to a period whatever the CPU does: divide by the rate for seconds.
+Rate: a sample is a read through the APB2 bridge and a write to RAM, the same load as a word of WAVE, so the limit is
+the same. Timer DMA channels that run together share it.
+Reading: CAPTURE_read_events must run before the ring is full again, every size / rate seconds at the latest. Else the
+oldest samples are lost, counted in the stats, and the events of that time are merged into the first one after it
+*/
+
+/* samples per second, a sample every 12 CPU cycles at 72MHz */
+#define CAPTURE_MAX_RATE (6000000)
+
+typedef enum
+{
+	CAPTURE_NO_ERR,
+	CAPTURE_NULL,
+	CAPTURE_INVALID_CONFIG,
+	CAPTURE_ALREADY_INIT,
+	CAPTURE_NOT_INIT,
+	CAPTURE_TOO_FAST, // above CAPTURE_MAX_RATE, or the timer can't run at the rate
+	CAPTURE_DMA_BUSY, // the DMA channel of the timer update is used by someone else
+	CAPTURE_BUSY	  // the capture is running
+} CAPTURE_ERR_t;
+
+typedef struct
+{
+	TIM_t		timer;
+	GPIO_PORT_t port;	  // the pins must be reserved as inputs, with GPIO_array_init
+	uint16_t	pin_mask; // the pins that make events, a bit per pin
+	uint32_t	rate;	  // samples per second
+	uint16_t *	buffer;	  // ring of samples, aligned to 4 bytes
+	uint16_t	size;	  // samples in the ring, even
+} CAPTURE_config_t;
+
+typedef struct
+{
+	uint32_t sample;  // when, in samples since CAPTURE_start
+	uint16_t state;	  // the watched pins after the change
+	uint16_t changed; // the pins that changed
+} CAPTURE_event_t;
+
+typedef struct
+{
+	uint32_t events;
+	uint32_t overruns;	   // reads that found the ring overwritten
+	uint32_t lost_samples; // samples overwritten before they were read
+	uint32_t max_backlog;  // samples waiting at a read, at the worst moment
+} CAPTURE_stats_t;
+
+/**
+ * @brief This function inits the capture, it does not start it
+ *
+ * @param config capture config
+ * @return CAPTURE_ERR_t errors if any
+ */
+CAPTURE_ERR_t CAPTURE_init(const CAPTURE_config_t * config);
+
+/**
+ * @brief This function returns the rate of the capture
+ *
+ * @return uint32_t samples per second, 0 if the capture is not initialized
+ */
+uint32_t CAPTURE_get_rate();
+
+/**
+ * @brief This function starts the capture, the sample count and the stats start from 0
+ *
+ * @return CAPTURE_ERR_t errors if any
+ *
+ * @remarks The pins are read once here, so the first event is the first change after the start
+ */
+CAPTURE_ERR_t CAPTURE_start();
+
+/**
+ * @brief This function stops the capture, the samples before it can still be read
+ *
+ */
+void CAPTURE_stop();
+
+/**
+ * @brief This function returns how many samples were taken since CAPTURE_start, the time now
+ *
+ * @return uint32_t samples, wraps around
+ */
+uint32_t CAPTURE_get_sample_count();
+
+/**
+ * @brief This function reads the changes of the watched pins in the samples taken since the last read
+ *
+ * @param events output, in order of time
+ * @param max how many events fit in events
+ * @return uint16_t how many events were written
+ *
+ * @remarks Runs of samples without a change are skipped two samples per load. When events is full the rest of the
+ * 			samples wait for the next read
+ */
+uint16_t CAPTURE_read_events(CAPTURE_event_t * events, uint16_t max);
+
+/**
+ * @brief This function returns the counters of the capture
+ *
+ * @param stats output, a copy of the counters
+ */
+void CAPTURE_get_stats(CAPTURE_stats_t * stats);
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void CAPTURE_startup();
+
+#endif /*__CAPTURE_H__*/
@@ -0,0 +1,183 @@
+#ifndef __DISPLAY_H__
+#define __DISPLAY_H__
+
+#include "common.h"
+#include "BUS.h"
+#include "GPIO.h"
+
+#define DISPLAY_WIDTH	  (128)
+#define DISPLAY_MAX_PAGES (8)
+/* a page is a row of bytes, 8 pixels high with the top pixel in bit 0 */
+#define DISPLAY_PAGE_HEIGHT (8)
+/* data/command pin of a display on I2C, where a control byte selects between them */
+#define DISPLAY_NO_DC (0xFF)
+/* a character and the blank column after it */
+#define DISPLAY_CHAR_WIDTH (6)
+
+typedef enum
+{
+	DISPLAY_SSD1306,
+	DISPLAY_SH1106, // 132 columns of RAM with the 128 visible ones from column 2, page addressing only
+	DISPLAY_CONTROLLER_COUNT
+} DISPLAY_CONTROLLER_t;
+
+typedef enum
+{
+	DISPLAY_NO_ERR,
+	DISPLAY_NULL,
+	DISPLAY_INVALID_CONFIG,
+	DISPLAY_ALREADY_INIT,
+	DISPLAY_NOT_INIT,
+	DISPLAY_PINS_RESERVED,
+	DISPLAY_BUSY,	  // the last upload is still running
+	DISPLAY_BUS_ERROR // the bus refused the transaction
+} DISPLAY_ERR_t;
+
+typedef struct
+{
+	DISPLAY_CONTROLLER_t controller;
+	uint8_t				 height; // 32 or 64 rows
+	uint8_t				 device; // the display on its bus, from BUS_add_device
+	GPIO_PORT_t			 dc_port;
+	uint8_t				 dc_pin; // SPI only, low for commands and high for data, DISPLAY_NO_DC on I2C
+} DISPLAY_config_t;
+
+typedef struct
+{
+	uint32_t frames;			 // uploads started by DISPLAY_flush with something to send
+	uint32_t bytes;				 // bytes sent in all the frames, commands and data
+	uint32_t transactions;		 // bus transactions of all the frames
+	uint32_t failed;			 // uploads stopped by a failed transaction, their regions are sent again on the next flush
+	uint16_t last_frame_bytes;
+	uint16_t max_frame_bytes;
+	uint8_t	 last_frame_regions; // windows of the last frame, after coalescing
+} DISPLAY_stats_t;
+
+/**
+ * @brief This function inits the display, the init commands are sent in the background
+ *
+ * @param config display config
+ * @return DISPLAY_ERR_t errors if any
+ *
+ * @remarks The whole frame is marked as changed, so the first DISPLAY_flush clears the RAM of the display
+ */
+DISPLAY_ERR_t DISPLAY_init(const DISPLAY_config_t * config);
+
+/**
+ * @brief This function clears the frame
+ *
+ */
+void DISPLAY_clear();
+
+/**
+ * @brief This function sets a pixel
+ *
+ * @param x column
+ * @param y row
+ * @param on lit or dark
+ *
+ * @remarks Every drawing function clips what is out of the display
+ */
+void DISPLAY_set_pixel(uint8_t x, uint8_t y, bool on);
+
+/**
+ * @brief This function draws a horizontal line
+ *
+ * @param x first column
+ * @param y row
+ * @param width columns
+ * @param on lit or dark
+ */
+void DISPLAY_draw_hline(uint8_t x, uint8_t y, uint8_t width, bool on);
+
+/**
+ * @brief This function draws a vertical line
+ *
+ * @param x column
+ * @param y first row
+ * @param height rows
+ * @param on lit or dark
+ */
+void DISPLAY_draw_vline(uint8_t x, uint8_t y, uint8_t height, bool on);
+
+/**
+ * @brief This function draws a line between two points, both included
+ *
+ * @param x0 first column
+ * @param y0 first row
+ * @param x1 last column
+ * @param y1 last row
+ * @param on lit or dark
+ */
+void DISPLAY_draw_line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, bool on);
+
+/**
+ * @brief This function fills a rectangle
+ *
+ * @param x first column
+ * @param y first row
+ * @param width columns
+ * @param height rows
+ * @param on lit or dark
+ *
+ * @remarks A byte of the frame is written once for all the rows of the rectangle in its page
+ */
+void DISPLAY_fill_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, bool on);
+
+/**
+ * @brief This function draws a horizontal bar, lit from the left in proportion to a value and dark after it
+ *
+ * @param x first column
+ * @param y first row
+ * @param width columns of a full bar
+ * @param height rows
+ * @param value value, above max shows a full bar
+ * @param max value of a full bar
+ */
+void DISPLAY_draw_bar(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint16_t value, uint16_t max);
+
+/**
+ * @brief This function draws text, each character is DISPLAY_CHAR_WIDTH columns and 8 rows with its background
+ *
+ * @param x first column
+ * @param y top row, a multiple of DISPLAY_PAGE_HEIGHT is the fastest
+ * @param text null terminated string, see FONT_get_glyph
+ * @param invert dark text on a lit background
+ * @return uint8_t the column after the text
+ */
+uint8_t DISPLAY_draw_text(uint8_t x, uint8_t y, const char * text, bool invert);
+
+/**
+ * @brief This function starts uploading the parts of the frame that changed since the last flush
+ *
+ * @return DISPLAY_ERR_t DISPLAY_BUSY if the last upload is still running, DISPLAY_NO_ERR if started or nothing changed
+ *
+ * @remarks The changed columns of each page are a region. On the SSD1306 regions of consecutive pages are coalesced
+ * 			into one window when that sends fewer bytes, counting the window commands. The upload runs from the bus
+ * 			interrupts at BUS_PRIORITY_LOW, a command transaction and then the data of each region, through the DMA of
+ * 			the port. Drawing during the upload is allowed, what it changes is sent by the next flush
+ */
+DISPLAY_ERR_t DISPLAY_flush();
+
+/**
+ * @brief This function checks if an upload or the init commands are running
+ *
+ * @return true busy
+ * @return false idle
+ */
+bool DISPLAY_is_busy();
+
+/**
+ * @brief This function returns the counters of the uploads
+ *
+ * @param stats output, a copy of the counters
+ */
+void DISPLAY_get_stats(DISPLAY_stats_t * stats);
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void DISPLAY_startup();
+
+#endif /*__DISPLAY_H__*/
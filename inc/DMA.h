@@ -111,6 +111,14 @@ typedef struct
 	uint8_t increament_address : 1;
 } DMA_address_t, *pDMA_address_t;
 
+/**
+ * @brief Callback called from the channel interrupt
+ *
+ * @param dma_channel_number the channel that generated the interrupt
+ * @param flags which DMA_FLAG_t flags were set, the flags are already cleared when this is called
+ */
+typedef void (*DMA_callback_t)(DMA_CHANNELS_t dma_channel_number, uint32_t flags);
+
 /**
  * @brief This function will init the DMA channel
  *
@@ -119,7 +127,7 @@ typedef struct
  * @param memory flash/ram address to read/write - flash is readonly!!!
  * @param priority which priority this gets - also lower channel number, high priority
  * @param direction from or to peripheral
- * @param interrupt_mask which interrupts to generate for the channel
+ * @param interrupt_mask which interrupts to generate for the channel, combination of DMA_INTERRUPT_XX
  * @return true init successfull
  * @return false init not successfull
  */
@@ -169,6 +177,66 @@ bool DMA_stop_channel(DMA_CHANNELS_t dma_channel_number);
  */
 bool DMA_set_software_trigger(DMA_CHANNELS_t dma_channel_number, bool software_trigger);
 
+/**
+ * @brief This function will enable or disable the circular mode, in circular mode the channel reloads
+ * 		  the data count and the addresses when the transfer is complete, and keeps on running until stopped
+ *
+ * @param dma_channel_number which DMA channel to change
+ * @param circular true or false
+ * @return true no error
+ * @return false error
+ *
+ * @remark the channel must be stopped when calling this function
+ */
+bool DMA_set_circular(DMA_CHANNELS_t dma_channel_number, bool circular);
+
+/**
+ * @brief This function will change the memory address of the channel, so a buffer can be transfered without copying it
+ *
+ * @param dma_channel_number which DMA channel to change
+ * @param address new memory address
+ * @return true no error
+ * @return false error
+ *
+ * @remark the channel must be stopped when calling this function
+ */
+bool DMA_set_memory(DMA_CHANNELS_t dma_channel_number, const void * address);
+
+/**
+ * @brief This function will enable or disable the memory address increment of the channel,
+ * 		  without it the same memory word is transfered again, to send a fill value
+ *
+ * @param dma_channel_number which DMA channel to change
+ * @param increment true or false
+ * @return true no error
+ * @return false error
+ *
+ * @remark the channel must be stopped when calling this function
+ */
+bool DMA_set_memory_increment(DMA_CHANNELS_t dma_channel_number, bool increment);
+
+/**
+ * @brief This function will set the callback to be called from the channel interrupt
+ *
+ * @param dma_channel_number which DMA channel to change
+ * @param callback function to call, NULL to disable the channel interrupt in the NVIC
+ * @return true no error
+ * @return false error
+ *
+ * @remark which interrupts are generated is selected by the interrupt_mask in DMA_init_channel
+ */
+bool DMA_set_callback(DMA_CHANNELS_t dma_channel_number, DMA_callback_t callback);
+
+/**
+ * @brief This function will return how many data items are left to transfer in the current cycle
+ *
+ * @param dma_channel_number which DMA channel to check
+ * @return uint16_t items left, 0 incase of an error
+ *
+ * @remarks in circular mode, (data_count - remaining) is the index the DMA will write to next
+ */
+uint16_t DMA_get_remaining(DMA_CHANNELS_t dma_channel_number);
+
 /**
  * @brief This function will get the desired flag for the given channel
  *
@@ -0,0 +1,20 @@
+#ifndef __FONT_H__
+#define __FONT_H__
+
+#include "common.h"
+
+/* 5x7 glyphs, a byte per column with the top row in bit 0, the way a page of a display is laid out */
+#define FONT_WIDTH	(5)
+#define FONT_HEIGHT (7)
+#define FONT_FIRST	(' ')
+#define FONT_LAST	('~')
+
+/**
+ * @brief This function returns the columns of a character
+ *
+ * @param c printable ASCII character
+ * @return const uint8_t* FONT_WIDTH bytes, the glyph of '?' for a character out of FONT_FIRST..FONT_LAST
+ */
+const uint8_t * FONT_get_glyph(char c);
+
+#endif /*__FONT_H__*/
@@ -89,6 +89,26 @@ typedef struct _GPIO_PIN_ARRAY
  */
 GPIO_ERR_t GPIO_array_init(pGPIO_PIN_ARRAY_t pin_array, GPIO_PORT_t port, uint8_t start_pin, uint8_t end_pin, GPIO_MODE_t mode, GPIO_CONFIG_t config);
 
+/**
+ * @brief This function changes the mode of an initialized pin array, the pins stay reserved
+ *
+ * @param pin_array pin_array object, from GPIO_array_init
+ * @param mode input/output
+ * @param config specific configuration
+ * @return GPIO_ERR_t errors if any
+ */
+GPIO_ERR_t GPIO_array_set_mode(pGPIO_PIN_ARRAY_t pin_array, GPIO_MODE_t mode, GPIO_CONFIG_t config);
+
+/**
+ * @brief This function releases the pins of an initialized pin array, they are back to floating inputs as after reset
+ *
+ * @param pin_array pin_array object, from GPIO_array_init
+ * @return GPIO_ERR_t errors if any
+ *
+ * @remarks Only call it on an array whose GPIO_array_init succeeded, the pins may belong to someone else otherwise
+ */
+GPIO_ERR_t GPIO_array_de_init(pGPIO_PIN_ARRAY_t pin_array);
+
 /*
  ? Output functions
 */
@@ -147,6 +167,39 @@ uint16_t GPIO_array_read_all(const GPIO_PIN_ARRAY_t * pin_array);
  */
 uint16_t GPIO_array_read_pins(const GPIO_PIN_ARRAY_t * pin_array, uint16_t pin_mask);
 
+/**
+ * @brief This function returns the set/reset register of the pins port, so a DMA or timer can write the pins
+ *
+ * @param pin_array pin_array object
+ * @return periph_ptr_t BSRR address, NULL if the pin array is invalid
+ */
+periph_ptr_t GPIO_array_get_bsrr(const GPIO_PIN_ARRAY_t * pin_array);
+
+/**
+ * @brief This function returns the set/reset register of a port, for words built from several pin arrays of the port
+ *
+ * @param port which port
+ * @return periph_ptr_t BSRR address, NULL if the port is invalid
+ */
+periph_ptr_t GPIO_get_bsrr(GPIO_PORT_t port);
+
+/**
+ * @brief This function returns the input data register of a port, so a DMA can sample its pins
+ *
+ * @param port which port
+ * @return periph_ptr_t IDR address, NULL if the port is invalid
+ */
+periph_ptr_t GPIO_get_idr(GPIO_PORT_t port);
+
+/**
+ * @brief This function builds the BSRR word that writes a value to the pins, without touching the other pins of the port
+ *
+ * @param pin_array pin_array object
+ * @param value value to write, bit 0 is the first pin
+ * @return uint32_t the BSRR word, write it to the address from GPIO_array_get_bsrr
+ */
+uint32_t GPIO_array_get_bsrr_value(const GPIO_PIN_ARRAY_t * pin_array, uint16_t value);
+
 /**
  * @brief This function is called on the startup of the chip
  * 
@@ -0,0 +1,141 @@
+#ifndef __I2C_H__
+#define __I2C_H__
+
+#include "common.h"
+
+#define I2C_STANDARD_MODE_FREQUENCY (100000)
+#define I2C_FAST_MODE_FREQUENCY		(400000)
+
+typedef enum
+{
+	I2C_1, // SCL PB6, SDA PB7
+	I2C_2, // SCL PB10, SDA PB11
+	I2C_COUNT
+} I2C_t;
+
+typedef enum
+{
+	I2C_NO_ERR,
+	I2C_NULL,
+	I2C_INVALID_PORT,
+	I2C_NOT_INIT,
+	I2C_ALREADY_INIT,
+	I2C_INVALID_FREQUENCY,
+	I2C_PINS_RESERVED,
+	I2C_BUSY
+} I2C_ERR_t;
+
+typedef enum
+{
+	I2C_OK,
+	I2C_NACK, // the device did not acknowledge its address or a byte
+	I2C_ARBITRATION_LOST,
+	I2C_BUS_ERROR // misplaced start or stop, the port was reset
+} I2C_RESULT_t;
+
+typedef struct
+{
+	uint32_t transfers; // transfers done, with any result
+	uint32_t nacks;
+	uint32_t arbitration_lost;
+	uint32_t bus_errors;
+	uint32_t recoveries; // times the bus was stuck and was cleared with clock pulses
+} I2C_stats_t;
+
+/**
+ * @brief Called when a transfer is done, from the I2C or DMA interrupt
+ *
+ * @param port which port
+ * @param result how the transfer ended
+ */
+typedef void (*I2C_callback_t)(I2C_t port, I2C_RESULT_t result);
+
+/**
+ * @brief This function inits a port as a master
+ *
+ * @param port which port
+ * @param frequency clock, at most I2C_FAST_MODE_FREQUENCY. Above I2C_STANDARD_MODE_FREQUENCY the port is in fast mode
+ * @return I2C_ERR_t errors if any
+ *
+ * @remarks The data bytes go through DMA when the DMA channels of the port are free, else through an interrupt per byte.
+ * 			A bus held low by a device is cleared here with clock pulses
+ */
+I2C_ERR_t I2C_init(I2C_t port, uint32_t frequency);
+
+/**
+ * @brief This function returns the clock of a port
+ *
+ * @param port which port
+ * @return uint32_t clock in Hz, rounded down, 0 if the port is not initialized
+ */
+uint32_t I2C_get_frequency(I2C_t port);
+
+/**
+ * @brief This function starts a transfer: a write, then a read after a repeated start
+ *
+ * @param port which port
+ * @param address 7 bit address
+ * @param tx bytes to write, must stay valid until the callback
+ * @param tx_length how many bytes to write, 0 for a read only
+ * @param rx where to write the read bytes
+ * @param rx_length how many bytes to read, 0 for a write only
+ * @param callback called when the transfer is done, can be NULL
+ * @return I2C_ERR_t I2C_BUSY if a transfer is running or the bus is held by someone else
+ *
+ * @remarks Every step runs from the interrupts: the start, the address, the write, the repeated start and the read.
+ * 			With DMA a transfer takes a bounded number of interrupts whatever its length. Both lengths 0 only checks that
+ * 			a device answers to the address
+ */
+I2C_ERR_t I2C_transfer(I2C_t port, uint8_t address, const uint8_t * tx, uint16_t tx_length, uint8_t * rx, uint16_t rx_length,
+					   I2C_callback_t callback);
+
+/**
+ * @brief This function starts writing registers of a device, the register address is sent before the data
+ *
+ * @param port which port
+ * @param address 7 bit address
+ * @param reg first register
+ * @param data bytes to write, must stay valid until the callback
+ * @param length how many bytes
+ * @param callback called when the transfer is done, can be NULL
+ * @return I2C_ERR_t errors if any
+ */
+I2C_ERR_t I2C_write_register(I2C_t port, uint8_t address, uint8_t reg, const uint8_t * data, uint16_t length, I2C_callback_t callback);
+
+/**
+ * @brief This function starts reading registers of a device, the register address is written and then the data is read
+ *
+ * @param port which port
+ * @param address 7 bit address
+ * @param reg first register
+ * @param data where to write the bytes
+ * @param length how many bytes
+ * @param callback called when the transfer is done, can be NULL
+ * @return I2C_ERR_t errors if any
+ */
+I2C_ERR_t I2C_read_register(I2C_t port, uint8_t address, uint8_t reg, uint8_t * data, uint16_t length, I2C_callback_t callback);
+
+/**
+ * @brief This function checks if a transfer is running
+ *
+ * @param port which port
+ * @return true busy
+ * @return false free for a transfer
+ */
+bool I2C_is_busy(I2C_t port);
+
+/**
+ * @brief This function returns the counters of a port
+ *
+ * @param port which port
+ * @param stats output, a copy of the counters
+ */
+void I2C_get_stats(I2C_t port, I2C_stats_t * stats);
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void I2C_startup();
+
+#endif /*__I2C_H__*/
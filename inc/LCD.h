@@ -0,0 +1,121 @@
+#ifndef __LCD_H__
+#define __LCD_H__
+
+#include "common.h"
+#include "GPIO.h"
+#include "TIM.h"
+
+/*
+HD44780 character LCD on a 4 bit bus, RW tied low.
+The controller is never read, every step waits the time of the datasheet on the timer instead
+*/
+
+#define LCD_MAX_COLUMNS (40)
+#define LCD_MAX_ROWS	(4)
+/* a step per tick, a byte takes 37us */
+#define LCD_TICK_FREQUENCY (20000)
+/* commands waiting to be sent, a power of 2 */
+#define LCD_QUEUE_SIZE (32)
+/* characters of LCD_define_char */
+#define LCD_CUSTOM_CHARS (8)
+
+typedef enum
+{
+	LCD_NO_ERR,
+	LCD_NULL,
+	LCD_INVALID_CONFIG,
+	LCD_ALREADY_INIT,
+	LCD_NOT_INIT,
+	LCD_PINS_RESERVED,
+	LCD_TIMER_ERROR, // the timer can't run at LCD_TICK_FREQUENCY
+	LCD_QUEUE_FULL
+} LCD_ERR_t;
+
+typedef struct
+{
+	GPIO_PORT_t data_port;
+	uint8_t		data_pin; // D4, D5 to D7 on the next pins
+	GPIO_PORT_t control_port;
+	uint8_t		rs_pin;
+	uint8_t		e_pin;
+	uint8_t		columns; // 8 to LCD_MAX_COLUMNS
+	uint8_t		rows;	 // 1 to LCD_MAX_ROWS, 4 rows are 2 rows of the controller split in halves
+	TIM_t		timer;	 // paces the steps, its update interrupt is used
+} LCD_config_t;
+
+/**
+ * @brief This function inits the pins and the timer, and queues the init sequence of the controller
+ *
+ * @param config LCD config
+ * @return LCD_ERR_t errors if any
+ *
+ * @remarks The sequence starts with the power on wait of the datasheet and sets the 4 bit mode from any state of
+ * 			the controller, no delay is spent here
+ */
+LCD_ERR_t LCD_init(const LCD_config_t * config);
+
+/**
+ * @brief This function writes text to the screen shadow, the changed characters are sent in the background
+ *
+ * @param row which row
+ * @param column first column
+ * @param text null terminated string, cut at the end of the row
+ * @return uint8_t characters written
+ *
+ * @remarks Only a copy and a compare per character, it never waits. Only characters that differ from what the
+ * 			LCD shows are sent, a character is a tick, and an address command when it does not follow the last one
+ */
+uint8_t LCD_write(uint8_t row, uint8_t column, const char * text);
+
+/**
+ * @brief This function writes a character to the screen shadow
+ *
+ * @param row which row
+ * @param column which column
+ * @param c the character, 0 to LCD_CUSTOM_CHARS - 1 for the custom ones
+ */
+void LCD_put_char(uint8_t row, uint8_t column, char c);
+
+/**
+ * @brief This function fills the screen shadow with spaces
+ *
+ * @remarks No clear command is sent, which would take 1.52ms. Only the characters that were not spaces are sent
+ */
+void LCD_clear();
+
+/**
+ * @brief This function queues a command, such as the cursor or display control
+ *
+ * @param command instruction byte of the datasheet
+ * @return LCD_ERR_t LCD_QUEUE_FULL if there is no room
+ *
+ * @remarks The queue goes before the characters of the shadow. Clear and return home wait their 1.52ms
+ */
+LCD_ERR_t LCD_command(uint8_t command);
+
+/**
+ * @brief This function queues the pattern of a custom character
+ *
+ * @param index 0 to LCD_CUSTOM_CHARS - 1
+ * @param pattern 8 rows, the 5 low bits of each are the pixels
+ * @return LCD_ERR_t LCD_QUEUE_FULL if there is no room
+ *
+ * @remarks The characters shown with this index change as soon as the pattern is sent
+ */
+LCD_ERR_t LCD_define_char(uint8_t index, const uint8_t * pattern);
+
+/**
+ * @brief This function checks if everything was sent
+ *
+ * @return true the queue is empty and the LCD shows the shadow
+ * @return false some steps are left
+ */
+bool LCD_is_idle();
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void LCD_startup();
+
+#endif /*__LCD_H__*/
@@ -0,0 +1,196 @@
+#ifndef __MIDI_H__
+#define __MIDI_H__
+
+#include "common.h"
+
+/* data bytes a SysEx event carries, a longer SysEx is split into chunks */
+#define MIDI_SYSEX_CHUNK_SIZE (12)
+/* largest serialized event, a SysEx chunk with both F0 and F7 */
+#define MIDI_MAX_EVENT_BYTES (MIDI_SYSEX_CHUNK_SIZE + 2)
+
+#ifndef MIDI_QUEUE_SIZE
+#define MIDI_QUEUE_SIZE (64) // ! must be a power of 2
+#endif /*MIDI_QUEUE_SIZE*/
+
+/* channel voice messages keep the channel in the low nibble */
+#define MIDI_TYPE(status)	 ((status) < MIDI_SYSEX_START ? (status) & 0xF0 : (status))
+#define MIDI_CHANNEL(status) ((status) & 0x0F)
+#define MIDI_IS_STATUS(byte) ((byte) & 0x80)
+/* clock, start, stop etc. can appear between the bytes of any other message */
+#define MIDI_IS_REALTIME(status) ((status) >= MIDI_CLOCK)
+
+typedef enum
+{
+	/* channel voice messages */
+	MIDI_NOTE_OFF		  = 0x80,
+	MIDI_NOTE_ON		  = 0x90,
+	MIDI_POLY_PRESSURE	  = 0xA0,
+	MIDI_CONTROL_CHANGE	  = 0xB0,
+	MIDI_PROGRAM_CHANGE	  = 0xC0,
+	MIDI_CHANNEL_PRESSURE = 0xD0,
+	MIDI_PITCH_BEND		  = 0xE0,
+	/* system common messages */
+	MIDI_SYSEX_START	  = 0xF0,
+	MIDI_TIME_CODE		  = 0xF1,
+	MIDI_SONG_POSITION	  = 0xF2,
+	MIDI_SONG_SELECT	  = 0xF3,
+	MIDI_TUNE_REQUEST	  = 0xF6,
+	MIDI_SYSEX_END		  = 0xF7,
+	/* system realtime messages */
+	MIDI_CLOCK			  = 0xF8,
+	MIDI_START			  = 0xFA,
+	MIDI_CONTINUE		  = 0xFB,
+	MIDI_STOP			  = 0xFC,
+	MIDI_ACTIVE_SENSING	  = 0xFE,
+	MIDI_RESET			  = 0xFF
+} MIDI_STATUS_t;
+
+/* flags of SysEx chunks */
+#define MIDI_FLAG_SYSEX_FIRST	(0x01) // the chunk starts the SysEx, F0 precedes it
+#define MIDI_FLAG_SYSEX_LAST	(0x02) // the chunk ends the SysEx, F7 follows it
+#define MIDI_FLAG_SYSEX_ABORTED (0x04) // another status byte cut the SysEx, no F7 was received
+
+/*
+A parsed message, 16 bytes.
+A SysEx is delivered as consecutive chunks with the MIDI_SYSEX_START status, the data excludes F0 and F7
+*/
+typedef struct
+{
+	uint8_t status; // full status byte, with the channel for channel voice messages
+	uint8_t port;	// where the message came from
+	uint8_t length; // data bytes used
+	uint8_t flags;	// MIDI_FLAG_XX of SysEx chunks
+	uint8_t data[MIDI_SYSEX_CHUNK_SIZE];
+} MIDI_event_t, *pMIDI_event_t;
+
+/*
+Single producer single consumer queue of events, one side can be an interrupt.
+head and tail run freely and wrap, the difference is the number of events
+*/
+typedef struct
+{
+	MIDI_event_t	  events[MIDI_QUEUE_SIZE];
+	volatile uint16_t head; // written by the producer only
+	volatile uint16_t tail; // written by the consumer only
+	uint32_t		  dropped;
+} MIDI_queue_t, *pMIDI_queue_t;
+
+typedef struct
+{
+	uint8_t		 port;
+	uint8_t		 status;   // status of the message being assembled, 0 when waiting for a status byte
+	uint8_t		 expected; // data bytes of the status
+	uint8_t		 count;	   // data bytes received so far
+	uint8_t		 data[2];
+	bool		 in_sysex;
+	MIDI_event_t sysex; // chunk being assembled
+	uint32_t	 stray_bytes; // data bytes without a status
+} MIDI_parser_t, *pMIDI_parser_t;
+
+typedef struct
+{
+	uint8_t running_status; // last channel voice status sent, 0 if the next message must send its status
+	bool	zero_velocity_note_off; // send note off as note on with velocity 0, so notes share the running status
+} MIDI_serializer_t, *pMIDI_serializer_t;
+
+/**
+ * @brief This function inits an empty queue
+ *
+ * @param queue queue object
+ */
+void MIDI_queue_init(pMIDI_queue_t queue);
+
+/**
+ * @brief This function adds an event to the queue, call it from the producer only
+ *
+ * @param queue queue object
+ * @param event event to copy into the queue
+ * @return true event added
+ * @return false the queue is full, the event is counted as dropped
+ */
+bool MIDI_queue_push(pMIDI_queue_t queue, const MIDI_event_t * event);
+
+/**
+ * @brief This function returns the oldest event without removing it, call it from the consumer only
+ *
+ * @param queue queue object
+ * @return const MIDI_event_t* the oldest event, NULL if the queue is empty
+ */
+const MIDI_event_t * MIDI_queue_peek(const MIDI_queue_t * queue);
+
+/**
+ * @brief This function removes the oldest event, call it from the consumer only
+ *
+ * @param queue queue object
+ * @param event where to copy the event, can be NULL to just drop it
+ * @return true an event was removed
+ * @return false the queue is empty
+ */
+bool MIDI_queue_pop(pMIDI_queue_t queue, MIDI_event_t * event);
+
+/**
+ * @brief This function returns how many events are waiting
+ *
+ * @param queue queue object
+ * @return uint16_t number of events
+ */
+uint16_t MIDI_queue_count(const MIDI_queue_t * queue);
+
+/**
+ * @brief This function inits a parser
+ *
+ * @param parser parser object
+ * @param port written to the port of every event
+ */
+void MIDI_parser_init(pMIDI_parser_t parser, uint8_t port);
+
+/**
+ * @brief This function parses a block of bytes from a stream, events are pushed as soon as they are complete
+ *
+ * @param parser parser object, holds the state between blocks
+ * @param bytes received bytes
+ * @param length how many bytes
+ * @param queue where to push the events
+ * @return uint16_t number of events pushed
+ *
+ * @remarks Running status is followed, realtime bytes are pushed right away even in the middle of another message,
+ * 			and a SysEx is pushed in chunks of MIDI_SYSEX_CHUNK_SIZE, so nothing is buffered beyond one chunk
+ */
+uint16_t MIDI_parse(pMIDI_parser_t parser, const uint8_t * bytes, uint16_t length, pMIDI_queue_t queue);
+
+/**
+ * @brief This function inits a serializer
+ *
+ * @param serializer serializer object
+ * @param zero_velocity_note_off send note off as note on with velocity 0
+ */
+void MIDI_serializer_init(pMIDI_serializer_t serializer, bool zero_velocity_note_off);
+
+/**
+ * @brief This function makes the next message send its status byte
+ *
+ * @param serializer serializer object
+ *
+ * @remarks call it after a gap in the output or periodically, so a receiver that missed the status can sync again
+ */
+void MIDI_serializer_reset(pMIDI_serializer_t serializer);
+
+/**
+ * @brief This function serializes an event, omitting the status byte when the running status allows it
+ *
+ * @param serializer serializer object
+ * @param event event to send
+ * @param output at least MIDI_MAX_EVENT_BYTES bytes
+ * @return uint8_t bytes written, 0 for an invalid event
+ */
+uint8_t MIDI_serialize(pMIDI_serializer_t serializer, const MIDI_event_t * event, uint8_t * output);
+
+/**
+ * @brief This function returns how many data bytes follow a status byte
+ *
+ * @param status status byte
+ * @return uint8_t number of data bytes, 0 for realtime and SysEx
+ */
+uint8_t MIDI_data_length(uint8_t status);
+
+#endif /*__MIDI_H__*/
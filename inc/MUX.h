@@ -0,0 +1,105 @@
+#ifndef __MUX_H__
+#define __MUX_H__
+
+#include "common.h"
+#include "ADC.h"
+#include "GPIO.h"
+#include "TIM.h"
+
+/* a mux common pin per ADC channel, all muxes share the select lines */
+#define MUX_MAX_MUXES (MAX_SEQUENCE)
+/* CD4051 has 3 select lines, CD4067 has 4 */
+#define MUX_MAX_SELECT_BITS (4)
+#define MUX_MAX_INPUTS		(1 << MUX_MAX_SELECT_BITS)
+
+/* index of a mux input in the results, the muxes are converted together for each select address */
+#define MUX_INDEX(count_muxes, mux, input) ((input) * (count_muxes) + (mux))
+
+typedef enum
+{
+	MUX_NO_ERR,
+	MUX_NULL,
+	MUX_INVALID_CONFIG,
+	MUX_INVALID_TIMER, // the timer can't trigger the ADC, use TIM_1, TIM_2 or TIM_4
+	MUX_PINS_RESERVED,
+	MUX_NO_BANDWIDTH, // the settle and sampling don't fit in the step period of the requested scan rate
+	MUX_ADC_BUSY,	  // the ADC was already initialized by someone else
+	MUX_DMA_BUSY	  // the DMA channel of the timer update is used by someone else
+} MUX_ERR_t;
+
+typedef struct
+{
+	GPIO_PORT_t			select_port;
+	uint8_t				select_start_pin;			 // first select line, the rest are the following pins
+	uint8_t				select_bits;				 // 3 for CD4051, 4 for CD4067
+	uint8_t				channels[MUX_MAX_MUXES];	 // ADC channel of each mux common pin
+	uint8_t				count_muxes;
+	ADC_SAMPLING_TIME_t sampling_time;				 // sampling time of the mux outputs
+	uint32_t			settle_ns;					 // from a select change to the start of sampling, the slowest mux of the bank
+	uint16_t			scan_rate;					 // full scans per second, 0 to scan as fast as the settle and sampling allow
+	TIM_t				timer;						 // paces the steps
+} MUX_config_t;
+
+/**
+ * @brief Callback called from the DMA interrupt after every full scan
+ *
+ */
+typedef void (*MUX_callback_t)();
+
+/**
+ * @brief This function inits the select lines and the ADC, and starts scanning
+ *
+ * @param config mux bank config
+ * @param output results, (count_muxes << select_bits) entries indexed with MUX_INDEX
+ * @param callback function to call after every full scan, can be NULL
+ * @return MUX_ERR_t errors if any
+ *
+ * @remarks Each timer update writes the next select address through DMA, the compare event settle_ns later triggers
+ * 			a conversion of all the mux outputs, and the ADC DMA stores them. The next address is written as soon as the last
+ * 			mux output was sampled, so its settle time overlaps the conversion. No CPU is used per step.
+ * 			The timer compare channel: TIM_1 channel 1, TIM_2 channel 2, TIM_4 channel 4
+ */
+MUX_ERR_t MUX_init(const MUX_config_t * config, uint16_t * output, MUX_callback_t callback);
+
+/**
+ * @brief This function returns the latest value of a mux input
+ *
+ * @param mux mux index in the config channels
+ * @param input mux input
+ * @return uint16_t the value, 0 if out of range
+ */
+uint16_t MUX_get_value(uint8_t mux, uint8_t input);
+
+/**
+ * @brief This function returns the actual number of full scans per second
+ *
+ * @return uint32_t scan rate, 0 if not scanning
+ */
+uint32_t MUX_get_scan_rate();
+
+/**
+ * @brief This function returns how many full scans were completed
+ *
+ * @return uint32_t number of scans since MUX_init
+ */
+uint32_t MUX_get_scan_count();
+
+/**
+ * @brief This function restarts the scanning after MUX_stop, from the first select address
+ *
+ */
+void MUX_start();
+
+/**
+ * @brief This function stops the scanning, the select lines, timer and ADC stay reserved
+ *
+ */
+void MUX_stop();
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void MUX_startup();
+
+#endif /*__MUX_H__*/
@@ -0,0 +1,76 @@
+#ifndef __POT_H__
+#define __POT_H__
+
+#include "common.h"
+
+/* one bit per channel in the dirty bitmap */
+#define POT_MAX_CHANNELS (32)
+/* fractional bits of the filter state, the state is value << POT_FRACTION_BITS */
+#define POT_FRACTION_BITS (8)
+
+#ifndef POT_DEFAULT_SMOOTHING
+#define POT_DEFAULT_SMOOTHING (2)
+#endif /*POT_DEFAULT_SMOOTHING*/
+
+#ifndef POT_DEFAULT_HYSTERESIS
+#define POT_DEFAULT_HYSTERESIS (8)
+#endif /*POT_DEFAULT_HYSTERESIS*/
+
+typedef struct
+{
+	int32_t	 state;		 // filtered value, fixed point with POT_FRACTION_BITS fraction bits
+	uint16_t value;		 // last reported value
+	uint16_t hysteresis; // how far the filtered value must move from the reported value to report a change
+	uint8_t	 smoothing;	 // one pole coefficient as a shift, state += (input - state) >> smoothing, 0 is no smoothing
+} POT_channel_t;
+
+typedef struct
+{
+	POT_channel_t channels[POT_MAX_CHANNELS];
+	uint8_t		  count;
+	bool		  primed; // false until the first block was processed
+} POT_bank_t, *pPOT_bank_t;
+
+/**
+ * @brief This function inits a filter bank, all channels get the same tuning
+ *
+ * @param bank bank object
+ * @param count how many channels, upto POT_MAX_CHANNELS
+ * @param smoothing one pole smoothing shift for all channels
+ * @param hysteresis deadband for all channels, in input units
+ * @return true init successfull
+ * @return false init not successfull
+ */
+bool POT_bank_init(pPOT_bank_t bank, uint8_t count, uint8_t smoothing, uint16_t hysteresis);
+
+/**
+ * @brief This function will tune a single channel of the bank
+ *
+ * @param bank bank object
+ * @param index channel index in the bank
+ * @param smoothing one pole smoothing shift, higher is smoother and slower
+ * @param hysteresis deadband, in input units
+ */
+void POT_set_channel(pPOT_bank_t bank, uint8_t index, uint8_t smoothing, uint16_t hysteresis);
+
+/**
+ * @brief This function runs the filter on a block of readings, for example an ADC snapshot
+ *
+ * @param bank bank object
+ * @param samples one reading per channel, in the bank order
+ * @return uint32_t dirty bitmap, bit i is set if channel i moved beyond its deadband
+ *
+ * @remark The first block primes the filters and reports all channels as dirty
+ */
+uint32_t POT_bank_update(pPOT_bank_t bank, const uint16_t * samples);
+
+/**
+ * @brief This function returns the last reported value of a channel
+ *
+ * @param bank bank object
+ * @param index channel index in the bank
+ * @return uint16_t the value, 0 for invalid index
+ */
+uint16_t POT_get_value(const POT_bank_t * bank, uint8_t index);
+
+#endif /*__POT_H__*/
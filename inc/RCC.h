@@ -53,6 +53,37 @@ void RCC_peripheral_set_clock(RCC_Peripherals_t periph, bool enable);
  */
 void RCC_peripheral_reset(RCC_Peripherals_t periph);
 
+/**
+ * @brief This function returns the frequency of the AHB bus, which is also the core frequency
+ * 
+ * @return uint32_t frequency in Hz
+ */
+uint32_t RCC_get_AHB_freq();
+
+/**
+ * @brief This function returns the frequency of the APB1 bus
+ * 
+ * @return uint32_t frequency in Hz
+ */
+uint32_t RCC_get_APB1_freq();
+
+/**
+ * @brief This function returns the frequency of the APB2 bus
+ * 
+ * @return uint32_t frequency in Hz
+ */
+uint32_t RCC_get_APB2_freq();
+
+/**
+ * @brief This function returns the clock frequency the given peripheral runs at
+ * 
+ * @param periph - peripheral ID
+ * @return uint32_t frequency in Hz
+ * 
+ * @remarks timers run at twice the bus frequency when the bus prescaler is not 1, the ADC runs after the ADC prescaler
+ */
+uint32_t RCC_get_peripheral_freq(RCC_Peripherals_t periph);
+
 /**
  * @brief This function will reset the clock configuration registers to thier default value
  * 
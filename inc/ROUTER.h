@@ -0,0 +1,221 @@
+#ifndef __ROUTER_H__
+#define __ROUTER_H__
+
+#include "common.h"
+#include "MIDI.h"
+#include "UART.h"
+
+#define ROUTER_MAX_INPUTS  (4)
+#define ROUTER_MAX_OUTPUTS (4)
+#define ROUTER_MAX_ROUTES  (16)
+/* parsed events waiting to be routed, per input */
+#define ROUTER_INPUT_QUEUE_SIZE (16) // ! must be a power of 2
+/* realtime bytes waiting for the next write, per output */
+#define ROUTER_REALTIME_QUEUE_SIZE (8)
+/* bytes in each write, a realtime byte waits for one write at most. Must fit MIDI_MAX_EVENT_BYTES */
+#define ROUTER_TX_BUFFER_SIZE (16)
+
+/* message classes of a filter */
+#define ROUTER_PASS_NOTES	   (0x0001) // note on, note off and poly pressure
+#define ROUTER_PASS_CONTROL	   (0x0002)
+#define ROUTER_PASS_PROGRAM	   (0x0004)
+#define ROUTER_PASS_PRESSURE   (0x0008) // channel pressure
+#define ROUTER_PASS_PITCH_BEND (0x0010)
+#define ROUTER_PASS_SYSEX	   (0x0020)
+#define ROUTER_PASS_COMMON	   (0x0040) // time code, song position, song select and tune request
+#define ROUTER_PASS_CLOCK	   (0x0080) // clock, start, continue and stop
+#define ROUTER_PASS_SENSING	   (0x0100) // active sensing and reset
+#define ROUTER_PASS_ALL		   (0x01FF)
+#define ROUTER_ALL_CHANNELS	   (0xFFFF)
+
+typedef struct
+{
+	uint16_t channels; // bit per channel of the channel voice messages
+	uint16_t types;	   // ROUTER_PASS_XX
+} ROUTER_filter_t;
+
+/**
+ * @brief Returns the received bytes of a source without copying them
+ *
+ * @param id source id
+ * @param data set to the first waiting byte
+ * @return uint16_t number of contiguous bytes at data
+ */
+typedef uint16_t (*ROUTER_read_t)(uint8_t id, const uint8_t ** data);
+
+/**
+ * @brief Frees read bytes of a source
+ *
+ * @param id source id
+ * @param count how many bytes
+ */
+typedef void (*ROUTER_consume_t)(uint8_t id, uint16_t count);
+
+/**
+ * @brief Starts writing bytes to a sink, the buffer stays valid until the sink is no longer busy
+ *
+ * @param id sink id
+ * @param data bytes
+ * @param length how many bytes
+ * @return true write started
+ * @return false the sink is busy
+ */
+typedef bool (*ROUTER_write_t)(uint8_t id, const uint8_t * data, uint16_t length);
+
+/**
+ * @brief Checks if a sink is still writing
+ *
+ * @param id sink id
+ * @return true busy
+ * @return false ready for a write
+ */
+typedef bool (*ROUTER_busy_t)(uint8_t id);
+
+/**
+ * @brief Hands a whole event to a sink of a packet transport, instead of its serialized bytes
+ *
+ * @param id sink id
+ * @param event the event, copied by the sink
+ * @return true event taken
+ * @return false the event was dropped
+ */
+typedef bool (*ROUTER_send_t)(uint8_t id, const MIDI_event_t * event);
+
+typedef struct
+{
+	ROUTER_read_t	 read;
+	ROUTER_consume_t consume;
+	uint8_t			 id;
+} ROUTER_source_t;
+
+/*
+A sink takes either bytes with write, or whole events with send. For an event sink busy means that an event may
+not fit, and the events skip the output buffer
+*/
+typedef struct
+{
+	ROUTER_write_t write;
+	ROUTER_send_t  send; // NULL for a byte sink
+	ROUTER_busy_t  busy;
+	uint8_t		   id;
+} ROUTER_sink_t;
+
+typedef struct
+{
+	uint32_t events;	  // events parsed or injected
+	uint32_t dropped;	  // injected events refused because the queue was full
+	uint32_t stray_bytes; // data bytes without a status
+	uint16_t depth;		  // events waiting to be routed
+	uint16_t max_depth;
+} ROUTER_input_stats_t;
+
+typedef struct
+{
+	uint32_t bytes;
+	uint32_t realtime_dropped; // realtime bytes refused because the realtime queue was full
+	uint32_t last_latency;	   // CPU cycles from receiving the oldest byte of the last write (or event) to starting it
+	uint32_t max_latency;
+	uint16_t depth; // bytes waiting for the next write
+	uint16_t max_depth;
+} ROUTER_output_stats_t;
+
+/**
+ * @brief This function adds an input
+ *
+ * @param source where the bytes come from, NULL for an input fed only by ROUTER_inject
+ * @return int8_t input index, -1 if there are too many inputs
+ */
+int8_t ROUTER_add_input(const ROUTER_source_t * source);
+
+/**
+ * @brief This function adds an output
+ *
+ * @param sink where the bytes go, must have write or send
+ * @param zero_velocity_note_off send note off as note on with velocity 0, for longer running status
+ * @return int8_t output index, -1 if there are too many outputs
+ */
+int8_t ROUTER_add_output(const ROUTER_sink_t * sink, bool zero_velocity_note_off);
+
+/**
+ * @brief This function adds an initialized UART as both an input and an output
+ *
+ * @param port which port, must be initialized
+ * @param input set to the input index
+ * @param output set to the output index
+ * @return true port added
+ * @return false too many inputs or outputs
+ */
+bool ROUTER_add_uart(UART_t port, int8_t * input, int8_t * output);
+
+/**
+ * @brief This function adds the USB-MIDI class as both an input and an output
+ *
+ * @param input set to the input index
+ * @param output set to the output index
+ * @return true the class was added
+ * @return false too many inputs or outputs
+ *
+ * @remarks USB_MIDI_init must be called before USB_init. Nothing is sent while the host has not configured the device
+ */
+bool ROUTER_add_usb(int8_t * input, int8_t * output);
+
+/**
+ * @brief This function routes an input to an output
+ *
+ * @param input input index
+ * @param output output index
+ * @param filter which messages pass, NULL passes everything
+ * @return true route added
+ * @return false too many routes, or invalid indexes
+ */
+bool ROUTER_add_route(uint8_t input, uint8_t output, const ROUTER_filter_t * filter);
+
+/**
+ * @brief This function removes all the routes
+ *
+ */
+void ROUTER_clear_routes();
+
+/**
+ * @brief This function adds a locally generated event to an input
+ *
+ * @param input input index
+ * @param event the event
+ * @return true event queued
+ * @return false the input queue is full
+ */
+bool ROUTER_inject(uint8_t input, const MIDI_event_t * event);
+
+/**
+ * @brief This function moves the messages from the inputs to the outputs, call it from the main loop
+ *
+ * @remarks Realtime messages skip the queues, they are written before any other byte on the next write of each output.
+ * 			A SysEx locks each of its outputs to its input until its last chunk, the other inputs that route to these
+ * 			outputs wait meanwhile. An event is routed to all its outputs at once, or waits in its input queue.
+ * 			The work is bounded per byte: a parse, a serialize per route and a copy
+ */
+void ROUTER_poll();
+
+/**
+ * @brief This function returns the counters of an input
+ *
+ * @param input input index
+ * @param stats output, a copy of the counters
+ */
+void ROUTER_get_input_stats(uint8_t input, ROUTER_input_stats_t * stats);
+
+/**
+ * @brief This function returns the counters of an output
+ *
+ * @param output output index
+ * @param stats output, a copy of the counters
+ */
+void ROUTER_get_output_stats(uint8_t output, ROUTER_output_stats_t * stats);
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void ROUTER_startup();
+
+#endif /*__ROUTER_H__*/
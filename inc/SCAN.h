@@ -0,0 +1,142 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include "common.h"
+#include "ADC.h"
+#include "TIM.h"
+
+/* how many channels can be requested, one bit each in the update masks */
+#define SCAN_MAX_REQUESTS (32)
+/* longest rotation of frames, slower channels are sampled once every upto SCAN_MAX_FRAMES frames */
+#define SCAN_MAX_FRAMES (16)
+
+typedef enum
+{
+	SCAN_NO_ERR,
+	SCAN_NULL,
+	SCAN_INVALID_REQUEST,
+	SCAN_TOO_MANY_SLOTS, // a frame needs more than MAX_SEQUENCE conversions
+	SCAN_NO_BANDWIDTH,	 // the longest frame doesn't fit in the frame period
+	SCAN_ADC_BUSY		 // the ADC was already initialized by someone else
+} SCAN_ERR_t;
+
+typedef struct
+{
+	uint8_t				channel;	   // ADC channel
+	ADC_SAMPLING_TIME_t sampling_time; // sampling time of the channel
+	uint16_t			rate;		   // requested samples per second
+} SCAN_request_t;
+
+/*
+A scan plan: the ADC converts one frame every frame period, each frame is a sequence profile.
+A channel with period p is in every p-th frame, starting at its phase. The frames repeat every frame_count frames
+*/
+typedef struct
+{
+	uint16_t	  frame_rate;  // frames per second, the highest requested rate
+	uint8_t		  frame_count; // rotation length, a power of 2
+	uint8_t		  request_count;
+	ADC_profile_t frames[SCAN_MAX_FRAMES];
+	uint8_t		  frame_requests[SCAN_MAX_FRAMES][MAX_SEQUENCE]; // request index of each slot of each frame
+	uint8_t		  periods[SCAN_MAX_REQUESTS];					 // in frames, a power of 2
+	uint8_t		  phases[SCAN_MAX_REQUESTS];
+	uint16_t	  achieved_rates[SCAN_MAX_REQUESTS];			 // samples per second of each request
+	uint16_t	  max_conversion_cycles;						 // ADC clock cycles of the longest frame
+	uint32_t	  max_conversion_time_ns;						 // conversion time of the longest frame
+	uint16_t	  load;											 // per mille of the frame period the ADC is busy in the longest frame
+} SCAN_plan_t, *pSCAN_plan_t;
+
+/* activity tracking of an adaptive scan */
+typedef struct
+{
+	uint16_t background_rate; // samples per second of the idle channels
+	uint16_t threshold;		  // change from the last resting value that marks a channel as moving
+	uint16_t idle_samples;	  // samples within the threshold before a moving channel is idle again
+} SCAN_adaptive_config_t;
+
+/**
+ * @brief Callback called from the timer interrupt after a frame was collected
+ *
+ * @param values latest value of every request, indexed like the requests
+ * @param updated which requests got a new value in this frame
+ */
+typedef void (*SCAN_callback_t)(const uint16_t * values, uint32_t updated);
+
+/**
+ * @brief This function plans the frames so each channel gets at least its requested rate
+ *
+ * @param plan plan object, filled even on failure so the achieved rates and load can be inspected
+ * @param requests channels and their rates, a channel can be requested once, a repeated channel is an invalid request
+ * @param count number of requests, upto SCAN_MAX_REQUESTS
+ * @return SCAN_ERR_t errors if any
+ *
+ * @remarks The frame rate is the highest requested rate, every other rate is rounded up so that the channel is sampled
+ * 			every power of 2 frames, upto SCAN_MAX_FRAMES. Channels are spread over the frames to balance the conversion time
+ */
+SCAN_ERR_t SCAN_plan(pSCAN_plan_t plan, const SCAN_request_t * requests, uint8_t count);
+
+/**
+ * @brief This function starts scanning with the given plan, the ADC is owned by the scanner until stopped
+ *
+ * @param plan plan object, must stay valid while scanning
+ * @param timer which timer paces the frames
+ * @param callback function to call after each frame, can be NULL
+ * @return SCAN_ERR_t errors if any
+ *
+ * @remarks Each timer update collects the previous frame, switches the ADC to the next frame profile and starts it,
+ * 			so the values are one frame period old at most
+ */
+SCAN_ERR_t SCAN_start(pSCAN_plan_t plan, TIM_t timer, SCAN_callback_t callback);
+
+/**
+ * @brief This function starts scanning with rates that follow the activity of each channel
+ *
+ * @param requests channels and their rates while moving
+ * @param count number of requests, upto SCAN_MAX_REQUESTS
+ * @param config activity tracking config
+ * @param timer which timer paces the frames
+ * @param callback function to call after each frame, can be NULL
+ * @return SCAN_ERR_t errors if any
+ *
+ * @remarks Every channel starts idle, at the background rate. A channel that moves is re-planned at its requested rate,
+ * 			so a touch is picked up within one background period and then follows the requested rate.
+ * 			The frames are re-planned only when the set of moving channels changes
+ */
+SCAN_ERR_t SCAN_start_adaptive(const SCAN_request_t * requests, uint8_t count, const SCAN_adaptive_config_t * config,
+							   TIM_t timer, SCAN_callback_t callback);
+
+/**
+ * @brief This function returns which requests of an adaptive scan are moving
+ *
+ * @return uint32_t bitmap of the moving requests
+ */
+uint32_t SCAN_get_moving();
+
+/**
+ * @brief This function stops the scanning
+ *
+ */
+void SCAN_stop();
+
+/**
+ * @brief This function returns the latest value of a request
+ *
+ * @param index request index
+ * @return uint16_t the value, 0 for an invalid index
+ */
+uint16_t SCAN_get_value(uint8_t index);
+
+/**
+ * @brief This function returns how many frames were not complete when the next one was due
+ *
+ * @return uint32_t number of overruns since SCAN_start
+ */
+uint32_t SCAN_get_overruns();
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void SCAN_startup();
+
+#endif /*__SCAN_H__*/
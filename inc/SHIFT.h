@@ -0,0 +1,93 @@
+#ifndef __SHIFT_H__
+#define __SHIFT_H__
+
+#include "common.h"
+#include "GPIO.h"
+#include "SPI.h"
+#include "TIM.h"
+
+/* bytes in the 74HC595 chain and in the 74HC165 chain, the longer chain sets the frame size */
+#define SHIFT_MAX_BYTES (16)
+
+typedef enum
+{
+	SHIFT_NO_ERR,
+	SHIFT_NULL,
+	SHIFT_INVALID_CONFIG,
+	SHIFT_ALREADY_INIT,
+	SHIFT_SPI_ERROR, // the port could not be initialized, see SPI_init
+	SHIFT_PINS_RESERVED,
+	SHIFT_TOO_FAST, // a byte and the latch don't fit in the slot of each byte at the requested refresh rate
+	SHIFT_DMA_BUSY	// the timer DMA channels are used by someone else, see SHIFT_init
+} SHIFT_ERR_t;
+
+typedef struct
+{
+	SPI_t		port;
+	uint32_t	spi_frequency; // max clock of the chains
+	TIM_t		timer;		   // paces the bytes and the latch
+	uint16_t	refresh_rate;  // frames per second
+	uint8_t		frame_bytes;   // chips in the longer chain
+	GPIO_PORT_t latch_port;
+	uint8_t		latch_pin; // RCLK of the 74HC595 chain, latches on the rising edge
+	uint8_t		load_pin;  // SH/LD of the 74HC165 chain, loads while low
+} SHIFT_config_t;
+
+/**
+ * @brief This function inits the SPI port, the latch pins and the timer, and starts refreshing
+ *
+ * @param config chains config
+ * @return SHIFT_ERR_t errors if any
+ *
+ * @remarks Each frame has a slot per byte and one more slot. The timer update writes the next LED byte to the SPI data
+ * 			register through DMA, and the SPI RX DMA stores the button byte clocked in at the same time. A compare
+ * 			event late in the slot of the last byte latches the LEDs and loads the buttons, and the compare of the extra
+ * 			slot releases both pins. No CPU is used per frame. Port and timer pairs with free DMA channels:
+ * 			SPI_1 with TIM_1 or TIM_4, SPI_2 with TIM_2, TIM_3 or TIM_4
+ */
+SHIFT_ERR_t SHIFT_init(const SHIFT_config_t * config);
+
+/**
+ * @brief This function returns the LED frame, written in place
+ *
+ * @return uint8_t* frame_bytes bytes, the first one goes to the 74HC595 furthest from the port, NULL if not initialized
+ *
+ * @remarks Bytes written now are shown from the next frame
+ */
+uint8_t * SHIFT_get_leds();
+
+/**
+ * @brief This function returns the button frame, updated in place every frame
+ *
+ * @return const uint8_t* frame_bytes bytes, the first one from the 74HC165 nearest to the port, NULL if not initialized
+ *
+ * @remarks The buttons are valid from the second frame after SHIFT_start
+ */
+const uint8_t * SHIFT_get_buttons();
+
+/**
+ * @brief This function returns the actual number of frames per second
+ *
+ * @return uint32_t refresh rate, 0 if not refreshing
+ */
+uint32_t SHIFT_get_refresh_rate();
+
+/**
+ * @brief This function restarts the refresh after SHIFT_stop, from the first byte
+ *
+ */
+void SHIFT_start();
+
+/**
+ * @brief This function stops the refresh, the port, pins and timer stay reserved
+ *
+ */
+void SHIFT_stop();
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void SHIFT_startup();
+
+#endif /*__SHIFT_H__*/
@@ -0,0 +1,141 @@
+#ifndef __SPI_H__
+#define __SPI_H__
+
+#include "common.h"
+
+/* sent by a transfer without data to send */
+#define SPI_FILL_BYTE (0xFF)
+
+typedef enum
+{
+	SPI_1, // SCK PA5, MISO PA6, MOSI PA7
+	SPI_2, // SCK PB13, MISO PB14, MOSI PB15
+	SPI_COUNT
+} SPI_t;
+
+/* clock polarity in bit 1 and phase in bit 0 */
+typedef enum
+{
+	SPI_MODE_0, // idle low, sample on the rising edge
+	SPI_MODE_1, // idle low, sample on the falling edge
+	SPI_MODE_2, // idle high, sample on the falling edge
+	SPI_MODE_3	// idle high, sample on the rising edge
+} SPI_MODE_t;
+
+typedef enum
+{
+	SPI_NO_ERR,
+	SPI_NULL,
+	SPI_INVALID_PORT,
+	SPI_NOT_INIT,
+	SPI_ALREADY_INIT,
+	SPI_INVALID_FREQUENCY,
+	SPI_PINS_RESERVED,
+	SPI_DMA_BUSY,
+	SPI_BUSY
+} SPI_ERR_t;
+
+/**
+ * @brief Called when a transfer is done, from the DMA interrupt
+ *
+ * @param port which port
+ */
+typedef void (*SPI_callback_t)(SPI_t port);
+
+/**
+ * @brief This function inits a port as a master, with DMA for both directions
+ *
+ * @param port which port
+ * @param max_frequency the clock is the fastest one up to this frequency
+ * @param mode clock polarity and phase
+ * @param lsb_first send the least significant bit first
+ * @return SPI_ERR_t errors if any
+ *
+ * @remarks The clock is the bus clock divided by 2 to 256, SPI1 is on APB2 and SPI2 on APB1.
+ * 			The chip select is left to the caller, NSS is not used
+ */
+SPI_ERR_t SPI_init(SPI_t port, uint32_t max_frequency, SPI_MODE_t mode, bool lsb_first);
+
+/**
+ * @brief This function releases a port, its pins and its DMA channels, so it can be initialized again
+ *
+ * @param port which port, no transfer may be running
+ */
+void SPI_de_init(SPI_t port);
+
+/**
+ * @brief This function changes the clock and the frame format of a port, for a device with other timings
+ *
+ * @param port which port
+ * @param max_frequency the clock is the fastest one up to this frequency
+ * @param mode clock polarity and phase
+ * @param lsb_first send the least significant bit first
+ * @return SPI_ERR_t SPI_BUSY if a transfer or a stream is running
+ */
+SPI_ERR_t SPI_configure(SPI_t port, uint32_t max_frequency, SPI_MODE_t mode, bool lsb_first);
+
+/**
+ * @brief This function returns the clock frequency of a port
+ *
+ * @param port which port
+ * @return uint32_t clock in Hz, 0 if the port is not initialized
+ */
+uint32_t SPI_get_frequency(SPI_t port);
+
+/**
+ * @brief This function starts a full duplex transfer
+ *
+ * @param port which port
+ * @param tx bytes to send, must stay valid until the transfer is done, NULL to send SPI_FILL_BYTE
+ * @param rx where to write the received bytes, NULL to drop them
+ * @param length how many bytes
+ * @param callback called when the last byte is done, can be NULL
+ * @return SPI_ERR_t SPI_BUSY if a transfer or a stream is running
+ */
+SPI_ERR_t SPI_transfer(SPI_t port, const uint8_t * tx, uint8_t * rx, uint16_t length, SPI_callback_t callback);
+
+/**
+ * @brief This function checks if a transfer or a stream is running
+ *
+ * @param port which port
+ * @return true busy
+ * @return false free for a transfer
+ */
+bool SPI_is_busy(SPI_t port);
+
+/**
+ * @brief This function starts receiving every byte into a circular buffer, the bytes are sent by another DMA
+ *
+ * @param port which port
+ * @param rx_ring received bytes, the DMA wraps at the end
+ * @param size size of the ring
+ * @return SPI_ERR_t SPI_BUSY if a transfer or a stream is running
+ *
+ * @remarks Nothing is sent by the port itself, a timer DMA writes the data register from SPI_get_data_register
+ * 			at its own pace. That DMA must be on another channel than the port RX and TX channels, which stay reserved.
+ * 			The RX DMA interrupt is off during the stream
+ */
+SPI_ERR_t SPI_start_stream(SPI_t port, uint8_t * rx_ring, uint16_t size);
+
+/**
+ * @brief This function stops a stream
+ *
+ * @param port which port
+ */
+void SPI_stop_stream(SPI_t port);
+
+/**
+ * @brief This function returns the data register of a port, for a DMA that writes it
+ *
+ * @param port which port
+ * @return periph_ptr_t data register, NULL for an invalid port
+ */
+periph_ptr_t SPI_get_data_register(SPI_t port);
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void SPI_startup();
+
+#endif /*__SPI_H__*/
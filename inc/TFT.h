@@ -0,0 +1,148 @@
+#ifndef __TFT_H__
+#define __TFT_H__
+
+#include "common.h"
+#include "GPIO.h"
+#include "TIM.h"
+#include "WAVE.h"
+
+/*
+8 bit 8080 parallel bus to a TFT controller with the MIPI DCS commands, such as the ILI9341 or the ST7789.
+Pixels are RGB565, sent high byte first. RD is not used and must be tied high
+*/
+
+/* a byte is two words of the waveform engine, the data with WR low and then WR high */
+#define TFT_MAX_WRITE_RATE (WAVE_MAX_RATE / 2)
+/* longest line of TFT_stream_rect, in pixels */
+#define TFT_MAX_WIDTH (320)
+/* chip select pin of a display without one */
+#define TFT_NO_CS (0xFF)
+
+typedef enum
+{
+	TFT_NO_ERR,
+	TFT_NULL,
+	TFT_INVALID_CONFIG,
+	TFT_ALREADY_INIT,
+	TFT_NOT_INIT,
+	TFT_PINS_RESERVED,
+	TFT_TOO_FAST,  // the timer can't run the slots at the requested rate, or above TFT_MAX_WRITE_RATE
+	TFT_DMA_BUSY,  // the DMA channel of the timer update is used by someone else, or the timer by another waveform
+	TFT_BUSY	   // a rectangle is being written
+} TFT_ERR_t;
+
+typedef struct
+{
+	GPIO_PORT_t data_port;
+	uint8_t		data_pin; // D0, D1 to D7 on the next pins, at most pin 8
+	uint8_t		wr_pin;	  // on the data port, the controller latches the data on its rising edge
+	GPIO_PORT_t control_port;
+	uint8_t		dc_pin; // low for commands, high for data
+	uint8_t		cs_pin; // active low, TFT_NO_CS if tied low
+	TIM_t		timer;	// paces the writes
+	uint32_t	write_rate; // bytes per second, at most TFT_MAX_WRITE_RATE
+} TFT_config_t;
+
+/**
+ * @brief Called when a rectangle is written, from the DMA interrupt
+ *
+ */
+typedef void (*TFT_callback_t)();
+
+/**
+ * @brief Fills the next line of a streamed rectangle, from the DMA interrupt
+ *
+ * @param row line of the rectangle, from 0
+ * @param line output, width pixels
+ */
+typedef void (*TFT_line_t)(uint16_t row, uint16_t * line);
+
+/**
+ * @brief This function inits the bus pins and the waveform engine of the timer
+ *
+ * @param config bus config
+ * @return TFT_ERR_t errors if any
+ *
+ * @remarks The controller itself is not configured, send its init sequence with TFT_command
+ */
+TFT_ERR_t TFT_init(const TFT_config_t * config);
+
+/**
+ * @brief This function returns the actual write rate
+ *
+ * @return uint32_t bytes per second, 0 if not initialized
+ */
+uint32_t TFT_get_write_rate();
+
+/**
+ * @brief This function sends a command and its parameters, from the CPU
+ *
+ * @param command command byte
+ * @param params parameter bytes, can be NULL if count is 0
+ * @param count how many parameters
+ * @return TFT_ERR_t TFT_BUSY if a rectangle is being written
+ *
+ * @remarks Each byte is three stores to the BSRR, no read-modify-write. Commands that need a delay after them, such as
+ * 			the sleep out, are the caller's business
+ */
+TFT_ERR_t TFT_command(uint8_t command, const uint8_t * params, uint8_t count);
+
+/**
+ * @brief This function starts writing a rectangle from a buffer
+ *
+ * @param x first column
+ * @param y first row
+ * @param width columns
+ * @param height rows
+ * @param pixels width * height pixels, row after row. Must stay valid until the callback
+ * @param callback called when the rectangle is written, can be NULL
+ * @return TFT_ERR_t errors if any
+ *
+ * @remarks The window is set from the CPU, then the bytes are streamed with WAVE_stream from a ring of words: the
+ * 			byte with WR low, then WR high. The DMA interrupt encodes the next half of the ring, about 8 CPU cycles per byte
+ */
+TFT_ERR_t TFT_write_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint16_t * pixels, TFT_callback_t callback);
+
+/**
+ * @brief This function starts writing a rectangle whose lines are made while it is written
+ *
+ * @param x first column
+ * @param y first row
+ * @param width columns, at most TFT_MAX_WIDTH
+ * @param height rows
+ * @param line called for each line when the previous one is consumed
+ * @param callback called when the rectangle is written, can be NULL
+ * @return TFT_ERR_t errors if any
+ */
+TFT_ERR_t TFT_stream_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, TFT_line_t line, TFT_callback_t callback);
+
+/**
+ * @brief This function starts filling a rectangle with a color
+ *
+ * @param x first column
+ * @param y first row
+ * @param width columns
+ * @param height rows
+ * @param color RGB565
+ * @param callback called when the rectangle is filled, can be NULL
+ * @return TFT_ERR_t errors if any
+ *
+ * @remarks The ring holds the words of the color and is sent over and over, the CPU only ends the fill
+ */
+TFT_ERR_t TFT_fill_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t color, TFT_callback_t callback);
+
+/**
+ * @brief This function checks if a rectangle is being written
+ *
+ * @return true busy
+ * @return false idle
+ */
+bool TFT_is_busy();
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void TFT_startup();
+
+#endif /*__TFT_H__*/
@@ -0,0 +1,184 @@
+#ifndef __TIM_H__
+#define __TIM_H__
+
+#include "common.h"
+#include "DMA.h"
+
+typedef enum
+{
+	TIM_1, // advanced timer on APB2
+	TIM_2,
+	TIM_3,
+	TIM_4,
+	TIM_COUNT
+} TIM_t;
+
+typedef enum
+{
+	TIM_CHANNEL_1,
+	TIM_CHANNEL_2,
+	TIM_CHANNEL_3,
+	TIM_CHANNEL_4,
+	TIM_CHANNEL_COUNT
+} TIM_CHANNEL_t;
+
+/*
+What the timer outputs on TRGO, used to trigger other peripherals such as the ADC
+From the reference manual page 404, MMS bits
+*/
+typedef enum
+{
+	TIM_TRGO_RESET,
+	TIM_TRGO_ENABLE,
+	TIM_TRGO_UPDATE,
+	TIM_TRGO_COMPARE_PULSE,
+	TIM_TRGO_OC1REF,
+	TIM_TRGO_OC2REF,
+	TIM_TRGO_OC3REF,
+	TIM_TRGO_OC4REF
+} TIM_TRGO_t;
+
+/* DMA requests a timer can generate, the values are the offset from the UDE bit in the DIER */
+typedef enum
+{
+	TIM_DMA_UPDATE	= 0,
+	TIM_DMA_CC1		= 1,
+	TIM_DMA_CC2		= 2,
+	TIM_DMA_CC3		= 3,
+	TIM_DMA_CC4		= 4,
+	TIM_DMA_TRIGGER = 6
+} TIM_DMA_REQUEST_t;
+
+/**
+ * @brief Callback called from the timer update interrupt
+ *
+ * @param timer the timer that overflowed
+ */
+typedef void (*TIM_callback_t)(TIM_t timer);
+
+/**
+ * @brief This function inits the timer to overflow at the given frequency
+ *
+ * @param timer which timer
+ * @param frequency update frequency in Hz
+ * @return true init successfull
+ * @return false frequency can't be reached
+ *
+ * @remarks the prescaler is kept as low as possible, so the period has the best resolution.
+ * 			the actual frequency is the timer clock / ((prescaler + 1) * (period + 1)), see TIM_get_frequency
+ */
+bool TIM_init(TIM_t timer, uint32_t frequency);
+
+/**
+ * @brief This function inits the timer with raw values
+ *
+ * @param timer which timer
+ * @param prescaler the timer counts at timer clock / (prescaler + 1)
+ * @param period the timer overflows after period + 1 counts
+ * @return true init successfull
+ * @return false init not successfull
+ */
+bool TIM_init_ex(TIM_t timer, uint16_t prescaler, uint16_t period);
+
+/**
+ * @brief This function returns the actual update frequency of the timer
+ *
+ * @param timer which timer
+ * @return uint32_t frequency in Hz, rounded down
+ */
+uint32_t TIM_get_frequency(TIM_t timer);
+
+/**
+ * @brief This function returns the clock of the timer counter, after the prescaler
+ *
+ * @param timer which timer
+ * @return uint32_t frequency in Hz
+ */
+uint32_t TIM_get_tick_frequency(TIM_t timer);
+
+/**
+ * @brief This function selects what the timer outputs on TRGO
+ *
+ * @param timer which timer
+ * @param trgo TRGO source
+ */
+void TIM_set_master_mode(TIM_t timer, TIM_TRGO_t trgo);
+
+/**
+ * @brief This function sets the compare value of a channel, the channel works in PWM mode 1
+ *
+ * @param timer which timer
+ * @param channel which channel
+ * @param value compare value, the channel output is active while the counter is below it
+ * @return true no error
+ * @return false error
+ *
+ * @remarks The compare event can trigger the ADC or a DMA request. The output is enabled internally only,
+ * 			the pin must be set to an alternate function with the GPIO API to be driven
+ */
+bool TIM_set_compare(TIM_t timer, TIM_CHANNEL_t channel, uint16_t value);
+
+/**
+ * @brief This function will enable or disable a DMA request of the timer
+ *
+ * @param timer which timer
+ * @param request which request
+ * @param enable true or false
+ */
+void TIM_set_dma_request(TIM_t timer, TIM_DMA_REQUEST_t request, bool enable);
+
+/**
+ * @brief This function returns which DMA channel serves the given timer request
+ *
+ * @param timer which timer
+ * @param request which request
+ * @return DMA_CHANNELS_t the channel, DMA_CH_COUNT if the request has no DMA channel
+ */
+DMA_CHANNELS_t TIM_get_dma_channel(TIM_t timer, TIM_DMA_REQUEST_t request);
+
+/**
+ * @brief This function will set the callback for the update interrupt of the timer
+ *
+ * @param timer which timer
+ * @param callback function to call on every update, NULL to disable the interrupt
+ */
+void TIM_set_callback(TIM_t timer, TIM_callback_t callback);
+
+/**
+ * @brief This function restarts the period, the counter is reset and the buffered prescaler, period and compares are loaded
+ *
+ * @param timer which timer
+ *
+ * @remarks no update interrupt or DMA request is generated
+ */
+void TIM_reload(TIM_t timer);
+
+/**
+ * @brief This function will start the timer
+ *
+ * @param timer which timer
+ */
+void TIM_start(TIM_t timer);
+
+/**
+ * @brief This function will stop the timer, the counter keeps its value
+ *
+ * @param timer which timer
+ */
+void TIM_stop(TIM_t timer);
+
+/**
+ * @brief This function returns the current counter value
+ *
+ * @param timer which timer
+ * @return uint16_t counter value
+ */
+uint16_t TIM_get_counter(TIM_t timer);
+
+/**
+ * @brief This function is called on startup of the chip
+ *
+ */
+void TIM_startup();
+
+#endif /*__TIM_H__*/
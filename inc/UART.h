@@ -0,0 +1,141 @@
+#ifndef __UART_H__
+#define __UART_H__
+
+#include "common.h"
+
+/* MIDI DIN runs at 31250 baud, 8N1 */
+#define UART_MIDI_BAUD (31250)
+
+typedef enum
+{
+	UART_1, // TX PA9, RX PA10
+	UART_2, // TX PA2, RX PA3
+	UART_3, // TX PB10, RX PB11
+	UART_COUNT
+} UART_t;
+
+typedef enum
+{
+	UART_NO_ERR,
+	UART_NULL,
+	UART_INVALID_PORT,
+	UART_INVALID_BAUD,
+	UART_PINS_RESERVED,
+	UART_DMA_BUSY, // one of the DMA channels of the port is used by someone else
+	UART_ALREADY_INIT
+} UART_ERR_t;
+
+typedef struct
+{
+	uint32_t rx_bytes;		 // bytes received by the DMA
+	uint32_t rx_dropped;	 // bytes overwritten in the ring before they were read
+	uint32_t tx_bytes;		 // bytes sent
+	uint32_t tx_busy;		 // writes refused because a transfer was in progress
+	uint32_t idle_flushes;	 // idle line events that flushed a partial packet
+	uint32_t framing_errors; // also a break on the line
+	uint32_t noise_errors;
+	uint32_t overrun_errors; // the DMA didn't read a byte in time
+} UART_stats_t;
+
+/**
+ * @brief Callback called from an interrupt when new bytes are in the receive ring
+ *
+ * @param port which port
+ */
+typedef void (*UART_rx_callback_t)(UART_t port);
+
+/**
+ * @brief Callback called from the DMA interrupt when a write is done
+ *
+ * @param port which port
+ * @param buffer the buffer that was written, it can be reused now
+ */
+typedef void (*UART_tx_callback_t)(UART_t port, const uint8_t * buffer);
+
+/**
+ * @brief This function inits the port, 8 data bits, no parity, 1 stop bit
+ *
+ * @param port which port
+ * @param baud baud rate, the divider is computed from the bus clock of the port
+ * @param rx_ring receive ring, the DMA writes into it in circular mode
+ * @param rx_size size of the receive ring
+ * @param rx_callback function to call when new bytes were received, can be NULL
+ * @param tx_callback function to call when a write is done, can be NULL
+ * @return UART_ERR_t errors if any
+ *
+ * @remarks The receive ring is flushed on each half of the ring and whenever the line goes idle for a frame,
+ * 			so there is no interrupt per byte, and a short message is seen one frame after its last byte
+ */
+UART_ERR_t UART_init(UART_t port, uint32_t baud, uint8_t * rx_ring, uint16_t rx_size, UART_rx_callback_t rx_callback,
+					 UART_tx_callback_t tx_callback);
+
+/**
+ * @brief This function sends a buffer with DMA, without copying it
+ *
+ * @param port which port
+ * @param data bytes to send, must stay valid until the write is done
+ * @param length how many bytes
+ * @return true the write started
+ * @return false a write is in progress, or the port isn't initialized
+ */
+bool UART_write(UART_t port, const uint8_t * data, uint16_t length);
+
+/**
+ * @brief This function checks if a write is in progress
+ *
+ * @param port which port
+ * @return true the DMA is still sending
+ * @return false the port is free for a write
+ */
+bool UART_is_busy(UART_t port);
+
+/**
+ * @brief This function returns how many received bytes are waiting in the ring
+ *
+ * @param port which port
+ * @return uint16_t number of bytes
+ */
+uint16_t UART_available(UART_t port);
+
+/**
+ * @brief This function returns the received bytes without copying them
+ *
+ * @param port which port
+ * @param data set to the first waiting byte in the ring
+ * @return uint16_t number of contiguous bytes at data, call UART_consume and call again for the bytes after the ring wraps
+ */
+uint16_t UART_peek(UART_t port, const uint8_t ** data);
+
+/**
+ * @brief This function frees read bytes from the ring
+ *
+ * @param port which port
+ * @param count how many bytes, upto UART_available
+ */
+void UART_consume(UART_t port, uint16_t count);
+
+/**
+ * @brief This function copies received bytes out of the ring
+ *
+ * @param port which port
+ * @param output where to copy
+ * @param max_length size of output
+ * @return uint16_t number of bytes copied
+ */
+uint16_t UART_read(UART_t port, uint8_t * output, uint16_t max_length);
+
+/**
+ * @brief This function returns the counters of the port
+ *
+ * @param port which port
+ * @param stats output, a copy of the counters
+ */
+void UART_get_stats(UART_t port, UART_stats_t * stats);
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void UART_startup();
+
+#endif /*__UART_H__*/
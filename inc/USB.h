@@ -0,0 +1,192 @@
+#ifndef __USB_H__
+#define __USB_H__
+
+#include "common.h"
+
+/* endpoint 0 packet size, a small control endpoint leaves the packet memory to the bulk endpoints */
+#define USB_EP0_SIZE (32)
+/* largest OUT data stage of a control request */
+#define USB_EP0_BUFFER_SIZE (64)
+#define USB_MAX_ENDPOINTS	(8)
+#define USB_MAX_CLASSES		(2)
+/* packet memory in bytes, the first 64 hold the buffer table */
+#define USB_PMA_SIZE (512)
+
+/* endpoint address, bit 7 set for IN (device to host) */
+#define USB_EP_IN(number)	((number) | 0x80)
+#define USB_EP_OUT(number)	(number)
+#define USB_EP_NUMBER(ep)	((ep) & 0x0F)
+#define USB_EP_IS_IN(ep)	((ep) & 0x80)
+
+/* bmRequestType fields */
+#define USB_REQUEST_DEVICE_TO_HOST (0x80)
+#define USB_REQUEST_TYPE_MASK	   (0x60)
+#define USB_REQUEST_STANDARD	   (0x00)
+#define USB_REQUEST_CLASS		   (0x20)
+#define USB_REQUEST_RECIPIENT_MASK (0x1F)
+#define USB_RECIPIENT_DEVICE	   (0)
+#define USB_RECIPIENT_INTERFACE	   (1)
+#define USB_RECIPIENT_ENDPOINT	   (2)
+
+typedef enum
+{
+	USB_EP_BULK,
+	USB_EP_CONTROL,
+	USB_EP_ISOCHRONOUS,
+	USB_EP_INTERRUPT
+} USB_EP_TYPE_t;
+
+typedef enum
+{
+	USB_GET_STATUS		  = 0,
+	USB_CLEAR_FEATURE	  = 1,
+	USB_SET_FEATURE		  = 3,
+	USB_SET_ADDRESS		  = 5,
+	USB_GET_DESCRIPTOR	  = 6,
+	USB_GET_CONFIGURATION = 8,
+	USB_SET_CONFIGURATION = 9,
+	USB_GET_INTERFACE	  = 10,
+	USB_SET_INTERFACE	  = 11
+} USB_REQUEST_t;
+
+typedef struct
+{
+	uint8_t	 request_type; // USB_REQUEST_XX
+	uint8_t	 request;
+	uint16_t value;
+	uint16_t index;
+	uint16_t length;
+} USB_setup_t;
+
+/**
+ * @brief Called when a transfer of an endpoint completes, from the USB interrupt
+ *
+ * @param ep endpoint address, USB_EP_IN for a finished IN packet, USB_EP_OUT for a received OUT packet
+ */
+typedef void (*USB_ep_callback_t)(uint8_t ep);
+
+/*
+A class (MIDI, CDC...) of the device, all the functions are called from the USB interrupt and can be NULL
+*/
+typedef struct
+{
+	/* the host reset the bus, the endpoints of the class are closed */
+	void (*reset)();
+	/* the host selected the configuration, open the endpoints with USB_ep_open */
+	void (*configured)();
+	/*
+	A class or interface request. For a request with an IN data stage set data and length, they must stay valid
+	until the transfer ends. The OUT data stage of a request is delivered to data_out.
+	Returns false if the request is not of this class
+	*/
+	bool (*setup)(const USB_setup_t * setup, const uint8_t ** data, uint16_t * length);
+	void (*data_out)(const USB_setup_t * setup, const uint8_t * data, uint16_t length);
+	/* start of frame, every 1ms while the bus is active */
+	void (*start_of_frame)(uint16_t frame);
+} USB_class_t;
+
+/**
+ * @brief This function adds a class to the device, call it before USB_init
+ *
+ * @param usb_class the class, must stay valid
+ * @return true class added
+ * @return false too many classes
+ */
+bool USB_register_class(const USB_class_t * usb_class);
+
+/**
+ * @brief This function starts the USB device and connects it to the host
+ *
+ * @return true the device is connecting
+ * @return false PA11 and PA12 are reserved
+ *
+ * @remarks The USB clock comes from the 72MHz PLL divided by 1.5, RCC_init_clock must run first.
+ * 			D+ is held low for a moment first, so the host sees a new device after a reset of the chip
+ */
+bool USB_init();
+
+/**
+ * @brief This function checks if the host configured the device
+ *
+ * @return true the endpoints of the classes are open
+ * @return false not connected, or not configured yet
+ */
+bool USB_is_configured();
+
+/**
+ * @brief This function opens an endpoint, call it from the configured callback of a class
+ *
+ * @param ep endpoint address, the endpoint number is the endpoint register
+ * @param type bulk, interrupt etc.
+ * @param size max packet size
+ * @param double_buffered use 2 packet buffers so the host and the application work at the same time, bulk only
+ * @param callback called on each finished packet, can be NULL
+ * @return true endpoint opened
+ * @return false invalid endpoint, or not enough packet memory
+ *
+ * @remarks A double buffered endpoint uses the register of both directions, its number cannot be used for the other one
+ */
+bool USB_ep_open(uint8_t ep, USB_EP_TYPE_t type, uint16_t size, bool double_buffered, USB_ep_callback_t callback);
+
+/**
+ * @brief This function checks if an IN endpoint has a free packet buffer
+ *
+ * @param ep endpoint address
+ * @return true USB_ep_write will take a packet
+ * @return false all the buffers wait for the host, or the endpoint is closed
+ */
+bool USB_ep_can_write(uint8_t ep);
+
+/**
+ * @brief This function copies a packet to the packet memory of an IN endpoint and hands it to the host
+ *
+ * @param ep endpoint address
+ * @param data packet bytes
+ * @param length at most the endpoint size, 0 sends an empty packet
+ * @return true packet queued
+ * @return false no free buffer, or the endpoint is closed
+ */
+bool USB_ep_write(uint8_t ep, const uint8_t * data, uint16_t length);
+
+/**
+ * @brief This function copies the received packet of an OUT endpoint and frees its buffer for the host
+ *
+ * @param ep endpoint address
+ * @param data at least the endpoint size
+ * @return uint16_t bytes received, 0 if no packet waits
+ *
+ * @remarks A packet that is not read keeps its buffer, the host gets NAK once all the buffers are full.
+ * 			That is the flow control of OUT endpoints, read from the callback or later from the main loop
+ */
+uint16_t USB_ep_read(uint8_t ep, uint8_t * data);
+
+/**
+ * @brief This function returns the size of the received packet of an OUT endpoint, without freeing it
+ *
+ * @param ep endpoint address
+ * @return int16_t bytes received, -1 if no packet waits
+ */
+int16_t USB_ep_peek_length(uint8_t ep);
+
+/**
+ * @brief This function stalls or un-stalls an endpoint
+ *
+ * @param ep endpoint address
+ * @param stall true to stall
+ */
+void USB_ep_set_stall(uint8_t ep, bool stall);
+
+/**
+ * @brief This function returns the frame number of the last start of frame
+ *
+ * @return uint16_t 11 bit frame number
+ */
+uint16_t USB_get_frame();
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void USB_startup();
+
+#endif /*__USB_H__*/
@@ -0,0 +1,97 @@
+#ifndef __USB_CDC_H__
+#define __USB_CDC_H__
+
+#include "common.h"
+#include "USB_DESC.h"
+
+/* each slot is a packet of the IN endpoint, frames are packed into the slots */
+#define USB_CDC_SLOT_SIZE (USB_DESC_CDC_IN_SIZE)
+#define USB_CDC_SLOTS	  (8) // ! must be a power of 2
+/* a partly filled slot waits at most this many frames (1ms) for more frames */
+#define USB_CDC_FLUSH_FRAMES (1)
+
+/**
+ * @brief Called with each packet the host sends, from the USB interrupt
+ *
+ * @param data the packet
+ * @param length bytes in the packet
+ */
+typedef void (*USB_CDC_rx_callback_t)(const uint8_t * data, uint16_t length);
+
+typedef struct
+{
+	uint32_t frames;		 // frames committed
+	uint32_t frames_dropped; // frames refused because the slots were full, or the host was not listening
+	uint32_t bytes;			 // bytes handed to the host
+	uint32_t packets;
+	uint32_t zero_length_packets; // sent after a full packet to end a transfer
+	uint32_t rx_bytes;
+	uint16_t max_slots_used; // slots waiting for the host at the worst moment
+} USB_CDC_stats_t;
+
+/**
+ * @brief This function adds the CDC class to the USB device, call it before USB_init
+ *
+ * @param rx_callback called with the data from the host, can be NULL
+ * @return true class added
+ * @return false the device has too many classes
+ */
+bool USB_CDC_init(USB_CDC_rx_callback_t rx_callback);
+
+/**
+ * @brief This function checks if a program on the host has the port open
+ *
+ * @return true the device is configured and the host set DTR
+ * @return false frames are dropped
+ */
+bool USB_CDC_is_open();
+
+/**
+ * @brief This function reserves room for a frame in the current slot, the frame is written in place
+ *
+ * @param length frame size, at most USB_CDC_SLOT_SIZE
+ * @return uint8_t* where to write the frame, NULL if the frame is dropped
+ *
+ * @remarks There is a single producer, the main loop or one interrupt. A reserved frame is sent only after
+ * 			USB_CDC_commit, the USB interrupt copies whole slots to the packet memory and nothing else copies them.
+ * 			The producer never waits: when the host is slower than the producer the frames are dropped and counted
+ */
+uint8_t * USB_CDC_reserve(uint16_t length);
+
+/**
+ * @brief This function publishes the frame of the last USB_CDC_reserve
+ *
+ */
+void USB_CDC_commit();
+
+/**
+ * @brief This function copies a frame into the current slot and commits it
+ *
+ * @param data the frame
+ * @param length frame size, at most USB_CDC_SLOT_SIZE
+ * @return true frame queued
+ * @return false frame dropped
+ */
+bool USB_CDC_write(const void * data, uint16_t length);
+
+/**
+ * @brief This function returns the free slots, to throttle the producer before frames are dropped
+ *
+ * @return uint8_t free slots, each one takes USB_CDC_SLOT_SIZE bytes
+ */
+uint8_t USB_CDC_get_free_slots();
+
+/**
+ * @brief This function returns the counters of the class
+ *
+ * @param stats output, a copy of the counters
+ */
+void USB_CDC_get_stats(USB_CDC_stats_t * stats);
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void USB_CDC_startup();
+
+#endif /*__USB_CDC_H__*/
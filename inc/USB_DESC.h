@@ -0,0 +1,55 @@
+#ifndef __USB_DESC_H__
+#define __USB_DESC_H__
+
+#include "common.h"
+#include "USB.h"
+
+/*
+Layout of the device, the interfaces and endpoints of every class are set here so they never collide.
+The packet memory holds 448 bytes after the buffer table: 64 for endpoint 0, 192 for MIDI and 168 for CDC
+*/
+#define USB_DESC_VENDOR_ID	(0x1209) // pid.codes
+#define USB_DESC_PRODUCT_ID (0x0001) // pid.codes test product
+#define USB_DESC_DEVICE_BCD (0x0100)
+
+#define USB_DESC_MIDI_CONTROL_INTERFACE	  (0)
+#define USB_DESC_MIDI_STREAMING_INTERFACE (1)
+#define USB_DESC_MIDI_OUT_EP			  (USB_EP_OUT(1))
+#define USB_DESC_MIDI_IN_EP				  (USB_EP_IN(2))
+#define USB_DESC_MIDI_OUT_SIZE			  (32)
+#define USB_DESC_MIDI_IN_SIZE			  (64)
+
+#define USB_DESC_CDC_CONTROL_INTERFACE (2)
+#define USB_DESC_CDC_DATA_INTERFACE	   (3)
+#define USB_DESC_CDC_NOTIFY_EP		   (USB_EP_IN(3))
+#define USB_DESC_CDC_IN_EP			   (USB_EP_IN(4))
+#define USB_DESC_CDC_OUT_EP			   (USB_EP_OUT(5))
+#define USB_DESC_CDC_NOTIFY_SIZE	   (8)
+#define USB_DESC_CDC_IN_SIZE		   (64)
+#define USB_DESC_CDC_OUT_SIZE		   (32)
+
+typedef enum
+{
+	USB_DESC_DEVICE		   = 1,
+	USB_DESC_CONFIGURATION = 2,
+	USB_DESC_STRING		   = 3,
+	USB_DESC_INTERFACE	   = 4,
+	USB_DESC_ENDPOINT	   = 5,
+	USB_DESC_ASSOCIATION   = 11,
+	USB_DESC_CS_INTERFACE  = 0x24,
+	USB_DESC_CS_ENDPOINT   = 0x25
+} USB_DESC_TYPE_t;
+
+/**
+ * @brief This function returns a descriptor for GET_DESCRIPTOR
+ *
+ * @param type USB_DESC_XX
+ * @param index descriptor index, the string number for strings
+ * @param length set to the descriptor length, the configuration includes all its interfaces
+ * @return const uint8_t* the descriptor, NULL if it does not exist
+ *
+ * @remarks The serial number string is the unique ID of the chip, in hex
+ */
+const uint8_t * USB_DESC_get(uint8_t type, uint8_t index, uint16_t * length);
+
+#endif /*__USB_DESC_H__*/
@@ -0,0 +1,99 @@
+#ifndef __USB_MIDI_H__
+#define __USB_MIDI_H__
+
+#include "common.h"
+#include "MIDI.h"
+
+/* the single virtual cable of the device */
+#define USB_MIDI_CABLE (0)
+/* 4 byte event packets waiting for the host */
+#define USB_MIDI_TX_PACKETS (64) // ! must be a power of 2
+/* bytes received from the host, before they are read */
+#define USB_MIDI_RX_SIZE (256) // ! must be a power of 2
+/* packets in a full transfer of the IN endpoint */
+#define USB_MIDI_PACKETS_PER_TRANSFER (16)
+/* a packet waits at most this many frames (1ms) for more packets to share its transfer */
+#define USB_MIDI_FLUSH_FRAMES (1)
+/* packets of the largest event, a SysEx chunk with both F0 and F7 after 2 bytes of the previous chunk */
+#define USB_MIDI_MAX_EVENT_PACKETS (6)
+
+/* code index numbers, the low nibble of the first byte of a packet */
+typedef enum
+{
+	USB_MIDI_CIN_COMMON_2	 = 0x2, // 2 byte system common message
+	USB_MIDI_CIN_COMMON_3	 = 0x3, // 3 byte system common message
+	USB_MIDI_CIN_SYSEX		 = 0x4, // SysEx starts or continues
+	USB_MIDI_CIN_SYSEX_END_1 = 0x5, // SysEx ends with 1 byte, or 1 byte system common message
+	USB_MIDI_CIN_SYSEX_END_2 = 0x6,
+	USB_MIDI_CIN_SYSEX_END_3 = 0x7,
+	/* 0x8 to 0xE are the channel voice messages, the high nibble of the status */
+	USB_MIDI_CIN_SINGLE_BYTE = 0xF
+} USB_MIDI_CIN_t;
+
+typedef struct
+{
+	uint32_t tx_packets;
+	uint32_t tx_transfers;	 // IN transfers, tx_packets / tx_transfers is the batching
+	uint32_t tx_dropped;	 // events sent while the host has not configured the device, or without room
+	uint32_t rx_packets;
+	uint32_t rx_invalid;	 // packets of another cable, or a reserved code index
+	uint32_t rx_throttled;	 // OUT packets left with the USB because the receive buffer was full
+} USB_MIDI_stats_t;
+
+/**
+ * @brief This function adds the MIDI class to the USB device, call it before USB_init
+ *
+ * @return true class added
+ * @return false the device has too many classes
+ */
+bool USB_MIDI_init();
+
+/**
+ * @brief This function packs an event to USB-MIDI packets for the host
+ *
+ * @param event the event, a SysEx is sent chunk by chunk
+ * @return true the event is queued
+ * @return false the device is not configured, or there is no room for the packets
+ *
+ * @remarks The packets leave in transfers of up to USB_MIDI_PACKETS_PER_TRANSFER packets. A full transfer is
+ * 			sent at once, a partial one on the next start of frame, so an event waits 1ms at most
+ */
+bool USB_MIDI_send(const MIDI_event_t * event);
+
+/**
+ * @brief This function checks if an event may not fit the transmit queue
+ *
+ * @return true wait before the next USB_MIDI_send
+ * @return false there is room for any event
+ */
+bool USB_MIDI_is_busy();
+
+/**
+ * @brief This function returns the received MIDI bytes without copying them
+ *
+ * @param data set to the first waiting byte
+ * @return uint16_t number of contiguous bytes at data
+ */
+uint16_t USB_MIDI_peek(const uint8_t ** data);
+
+/**
+ * @brief This function frees read bytes, packets that waited for room are received
+ *
+ * @param count how many bytes
+ */
+void USB_MIDI_consume(uint16_t count);
+
+/**
+ * @brief This function returns the counters of the class
+ *
+ * @param stats output, a copy of the counters
+ */
+void USB_MIDI_get_stats(USB_MIDI_stats_t * stats);
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void USB_MIDI_startup();
+
+#endif /*__USB_MIDI_H__*/
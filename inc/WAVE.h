@@ -0,0 +1,153 @@
+#ifndef __WAVE_H__
+#define __WAVE_H__
+
+#include "common.h"
+#include "GPIO.h"
+#include "TIM.h"
+
+/*
+Waveforms of several pins of a port: a list of BSRR words, one written per period of a timer by the DMA channel of
+its update. Build the words with GPIO_array_get_bsrr_value, a word only changes the pins it sets or resets.
+
+Timing: the period is exact, a whole number of timer ticks (13.9ns at 72MHz). A word reaches the pins a fixed delay
+after its update, the DMA request and the transfer to the port, plus a jitter of the transfers of other DMA channels
+that go first, about 70ns per transfer. The CPU never delays a word.
+Rate: a word is a read from RAM and a write through the APB2 bridge, about 6 cycles of the bus matrix. At most one
+request per timer can wait, a word every 12 CPU cycles leaves room for the other DMA channels and the CPU. Above
+WAVE_MAX_RATE a word can be lost, and with busy DMA channels the safe rate is lower.
+Streaming: each half of the ring is refilled while the other half is sent, WAVE_get_stats measures the refills
+*/
+
+/* words per second, a word every 12 CPU cycles at 72MHz */
+#define WAVE_MAX_RATE (6000000)
+
+typedef enum
+{
+	WAVE_NO_ERR,
+	WAVE_NULL,
+	WAVE_INVALID_CONFIG,
+	WAVE_ALREADY_INIT,
+	WAVE_NOT_INIT,
+	WAVE_TOO_FAST, // above WAVE_MAX_RATE, or the timer can't run at the rate
+	WAVE_DMA_BUSY, // the DMA channel of the timer update is used by someone else
+	WAVE_BUSY	   // a waveform is running
+} WAVE_ERR_t;
+
+typedef struct
+{
+	TIM_t		timer; // an engine per timer
+	GPIO_PORT_t port;  // the pins must be reserved as outputs, with GPIO_array_init
+	uint32_t	rate;  // words per second
+} WAVE_config_t;
+
+typedef struct
+{
+	uint32_t refills;
+	uint32_t late_refills;		// the DMA was already back in the half being refilled, some words were old
+	uint32_t last_refill_cycles; // CPU cycles of the refill callback
+	uint32_t max_refill_cycles;
+} WAVE_stats_t;
+
+/**
+ * @brief Called when a waveform is over, from the DMA interrupt
+ *
+ * @param timer the engine
+ */
+typedef void (*WAVE_callback_t)(TIM_t timer);
+
+/**
+ * @brief Fills a half of the ring of a stream, from the DMA interrupt
+ *
+ * @param timer the engine
+ * @param words the half
+ * @param count words in the half
+ * @return true the data ended in this half, the rest is filled with words that change nothing
+ * @return false more data follows
+ */
+typedef bool (*WAVE_refill_t)(TIM_t timer, uint32_t * words, uint16_t count);
+
+/**
+ * @brief This function inits an engine: its timer and the DMA channel of the update
+ *
+ * @param config engine config
+ * @return WAVE_ERR_t errors if any
+ */
+WAVE_ERR_t WAVE_init(const WAVE_config_t * config);
+
+/**
+ * @brief This function changes the rate of an engine
+ *
+ * @param timer the engine
+ * @param rate words per second
+ * @return WAVE_ERR_t WAVE_BUSY if a waveform is running
+ */
+WAVE_ERR_t WAVE_set_rate(TIM_t timer, uint32_t rate);
+
+/**
+ * @brief This function returns the actual rate of an engine
+ *
+ * @param timer the engine
+ * @return uint32_t words per second, 0 if not initialized
+ */
+uint32_t WAVE_get_rate(TIM_t timer);
+
+/**
+ * @brief This function starts writing words to the port
+ *
+ * @param timer the engine
+ * @param words the words, must stay valid until the end
+ * @param count how many words
+ * @param loop start over after the last word until WAVE_stop, else stop after it
+ * @param callback called after the last word when not looping, can be NULL
+ * @return WAVE_ERR_t errors if any
+ *
+ * @remarks The first word is written a period after this call. A loop takes no interrupt and no CPU at all
+ */
+WAVE_ERR_t WAVE_play(TIM_t timer, const uint32_t * words, uint16_t count, bool loop, WAVE_callback_t callback);
+
+/**
+ * @brief This function starts writing words from a ring that is refilled while it is sent
+ *
+ * @param timer the engine
+ * @param ring the ring, even count of words
+ * @param count words in the ring
+ * @param refill fills each half, both halves are filled before the start
+ * @param callback called after the half with the end of the data was sent, can be NULL
+ * @return WAVE_ERR_t errors if any
+ *
+ * @remarks A refill has the time of half the ring to run. The half after the end is refilled too, because the DMA
+ * 			starts sending it before the interrupt stops the timer
+ */
+WAVE_ERR_t WAVE_stream(TIM_t timer, uint32_t * ring, uint16_t count, WAVE_refill_t refill, WAVE_callback_t callback);
+
+/**
+ * @brief This function stops a waveform, the pins keep the last word, the callback is not called
+ *
+ * @param timer the engine
+ */
+void WAVE_stop(TIM_t timer);
+
+/**
+ * @brief This function checks if a waveform is running
+ *
+ * @param timer the engine
+ * @return true running
+ * @return false idle
+ */
+bool WAVE_is_busy(TIM_t timer);
+
+/**
+ * @brief This function returns the counters of the refills of an engine
+ *
+ * @param timer the engine
+ * @param stats output, a copy of the counters
+ */
+void WAVE_get_stats(TIM_t timer, WAVE_stats_t * stats);
+
+/**
+ * @brief This function is called on the startup of the chip
+ *
+ */
+void WAVE_startup();
+
+#endif /*__WAVE_H__*/
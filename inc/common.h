@@ -51,11 +51,15 @@ typedef enum
 	TIM1_CC_IRQn                = 27,     /*!< TIM1 Capture Compare Interrupt                       */
 	TIM2_IRQn                   = 28,     /*!< TIM2 global Interrupt                                */
 	TIM3_IRQn                   = 29,     /*!< TIM3 global Interrupt                                */
+	TIM4_IRQn                   = 30,     /*!< TIM4 global Interrupt                                */
 	I2C1_EV_IRQn                = 31,     /*!< I2C1 Event Interrupt                                 */
 	I2C1_ER_IRQn                = 32,     /*!< I2C1 Error Interrupt                                 */
+	I2C2_EV_IRQn                = 33,     /*!< I2C2 Event Interrupt                                 */
+	I2C2_ER_IRQn                = 34,     /*!< I2C2 Error Interrupt                                 */
 	SPI1_IRQn                   = 35,     /*!< SPI1 global Interrupt                                */
 	USART1_IRQn                 = 37,     /*!< USART1 global Interrupt                              */
 	USART2_IRQn                 = 38,     /*!< USART2 global Interrupt                              */
+	USART3_IRQn                 = 39,     /*!< USART3 global Interrupt                              */
 	EXTI15_10_IRQn              = 40,     /*!< External Line[15:10] Interrupts                      */
 	RTC_Alarm_IRQn              = 41,     /*!< RTC Alarm through EXTI Line Interrupt                */
 	USBWakeUp_IRQn              = 42,     /*!< USB Device WakeUp from suspend through EXTI Line Interrupt */
@@ -14,4 +14,19 @@
  */
 uint32_t utils_generate_mask(uint8_t start_bit, uint8_t end_bit);
 
+/**
+ * @brief This function starts the CPU cycle counter of the DWT, it is safe to call it again
+ * 
+ */
+void utils_cycle_counter_start();
+
+/**
+ * @brief This function returns the CPU cycle counter
+ * 
+ * @return uint32_t CPU cycles, wraps around every 2^32 cycles (about 59 seconds at 72MHz)
+ * 
+ * @remarks Subtract two readings as uint32_t to get the elapsed cycles across a wrap
+ */
+uint32_t utils_get_cycles();
+
 #endif /* __UTILS_H__ */
\ No newline at end of file
@@ -28,6 +28,8 @@ typedef struct
 
 #define ADC1_BASE (APB2PERIPH_BASE + 0x00002400U)
 #define ADC1	  ((ADC_TypeDef *)ADC1_BASE)
+#define ADC2_BASE (APB2PERIPH_BASE + 0x00002800U)
+#define ADC2	  ((ADC_TypeDef *)ADC2_BASE)
 
 #define SEQUENCE_REG_CH_COUNT (6)
 #define SEQUENCE_REG_3_MIN_CH (0)
@@ -39,6 +41,7 @@ typedef struct
 #define SEQUENCE_CH_SIZE	  (5)
 #define SEQUENCE_LEN_OFFSET	  (20)
 #define SEQUENCE_LEN_SIZE	  (4)
+#define SEQUENCE_CH_MASK	  (0x1F)
 
 #define SAMPLING_REG_CH_COUNT (10)
 #define SAMPLING_REG_2_MIN_CH (0)
@@ -46,85 +49,329 @@ typedef struct
 #define SAMPLING_REG_1_MIN_CH (SAMPLING_REG_2_MIN_CH + SAMPLING_REG_CH_COUNT)
 #define SAMPLING_REG_1_MAX_CH (SAMPLING_REG_1_MIN_CH + SAMPLING_REG_CH_COUNT - 1)
 #define SAMPLING_TIME_SIZE	  (3)
+#define SAMPLING_TIME_MASK	  (0x7)
 
 #define ADC_CR2_ADON (0)
 #define ADC_CR2_CAL	 (2)
-#define ADC_CR1_CONT (1)
-#define ADC_CR2_SCAN (8)
+#define ADC_CR2_CONT (1)
+#define ADC_CR1_SCAN (8)
 #define ADC_CR2_DMA	 (8)
-static bool s_adc1_init = false;
+
+#define ADC_CR1_DUALMOD		 (16)
+#define ADC_CR1_DUALMOD_MASK (0x000F0000)
+#define ADC_CR2_EXTSEL		 (17)
+#define ADC_CR2_EXTSEL_MASK	 (0x000E0000)
+#define ADC_CR2_EXTTRIG		 (20)
+#define ADC_CR2_SWSTART		 (22)
+
+#define ADC_CR1_JEOCIE		  (7)
+#define ADC_CR2_JEXTSEL		  (12)
+#define ADC_CR2_JEXTSEL_MASK  (0x00007000)
+#define ADC_CR2_JEXTTRIG	  (15)
+#define ADC_CR2_JSWSTART	  (21)
+#define ADC_SR_JEOC			  (2)
+#define INJECTED_SEQUENCE_LEN (20)
+
+#define ADC_CR2_TSVREFE (23)
+/* Vrefint needs 10us to start, and 17.1us of sampling */
+#define ADC_VREFINT_STARTUP_LOOPS (720)
+
+#define ADC_CR1_AWDCH_MASK (0x0000001F)
+#define ADC_CR1_AWDIE	   (6)
+#define ADC_CR1_AWDSGL	   (9)
+#define ADC_CR1_AWDEN	   (23)
+#define ADC_SR_AWD		   (0)
+/* EXTSEL value for the SWSTART bit as the regular trigger */
+#define ADC_EXTSEL_SWSTART (7)
+
+/* DUALMOD values, from the reference manual page 238 */
+#define ADC_DUALMOD_INDEPENDENT	 (0x0)
+#define ADC_DUALMOD_SIMULTANEOUS (0x6)
+#define ADC_DUALMOD_INTERLEAVED	 (0x7)
+
+/* tSTAB, the ADC needs 1us after powering up before it can convert, about 72 cycles at 72MHz */
+#define ADC_STABILIZATION_LOOPS (72)
+
+/* in loop mode the DMA fills one half while the other half holds the last complete sequence */
+#define FRAME_BUFFER_COUNT (2)
+
+static bool		  s_adc1_init		  = false;
+static uint16_t * s_output			  = NULL;
+static uint8_t	  s_channel_count	  = 0;
+static bool		  s_dual			  = false;
+static bool		  s_loop_running	  = false;
+/* the profiles used by the init functions, the second one is for ADC2 in dual mode */
+static ADC_profile_t		 s_init_profiles[2];
+static const ADC_profile_t * s_profile = NULL;
+/*
+ the DMA runs over both halves in loop mode, each half is s_channel_count items long.
+ items are 16 bits with ADC1 only, and 32 bits in dual mode, so the buffer is sized for the larger
+*/
+static uint32_t s_frame_buffer[FRAME_BUFFER_COUNT * MAX_SEQUENCE];
+/* odd when the last complete sequence is in the first half, even when it is in the second half, 0 before the first sequence */
+static volatile uint32_t s_frame_sequence = 0;
+
+/* ADC clock cycles for each sampling time, including the 12.5 cycles of the conversion */
+static const uint16_t s_conversion_cycles[] = { 14, 20, 26, 41, 54, 68, 84, 252 };
+
+static ADC_SAMPLING_TIME_t s_tuned_times[ADC_CHANNEL_COUNT];
+static bool				   s_injected_used = false;
+
+static ADC_frame_callback_t s_frame_callback = NULL;
+static uint32_t				s_start_cycles	 = 0;
+static uint32_t				s_clock_cycles	 = 0; // CPU cycles per ADC clock cycle, read once by ADC_start_async
+static uint32_t				s_frame_cycles	 = 0; // CPU cycles to convert a sequence
+
+static ADC_callback_t s_triggered_callback = NULL;
+static ADC_callback_t s_injected_callback = NULL;
+static ADC_callback_t s_watchdog_callback = NULL;
+
+/* oversampling, frames is 0 when disabled */
+static volatile uint8_t	 s_oversample_frames = 0;
+static uint8_t			 s_oversample_shift	 = 0;
+static uint8_t			 s_oversample_count	 = 0;
+static uint32_t			 s_accumulators[ADC_CHANNEL_COUNT];
+static uint16_t			 s_oversampled[FRAME_BUFFER_COUNT][ADC_CHANNEL_COUNT];
+/* same parity scheme as s_frame_sequence */
+static volatile uint32_t s_oversampled_sequence = 0;
 
 /**
  * @brief This function starts up the ADC
  *
+ * @param adc which ADC
+ * @param clock the clock of that ADC
  */
-static void startup_adc()
+static void startup_adc(ADC_TypeDef * adc, RCC_Peripherals_t clock)
 {
 	// ! Start the clocks!!
-	RCC_peripheral_set_clock(RCC_ADC1, true);
+	RCC_peripheral_set_clock(clock, true);
 
-	ADC1->CR2 = 1 << ADC_CR2_ADON;		  // Enable ADC, ADON bit 0
-	ADC1->CR2 |= 1 << ADC_CR2_CAL;		  // Calibrate
-	WAIT(ADC1->CR2 & (1 << ADC_CR2_CAL)); // Wait for calibration to end
-	ADC1->CR2 |= 1 << ADC_CR2_DMA;
+	// the injected group might have powered and calibrated it already, keep its configuration
+	if ((adc->CR2 & (1 << ADC_CR2_ADON)) == 0)
+	{
+		adc->CR2 = 1 << ADC_CR2_ADON;		 // Enable ADC, ADON bit 0
+		adc->CR2 |= 1 << ADC_CR2_CAL;		 // Calibrate
+		WAIT(adc->CR2 & (1 << ADC_CR2_CAL)); // Wait for calibration to end
+	}
+	// only ADC1 has a DMA request, in dual mode ADC2 data is read from the upper half of ADC1 DR
+	if (adc == ADC1 && (adc->CR2 & (1 << ADC_CR2_DMA)) == 0)
+	{
+		adc->CR2 |= 1 << ADC_CR2_DMA;
+	}
 }
 
 /**
- * @brief Set the up dma channel for the ADC
+ * @brief This function returns the half of the loop buffer that holds the given sequence
  *
- * @param output where shall the DMA store the data
- * @param count_channels how much data is allocated
+ * @param sequence sequence number, not 0
+ * @return void* uint16_t array with ADC1 only, uint32_t array in dual mode
  */
-static bool setup_dma_channel(uint16_t * output, uint8_t count_channels)
+static void * get_frame(uint32_t sequence)
 {
-	RCC_peripheral_set_clock(RCC_DMA1, true);
-	DMA_address_t periph = { .access_size = DMA_ACCESS_16BIT, .address = (uint32_t *)ADC_get_data_register(), .increament_address = false };
-	DMA_address_t memory = { .access_size = DMA_ACCESS_16BIT, .address = output, .increament_address = true };
-	if (DMA_init_channel(DMA_CH1_ADC1, &periph, &memory, DMA_CH_PRIORITY_HIGH, DMA_DIRECTION_PERIPH_TO_MEM, 0) == false)
+	uint8_t half = (sequence & 1) ? 0 : 1;
+	if (s_dual)
 	{
-		// Is the channel reserved?
-		return false;
+		return s_frame_buffer + half * s_channel_count;
 	}
-	return true;
+	return (uint16_t *)s_frame_buffer + half * s_channel_count;
 }
 
 /**
- * @brief Set the channel in the sequence selection registers
+ * @brief This function adds a complete sequence to the accumulators, and publishes the results every s_oversample_frames sequences
  *
- * @param sequence_index channel index in sequence
- * @param channel which channel to measure
+ * @param frame the complete sequence
  */
-static void set_channel_sequence_index(uint8_t sequence_index, uint8_t channel)
+static void accumulate_frame(const uint16_t * frame)
 {
-	periph_ptr_t sequence_register = NULL;
-	uint8_t		 start_bit		   = SEQUENCE_CH_SIZE * (sequence_index % SEQUENCE_REG_CH_COUNT);
-	if (channel > MAX_CHANNEL || sequence_index > MAX_SEQUENCE)
+	uint16_t * results = NULL;
+	for (size_t i = 0; i < s_channel_count; i++)
+	{
+		s_accumulators[s_profile->channels[i]] += frame[i];
+	}
+	s_oversample_count++;
+	if (s_oversample_count < s_oversample_frames)
 	{
 		return;
 	}
+	// write the buffer the readers are not pointed to, odd sequences are in buffer 0
+	results = s_oversampled[(s_oversampled_sequence & 1) ? 1 : 0];
+	for (size_t i = 0; i < ADC_CHANNEL_COUNT; i++)
+	{
+		results[i]		  = s_accumulators[i] >> s_oversample_shift;
+		s_accumulators[i] = 0;
+	}
+	s_oversample_count = 0;
+	s_oversampled_sequence++;
+}
 
-	if (sequence_index <= SEQUENCE_REG_3_MAX_CH)
+/**
+ * @brief This function checks that the decimated results of a sequence fit in 16 bits
+ *
+ * @param profile the sequence
+ * @param frames sequences accumulated for each result
+ * @param shift right shift of the accumulated sum
+ * @return true every result fits
+ * @return false a channel repeated in the sequence can overflow its result
+ */
+static bool oversampling_fits(const ADC_profile_t * profile, uint8_t frames, uint8_t shift)
+{
+	uint8_t repeats[ADC_CHANNEL_COUNT] = { 0 };
+	uint8_t max_repeats				   = 0;
+	for (size_t i = 0; i < profile->count_channels; i++)
 	{
-		sequence_register = &ADC1->SQR3;
+		repeats[profile->channels[i]]++;
+		if (repeats[profile->channels[i]] > max_repeats)
+		{
+			max_repeats = repeats[profile->channels[i]];
+		}
 	}
-	else if (sequence_index <= SEQUENCE_REG_2_MAX_CH)
+	return (((uint32_t)frames * max_repeats * ADC_MAX_VALUE) >> shift) <= 0xFFFF;
+}
+
+/**
+ * @brief This function is called by the DMA when half or all of the double buffer was filled in loop mode
+ *
+ * @param dma_channel_number DMA channel of the ADC
+ * @param flags which flags caused the interrupt
+ */
+static void frame_complete_callback(DMA_CHANNELS_t dma_channel_number, uint32_t flags)
+{
+	uint32_t sequence = s_frame_sequence;
+	// keep the parity of the sequence matching the buffer half, even if an interrupt was missed
+	if (flags & DMA_FLAG_FINISHED)
 	{
-		sequence_register = &ADC1->SQR2;
+		sequence += (sequence & 1) ? 1 : 2;
 	}
-	else if (sequence_index <= SEQUENCE_REG_1_MAX_CH)
+	else if (flags & DMA_FLAG_HALF)
 	{
-		sequence_register = &ADC1->SQR1;
+		sequence += (sequence & 1) ? 2 : 1;
 	}
-	else
+	s_frame_sequence = sequence;
+	if (s_oversample_frames != 0 && !s_dual)
 	{
-		return; // Invalid channel
+		accumulate_frame(get_frame(sequence));
+	}
+	if (s_frame_callback != NULL)
+	{
+		// from the start, so the interrupt latency doesn't move the timestamps
+		s_frame_callback(get_frame(sequence), s_channel_count, s_start_cycles + (sequence - 1) * s_frame_cycles);
 	}
-	// clear previous selection
-	*sequence_register &= ~(utils_generate_mask(start_bit, start_bit + SEQUENCE_CH_SIZE));
-	*sequence_register |= channel << start_bit;
 }
 
-static void set_channel_sampling_time(uint8_t channel, ADC_SAMPLING_TIME_t sampling_time)
+/**
+ * @brief This function is called from the DMA interrupt when a single sequence is done
+ *
+ * @param dma_channel_number the ADC channel
+ * @param flags which flags were set
+ */
+static void single_complete_callback(DMA_CHANNELS_t dma_channel_number, uint32_t flags)
+{
+	if ((flags & DMA_FLAG_FINISHED) && s_frame_callback != NULL)
+	{
+		s_frame_callback(s_output, s_channel_count, s_start_cycles);
+	}
+}
+
+/**
+ * @brief This function is called from the DMA interrupt each time the output of a triggered start was filled
+ *
+ * @param dma_channel_number the ADC channel
+ * @param flags which flags were set
+ */
+static void triggered_complete_callback(DMA_CHANNELS_t dma_channel_number, uint32_t flags)
+{
+	if ((flags & DMA_FLAG_FINISHED) && s_triggered_callback != NULL)
+	{
+		s_triggered_callback();
+	}
+}
+
+/**
+ * @brief This function selects what starts the regular group of ADC1
+ *
+ * @param trigger the trigger, ADC_trigger_software to start with ADON
+ */
+static void set_regular_trigger(ADC_REGULAR_TRIGGER_t trigger)
+{
+	uint32_t cr2 = ADC1->CR2 & ~(ADC_CR2_EXTSEL_MASK | (1 << ADC_CR2_EXTTRIG));
+	if (trigger != ADC_trigger_software)
+	{
+		cr2 |= (trigger << ADC_CR2_EXTSEL) | (1 << ADC_CR2_EXTTRIG);
+	}
+	// ! writing the same value with ADON set starts a conversion
+	if (cr2 != ADC1->CR2)
+	{
+		ADC1->CR2 = cr2;
+	}
+}
+
+/**
+ * @brief Set the up dma channel for the ADC
+ *
+ * @param output where shall the DMA store the data
+ * @param access_size 16 bit for ADC1 only, 32 bit for dual mode
+ * @param circular true to loop over the output
+ * @param interrupts which DMA_INTERRUPT_XX interrupts to generate
+ * @param callback function to call from the DMA interrupt, can be NULL
+ */
+static bool setup_dma_channel(void * output, DMA_ACCESS_TYPE_t access_size, bool circular, uint32_t interrupts, DMA_callback_t callback)
+{
+	DMA_address_t periph	 = { .access_size = access_size, .address = (uint32_t *)ADC_get_data_register(), .increament_address = false };
+	DMA_address_t memory	 = { .access_size = access_size, .address = output, .increament_address = true };
+	RCC_peripheral_set_clock(RCC_DMA1, true);
+	// the channel might be configured from a previous start
+	if (s_adc1_init)
+	{
+		DMA_stop_channel(DMA_CH1_ADC1);
+		DMA_de_init_channel(DMA_CH1_ADC1);
+	}
+	if (DMA_init_channel(DMA_CH1_ADC1, &periph, &memory, DMA_CH_PRIORITY_HIGH, DMA_DIRECTION_PERIPH_TO_MEM, interrupts) == false)
+	{
+		// Is the channel reserved?
+		return false;
+	}
+	DMA_channel_clear_flags(DMA_CH1_ADC1);
+	DMA_set_circular(DMA_CH1_ADC1, circular);
+	DMA_set_callback(DMA_CH1_ADC1, callback);
+	return true;
+}
+
+/**
+ * @brief This function powers up the ADC if it was stopped, and waits for it to stabilize
+ *
+ * @param adc which ADC
+ */
+static void power_up(ADC_TypeDef * adc)
+{
+	if (adc->CR2 & (1 << ADC_CR2_ADON))
+	{
+		return;
+	}
+	adc->CR2 |= 1 << ADC_CR2_ADON;
+	for (volatile uint32_t i = 0; i < ADC_STABILIZATION_LOOPS; i++)
+	{
+		asm("nop");
+	}
+}
+
+/**
+ * @brief This function writes the register images of a profile to the ADC
+ *
+ * @param adc which ADC
+ * @param profile profile to write
+ *
+ * @remarks only the sampling times of the profile channels are changed, so the injected channels keep theirs
+ */
+static void write_profile(ADC_TypeDef * adc, const ADC_profile_t * profile)
+{
+	adc->SQR1  = profile->sqr1;
+	adc->SQR2  = profile->sqr2;
+	adc->SQR3  = profile->sqr3;
+	adc->SMPR1 = (adc->SMPR1 & ~profile->smpr1_mask) | profile->smpr1;
+	adc->SMPR2 = (adc->SMPR2 & ~profile->smpr2_mask) | profile->smpr2;
+}
+
+static void set_channel_sampling_time(ADC_TypeDef * adc, uint8_t channel, ADC_SAMPLING_TIME_t sampling_time)
 {
 	// Max sampling rate is 239.5 adc clock cycles
 	periph_ptr_t sampling_register = NULL;
@@ -135,74 +382,182 @@ static void set_channel_sampling_time(uint8_t channel, ADC_SAMPLING_TIME_t sampl
 	}
 	if (channel <= SAMPLING_REG_2_MAX_CH)
 	{
-		sampling_register = &ADC1->SMPR2;
+		sampling_register = &adc->SMPR2;
 	}
 	else if (channel <= SAMPLING_REG_1_MAX_CH)
 	{
-		sampling_register = &ADC1->SMPR1;
+		sampling_register = &adc->SMPR1;
 	}
 	else
 	{
 		return;
 	}
-	*sampling_register &= ~(utils_generate_mask(start_bit, start_bit + SAMPLING_TIME_SIZE));
+	*sampling_register &= ~(utils_generate_mask(start_bit, start_bit + SAMPLING_TIME_SIZE - 1));
 	*sampling_register |= sampling_time << start_bit;
 }
 
-static void set_sequence_channel_count(uint8_t channel_count)
+/**
+ * @brief This function copies the last complete sequence of the loop buffer
+ *
+ * @param output where to copy
+ * @param dual true to copy 32 bit items, false for 16 bit items
+ * @return uint32_t sequence number of the copy, 0 if there is no sequence yet
+ */
+static uint32_t read_frame(void * output, bool dual)
 {
-	if (channel_count > MAX_SEQUENCE)
+	uint32_t sequence = 0;
+	if (output == NULL || dual != s_dual)
 	{
-		return;
+		return 0;
 	}
-	ADC1->SQR1 &= ~(utils_generate_mask(SEQUENCE_LEN_OFFSET, SEQUENCE_LEN_OFFSET + SEQUENCE_LEN_SIZE - 1));
-	// the value is count x times + 1
-	ADC1->SQR1 |= (channel_count - 1) << SEQUENCE_LEN_OFFSET;
+	do
+	{
+		sequence = s_frame_sequence;
+		if (sequence == 0)
+		{
+			return 0; // no complete sequence yet
+		}
+		for (size_t i = 0; i < s_channel_count; i++)
+		{
+			if (dual)
+			{
+				((uint32_t *)output)[i] = ((const uint32_t *)get_frame(sequence))[i];
+			}
+			else
+			{
+				((uint16_t *)output)[i] = ((const uint16_t *)get_frame(sequence))[i];
+			}
+		}
+		// make sure the copy is done before checking the sequence again
+		__DMB();
+		/*
+		 the half we copied is only overwritten after the DMA fills the other half, which changes the sequence.
+		 if it changed while copying, the copy might be torn and we try again
+		*/
+	} while (sequence != s_frame_sequence);
+	return sequence;
 }
 
 /*
  ? Public functions
 */
 
+/**
+ * @brief This function measures a channel right after Vrefint, with the injected group
+ *
+ * @param channel which channel
+ * @param sampling_time sampling time of the channel
+ * @return uint16_t average of ADC_TUNE_REPEATS conversions
+ */
+static uint16_t measure_after_vrefint(uint8_t channel, ADC_SAMPLING_TIME_t sampling_time)
+{
+	uint32_t sum = 0;
+	set_channel_sampling_time(ADC1, channel, sampling_time);
+	for (size_t i = 0; i < ADC_TUNE_REPEATS; i++)
+	{
+		ADC1->SR &= ~(1 << ADC_SR_JEOC);
+		ADC1->CR2 |= 1 << ADC_CR2_JSWSTART;
+		WAIT((ADC1->SR & (1 << ADC_SR_JEOC)) == 0);
+		sum += ADC1->JDR2;
+	}
+	return sum / ADC_TUNE_REPEATS;
+}
+
 bool ADC_init(uint8_t * channels, uint8_t count_channels, uint16_t * output)
+{
+	return ADC_init_ex(channels, NULL, count_channels, output);
+}
+
+bool ADC_init_ex(uint8_t * channels, ADC_SAMPLING_TIME_t * channels_sampling_time, uint8_t count_channels, uint16_t * output)
 {
 	if (s_adc1_init)
 	{
 		return false;
 	}
-	startup_adc();
-	if (setup_dma_channel(output, count_channels) == false)
+	if (ADC_profile_build(&s_init_profiles[0], channels, channels_sampling_time, count_channels) == false)
 	{
 		return false;
 	}
-	for (size_t i = 0; i < count_channels; i++)
+	startup_adc(ADC1, RCC_ADC1);
+	if (setup_dma_channel(output, DMA_ACCESS_16BIT, false, 0, NULL) == false)
 	{
-		set_channel_sampling_time(channels[i], ADC_DEFAULT_SAMPLING_TIME);
-		set_channel_sequence_index(i, channels[i]);
+		return false;
 	}
-	set_sequence_channel_count(count_channels);
-	s_adc1_init = true;
+	write_profile(ADC1, &s_init_profiles[0]);
+	s_profile		= &s_init_profiles[0];
+	s_output		= output;
+	s_channel_count = count_channels;
+	s_adc1_init		= true;
 	return true;
 }
 
-bool ADC_init_ex(uint8_t * channels, ADC_SAMPLING_TIME_t * channels_sampling_time, uint8_t count_channels, uint16_t * output)
+bool ADC_init_dual(ADC_dual_mode_t mode, uint8_t * channels_adc1, uint8_t * channels_adc2, uint8_t count_channels, uint32_t * output)
 {
-	if (s_adc1_init)
+	ADC_SAMPLING_TIME_t sampling_times[MAX_SEQUENCE];
+	ADC_SAMPLING_TIME_t sampling_time = ADC_DEFAULT_SAMPLING_TIME;
+	uint32_t			dual_mode	  = ADC_DUALMOD_SIMULTANEOUS;
+	if (s_adc1_init || channels_adc1 == NULL)
 	{
 		return false;
 	}
-	startup_adc();
-	if (setup_dma_channel(output, count_channels) == false)
+	if (count_channels == 0 || count_channels > MAX_SEQUENCE)
 	{
 		return false;
 	}
+	switch (mode)
+	{
+	case ADC_dual_simultaneous:
+		if (channels_adc2 == NULL)
+		{
+			return false;
+		}
+		for (size_t i = 0; i < count_channels; i++)
+		{
+			// both ADCs must not sample the same channel at the same time
+			if (channels_adc1[i] == channels_adc2[i])
+			{
+				return false;
+			}
+		}
+		break;
+	case ADC_dual_interleaved:
+		// the ADCs start 7 adc clock cycles apart, the sampling must end before the other ADC starts sampling
+		dual_mode	   = ADC_DUALMOD_INTERLEAVED;
+		sampling_time  = ADC_SAMPLING_1_5;
+		channels_adc2  = channels_adc1;
+		count_channels = 1;
+		break;
+	default:
+		return false;
+	}
 	for (size_t i = 0; i < count_channels; i++)
 	{
-		set_channel_sampling_time(channels[i], channels_sampling_time[i]);
-		set_channel_sequence_index(i, channels[i]);
+		sampling_times[i] = sampling_time;
+	}
+	if (ADC_profile_build(&s_init_profiles[0], channels_adc1, sampling_times, count_channels) == false ||
+		ADC_profile_build(&s_init_profiles[1], channels_adc2, sampling_times, count_channels) == false)
+	{
+		return false;
 	}
-	set_sequence_channel_count(count_channels);
-	s_adc1_init = true;
+	startup_adc(ADC1, RCC_ADC1);
+	startup_adc(ADC2, RCC_ADC2);
+	if (setup_dma_channel(output, DMA_ACCESS_32BIT, false, 0, NULL) == false)
+	{
+		return false;
+	}
+	write_profile(ADC1, &s_init_profiles[0]);
+	write_profile(ADC2, &s_init_profiles[1]);
+
+	// ADC1 is the master and is started by SWSTART, ADC2 must be set to a software trigger so it only follows ADC1
+	ADC1->CR2 = (ADC1->CR2 & ~ADC_CR2_EXTSEL_MASK) | (ADC_EXTSEL_SWSTART << ADC_CR2_EXTSEL) | (1 << ADC_CR2_EXTTRIG);
+	ADC2->CR2 = (ADC2->CR2 & ~ADC_CR2_EXTSEL_MASK) | (ADC_EXTSEL_SWSTART << ADC_CR2_EXTSEL) | (1 << ADC_CR2_EXTTRIG);
+	ADC1->CR1 = (ADC1->CR1 & ~ADC_CR1_DUALMOD_MASK) | (dual_mode << ADC_CR1_DUALMOD);
+
+	s_profile		= &s_init_profiles[0];
+	s_output		= (uint16_t *)output;
+	s_channel_count = count_channels;
+	s_dual			= true;
+	s_adc1_init		= true;
 	return true;
 }
 
@@ -216,25 +571,288 @@ periph_ptr_t ADC_get_data_register()
 	return &ADC1->DR;
 }
 
-void ADC_start(ADC_mode_t mode, uint8_t count_channels)
+/**
+ * @brief This function starts the regular group, the frame callback is taken from s_frame_callback
+ *
+ * @param mode which mode to use
+ * @param count_channels how many channels are in the sequence
+ */
+static void start_regular(ADC_mode_t mode, uint8_t count_channels)
 {
-	if (!s_adc1_init)
+	uint16_t		  dma_count	  = count_channels;
+	DMA_ACCESS_TYPE_t access_size = s_dual ? DMA_ACCESS_32BIT : DMA_ACCESS_16BIT;
+	uint32_t		  cr2		  = 0;
+	if (!s_adc1_init || count_channels == 0 || count_channels > MAX_SEQUENCE)
 	{
 		return; // ADC isn't ready
 	}
 	switch (mode)
 	{
 	case ADC_mode_loop:
-		ADC1->CR2 |= 1 << ADC_CR1_CONT; // enable continius mode
+		if (setup_dma_channel(s_frame_buffer, access_size, true, DMA_INTERRUPT_HALF | DMA_INTERRUPT_COMPLETE, frame_complete_callback) == false)
+		{
+			return;
+		}
+		s_frame_sequence = 0;
+		s_loop_running	 = true;
+		dma_count		 = count_channels * FRAME_BUFFER_COUNT;
+		ADC1->CR2 |= 1 << ADC_CR2_CONT; // enable continius mode
+		break;
 	case ADC_mode_single:
-		ADC1->CR1 |= 1 << ADC_CR2_SCAN; // enable scan mode
+		if (setup_dma_channel(s_output, access_size, false, s_frame_callback != NULL ? DMA_INTERRUPT_COMPLETE : 0,
+							  s_frame_callback != NULL ? single_complete_callback : NULL) == false)
+		{
+			return;
+		}
+		s_loop_running = false;
+		ADC1->CR2 &= ~(1 << ADC_CR2_CONT);
 		break;
 	default:
 		return;
 		break;
 	}
-	DMA_start_channel(DMA_CH1_ADC1, count_channels, false);
-	ADC1->CR2 |= 1 << ADC_CR2_ADON; // ADC on!
+	s_channel_count = count_channels;
+	ADC1->CR1 |= 1 << ADC_CR1_SCAN; // enable scan mode
+	DMA_start_channel(DMA_CH1_ADC1, dma_count, false);
+	// after ADC_stop the first ADON only powers the ADC up
+	power_up(ADC1);
+	if (s_dual)
+	{
+		power_up(ADC2);
+		// the slave follows the master, it gets the same scan and continuous settings
+		ADC2->CR1 |= 1 << ADC_CR1_SCAN;
+		cr2 = (ADC2->CR2 & ~(1 << ADC_CR2_CONT)) | (ADC1->CR2 & (1 << ADC_CR2_CONT));
+		// ! writing the same value with ADON set starts a conversion
+		if (cr2 != ADC2->CR2)
+		{
+			ADC2->CR2 = cr2;
+		}
+		ADC1->CR2 |= 1 << ADC_CR2_SWSTART; // starts both ADCs
+	}
+	else
+	{
+		set_regular_trigger(ADC_trigger_software);
+		s_start_cycles = utils_get_cycles();
+		ADC1->CR2 |= 1 << ADC_CR2_ADON; // ADC on!
+	}
+}
+
+void ADC_start(ADC_mode_t mode, uint8_t count_channels)
+{
+	s_frame_callback = NULL;
+	start_regular(mode, count_channels);
+}
+
+bool ADC_start_async(ADC_mode_t mode, uint8_t count_channels, ADC_frame_callback_t callback)
+{
+	if (!s_adc1_init || s_dual || callback == NULL || count_channels == 0 || count_channels > MAX_SEQUENCE || mode > ADC_mode_loop)
+	{
+		return false;
+	}
+	utils_cycle_counter_start();
+	// the ADC clock is the AHB clock divided by whole numbers, so an ADC clock cycle is a whole number of CPU cycles
+	s_clock_cycles = RCC_get_AHB_freq() / RCC_get_peripheral_freq(RCC_ADC1);
+	s_frame_cycles = s_profile->conversion_cycles * s_clock_cycles;
+	s_frame_callback = callback;
+	start_regular(mode, count_channels);
+	return true;
+}
+
+bool ADC_start_triggered(ADC_REGULAR_TRIGGER_t trigger, uint16_t * output, uint16_t count, ADC_callback_t callback)
+{
+	if (!s_adc1_init || s_dual || output == NULL || count == 0 || trigger >= ADC_trigger_software)
+	{
+		return false;
+	}
+	s_triggered_callback = callback;
+	if (setup_dma_channel(output, DMA_ACCESS_16BIT, true, callback != NULL ? DMA_INTERRUPT_COMPLETE : 0, triggered_complete_callback) == false)
+	{
+		return false;
+	}
+	s_loop_running = false;
+	ADC1->CR2 &= ~(1 << ADC_CR2_CONT);
+	ADC1->CR1 |= 1 << ADC_CR1_SCAN;
+	DMA_start_channel(DMA_CH1_ADC1, count, false);
+	// ! only power up, writing ADON again would start a conversion without the trigger
+	power_up(ADC1);
+	set_regular_trigger(trigger);
+	return true;
+}
+
+bool ADC_profile_build(ADC_profile_t * profile, const uint8_t * channels, const ADC_SAMPLING_TIME_t * channels_sampling_time, uint8_t count_channels)
+{
+	ADC_SAMPLING_TIME_t sampling_time = ADC_DEFAULT_SAMPLING_TIME;
+	uint8_t				channel		  = 0;
+	uint8_t				offset		  = 0;
+	if (profile == NULL || channels == NULL || count_channels == 0 || count_channels > MAX_SEQUENCE)
+	{
+		return false;
+	}
+	profile->sqr1			   = (count_channels - 1) << SEQUENCE_LEN_OFFSET;
+	profile->sqr2			   = 0;
+	profile->sqr3			   = 0;
+	profile->smpr1			   = 0;
+	profile->smpr2			   = 0;
+	profile->smpr1_mask		   = 0;
+	profile->smpr2_mask		   = 0;
+	profile->conversion_cycles = 0;
+	profile->count_channels	   = count_channels;
+	for (size_t i = 0; i < count_channels; i++)
+	{
+		channel		  = channels[i];
+		if (channel > MAX_CHANNEL)
+		{
+			return false;
+		}
+		sampling_time = channels_sampling_time == NULL ? s_tuned_times[channel] : channels_sampling_time[i];
+		if (sampling_time > ADC_SAMPLING_239_5)
+		{
+			return false;
+		}
+		profile->channels[i] = channel;
+		offset				 = SEQUENCE_CH_SIZE * (i % SEQUENCE_REG_CH_COUNT);
+		if (i <= SEQUENCE_REG_3_MAX_CH)
+		{
+			profile->sqr3 |= channel << offset;
+		}
+		else if (i <= SEQUENCE_REG_2_MAX_CH)
+		{
+			profile->sqr2 |= channel << offset;
+		}
+		else
+		{
+			profile->sqr1 |= channel << offset;
+		}
+		// a repeated channel keeps the last sampling time, like the hardware would
+		offset = SAMPLING_TIME_SIZE * (channel % SAMPLING_REG_CH_COUNT);
+		if (channel <= SAMPLING_REG_2_MAX_CH)
+		{
+			profile->smpr2 = (profile->smpr2 & ~(SAMPLING_TIME_MASK << offset)) | (sampling_time << offset);
+			profile->smpr2_mask |= SAMPLING_TIME_MASK << offset;
+		}
+		else
+		{
+			profile->smpr1 = (profile->smpr1 & ~(SAMPLING_TIME_MASK << offset)) | (sampling_time << offset);
+			profile->smpr1_mask |= SAMPLING_TIME_MASK << offset;
+		}
+	}
+	// sum after all repeats are resolved, the hardware uses the final sampling time of each channel
+	for (size_t i = 0; i < count_channels; i++)
+	{
+		channel = profile->channels[i];
+		if (channel <= SAMPLING_REG_2_MAX_CH)
+		{
+			sampling_time = (profile->smpr2 >> (SAMPLING_TIME_SIZE * channel)) & SAMPLING_TIME_MASK;
+		}
+		else
+		{
+			sampling_time = (profile->smpr1 >> (SAMPLING_TIME_SIZE * (channel - SAMPLING_REG_1_MIN_CH))) & SAMPLING_TIME_MASK;
+		}
+		profile->conversion_cycles += s_conversion_cycles[sampling_time];
+	}
+	return true;
+}
+
+uint16_t ADC_get_conversion_cycles(ADC_SAMPLING_TIME_t sampling_time)
+{
+	if (sampling_time > ADC_SAMPLING_239_5)
+	{
+		return 0;
+	}
+	return s_conversion_cycles[sampling_time];
+}
+
+bool ADC_profile_apply(const ADC_profile_t * profile)
+{
+	bool restart = s_loop_running;
+	if (!s_adc1_init || s_dual || profile == NULL || profile->count_channels == 0 || profile->count_channels > MAX_SEQUENCE)
+	{
+		return false;
+	}
+	// the running oversampling must still fit with the repeats of the new sequence
+	if (s_oversample_frames != 0 && !oversampling_fits(profile, s_oversample_frames, s_oversample_shift))
+	{
+		return false;
+	}
+	if (restart)
+	{
+		// the DMA length of the double buffer depends on the sequence length
+		ADC_stop();
+	}
+	write_profile(ADC1, profile);
+	s_profile		= profile;
+	s_channel_count = profile->count_channels;
+	// a plain multiply, SCAN applies a profile per frame from its timer interrupt
+	s_frame_cycles = profile->conversion_cycles * s_clock_cycles;
+	if (restart)
+	{
+		// keeps the frame callback of an ADC_start_async loop
+		start_regular(ADC_mode_loop, profile->count_channels);
+	}
+	return true;
+}
+
+const ADC_profile_t * ADC_profile_get_active()
+{
+	return s_profile;
+}
+
+uint32_t ADC_read_snapshot(uint16_t * output)
+{
+	return read_frame(output, false);
+}
+
+uint32_t ADC_read_snapshot_dual(uint32_t * output)
+{
+	return read_frame(output, true);
+}
+
+bool ADC_set_oversampling(const ADC_oversampling_t * config)
+{
+	// stop the accumulation in the interrupt before touching its state
+	s_oversample_frames = 0;
+	if (config == NULL || config->frames == 0)
+	{
+		return true;
+	}
+	if (config->shift >= 32 || s_profile == NULL || !oversampling_fits(s_profile, config->frames, config->shift))
+	{
+		return false;
+	}
+	for (size_t i = 0; i < ADC_CHANNEL_COUNT; i++)
+	{
+		s_accumulators[i] = 0;
+	}
+	s_oversample_count	   = 0;
+	s_oversample_shift	   = config->shift;
+	s_oversampled_sequence = 0;
+	s_oversample_frames	   = config->frames;
+	return true;
+}
+
+uint32_t ADC_read_oversampled(uint16_t * output)
+{
+	uint32_t		 sequence = 0;
+	const uint16_t * results  = NULL;
+	if (output == NULL)
+	{
+		return 0;
+	}
+	do
+	{
+		sequence = s_oversampled_sequence;
+		if (sequence == 0)
+		{
+			return 0; // no result yet
+		}
+		results = s_oversampled[(sequence & 1) ? 0 : 1];
+		for (size_t i = 0; i < ADC_CHANNEL_COUNT; i++)
+		{
+			output[i] = results[i];
+		}
+		__DMB();
+	} while (sequence != s_oversampled_sequence);
+	return sequence;
 }
 
 void ADC_stop()
@@ -243,10 +861,276 @@ void ADC_stop()
 	{
 		return; // ADC isn't ready
 	}
+	s_loop_running = false;
+	ADC1->CR2 &= ~(1 << ADC_CR2_CONT);
 	ADC1->CR2 &= ~0x1; // ADC off!
+	if (!s_dual)
+	{
+		set_regular_trigger(ADC_trigger_software);
+	}
+	if (s_dual)
+	{
+		ADC2->CR2 &= ~(1 << ADC_CR2_CONT);
+		ADC2->CR2 &= ~0x1;
+	}
+	DMA_stop_channel(DMA_CH1_ADC1);
+}
+
+void ADC_de_init()
+{
+	if (!s_adc1_init)
+	{
+		return;
+	}
+	ADC_stop();
+	DMA_de_init_channel(DMA_CH1_ADC1);
+	if (s_dual)
+	{
+		ADC1->CR1 &= ~ADC_CR1_DUALMOD_MASK;
+	}
+	s_dual				 = false;
+	s_adc1_init			 = false;
+	s_profile			 = NULL;
+	s_output			 = NULL;
+	s_channel_count		 = 0;
+	s_frame_callback	 = NULL;
+	s_triggered_callback = NULL;
+}
+
+bool ADC_injected_init(const uint8_t * channels, const ADC_SAMPLING_TIME_t * channels_sampling_time, uint8_t count_channels, ADC_INJECTED_TRIGGER_t trigger)
+{
+	uint32_t jsqr = 0;
+	uint32_t cr2  = 0;
+	if (channels == NULL || count_channels == 0 || count_channels > MAX_INJECTED_SEQUENCE || trigger > ADC_injected_trigger_software)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < count_channels; i++)
+	{
+		if (channels[i] > MAX_CHANNEL)
+		{
+			return false;
+		}
+		// a shorter sequence ends at JSQ4, the first channel is in JSQ(4 - count + 1) and its result is in JDR1
+		jsqr |= channels[i] << (SEQUENCE_CH_SIZE * (MAX_INJECTED_SEQUENCE - count_channels + i));
+	}
+	jsqr |= (count_channels - 1) << INJECTED_SEQUENCE_LEN;
+
+	startup_adc(ADC1, RCC_ADC1);
+	for (size_t i = 0; i < count_channels; i++)
+	{
+		set_channel_sampling_time(ADC1, channels[i], channels_sampling_time == NULL ? s_tuned_times[channels[i]] : channels_sampling_time[i]);
+	}
+	ADC1->JSQR		= jsqr;
+	s_injected_used = true;
+	// scan mode converts all the injected channels, not just the first
+	ADC1->CR1 |= 1 << ADC_CR1_SCAN;
+	cr2 = (ADC1->CR2 & ~ADC_CR2_JEXTSEL_MASK) | (trigger << ADC_CR2_JEXTSEL) | (1 << ADC_CR2_JEXTTRIG);
+	// ! writing the same value with ADON set starts a regular conversion
+	if (cr2 != ADC1->CR2)
+	{
+		ADC1->CR2 = cr2;
+	}
+	return true;
+}
+
+void ADC_injected_start()
+{
+	ADC1->CR2 |= 1 << ADC_CR2_JSWSTART;
+}
+
+uint16_t ADC_injected_read(uint8_t index)
+{
+	if (index >= MAX_INJECTED_SEQUENCE)
+	{
+		return 0;
+	}
+	return (&ADC1->JDR1)[index];
+}
+
+void ADC_injected_set_callback(ADC_callback_t callback)
+{
+	s_injected_callback = callback;
+	if (callback == NULL)
+	{
+		ADC1->CR1 &= ~(1 << ADC_CR1_JEOCIE);
+	}
+	else
+	{
+		ADC1->SR &= ~(1 << ADC_SR_JEOC);
+		ADC1->CR1 |= 1 << ADC_CR1_JEOCIE;
+		NVIC_EnableIRQ(ADC1_2_IRQn);
+	}
+}
+
+bool ADC_watchdog_arm(uint8_t channel, uint16_t low, uint16_t high, ADC_callback_t callback)
+{
+	uint32_t cr1 = 0;
+	if ((channel > MAX_CHANNEL && channel != ADC_WATCHDOG_ALL_CHANNELS) || low > high || high > ADC_MAX_VALUE)
+	{
+		return false;
+	}
+	ADC_watchdog_disarm();
+	ADC1->HTR = high;
+	ADC1->LTR = low;
+	cr1 = ADC1->CR1 & ~(ADC_CR1_AWDCH_MASK | (1 << ADC_CR1_AWDSGL));
+	if (channel != ADC_WATCHDOG_ALL_CHANNELS)
+	{
+		cr1 |= (1 << ADC_CR1_AWDSGL) | channel;
+	}
+	s_watchdog_callback = callback;
+	// clear a stale event before enabling the interrupt
+	ADC1->SR  = ~(1 << ADC_SR_AWD);
+	ADC1->CR1 = cr1 | (1 << ADC_CR1_AWDEN) | (1 << ADC_CR1_AWDIE);
+	NVIC_EnableIRQ(ADC1_2_IRQn);
+	return true;
+}
+
+bool ADC_watchdog_arm_around(uint8_t channel, uint16_t value, uint16_t deadband, ADC_callback_t callback)
+{
+	uint16_t low  = value > deadband ? value - deadband : 0;
+	uint16_t high = (uint32_t)value + deadband < ADC_MAX_VALUE ? value + deadband : ADC_MAX_VALUE;
+	if (channel == ADC_WATCHDOG_ALL_CHANNELS)
+	{
+		return false;
+	}
+	return ADC_watchdog_arm(channel, low, high, callback);
+}
+
+void ADC_watchdog_disarm()
+{
+	ADC1->CR1 &= ~((1 << ADC_CR1_AWDEN) | (1 << ADC_CR1_AWDIE));
+}
+
+bool ADC_tune_sampling_times(const uint8_t * channels, uint8_t count_channels, uint16_t tolerance, ADC_SAMPLING_TIME_t * results)
+{
+	uint32_t			cr1		 = 0;
+	uint32_t			cr2		 = 0;
+	uint32_t			smpr1	 = 0;
+	uint32_t			smpr2	 = 0;
+	uint16_t			baseline = 0;
+	int32_t				error	 = 0;
+	ADC_SAMPLING_TIME_t tuned	 = ADC_SAMPLING_239_5;
+	if (channels == NULL || count_channels == 0 || s_injected_used)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < count_channels; i++)
+	{
+		if (channels[i] > MAX_CHANNEL)
+		{
+			return false;
+		}
+	}
+	startup_adc(ADC1, RCC_ADC1);
+	cr1	  = ADC1->CR1;
+	cr2	  = ADC1->CR2;
+	smpr1 = ADC1->SMPR1;
+	smpr2 = ADC1->SMPR2;
+	if ((cr2 & (1 << ADC_CR2_TSVREFE)) == 0)
+	{
+		ADC1->CR2 |= 1 << ADC_CR2_TSVREFE;
+		for (volatile uint32_t i = 0; i < ADC_VREFINT_STARTUP_LOOPS; i++)
+		{
+			asm("nop");
+		}
+	}
+	// no interrupt handler should take the end of conversion flag
+	ADC1->CR1 = (cr1 & ~(1 << ADC_CR1_JEOCIE)) | (1 << ADC_CR1_SCAN);
+	if ((ADC1->CR2 & (ADC_CR2_JEXTSEL_MASK | (1 << ADC_CR2_JEXTTRIG))) != (ADC_CR2_JEXTSEL_MASK | (1 << ADC_CR2_JEXTTRIG)))
+	{
+		// JSWSTART is the injected trigger, all JEXTSEL bits set
+		ADC1->CR2 |= ADC_CR2_JEXTSEL_MASK | (1 << ADC_CR2_JEXTTRIG);
+	}
+	set_channel_sampling_time(ADC1, ADC_CHANNEL_VREFINT, ADC_SAMPLING_239_5);
+	for (size_t i = 0; i < count_channels; i++)
+	{
+		// Vrefint in JSQ3 then the channel in JSQ4, a sequence of 2
+		ADC1->JSQR = (1 << INJECTED_SEQUENCE_LEN) | (ADC_CHANNEL_VREFINT << (SEQUENCE_CH_SIZE * 2)) | (channels[i] << (SEQUENCE_CH_SIZE * 3));
+		baseline   = measure_after_vrefint(channels[i], ADC_SAMPLING_239_5);
+		tuned	   = ADC_SAMPLING_239_5;
+		for (ADC_SAMPLING_TIME_t time = ADC_SAMPLING_1_5; time < ADC_SAMPLING_239_5; time++)
+		{
+			error = (int32_t)measure_after_vrefint(channels[i], time) - baseline;
+			if (error <= tolerance && -error <= tolerance)
+			{
+				tuned = time;
+				break;
+			}
+		}
+		s_tuned_times[channels[i]] = tuned;
+		if (results != NULL)
+		{
+			results[i] = tuned;
+		}
+	}
+	ADC1->JSQR	= 0;
+	ADC1->SR   &= ~(1 << ADC_SR_JEOC);
+	ADC1->SMPR1 = smpr1;
+	ADC1->SMPR2 = smpr2;
+	ADC1->CR1	= cr1;
+	// ! writing the same value with ADON set starts a conversion
+	if (ADC1->CR2 != cr2)
+	{
+		ADC1->CR2 = cr2;
+	}
+	return true;
+}
+
+ADC_SAMPLING_TIME_t ADC_get_tuned_sampling_time(uint8_t channel)
+{
+	if (channel > MAX_CHANNEL)
+	{
+		return ADC_DEFAULT_SAMPLING_TIME;
+	}
+	return s_tuned_times[channel];
 }
 
 void ADC_startup()
 {
-	s_adc1_init = false;
+	for (size_t i = 0; i < ADC_CHANNEL_COUNT; i++)
+	{
+		s_tuned_times[i] = ADC_DEFAULT_SAMPLING_TIME;
+	}
+	s_injected_used = false;
+	s_adc1_init		 = false;
+	s_dual			 = false;
+	s_loop_running	 = false;
+	s_profile		 = NULL;
+	s_output		 = NULL;
+	s_channel_count	 = 0;
+	s_frame_sequence = 0;
+	ADC_set_oversampling(NULL);
+	s_frame_callback	 = NULL;
+	s_triggered_callback = NULL;
+	s_injected_callback	 = NULL;
+	s_watchdog_callback	 = NULL;
+}
+
+/*
+ ? Interrupt handlers
+*/
+
+void ADC1_2_IRQHandler()
+{
+	uint32_t status = ADC1->SR;
+	if ((status & (1 << ADC_SR_JEOC)) && (ADC1->CR1 & (1 << ADC_CR1_JEOCIE)))
+	{
+		// SR bits are cleared by writing 0, writing 1 has no effect
+		ADC1->SR = ~(1 << ADC_SR_JEOC);
+		if (s_injected_callback != NULL)
+		{
+			s_injected_callback();
+		}
+	}
+	if ((status & (1 << ADC_SR_AWD)) && (ADC1->CR1 & (1 << ADC_CR1_AWDIE)))
+	{
+		// one shot, the value stays outside the window until the watchdog is re-armed around it
+		ADC_watchdog_disarm();
+		ADC1->SR = ~(1 << ADC_SR_AWD);
+		if (s_watchdog_callback != NULL)
+		{
+			s_watchdog_callback();
+		}
+	}
 }
\ No newline at end of file
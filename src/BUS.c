@@ -0,0 +1,609 @@
+#include "BUS.h"
+#include "utils.h"
+
+typedef enum
+{
+	SPI_PHASE_REGISTER,
+	SPI_PHASE_WRITE,
+	SPI_PHASE_READ,
+	SPI_PHASE_COUNT
+} BUS_SPI_PHASE_t;
+
+typedef struct
+{
+	BUS_transfer_t transfer;
+	BUS_callback_t callback;
+	void *		   context;
+	uint32_t	   submitted; // CPU cycles
+	uint32_t	   deadline;  // CPU cycles, when has_deadline
+	uint32_t	   sequence;
+	uint16_t	   done;  // bytes of the finished chunks
+	uint16_t	   chunk; // bytes of the running chunk
+	uint8_t		   device;
+	uint8_t		   priority;
+	bool		   has_deadline;
+	bool		   started;
+	bool		   used;
+} BUS_entry_t;
+
+typedef struct
+{
+	BUS_backend_t backend;
+	BUS_entry_t	  queue[BUS_QUEUE_SIZE];
+	BUS_stats_t	  stats;
+	uint32_t	  sequence;
+	int8_t		  running;	  // entry of the running chunk, -1 when the bus is free
+	int8_t		  selected;	  // entry with the chip select of its device taken, -1 for none
+	int8_t		  configured; // device the bus was last configured for
+} BUS_bus_t;
+
+typedef struct
+{
+	BUS_device_config_t config;
+	GPIO_PIN_ARRAY_t	cs;
+	BUS_device_stats_t	stats;
+	uint8_t				bus;
+} BUS_device_t;
+
+static BUS_bus_t	s_buses[BUS_MAX_BUSES];
+static BUS_device_t s_devices[BUS_MAX_DEVICES];
+static uint8_t		s_bus_count	   = 0;
+static uint8_t		s_device_count = 0;
+
+/* the bus of each SPI port, -1 when the port is not a bus */
+static int8_t s_spi_buses[SPI_COUNT];
+/* the transfer of each SPI port, sent one phase after the other */
+static BUS_transfer_t s_spi_transfers[SPI_COUNT];
+static uint8_t		  s_spi_phases[SPI_COUNT];
+/* the bus of each I2C port, -1 when the port is not a bus */
+static int8_t s_i2c_buses[I2C_COUNT];
+
+/*
+ ? SPI adapters
+*/
+
+static bool spi_configure(uint8_t id, const BUS_device_config_t * device)
+{
+	return SPI_configure(id, device->max_frequency, device->mode, device->lsb_first) == SPI_NO_ERR;
+}
+
+static void spi_done(SPI_t port);
+
+/**
+ * @brief This function starts the next phase of the transfer of a port: the register, the write and the read
+ *
+ * @param port which port
+ * @return SPI_ERR_t SPI_NO_ERR if a phase started, SPI_NULL if no phase is left
+ */
+static SPI_ERR_t spi_next_phase(SPI_t port)
+{
+	const BUS_transfer_t * transfer = &s_spi_transfers[port];
+	while (s_spi_phases[port] < SPI_PHASE_COUNT)
+	{
+		switch (s_spi_phases[port]++)
+		{
+		case SPI_PHASE_REGISTER:
+			if (transfer->has_reg)
+			{
+				return SPI_transfer(port, &transfer->reg, NULL, 1, spi_done);
+			}
+			break;
+		case SPI_PHASE_WRITE:
+			if (transfer->tx_length != 0)
+			{
+				return SPI_transfer(port, transfer->tx, transfer->full_duplex ? transfer->rx : NULL, transfer->tx_length, spi_done);
+			}
+			break;
+		default:
+			if (!transfer->full_duplex && transfer->rx_length != 0)
+			{
+				return SPI_transfer(port, NULL, transfer->rx, transfer->rx_length, spi_done);
+			}
+			break;
+		}
+	}
+	return SPI_NULL;
+}
+
+static void spi_done(SPI_t port)
+{
+	SPI_ERR_t error = spi_next_phase(port);
+	if (error != SPI_NO_ERR)
+	{
+		BUS_transfer_done(s_spi_buses[port], error == SPI_NULL);
+	}
+}
+
+static bool spi_start(uint8_t id, const BUS_device_config_t * device, const BUS_transfer_t * transfer)
+{
+	s_spi_transfers[id] = *transfer;
+	s_spi_phases[id]	= SPI_PHASE_REGISTER;
+	return spi_next_phase(id) == SPI_NO_ERR;
+}
+
+/*
+ ? I2C adapters
+*/
+
+static void i2c_done(I2C_t port, I2C_RESULT_t result)
+{
+	BUS_transfer_done(s_i2c_buses[port], result == I2C_OK);
+}
+
+static bool i2c_start(uint8_t id, const BUS_device_config_t * device, const BUS_transfer_t * transfer)
+{
+	I2C_ERR_t error = I2C_NO_ERR;
+	if (transfer->full_duplex)
+	{
+		return false;
+	}
+	if (!transfer->has_reg)
+	{
+		error = I2C_transfer(id, device->address, transfer->tx, transfer->tx_length, transfer->rx, transfer->rx_length, i2c_done);
+	}
+	else if (transfer->rx_length == 0)
+	{
+		error = I2C_write_register(id, device->address, transfer->reg, transfer->tx, transfer->tx_length, i2c_done);
+	}
+	else if (transfer->tx_length == 0)
+	{
+		error = I2C_read_register(id, device->address, transfer->reg, transfer->rx, transfer->rx_length, i2c_done);
+	}
+	else
+	{
+		return false; // a register, a write and a read is not a single I2C transfer
+	}
+	return error == I2C_NO_ERR;
+}
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function compares 2 queued transactions
+ *
+ * @param a a transaction
+ * @param b another transaction
+ * @return true a goes before b
+ * @return false b goes before a
+ */
+static bool is_more_urgent(const BUS_entry_t * a, const BUS_entry_t * b)
+{
+	if (a->priority != b->priority)
+	{
+		return a->priority < b->priority;
+	}
+	if (a->has_deadline != b->has_deadline)
+	{
+		return a->has_deadline;
+	}
+	// the cycle counter wraps, so the times are compared by their difference
+	if (a->has_deadline && a->deadline != b->deadline)
+	{
+		return (int32_t)(a->deadline - b->deadline) < 0;
+	}
+	return (int32_t)(a->sequence - b->sequence) < 0;
+}
+
+/**
+ * @brief This function finds the next transaction of a bus
+ *
+ * @param bus the bus
+ * @return int8_t queue entry, -1 if the queue is empty
+ */
+static int8_t pick(const BUS_bus_t * bus)
+{
+	int8_t best = -1;
+	for (size_t i = 0; i < BUS_QUEUE_SIZE; i++)
+	{
+		if (bus->queue[i].used && (best < 0 || is_more_urgent(&bus->queue[i], &bus->queue[best])))
+		{
+			best = i;
+		}
+	}
+	return best;
+}
+
+/**
+ * @brief This function returns the total bytes of a transaction
+ *
+ * @param transfer the transaction
+ * @return uint16_t bytes over both phases
+ */
+static uint16_t get_total(const BUS_transfer_t * transfer)
+{
+	return transfer->full_duplex ? transfer->tx_length : transfer->tx_length + transfer->rx_length;
+}
+
+/**
+ * @brief This function builds the next chunk of a transaction
+ *
+ * @param entry the transaction
+ * @param max_chunk max bytes of a chunk, 0 for the whole transaction
+ * @param chunk output, the chunk
+ * @return uint16_t bytes of the chunk
+ */
+static uint16_t get_chunk(const BUS_entry_t * entry, uint16_t max_chunk, BUS_transfer_t * chunk)
+{
+	const BUS_transfer_t * transfer = &entry->transfer;
+	uint16_t			   length	= 0;
+	if (max_chunk == 0)
+	{
+		*chunk = *transfer;
+		return get_total(transfer);
+	}
+	*chunk = (BUS_transfer_t){ .reg = transfer->reg, .has_reg = transfer->has_reg, .reg_fixed = transfer->reg_fixed, .full_duplex = transfer->full_duplex };
+	if (transfer->full_duplex)
+	{
+		length			  = transfer->tx_length - entry->done;
+		length			  = length > max_chunk ? max_chunk : length;
+		chunk->tx		  = transfer->tx + entry->done;
+		chunk->rx		  = transfer->rx + entry->done;
+		chunk->tx_length  = length;
+		chunk->rx_length  = length;
+	}
+	else if (entry->done < transfer->tx_length)
+	{
+		// the write phase is split on its own, a chunk is never part write and part read
+		length			 = transfer->tx_length - entry->done;
+		length			 = length > max_chunk ? max_chunk : length;
+		chunk->tx		 = transfer->tx + entry->done;
+		chunk->tx_length = length;
+	}
+	else
+	{
+		length			 = get_total(transfer) - entry->done;
+		length			 = length > max_chunk ? max_chunk : length;
+		chunk->rx		 = transfer->rx + entry->done - transfer->tx_length;
+		chunk->rx_length = length;
+	}
+	// the device advances its register address on each byte, a chunk starts where the previous one ended
+	if (!transfer->reg_fixed)
+	{
+		chunk->reg += entry->done < transfer->tx_length ? entry->done : entry->done - transfer->tx_length;
+	}
+	return length;
+}
+
+/**
+ * @brief This function releases the chip select of a bus, if taken
+ *
+ * @param bus the bus
+ */
+static void release_cs(BUS_bus_t * bus)
+{
+	BUS_device_t * device = NULL;
+	if (bus->selected < 0)
+	{
+		return;
+	}
+	device = &s_devices[bus->queue[bus->selected].device];
+	if (device->config.cs_pin != BUS_NO_CS)
+	{
+		GPIO_array_write_all(&device->cs, true);
+	}
+	bus->selected = -1;
+}
+
+/**
+ * @brief This function removes a transaction from the queue and counts it
+ *
+ * @param bus the bus
+ * @param index queue entry
+ * @param success false if the transaction failed
+ */
+static void finish(BUS_bus_t * bus, uint8_t index, bool success)
+{
+	BUS_entry_t *		 entry	 = &bus->queue[index];
+	BUS_device_stats_t * stats	 = &s_devices[entry->device].stats;
+	uint32_t			 now	 = utils_get_cycles();
+	uint32_t			 latency = now - entry->submitted;
+	// the device frames its commands with the chip select, so it is released after each transaction
+	release_cs(bus);
+	if (success)
+	{
+		stats->transactions++;
+	}
+	else
+	{
+		stats->failed++;
+	}
+	if (entry->has_deadline && (int32_t)(now - entry->deadline) > 0)
+	{
+		stats->deadline_missed++;
+	}
+	stats->last_latency = latency;
+	stats->max_latency	= latency > stats->max_latency ? latency : stats->max_latency;
+	entry->used			= false;
+	bus->stats.depth--;
+}
+
+/**
+ * @brief This function starts the next chunk on a free bus, failed transactions are finished on the way
+ *
+ * @param index bus index
+ *
+ * @remarks Called with the interrupts disabled
+ */
+static void schedule(uint8_t index)
+{
+	BUS_bus_t *	   bus	  = &s_buses[index];
+	BUS_entry_t *  entry  = NULL;
+	BUS_device_t * device = NULL;
+	BUS_transfer_t chunk;
+	BUS_callback_t callback	 = NULL;
+	int8_t		   next		 = -1;
+	uint32_t	   wait		 = 0;
+	bool		   continued = false;
+	while (bus->running < 0)
+	{
+		next = pick(bus);
+		if (next < 0)
+		{
+			return;
+		}
+		entry  = &bus->queue[next];
+		device = &s_devices[entry->device];
+		// a transaction keeps the chip select between its chunks, unless another transaction took the bus
+		continued = bus->selected == next;
+		if (!continued)
+		{
+			release_cs(bus);
+			if (bus->configured != entry->device && bus->backend.configure != NULL &&
+				!bus->backend.configure(bus->backend.id, &device->config))
+			{
+				callback = entry->callback;
+				finish(bus, next, false);
+				if (callback != NULL)
+				{
+					callback(entry->device, false, entry->context);
+				}
+				continue;
+			}
+			bus->configured = entry->device;
+			bus->selected	= next;
+			if (device->config.cs_pin != BUS_NO_CS)
+			{
+				GPIO_array_write_all(&device->cs, false);
+			}
+		}
+		if (!entry->started)
+		{
+			wait					= utils_get_cycles() - entry->submitted;
+			device->stats.max_wait	= wait > device->stats.max_wait ? wait : device->stats.max_wait;
+			entry->started			= true;
+		}
+		entry->chunk = get_chunk(entry, device->config.max_chunk, &chunk);
+		// with the chip select still taken the device sees a single command, its register byte was sent by the first chunk
+		if (continued && device->config.cs_pin != BUS_NO_CS)
+		{
+			chunk.has_reg = false;
+		}
+		bus->running = next;
+		if (!bus->backend.start(bus->backend.id, &device->config, &chunk))
+		{
+			bus->running = -1;
+			callback	 = entry->callback;
+			finish(bus, next, false);
+			if (callback != NULL)
+			{
+				callback(entry->device, false, entry->context);
+			}
+			continue;
+		}
+		device->stats.chunks++;
+	}
+}
+
+/*
+ ? Public functions
+*/
+
+int8_t BUS_add(const BUS_backend_t * backend)
+{
+	BUS_bus_t * bus = NULL;
+	if (backend == NULL || backend->start == NULL || s_bus_count >= BUS_MAX_BUSES)
+	{
+		return -1;
+	}
+	bus				= &s_buses[s_bus_count];
+	bus->backend	= *backend;
+	bus->stats		= (BUS_stats_t){ 0 };
+	bus->sequence	= 0;
+	bus->running	= -1;
+	bus->selected	= -1;
+	bus->configured = -1;
+	for (size_t i = 0; i < BUS_QUEUE_SIZE; i++)
+	{
+		bus->queue[i].used = false;
+	}
+	utils_cycle_counter_start();
+	return s_bus_count++;
+}
+
+int8_t BUS_add_spi(SPI_t port)
+{
+	BUS_backend_t backend = { .configure = spi_configure, .start = spi_start, .id = port };
+	if (port >= SPI_COUNT || SPI_get_frequency(port) == 0 || s_spi_buses[port] >= 0)
+	{
+		return -1;
+	}
+	s_spi_buses[port] = BUS_add(&backend);
+	return s_spi_buses[port];
+}
+
+int8_t BUS_add_i2c(I2C_t port)
+{
+	BUS_backend_t backend = { .configure = NULL, .start = i2c_start, .id = port };
+	if (port >= I2C_COUNT || I2C_get_frequency(port) == 0 || s_i2c_buses[port] >= 0)
+	{
+		return -1;
+	}
+	s_i2c_buses[port] = BUS_add(&backend);
+	return s_i2c_buses[port];
+}
+
+int8_t BUS_add_device(uint8_t bus, const BUS_device_config_t * config)
+{
+	BUS_device_t * device = NULL;
+	if (config == NULL || bus >= s_bus_count || s_device_count >= BUS_MAX_DEVICES)
+	{
+		return -1;
+	}
+	if (config->cs_pin != BUS_NO_CS && config->cs_pin > GPIO_MAX_PIN)
+	{
+		return -1;
+	}
+	device = &s_devices[s_device_count];
+	if (config->cs_pin != BUS_NO_CS)
+	{
+		if (GPIO_array_init(&device->cs, config->cs_port, config->cs_pin, config->cs_pin, GPIO_MODE_OUTPUT_50Mhz,
+							GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+		{
+			return -1;
+		}
+		GPIO_array_write_all(&device->cs, true);
+	}
+	device->config = *config;
+	device->stats  = (BUS_device_stats_t){ 0 };
+	device->bus	   = bus;
+	return s_device_count++;
+}
+
+bool BUS_submit(uint8_t device, const BUS_transfer_t * transfer, BUS_PRIORITY_t priority, uint32_t deadline, BUS_callback_t callback,
+				void * context)
+{
+	BUS_bus_t *	  bus	  = NULL;
+	BUS_entry_t * entry	  = NULL;
+	uint32_t	  primask = 0;
+	if (device >= s_device_count || transfer == NULL || priority >= BUS_PRIORITY_COUNT || (get_total(transfer) == 0 && !transfer->has_reg))
+	{
+		return false;
+	}
+	if ((transfer->tx_length != 0 && transfer->tx == NULL) || (transfer->rx_length != 0 && transfer->rx == NULL) ||
+		(transfer->full_duplex && transfer->rx_length != transfer->tx_length))
+	{
+		return false;
+	}
+	bus		= &s_buses[s_devices[device].bus];
+	primask = __get_PRIMASK();
+	__disable_irq();
+	for (size_t i = 0; i < BUS_QUEUE_SIZE && entry == NULL; i++)
+	{
+		if (!bus->queue[i].used)
+		{
+			entry = &bus->queue[i];
+		}
+	}
+	if (entry == NULL)
+	{
+		bus->stats.dropped++;
+		__set_PRIMASK(primask);
+		return false;
+	}
+	*entry = (BUS_entry_t){
+		.transfer	  = *transfer,
+		.callback	  = callback,
+		.context	  = context,
+		.submitted	  = utils_get_cycles(),
+		.sequence	  = bus->sequence++,
+		.device		  = device,
+		.priority	  = priority,
+		.has_deadline = deadline != BUS_NO_DEADLINE,
+		.used		  = true,
+	};
+	entry->deadline = entry->submitted + deadline;
+	bus->stats.depth++;
+	bus->stats.max_depth = bus->stats.depth > bus->stats.max_depth ? bus->stats.depth : bus->stats.max_depth;
+	schedule(s_devices[device].bus);
+	__set_PRIMASK(primask);
+	return true;
+}
+
+void BUS_transfer_done(uint8_t index, bool success)
+{
+	BUS_bus_t *	   bus		= NULL;
+	BUS_entry_t *  entry	= NULL;
+	BUS_callback_t callback = NULL;
+	void *		   context	= NULL;
+	uint8_t		   device	= 0;
+	int8_t		   running	= -1;
+	uint32_t	   primask	= 0;
+	if (index >= s_bus_count || s_buses[index].running < 0)
+	{
+		return;
+	}
+	bus		= &s_buses[index];
+	running = bus->running;
+	entry	= &bus->queue[running];
+	primask = __get_PRIMASK();
+	__disable_irq();
+	bus->running = -1;
+	entry->done += entry->chunk;
+	if (!success || entry->done >= get_total(&entry->transfer))
+	{
+		callback = entry->callback;
+		context	 = entry->context;
+		device	 = entry->device;
+		finish(bus, running, success);
+		schedule(index);
+	}
+	else
+	{
+		// between chunks, a more urgent transaction takes the bus
+		schedule(index);
+		if (bus->running != running)
+		{
+			bus->stats.preemptions++;
+		}
+	}
+	__set_PRIMASK(primask);
+	// the next transaction is already running
+	if (callback != NULL)
+	{
+		callback(device, success, context);
+	}
+}
+
+bool BUS_is_idle(uint8_t bus)
+{
+	if (bus >= s_bus_count)
+	{
+		return true;
+	}
+	return s_buses[bus].stats.depth == 0;
+}
+
+void BUS_get_device_stats(uint8_t device, BUS_device_stats_t * stats)
+{
+	if (device >= s_device_count || stats == NULL)
+	{
+		return;
+	}
+	*stats = s_devices[device].stats;
+}
+
+void BUS_get_stats(uint8_t bus, BUS_stats_t * stats)
+{
+	if (bus >= s_bus_count || stats == NULL)
+	{
+		return;
+	}
+	*stats = s_buses[bus].stats;
+}
+
+void BUS_startup()
+{
+	s_bus_count	   = 0;
+	s_device_count = 0;
+	for (size_t i = 0; i < SPI_COUNT; i++)
+	{
+		s_spi_buses[i]	= -1;
+		s_spi_phases[i] = SPI_PHASE_COUNT;
+	}
+	for (size_t i = 0; i < I2C_COUNT; i++)
+	{
+		s_i2c_buses[i] = -1;
+	}
+}
@@ -0,0 +1,270 @@
+#include "CAPTURE.h"
+#include "DMA.h"
+#include "RCC.h"
+
+static bool				s_initialized = false;
+static bool				s_running	  = false;
+static TIM_t			s_timer		  = TIM_COUNT;
+static DMA_CHANNELS_t	s_dma		  = DMA_CH_COUNT;
+static periph_ptr_t		s_idr		  = NULL;
+static uint16_t *		s_buffer	  = NULL;
+static uint16_t			s_size		  = 0;
+static uint16_t			s_mask		  = 0;
+static volatile uint32_t s_laps		  = 0; // times the DMA wrapped around the ring
+static uint32_t			s_read		  = 0; // sample number of the next sample to read
+static uint16_t			s_index		  = 0; // and its place in the ring
+static uint16_t			s_last		  = 0; // the watched pins in the sample before it
+static CAPTURE_stats_t	s_stats;
+
+/*
+ ? static functions
+*/
+
+static void dma_callback(DMA_CHANNELS_t dma_channel_number, uint32_t flags)
+{
+	if (flags & DMA_FLAG_FINISHED)
+	{
+		s_laps++;
+	}
+}
+
+/**
+ * @brief This function returns how many samples the DMA wrote since the start
+ *
+ * @return uint32_t samples, wraps around
+ */
+static uint32_t get_written()
+{
+	uint32_t primask   = __get_PRIMASK();
+	uint32_t laps	   = 0;
+	uint16_t remaining = 0;
+	__disable_irq();
+	laps	  = s_laps;
+	remaining = DMA_get_remaining(s_dma);
+	// the DMA may have wrapped before its interrupt ran, the flag stays set until the interrupt clears it
+	if (DMA_channel_get_flag(s_dma, DMA_FLAG_FINISHED))
+	{
+		laps++;
+		remaining = DMA_get_remaining(s_dma);
+	}
+	__set_PRIMASK(primask);
+	return laps * s_size + (s_size - remaining);
+}
+
+/**
+ * @brief This function finds the first sample with a change of the watched pins
+ *
+ * @param index first sample to check
+ * @param end the sample after the last one to check, at most the end of the ring
+ * @return uint16_t index of the change, end if there is none
+ */
+static uint16_t find_change(uint16_t index, uint16_t end)
+{
+	uint32_t pair_mask = s_mask | ((uint32_t)s_mask << 16);
+	uint32_t pair_last = s_last | ((uint32_t)s_last << 16);
+	if ((index & 1) && index < end)
+	{
+		if ((s_buffer[index] & s_mask) != s_last)
+		{
+			return index;
+		}
+		index++;
+	}
+	// the ring is aligned, so a pair of samples is a single load
+	while (index + 2 <= end && (*(const uint32_t *)&s_buffer[index] & pair_mask) == pair_last)
+	{
+		index += 2;
+	}
+	while (index < end && (s_buffer[index] & s_mask) == s_last)
+	{
+		index++;
+	}
+	return index;
+}
+
+/**
+ * @brief This function moves the read position forward
+ *
+ * @param count how many samples
+ */
+static void skip(uint32_t count)
+{
+	s_read += count;
+	s_index = (s_index + count) % s_size;
+}
+
+/*
+ ? Public functions
+*/
+
+CAPTURE_ERR_t CAPTURE_init(const CAPTURE_config_t * config)
+{
+	DMA_address_t periph = { .access_size = DMA_ACCESS_16BIT, .address = NULL, .increament_address = false };
+	DMA_address_t memory = { .access_size = DMA_ACCESS_16BIT, .address = NULL, .increament_address = true };
+	if (config == NULL || config->buffer == NULL)
+	{
+		return CAPTURE_NULL;
+	}
+	if (s_initialized)
+	{
+		return CAPTURE_ALREADY_INIT;
+	}
+	if (config->timer >= TIM_COUNT || GPIO_get_idr(config->port) == NULL || config->pin_mask == 0 || config->rate == 0 ||
+		config->size < 2 || config->size % 2 != 0 || ((uintptr_t)config->buffer & 3) != 0)
+	{
+		return CAPTURE_INVALID_CONFIG;
+	}
+	if (config->rate > CAPTURE_MAX_RATE || TIM_init(config->timer, config->rate) == false)
+	{
+		return CAPTURE_TOO_FAST;
+	}
+	s_timer		   = config->timer;
+	s_idr		   = GPIO_get_idr(config->port);
+	s_buffer	   = config->buffer;
+	s_size		   = config->size;
+	s_mask		   = config->pin_mask;
+	s_dma		   = TIM_get_dma_channel(s_timer, TIM_DMA_UPDATE);
+	periph.address = (uint32_t *)s_idr;
+	memory.address = s_buffer;
+	RCC_peripheral_set_clock(RCC_DMA1, true);
+	if (DMA_init_channel(s_dma, &periph, &memory, DMA_CH_PRIORITY_VERY_HIGH, DMA_DIRECTION_PERIPH_TO_MEM, DMA_INTERRUPT_COMPLETE) == false)
+	{
+		return CAPTURE_DMA_BUSY;
+	}
+	DMA_set_circular(s_dma, true);
+	DMA_set_callback(s_dma, dma_callback);
+	s_initialized = true;
+	return CAPTURE_NO_ERR;
+}
+
+uint32_t CAPTURE_get_rate()
+{
+	if (!s_initialized)
+	{
+		return 0;
+	}
+	return TIM_get_frequency(s_timer);
+}
+
+CAPTURE_ERR_t CAPTURE_start()
+{
+	if (!s_initialized)
+	{
+		return CAPTURE_NOT_INIT;
+	}
+	if (s_running)
+	{
+		return CAPTURE_BUSY;
+	}
+	s_laps	= 0;
+	s_read	= 0;
+	s_index = 0;
+	s_last	= *s_idr & s_mask;
+	s_stats = (CAPTURE_stats_t){ 0 };
+	DMA_stop_channel(s_dma);
+	DMA_channel_clear_flags(s_dma);
+	DMA_start_channel(s_dma, s_size, false);
+	TIM_reload(s_timer);
+	TIM_set_dma_request(s_timer, TIM_DMA_UPDATE, true);
+	TIM_start(s_timer);
+	s_running = true;
+	return CAPTURE_NO_ERR;
+}
+
+void CAPTURE_stop()
+{
+	if (!s_running)
+	{
+		return;
+	}
+	TIM_stop(s_timer);
+	TIM_set_dma_request(s_timer, TIM_DMA_UPDATE, false);
+	s_running = false;
+	// the channel keeps its count, so the samples before the stop can still be read
+	DMA_stop_channel(s_dma);
+}
+
+uint32_t CAPTURE_get_sample_count()
+{
+	if (!s_initialized)
+	{
+		return 0;
+	}
+	return get_written();
+}
+
+uint16_t CAPTURE_read_events(CAPTURE_event_t * events, uint16_t max)
+{
+	uint32_t written = 0;
+	uint32_t backlog = 0;
+	uint16_t end	 = 0;
+	uint16_t change	 = 0;
+	uint16_t sample	 = 0;
+	uint16_t count	 = 0;
+	if (!s_initialized || events == NULL)
+	{
+		return 0;
+	}
+	written = get_written();
+	backlog = written - s_read;
+	if (backlog > s_stats.max_backlog)
+	{
+		s_stats.max_backlog = backlog;
+	}
+	if (backlog > s_size)
+	{
+		// the oldest samples were overwritten, keep the newest half of the ring so the DMA can't catch up during the read
+		s_stats.overruns++;
+		s_stats.lost_samples += backlog - s_size / 2;
+		skip(backlog - s_size / 2);
+	}
+	while (s_read != written && count < max)
+	{
+		end = s_size;
+		if (written - s_read < (uint32_t)(s_size - s_index))
+		{
+			end = s_index + (written - s_read);
+		}
+		change = find_change(s_index, end);
+		skip(change - s_index);
+		if (change == end)
+		{
+			continue;
+		}
+		sample					= s_buffer[change] & s_mask;
+		events[count].sample	= s_read;
+		events[count].state		= sample;
+		events[count].changed	= sample ^ s_last;
+		s_last					= sample;
+		count++;
+		skip(1);
+	}
+	s_stats.events += count;
+	return count;
+}
+
+void CAPTURE_get_stats(CAPTURE_stats_t * stats)
+{
+	if (stats == NULL)
+	{
+		return;
+	}
+	*stats = s_stats;
+}
+
+void CAPTURE_startup()
+{
+	s_initialized = false;
+	s_running	  = false;
+	s_timer		  = TIM_COUNT;
+	s_dma		  = DMA_CH_COUNT;
+	s_idr		  = NULL;
+	s_buffer	  = NULL;
+	s_size		  = 0;
+	s_mask		  = 0;
+	s_laps		  = 0;
+	s_read		  = 0;
+	s_index		  = 0;
+	s_last		  = 0;
+	s_stats		  = (CAPTURE_stats_t){ 0 };
+}
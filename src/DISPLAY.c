@@ -0,0 +1,594 @@
+#include "DISPLAY.h"
+#include "FONT.h"
+#include "utils.h"
+
+#define SSD1306_SET_COLUMNS	 (0x21)
+#define SSD1306_SET_PAGES	 (0x22)
+#define SH1106_SET_PAGE		 (0xB0)
+#define SH1106_COLUMN_LOW	 (0x00)
+#define SH1106_COLUMN_HIGH	 (0x10)
+#define SH1106_COLUMN_OFFSET (2)
+/* the control byte on I2C, before a stream of commands or of data */
+#define CONTROL_COMMANDS (0x00)
+#define CONTROL_DATA	 (0x40)
+/* the multiplex ratio and the COM pins config depend on the rows, they are at the same place in both init sequences */
+#define INIT_MULTIPLEX_INDEX (4)
+#define INIT_COM_PINS_INDEX	 (9)
+#define MAX_COMMANDS		 (32)
+/* bytes a region costs besides its data: the window commands and the start of its transactions */
+#define REGION_OVERHEAD (8)
+/* the next transaction of a region is its window commands */
+#define PAGE_COMMANDS (0xFF)
+
+/* the changed columns of a page, clean when first > last */
+typedef struct
+{
+	uint8_t first;
+	uint8_t last;
+} DISPLAY_span_t;
+
+typedef struct
+{
+	uint8_t first_page;
+	uint8_t last_page;
+	uint8_t first_column;
+	uint8_t last_column;
+} DISPLAY_region_t;
+
+static const uint8_t s_ssd1306_init[] = {
+	0xAE,		// display off
+	0xD5, 0x80, // clock divider
+	0xA8, 0x3F, // multiplex ratio, the rows - 1
+	0xD3, 0x00, // no vertical offset
+	0x40,		// start line 0
+	0xDA, 0x12, // COM pins
+	0xA1,		// column 127 on the left
+	0xC8,		// scan from the last row
+	0x8D, 0x14, // charge pump on
+	0x20, 0x00, // horizontal addressing, a window wraps to its next page
+	0x81, 0xCF, // contrast
+	0xD9, 0xF1, // precharge
+	0xDB, 0x40, // VCOMH level
+	0xA4,		// show the RAM
+	0xA6,		// not inverted
+	0xAF,		// display on
+};
+
+static const uint8_t s_sh1106_init[] = {
+	0xAE,		// display off
+	0xD5, 0x80, // clock divider
+	0xA8, 0x3F, // multiplex ratio, the rows - 1
+	0xD3, 0x00, // no vertical offset
+	0x40,		// start line 0
+	0xDA, 0x12, // COM pins
+	0xA1,		// column 131 on the left
+	0xC8,		// scan from the last row
+	0xAD, 0x8B, // DC-DC converter on
+	0x81, 0x80, // contrast
+	0xD9, 0x22, // precharge
+	0xDB, 0x35, // VCOM level
+	0xA4,		// show the RAM
+	0xA6,		// not inverted
+	0xAF,		// display on
+};
+
+static bool					s_initialized = false;
+static volatile bool		s_busy		  = false;
+static DISPLAY_CONTROLLER_t s_controller  = DISPLAY_SSD1306;
+static uint8_t				s_device	  = 0;
+static uint8_t				s_height	  = 0;
+static uint8_t				s_pages		  = 0;
+static uint8_t				s_dc_pin	  = DISPLAY_NO_DC;
+static GPIO_PIN_ARRAY_t		s_dc_pins;
+static uint8_t				s_frame[DISPLAY_MAX_PAGES][DISPLAY_WIDTH];
+static DISPLAY_span_t		s_dirty[DISPLAY_MAX_PAGES];
+/* the regions of the upload, at most one per page */
+static DISPLAY_region_t s_regions[DISPLAY_MAX_PAGES];
+static uint8_t			s_region_count = 0;
+/* the region and page of the next transaction */
+static uint8_t s_region_index = 0;
+static uint8_t s_page		  = PAGE_COMMANDS;
+/* the region of the transaction on the bus, sent again if the upload fails */
+static uint8_t		   s_active_region = 0;
+static uint8_t		   s_commands[MAX_COMMANDS];
+static DISPLAY_stats_t s_stats;
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function marks columns of a page as changed
+ *
+ * @param page which page
+ * @param first first column
+ * @param last last column
+ */
+static void mark_dirty(uint8_t page, uint8_t first, uint8_t last)
+{
+	DISPLAY_span_t * span = &s_dirty[page];
+	span->first			  = first < span->first ? first : span->first;
+	span->last			  = last > span->last ? last : span->last;
+}
+
+/**
+ * @brief This function writes some rows of a byte of the frame
+ *
+ * @param x column
+ * @param page which page
+ * @param mask rows to write
+ * @param value new rows
+ */
+static inline void write_column(uint8_t x, uint8_t page, uint8_t mask, uint8_t value)
+{
+	s_frame[page][x] = (s_frame[page][x] & ~mask) | (value & mask);
+}
+
+/**
+ * @brief This function sets a pixel, out of the display is ignored
+ *
+ * @param x column
+ * @param y row
+ * @param on lit or dark
+ */
+static void plot(int16_t x, int16_t y, bool on)
+{
+	uint8_t mask = 0;
+	if (x < 0 || x >= DISPLAY_WIDTH || y < 0 || y >= s_height)
+	{
+		return;
+	}
+	mask = 1 << (y % DISPLAY_PAGE_HEIGHT);
+	write_column(x, y / DISPLAY_PAGE_HEIGHT, mask, on ? mask : 0);
+	mark_dirty(y / DISPLAY_PAGE_HEIGHT, x, x);
+}
+
+/**
+ * @brief This function returns the data bytes of a region
+ *
+ * @param region the region
+ * @return uint16_t bytes
+ */
+static uint16_t region_data(const DISPLAY_region_t * region)
+{
+	return (uint16_t)(region->last_page - region->first_page + 1) * (region->last_column - region->first_column + 1);
+}
+
+/**
+ * @brief This function writes the commands that open the window of a region
+ *
+ * @param region the region
+ * @return uint8_t how many command bytes
+ */
+static uint8_t window_commands(const DISPLAY_region_t * region)
+{
+	uint8_t column = 0;
+	if (s_controller == DISPLAY_SH1106)
+	{
+		// a region of the SH1106 is a single page, its data is written from the first column on
+		column		  = region->first_column + SH1106_COLUMN_OFFSET;
+		s_commands[0] = SH1106_SET_PAGE | region->first_page;
+		s_commands[1] = SH1106_COLUMN_LOW | (column & 0x0F);
+		s_commands[2] = SH1106_COLUMN_HIGH | (column >> 4);
+		return 3;
+	}
+	s_commands[0] = SSD1306_SET_COLUMNS;
+	s_commands[1] = region->first_column;
+	s_commands[2] = region->last_column;
+	s_commands[3] = SSD1306_SET_PAGES;
+	s_commands[4] = region->first_page;
+	s_commands[5] = region->last_page;
+	return 6;
+}
+
+static void transaction_done(uint8_t device, bool success, void * context);
+
+/**
+ * @brief This function queues a transaction to the display
+ *
+ * @param data bytes to send
+ * @param length how many bytes
+ * @param is_data display RAM data, else commands
+ * @return true queued
+ * @return false the bus refused the transaction
+ */
+static bool submit(const uint8_t * data, uint16_t length, bool is_data)
+{
+	BUS_transfer_t transfer = { .tx = data, .tx_length = length };
+	if (s_dc_pin == DISPLAY_NO_DC)
+	{
+		transfer.has_reg   = true;
+		transfer.reg_fixed = true;
+		transfer.reg	   = is_data ? CONTROL_DATA : CONTROL_COMMANDS;
+	}
+	else
+	{
+		// the last transaction of the display is done, whatever else runs on the bus does not look at this pin
+		GPIO_array_write_all(&s_dc_pins, is_data);
+	}
+	return BUS_submit(s_device, &transfer, BUS_PRIORITY_LOW, BUS_NO_DEADLINE, transaction_done, NULL);
+}
+
+/**
+ * @brief This function stops the upload, and marks what was not sent as changed again
+ *
+ */
+static void abort_upload()
+{
+	const DISPLAY_region_t * region = NULL;
+	for (size_t i = s_active_region; i < s_region_count; i++)
+	{
+		region = &s_regions[i];
+		for (size_t page = region->first_page; page <= region->last_page; page++)
+		{
+			mark_dirty(page, region->first_column, region->last_column);
+		}
+	}
+	s_region_count = 0;
+	s_stats.failed++;
+	s_busy = false;
+}
+
+/**
+ * @brief This function queues the next transaction of the upload: the window commands of a region, then its data
+ *
+ * @return true queued, or the upload is over
+ * @return false the bus refused the transaction
+ */
+static bool submit_next()
+{
+	const DISPLAY_region_t * region	 = NULL;
+	const uint8_t *			 data	 = NULL;
+	uint16_t				 length	 = 0;
+	bool					 is_data = true;
+	if (s_region_index >= s_region_count)
+	{
+		s_busy = false;
+		return true;
+	}
+	region			= &s_regions[s_region_index];
+	s_active_region = s_region_index;
+	if (s_page == PAGE_COMMANDS)
+	{
+		data	= s_commands;
+		length	= window_commands(region);
+		is_data = false;
+		s_page	= region->first_page;
+	}
+	else if (region->first_column == 0 && region->last_column == DISPLAY_WIDTH - 1)
+	{
+		// full width pages follow each other in the frame, a single transaction sends them all
+		data   = s_frame[region->first_page];
+		length = region_data(region);
+		s_page = region->last_page;
+	}
+	else
+	{
+		data   = &s_frame[s_page][region->first_column];
+		length = region->last_column - region->first_column + 1;
+	}
+	if (is_data && s_page++ == region->last_page)
+	{
+		s_region_index++;
+		s_page = PAGE_COMMANDS;
+	}
+	s_stats.transactions++;
+	return submit(data, length, is_data);
+}
+
+static void transaction_done(uint8_t device, bool success, void * context)
+{
+	if (!success || !submit_next())
+	{
+		abort_upload();
+	}
+}
+
+/*
+ ? Public functions
+*/
+
+DISPLAY_ERR_t DISPLAY_init(const DISPLAY_config_t * config)
+{
+	const uint8_t * init   = s_ssd1306_init;
+	uint8_t			length = sizeof(s_ssd1306_init);
+	if (config == NULL)
+	{
+		return DISPLAY_NULL;
+	}
+	if (s_initialized)
+	{
+		return DISPLAY_ALREADY_INIT;
+	}
+	if (config->controller >= DISPLAY_CONTROLLER_COUNT || (config->height != 32 && config->height != 64) ||
+		(config->dc_pin != DISPLAY_NO_DC && config->dc_pin > GPIO_MAX_PIN))
+	{
+		return DISPLAY_INVALID_CONFIG;
+	}
+	if (config->dc_pin != DISPLAY_NO_DC && GPIO_array_init(&s_dc_pins, config->dc_port, config->dc_pin, config->dc_pin,
+														   GPIO_MODE_OUTPUT_50Mhz, GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		return DISPLAY_PINS_RESERVED;
+	}
+	s_controller = config->controller;
+	s_device	 = config->device;
+	s_height	 = config->height;
+	s_pages		 = config->height / DISPLAY_PAGE_HEIGHT;
+	s_dc_pin	 = config->dc_pin;
+	if (s_controller == DISPLAY_SH1106)
+	{
+		init   = s_sh1106_init;
+		length = sizeof(s_sh1106_init);
+	}
+	for (size_t i = 0; i < length; i++)
+	{
+		s_commands[i] = init[i];
+	}
+	s_commands[INIT_MULTIPLEX_INDEX] = s_height - 1;
+	s_commands[INIT_COM_PINS_INDEX]	 = s_height == 64 ? 0x12 : 0x02;
+	// the RAM of the display holds garbage, the first flush sends the whole frame
+	DISPLAY_clear();
+	s_region_count	= 0;
+	s_region_index	= 0;
+	s_active_region = 0;
+	s_busy			= true;
+	if (!submit(s_commands, length, false))
+	{
+		s_busy = false;
+		if (s_dc_pin != DISPLAY_NO_DC)
+		{
+			GPIO_array_de_init(&s_dc_pins);
+			s_dc_pin = DISPLAY_NO_DC;
+		}
+		return DISPLAY_BUS_ERROR;
+	}
+	s_initialized = true;
+	return DISPLAY_NO_ERR;
+}
+
+void DISPLAY_clear()
+{
+	DISPLAY_fill_rect(0, 0, DISPLAY_WIDTH, s_height, false);
+}
+
+void DISPLAY_set_pixel(uint8_t x, uint8_t y, bool on)
+{
+	plot(x, y, on);
+}
+
+void DISPLAY_draw_hline(uint8_t x, uint8_t y, uint8_t width, bool on)
+{
+	DISPLAY_fill_rect(x, y, width, 1, on);
+}
+
+void DISPLAY_draw_vline(uint8_t x, uint8_t y, uint8_t height, bool on)
+{
+	DISPLAY_fill_rect(x, y, 1, height, on);
+}
+
+void DISPLAY_draw_line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, bool on)
+{
+	int16_t x		= x0;
+	int16_t y		= y0;
+	int16_t dx		= x1 > x0 ? x1 - x0 : x0 - x1;
+	int16_t dy		= y1 > y0 ? y0 - y1 : y1 - y0;
+	int16_t step_x	= x1 > x0 ? 1 : -1;
+	int16_t step_y	= y1 > y0 ? 1 : -1;
+	int16_t error	= dx + dy;
+	int16_t doubled = 0;
+	// Bresenham, dy is negative
+	while (true)
+	{
+		plot(x, y, on);
+		if (x == x1 && y == y1)
+		{
+			break;
+		}
+		doubled = 2 * error;
+		if (doubled >= dy)
+		{
+			error += dy;
+			x += step_x;
+		}
+		if (doubled <= dx)
+		{
+			error += dx;
+			y += step_y;
+		}
+	}
+}
+
+void DISPLAY_fill_rect(uint8_t x, uint8_t y, uint8_t width, uint8_t height, bool on)
+{
+	uint16_t x_end = (uint16_t)x + width;
+	uint16_t y_end = (uint16_t)y + height;
+	uint8_t	 first = 0;
+	uint8_t	 last  = 0;
+	uint8_t	 mask  = 0;
+	x_end		   = x_end > DISPLAY_WIDTH ? DISPLAY_WIDTH : x_end;
+	y_end		   = y_end > s_height ? s_height : y_end;
+	if (x >= x_end || y >= y_end)
+	{
+		return;
+	}
+	for (uint8_t page = y / DISPLAY_PAGE_HEIGHT; page * DISPLAY_PAGE_HEIGHT < y_end; page++)
+	{
+		// the rows of the rectangle in this page
+		first = y > page * DISPLAY_PAGE_HEIGHT ? y - page * DISPLAY_PAGE_HEIGHT : 0;
+		last  = y_end < (page + 1) * DISPLAY_PAGE_HEIGHT ? y_end - 1 - page * DISPLAY_PAGE_HEIGHT : DISPLAY_PAGE_HEIGHT - 1;
+		mask  = (uint8_t)utils_generate_mask(first, last);
+		for (uint16_t column = x; column < x_end; column++)
+		{
+			write_column(column, page, mask, on ? mask : 0);
+		}
+		mark_dirty(page, x, x_end - 1);
+	}
+}
+
+void DISPLAY_draw_bar(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint16_t value, uint16_t max)
+{
+	uint8_t lit = width;
+	if (max != 0 && value < max)
+	{
+		lit = (uint32_t)width * value / max;
+	}
+	DISPLAY_fill_rect(x, y, lit, height, true);
+	if ((uint16_t)x + lit < DISPLAY_WIDTH)
+	{
+		DISPLAY_fill_rect(x + lit, y, width - lit, height, false);
+	}
+}
+
+uint8_t DISPLAY_draw_text(uint8_t x, uint8_t y, const char * text, bool invert)
+{
+	const uint8_t * glyph  = NULL;
+	uint8_t			page   = y / DISPLAY_PAGE_HEIGHT;
+	uint8_t			shift  = y % DISPLAY_PAGE_HEIGHT;
+	uint8_t			start  = x;
+	uint8_t			column = 0;
+	if (text == NULL || y >= s_height)
+	{
+		return x;
+	}
+	for (; *text != '\0' && x < DISPLAY_WIDTH; text++)
+	{
+		glyph = FONT_get_glyph(*text);
+		for (size_t i = 0; i < DISPLAY_CHAR_WIDTH && x < DISPLAY_WIDTH; i++, x++)
+		{
+			column = i < FONT_WIDTH ? glyph[i] : 0;
+			column = invert ? ~column : column;
+			if (shift == 0)
+			{
+				// the glyph is a page high, its bytes are copied as they are
+				s_frame[page][x] = column;
+				continue;
+			}
+			write_column(x, page, 0xFF << shift, column << shift);
+			if (page + 1 < s_pages)
+			{
+				write_column(x, page + 1, 0xFF >> (DISPLAY_PAGE_HEIGHT - shift), column >> (DISPLAY_PAGE_HEIGHT - shift));
+			}
+		}
+	}
+	if (x == start)
+	{
+		return x;
+	}
+	mark_dirty(page, start, x - 1);
+	if (shift != 0 && page + 1 < s_pages)
+	{
+		mark_dirty(page + 1, start, x - 1);
+	}
+	return x;
+}
+
+DISPLAY_ERR_t DISPLAY_flush()
+{
+	DISPLAY_region_t * region	= NULL;
+	DISPLAY_span_t	   span		= { 0 };
+	uint8_t			   first	= 0;
+	uint8_t			   last		= 0;
+	uint16_t		   merged	= 0;
+	uint16_t		   bytes	= 0;
+	uint8_t			   commands = s_controller == DISPLAY_SH1106 ? 3 : 6;
+	if (!s_initialized)
+	{
+		return DISPLAY_NOT_INIT;
+	}
+	if (s_busy)
+	{
+		return DISPLAY_BUSY;
+	}
+	s_region_count = 0;
+	for (uint8_t page = 0; page < s_pages; page++)
+	{
+		span = s_dirty[page];
+		if (span.first > span.last)
+		{
+			continue;
+		}
+		s_dirty[page] = (DISPLAY_span_t){ .first = DISPLAY_WIDTH, .last = 0 };
+		region		  = s_region_count != 0 ? &s_regions[s_region_count - 1] : NULL;
+		// the SH1106 can't wrap a window to the next page, it has a region per page
+		if (region != NULL && s_controller == DISPLAY_SSD1306 && region->last_page + 1 == page)
+		{
+			first  = span.first < region->first_column ? span.first : region->first_column;
+			last   = span.last > region->last_column ? span.last : region->last_column;
+			merged = (uint16_t)(page - region->first_page + 1) * (last - first + 1);
+			if (merged <= region_data(region) + (span.last - span.first + 1) + REGION_OVERHEAD)
+			{
+				region->first_column = first;
+				region->last_column	 = last;
+				region->last_page	 = page;
+				continue;
+			}
+		}
+		s_regions[s_region_count++] = (DISPLAY_region_t){
+			.first_page = page, .last_page = page, .first_column = span.first, .last_column = span.last
+		};
+	}
+	if (s_region_count == 0)
+	{
+		return DISPLAY_NO_ERR;
+	}
+	for (size_t i = 0; i < s_region_count; i++)
+	{
+		bytes += commands + region_data(&s_regions[i]);
+	}
+	s_stats.frames++;
+	s_stats.bytes += bytes;
+	s_stats.last_frame_bytes   = bytes;
+	s_stats.last_frame_regions = s_region_count;
+	if (bytes > s_stats.max_frame_bytes)
+	{
+		s_stats.max_frame_bytes = bytes;
+	}
+	s_region_index	= 0;
+	s_active_region = 0;
+	s_page			= PAGE_COMMANDS;
+	s_busy			= true;
+	if (!submit_next())
+	{
+		abort_upload();
+		return DISPLAY_BUS_ERROR;
+	}
+	return DISPLAY_NO_ERR;
+}
+
+bool DISPLAY_is_busy()
+{
+	return s_busy;
+}
+
+void DISPLAY_get_stats(DISPLAY_stats_t * stats)
+{
+	uint32_t primask = 0;
+	if (stats == NULL)
+	{
+		return;
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*stats = s_stats;
+	__set_PRIMASK(primask);
+}
+
+void DISPLAY_startup()
+{
+	s_initialized	= false;
+	s_busy			= false;
+	s_controller	= DISPLAY_SSD1306;
+	s_device		= 0;
+	s_height		= 0;
+	s_pages			= 0;
+	s_dc_pin		= DISPLAY_NO_DC;
+	s_region_count	= 0;
+	s_region_index	= 0;
+	s_active_region = 0;
+	s_page			= PAGE_COMMANDS;
+	s_stats			= (DISPLAY_stats_t){ 0 };
+	for (size_t i = 0; i < DISPLAY_MAX_PAGES; i++)
+	{
+		s_dirty[i] = (DISPLAY_span_t){ .first = DISPLAY_WIDTH, .last = 0 };
+	}
+}
@@ -11,11 +11,17 @@
 #define DMA_CCR_PERIPH_SIZE (8)
 #define DMA_CCR_MEMORY_INC	(7)
 #define DMA_CCR_PERIPH_INC	(6)
+#define DMA_CCR_CIRCULAR	(5)
 #define DMA_CCR_DIRECTION	(4)
-#define DMA_CCR_INTERRUPTS	(1)
 #define DMA_CCR_ENABLE		(0)
 
-#define DMA_ISR_FLAG_PER_CHANNEL (3)
+/* the DMA_INTERRUPT_XX values are already in their place in the CCR */
+#define DMA_CCR_INTERRUPT_MASK (DMA_INTERRUPT_ERROR | DMA_INTERRUPT_HALF | DMA_INTERRUPT_COMPLETE)
+
+/* each channel has 4 flags in the ISR: global, finished, half, error. DMA_FLAG_t starts from the finished flag */
+#define DMA_ISR_FLAG_PER_CHANNEL (4)
+#define DMA_ISR_GLOBAL_FLAG		 (1)
+#define DMA_ISR_FLAG_OFFSET		 (1)
 
 typedef struct
 {
@@ -34,7 +40,8 @@ typedef struct
 #define s_DMA_CHANNELS ((DMA_CH_CONFIG_t *)DMA1_Channels_BASE)
 #define s_DMA1		   ((DMA_COMMON_t *)DMA1_BASE)
 
-static uint8_t s_reserved_channels = 0;
+static uint8_t		  s_reserved_channels = 0;
+static DMA_callback_t s_callbacks[DMA_CH_COUNT] = { NULL };
 
 /*
  ? Channel usage monitoring functions
@@ -126,7 +133,7 @@ bool DMA_init_channel(DMA_CHANNELS_t		dma_channel_number,
 	channel->CCR |= (memory->access_size << DMA_CCR_MEMORY_SIZE) | (memory->increament_address << DMA_CCR_MEMORY_INC);
 	channel->CCR |= (peripheral->access_size << DMA_CCR_PERIPH_SIZE) | (peripheral->increament_address << DMA_CCR_PERIPH_INC);
 	channel->CCR |= direction << DMA_CCR_DIRECTION;
-	channel->CCR |= interrupt_mask << DMA_CCR_INTERRUPTS;
+	channel->CCR |= interrupt_mask & DMA_CCR_INTERRUPT_MASK;
 
 	/* initialize addresses */
 	channel->CMAR = memory->address;
@@ -144,6 +151,7 @@ bool DMA_de_init_channel(DMA_CHANNELS_t dma_channel_number)
 	}
 
 	free_channel(dma_channel_number);
+	DMA_set_callback(dma_channel_number, NULL);
 	channel->CCR   = 0;
 	channel->CMAR  = 0;
 	channel->CPAR  = 0;
@@ -202,31 +210,166 @@ bool DMA_set_software_trigger(DMA_CHANNELS_t dma_channel_number, bool software_t
 	{
 		channel->CCR &= ~(1 << DMA_CCR_SOFT_TRIG);
 	}
+	return true;
+}
+
+bool DMA_set_circular(DMA_CHANNELS_t dma_channel_number, bool circular)
+{
+	DMA_CH_CONFIG_t * channel = get_channel(dma_channel_number);
+	if (channel == NULL) /* should never happen */
+	{
+		return false;
+	}
+	if (circular)
+	{
+		channel->CCR |= 1 << DMA_CCR_CIRCULAR;
+	}
+	else
+	{
+		channel->CCR &= ~(1 << DMA_CCR_CIRCULAR);
+	}
+	return true;
+}
+
+bool DMA_set_callback(DMA_CHANNELS_t dma_channel_number, DMA_callback_t callback)
+{
+	if (dma_channel_number >= DMA_CH_COUNT)
+	{
+		return false;
+	}
+	s_callbacks[dma_channel_number] = callback;
+	if (callback == NULL)
+	{
+		NVIC_DisableIRQ(DMA1_Channel1_IRQn + dma_channel_number);
+	}
+	else
+	{
+		NVIC_EnableIRQ(DMA1_Channel1_IRQn + dma_channel_number);
+	}
+	return true;
+}
+
+bool DMA_set_memory(DMA_CHANNELS_t dma_channel_number, const void * address)
+{
+	DMA_CH_CONFIG_t * channel = get_channel(dma_channel_number);
+	if (channel == NULL) /* should never happen */
+	{
+		return false;
+	}
+	channel->CMAR = (uint32_t)address;
+	return true;
+}
+
+bool DMA_set_memory_increment(DMA_CHANNELS_t dma_channel_number, bool increment)
+{
+	DMA_CH_CONFIG_t * channel = get_channel(dma_channel_number);
+	if (channel == NULL) /* should never happen */
+	{
+		return false;
+	}
+	if (increment)
+	{
+		channel->CCR |= 1 << DMA_CCR_MEMORY_INC;
+	}
+	else
+	{
+		channel->CCR &= ~(1 << DMA_CCR_MEMORY_INC);
+	}
+	return true;
+}
+
+uint16_t DMA_get_remaining(DMA_CHANNELS_t dma_channel_number)
+{
+	DMA_CH_CONFIG_t * channel = get_channel(dma_channel_number);
+	if (channel == NULL) /* should never happen */
+	{
+		return 0;
+	}
+	return channel->CNDTR;
 }
 
 bool DMA_channel_get_flag(DMA_CHANNELS_t dma_channel_number, DMA_FLAG_t flag)
 {
 	uint32_t flag_mask = 0;
-	if (dma_channel_number > DMA_CH_COUNT)
+	if (dma_channel_number >= DMA_CH_COUNT)
 	{
 		return false;
 	}
-	flag_mask = flag << (dma_channel_number * DMA_ISR_FLAG_PER_CHANNEL + 1);
+	flag_mask = flag << (dma_channel_number * DMA_ISR_FLAG_PER_CHANNEL + DMA_ISR_FLAG_OFFSET);
 	return s_DMA1->ISR & flag_mask;
 }
 
 bool DMA_channel_clear_flags(DMA_CHANNELS_t dma_channel_number)
 {
-	if (dma_channel_number > DMA_CH_COUNT)
+	if (dma_channel_number >= DMA_CH_COUNT)
 	{
 		return false;
 	}
-	s_DMA1->IFCR |= DMA_FLAG_ALL << (dma_channel_number * DMA_ISR_FLAG_PER_CHANNEL);
+	// IFCR is write only, writing 0 has no effect
+	s_DMA1->IFCR = ((DMA_FLAG_ALL << DMA_ISR_FLAG_OFFSET) | DMA_ISR_GLOBAL_FLAG) << (dma_channel_number * DMA_ISR_FLAG_PER_CHANNEL);
 	return true;
 }
 
 void DMA_startup()
 {
 	s_reserved_channels = 0;
+	for (size_t i = 0; i < DMA_CH_COUNT; i++)
+	{
+		s_callbacks[i] = NULL;
+	}
 	RCC_peripheral_set_clock(RCC_DMA1, true);
+}
+
+/*
+ ? Interrupt handlers
+*/
+
+/**
+ * @brief This function reads and clears the flags of the channel, and passes them to the channel callback
+ *
+ * @param dma_channel_number channel that generated the interrupt
+ */
+static void handle_channel_interrupt(DMA_CHANNELS_t dma_channel_number)
+{
+	uint32_t flags = (s_DMA1->ISR >> (dma_channel_number * DMA_ISR_FLAG_PER_CHANNEL + DMA_ISR_FLAG_OFFSET)) & DMA_FLAG_ALL;
+	DMA_channel_clear_flags(dma_channel_number);
+	if (s_callbacks[dma_channel_number] != NULL)
+	{
+		s_callbacks[dma_channel_number](dma_channel_number, flags);
+	}
+}
+
+void DMA1_Channel1_IRQHandler()
+{
+	handle_channel_interrupt(DMA_CH1);
+}
+
+void DMA1_Channel2_IRQHandler()
+{
+	handle_channel_interrupt(DMA_CH2);
+}
+
+void DMA1_Channel3_IRQHandler()
+{
+	handle_channel_interrupt(DMA_CH3);
+}
+
+void DMA1_Channel4_IRQHandler()
+{
+	handle_channel_interrupt(DMA_CH4);
+}
+
+void DMA1_Channel5_IRQHandler()
+{
+	handle_channel_interrupt(DMA_CH5);
+}
+
+void DMA1_Channel6_IRQHandler()
+{
+	handle_channel_interrupt(DMA_CH6);
+}
+
+void DMA1_Channel7_IRQHandler()
+{
+	handle_channel_interrupt(DMA_CH7);
 }
\ No newline at end of file
@@ -277,6 +277,36 @@ GPIO_ERR_t GPIO_array_init(pGPIO_PIN_ARRAY_t pin_array, GPIO_PORT_t port, uint8_
 	return return_value;
 }
 
+GPIO_ERR_t GPIO_array_set_mode(pGPIO_PIN_ARRAY_t pin_array, GPIO_MODE_t mode, GPIO_CONFIG_t config)
+{
+	if (pin_array == NULL)
+	{
+		return GPIO_NULL;
+	}
+	// the pins stay reserved by the array, only their configuration changes
+	pin_array->mode	  = mode;
+	pin_array->config = config;
+	return config_pins(pin_array);
+}
+
+GPIO_ERR_t GPIO_array_de_init(pGPIO_PIN_ARRAY_t pin_array)
+{
+	GPIO_ERR_t return_value = GPIO_NO_ERR;
+	if (pin_array == NULL)
+	{
+		return GPIO_NULL;
+	}
+	if (get_port(pin_array->port) == NULL)
+	{
+		return GPIO_INVALID_PORT;
+	}
+	pin_array->mode	  = GPIO_MODE_INPUT;
+	pin_array->config = GPIO_CONFIG_INPUT_FLOATING;
+	return_value	  = config_pins(pin_array);
+	s_reserved_pins[pin_array->port] &= ~utils_generate_mask(pin_array->start_pin, pin_array->end_pin);
+	return return_value;
+}
+
 /*
  * OUTPUT functions
  */
@@ -364,6 +394,59 @@ uint16_t GPIO_array_read_pins(const GPIO_PIN_ARRAY_t * pin_array, uint16_t pin_m
 	return (port_struct->IDR & pin_mask) >> pin_array->start_pin;
 }
 
+/*
+ * DMA functions
+ */
+
+periph_ptr_t GPIO_array_get_bsrr(const GPIO_PIN_ARRAY_t * pin_array)
+{
+	GPIO_TypeDef * port_struct = NULL;
+	if (pin_array == NULL)
+	{
+		return NULL;
+	}
+	port_struct = get_port(pin_array->port);
+	if (port_struct == NULL)
+	{
+		return NULL;
+	}
+	return &port_struct->BSRR;
+}
+
+periph_ptr_t GPIO_get_bsrr(GPIO_PORT_t port)
+{
+	GPIO_TypeDef * port_struct = get_port(port);
+	if (port_struct == NULL)
+	{
+		return NULL;
+	}
+	return &port_struct->BSRR;
+}
+
+periph_ptr_t GPIO_get_idr(GPIO_PORT_t port)
+{
+	GPIO_TypeDef * port_struct = get_port(port);
+	if (port_struct == NULL)
+	{
+		return NULL;
+	}
+	return &port_struct->IDR;
+}
+
+uint32_t GPIO_array_get_bsrr_value(const GPIO_PIN_ARRAY_t * pin_array, uint16_t value)
+{
+	uint16_t pin_mask = 0;
+	uint16_t set_mask = 0;
+	if (pin_array == NULL)
+	{
+		return 0;
+	}
+	pin_mask = utils_generate_mask(pin_array->start_pin, pin_array->end_pin);
+	set_mask = (value << pin_array->start_pin) & pin_mask;
+	// the upper half resets pins, the lower half sets them
+	return ((uint32_t)(pin_mask & ~set_mask) << 16) | set_mask;
+}
+
 void GPIO_startup()
 {
 	reset_reserved_pins();
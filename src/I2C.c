@@ -0,0 +1,793 @@
+#include "I2C.h"
+#include "DMA.h"
+#include "GPIO.h"
+#include "RCC.h"
+#include "utils.h"
+
+typedef struct
+{
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t OAR1;
+	__IO uint32_t OAR2;
+	__IO uint32_t DR;
+	__IO uint32_t SR1;
+	__IO uint32_t SR2;
+	__IO uint32_t CCR;
+	__IO uint32_t TRISE;
+} I2C_TypeDef;
+
+#define I2C1_BASE (APB1PERIPH_BASE + 0x00005400U)
+#define I2C2_BASE (APB1PERIPH_BASE + 0x00005800U)
+
+#define I2C_CR1_PE		(0)
+#define I2C_CR1_START	(8)
+#define I2C_CR1_STOP	(9)
+#define I2C_CR1_ACK		(10)
+#define I2C_CR1_POS		(11)
+#define I2C_CR1_SWRST	(15)
+#define I2C_CR2_ITERREN (8)
+#define I2C_CR2_ITEVTEN (9)
+#define I2C_CR2_ITBUFEN (10)
+#define I2C_CR2_DMAEN	(11)
+#define I2C_CR2_LAST	(12)
+#define I2C_SR1_SB		(0)
+#define I2C_SR1_ADDR	(1)
+#define I2C_SR1_BTF		(2)
+#define I2C_SR1_RXNE	(6)
+#define I2C_SR1_TXE		(7)
+#define I2C_SR1_BERR	(8)
+#define I2C_SR1_ARLO	(9)
+#define I2C_SR1_AF		(10)
+#define I2C_SR1_OVR		(11)
+#define I2C_SR2_BUSY	(1)
+#define I2C_CCR_FS		(15)
+/* error flags, cleared by writing 0 */
+#define I2C_SR1_ERRORS ((1 << I2C_SR1_BERR) | (1 << I2C_SR1_ARLO) | (1 << I2C_SR1_AF) | (1 << I2C_SR1_OVR))
+
+#define I2C_MAX_CCR		   (0xFFF)
+#define I2C_MIN_CCR_FAST   (1)
+#define I2C_MIN_CCR		   (4)
+#define I2C_MIN_APB1_MHZ   (2)
+#define I2C_MAX_RISE_NS	   (1000)
+#define I2C_MAX_RISE_NS_FM (300)
+/* a device stuck in the middle of a byte is released after at most 9 clocks */
+#define RECOVERY_CLOCKS (9)
+/* clock of the recovery, 5us per half period */
+#define RECOVERY_HALF_PERIOD_HZ (200000)
+/* bytes left when the reading without DMA stops acknowledging, see the reference manual method 2 */
+#define READ_END_BYTES (3)
+
+typedef enum
+{
+	I2C_IDLE,
+	I2C_START,		// waiting for the start to be sent
+	I2C_ADDRESS,	// waiting for the address to be acknowledged
+	I2C_WRITE,		// the register and data bytes
+	I2C_READ,		// a byte at a time, or the last byte
+	I2C_READ_END,	// waiting for the third byte before the last one, to stop acknowledging
+	I2C_READ_TWO,	// 2 bytes read, waiting for both
+	I2C_READ_DMA
+} I2C_STATE_t;
+
+typedef struct
+{
+	I2C_callback_t		 callback;
+	const uint8_t *		 tx;
+	uint8_t *			 rx;
+	uint16_t			 tx_length;
+	uint16_t			 rx_length;
+	uint16_t			 index; // bytes of the current phase done without DMA
+	uint32_t			 max_frequency;
+	uint32_t			 frequency;
+	uint8_t				 address;
+	uint8_t				 reg;
+	bool				 has_reg;
+	bool				 reading; // the read phase, after the repeated start
+	bool				 dma;	  // the DMA channels were free at init
+	volatile I2C_STATE_t state;
+	I2C_stats_t			 stats;
+	bool				 init;
+} I2C_port_t;
+
+static const I2C_TypeDef * const s_i2cs[I2C_COUNT] = {
+	(I2C_TypeDef *)I2C1_BASE,
+	(I2C_TypeDef *)I2C2_BASE,
+};
+
+static const RCC_Peripherals_t s_clocks[I2C_COUNT]	  = { RCC_I2C1, RCC_I2C2 };
+static const IRQn_Type		   s_event_irqs[I2C_COUNT] = { I2C1_EV_IRQn, I2C2_EV_IRQn };
+static const IRQn_Type		   s_error_irqs[I2C_COUNT] = { I2C1_ER_IRQn, I2C2_ER_IRQn };
+static const DMA_CHANNELS_t	   s_tx_dma[I2C_COUNT]	  = { DMA_CH6_I2C1_TX, DMA_CH4_I2C2_TX };
+static const DMA_CHANNELS_t	   s_rx_dma[I2C_COUNT]	  = { DMA_CH7_I2C1_RX, DMA_CH5_I2C2_RX };
+/* SDA is the pin after SCL on both ports */
+static const uint8_t s_scl_pins[I2C_COUNT] = { 6, 10 };
+
+static GPIO_PIN_ARRAY_t s_scl_pin_arrays[I2C_COUNT];
+static GPIO_PIN_ARRAY_t s_sda_pin_arrays[I2C_COUNT];
+static I2C_port_t		s_ports[I2C_COUNT];
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief Get the I2C registers
+ *
+ * @param port which port
+ * @return I2C_TypeDef* registers
+ */
+static I2C_TypeDef * get_i2c(I2C_t port)
+{
+	return (I2C_TypeDef *)s_i2cs[port];
+}
+
+/**
+ * @brief This function sets the clock registers and enables the port and its interrupts
+ *
+ * @param port which port
+ */
+static void setup_registers(I2C_t port)
+{
+	I2C_TypeDef * i2c		= get_i2c(port);
+	uint32_t	  apb_freq	= RCC_get_peripheral_freq(s_clocks[port]);
+	uint32_t	  apb_mhz	= apb_freq / 1000000;
+	uint32_t	  frequency = s_ports[port].max_frequency;
+	uint32_t	  ccr		= 0;
+	i2c->CR1 &= ~(1 << I2C_CR1_PE);
+	i2c->CR2 = apb_mhz | (1 << I2C_CR2_ITERREN) | (1 << I2C_CR2_ITEVTEN);
+	if (frequency > I2C_STANDARD_MODE_FREQUENCY)
+	{
+		// duty cycle 2, the clock is apb / (3 * ccr), rounded to a slower clock
+		ccr		   = (apb_freq + 3 * frequency - 1) / (3 * frequency);
+		ccr		   = ccr < I2C_MIN_CCR_FAST ? I2C_MIN_CCR_FAST : ccr;
+		i2c->CCR   = (1 << I2C_CCR_FS) | ccr;
+		i2c->TRISE = apb_mhz * I2C_MAX_RISE_NS_FM / 1000 + 1;
+		s_ports[port].frequency = apb_freq / (3 * ccr);
+	}
+	else
+	{
+		ccr		   = (apb_freq + 2 * frequency - 1) / (2 * frequency);
+		ccr		   = ccr < I2C_MIN_CCR ? I2C_MIN_CCR : ccr;
+		i2c->CCR   = ccr;
+		i2c->TRISE = apb_mhz * I2C_MAX_RISE_NS / 1000 + 1;
+		s_ports[port].frequency = apb_freq / (2 * ccr);
+	}
+	i2c->CR1 = 1 << I2C_CR1_PE;
+}
+
+/**
+ * @brief This function busy waits half a period of the recovery clock
+ *
+ */
+static void wait_half_period()
+{
+	uint32_t start	= utils_get_cycles();
+	uint32_t cycles = RCC_get_AHB_freq() / RECOVERY_HALF_PERIOD_HZ;
+	WAIT(utils_get_cycles() - start < cycles)
+}
+
+/**
+ * @brief This function frees a bus held low by a device, and resets the port
+ *
+ * @param port which port
+ *
+ * @remarks The errata sheet workaround for a BUSY flag that stays set: the pins are driven as GPIO, SCL is pulsed
+ * 			until the device releases SDA, a stop is sent, and the port is reset with SWRST. Takes about 100us
+ */
+static void recover_bus(I2C_t port)
+{
+	I2C_TypeDef *	   i2c = get_i2c(port);
+	GPIO_PIN_ARRAY_t * scl = &s_scl_pin_arrays[port];
+	GPIO_PIN_ARRAY_t * sda = &s_sda_pin_arrays[port];
+	i2c->CR1 &= ~(1 << I2C_CR1_PE);
+	GPIO_array_write_all(scl, true);
+	GPIO_array_write_all(sda, true);
+	GPIO_array_set_mode(scl, GPIO_MODE_OUTPUT_50Mhz, GPIO_CONFIG_OUTPUT_OPEN_DRAIN);
+	GPIO_array_set_mode(sda, GPIO_MODE_OUTPUT_50Mhz, GPIO_CONFIG_OUTPUT_OPEN_DRAIN);
+	wait_half_period();
+	for (size_t i = 0; i < RECOVERY_CLOCKS && GPIO_array_read_all(sda) == 0; i++)
+	{
+		GPIO_array_write_all(scl, false);
+		wait_half_period();
+		GPIO_array_write_all(scl, true);
+		wait_half_period();
+	}
+	// a stop: SDA rises while SCL is high
+	GPIO_array_write_all(scl, false);
+	wait_half_period();
+	GPIO_array_write_all(sda, false);
+	wait_half_period();
+	GPIO_array_write_all(scl, true);
+	wait_half_period();
+	GPIO_array_write_all(sda, true);
+	wait_half_period();
+	GPIO_array_set_mode(scl, GPIO_MODE_OUTPUT_50Mhz, GPIO_CONFIG_OUTPUT_OPEN_DRAIN_ALT);
+	GPIO_array_set_mode(sda, GPIO_MODE_OUTPUT_50Mhz, GPIO_CONFIG_OUTPUT_OPEN_DRAIN_ALT);
+	i2c->CR1 |= 1 << I2C_CR1_SWRST;
+	i2c->CR1 &= ~(1 << I2C_CR1_SWRST);
+	setup_registers(port);
+	s_ports[port].stats.recoveries++;
+}
+
+/**
+ * @brief This function ends the transfer of a port, and calls its callback
+ *
+ * @param port which port
+ * @param result how the transfer ended
+ */
+static void finish_transfer(I2C_t port, I2C_RESULT_t result)
+{
+	I2C_TypeDef * i2c	= get_i2c(port);
+	I2C_port_t *  state = &s_ports[port];
+	i2c->CR2 &= ~((1 << I2C_CR2_ITBUFEN) | (1 << I2C_CR2_DMAEN) | (1 << I2C_CR2_LAST));
+	i2c->CR1 &= ~((1 << I2C_CR1_ACK) | (1 << I2C_CR1_POS));
+	if (state->dma)
+	{
+		DMA_stop_channel(s_tx_dma[port]);
+		DMA_stop_channel(s_rx_dma[port]);
+	}
+	state->stats.transfers++;
+	state->state = I2C_IDLE;
+	if (state->callback != NULL)
+	{
+		state->callback(port, result);
+	}
+}
+
+/**
+ * @brief This function sends a start, for the write phase or the read phase
+ *
+ * @param port which port
+ */
+static void send_start(I2C_t port)
+{
+	s_ports[port].state = I2C_START;
+	get_i2c(port)->CR1 |= 1 << I2C_CR1_START;
+}
+
+/**
+ * @brief This function ends the write phase, with a repeated start for the read phase or a stop
+ *
+ * @param port which port
+ */
+static void end_write(I2C_t port)
+{
+	I2C_TypeDef * i2c	= get_i2c(port);
+	I2C_port_t *  state = &s_ports[port];
+	i2c->CR2 &= ~((1 << I2C_CR2_ITBUFEN) | (1 << I2C_CR2_DMAEN));
+	if (state->rx_length != 0)
+	{
+		state->reading = true;
+		send_start(port);
+		return;
+	}
+	i2c->CR1 |= 1 << I2C_CR1_STOP;
+	finish_transfer(port, I2C_OK);
+}
+
+/**
+ * @brief This function handles the acknowledged address of the write phase
+ *
+ * @param port which port
+ */
+static void start_write(I2C_t port)
+{
+	I2C_TypeDef *	  i2c	= get_i2c(port);
+	I2C_port_t *	  state = &s_ports[port];
+	volatile uint32_t clear = 0;
+	state->index			= 0;
+	state->state			= I2C_WRITE;
+	// reading SR2 clears ADDR and releases the clock
+	clear = i2c->SR2;
+	(void)clear;
+	if (state->has_reg)
+	{
+		i2c->DR = state->reg;
+	}
+	// the DMA serves TXE, so it is enabled only once the register byte is in, or it would race the CPU for DR
+	if (state->dma && state->tx_length != 0)
+	{
+		DMA_channel_clear_flags(s_tx_dma[port]);
+		DMA_set_memory(s_tx_dma[port], state->tx);
+		DMA_start_channel(s_tx_dma[port], state->tx_length, false);
+		i2c->CR2 |= 1 << I2C_CR2_DMAEN;
+	}
+	else if (state->tx_length != 0)
+	{
+		i2c->CR2 |= 1 << I2C_CR2_ITBUFEN;
+	}
+	else if (!state->has_reg && state->tx_length == 0)
+	{
+		// only the address, no byte will set BTF
+		end_write(port);
+	}
+}
+
+/**
+ * @brief This function handles the acknowledged address of the read phase
+ *
+ * @param port which port
+ *
+ * @remarks The errata sheet asks for the steps between clearing ADDR and setting STOP to not be interrupted,
+ * 			or the device may clock out one more byte
+ */
+static void start_read(I2C_t port)
+{
+	I2C_TypeDef *	  i2c	  = get_i2c(port);
+	I2C_port_t *	  state	  = &s_ports[port];
+	volatile uint32_t clear	  = 0;
+	uint32_t		  primask = 0;
+	state->index			  = 0;
+	if (state->rx_length == 1)
+	{
+		i2c->CR1 &= ~(1 << I2C_CR1_ACK);
+		primask = __get_PRIMASK();
+		__disable_irq();
+		clear = i2c->SR2;
+		i2c->CR1 |= 1 << I2C_CR1_STOP;
+		__set_PRIMASK(primask);
+		state->state = I2C_READ;
+		i2c->CR2 |= 1 << I2C_CR2_ITBUFEN;
+	}
+	else if (state->rx_length == 2)
+	{
+		// the NACK is set now for the second byte, which is in the shift register when BTF is set
+		i2c->CR1 &= ~(1 << I2C_CR1_ACK);
+		i2c->CR1 |= 1 << I2C_CR1_POS;
+		clear		 = i2c->SR2;
+		state->state = I2C_READ_TWO;
+	}
+	else if (state->dma)
+	{
+		// LAST makes the port NACK the byte of the last DMA transfer by itself
+		i2c->CR1 |= 1 << I2C_CR1_ACK;
+		DMA_channel_clear_flags(s_rx_dma[port]);
+		DMA_set_memory(s_rx_dma[port], state->rx);
+		DMA_start_channel(s_rx_dma[port], state->rx_length, false);
+		i2c->CR2 |= (1 << I2C_CR2_DMAEN) | (1 << I2C_CR2_LAST);
+		state->state = I2C_READ_DMA;
+		clear		 = i2c->SR2;
+	}
+	else
+	{
+		i2c->CR1 |= 1 << I2C_CR1_ACK;
+		clear = i2c->SR2;
+		if (state->rx_length == READ_END_BYTES)
+		{
+			state->state = I2C_READ_END;
+		}
+		else
+		{
+			state->state = I2C_READ;
+			i2c->CR2 |= 1 << I2C_CR2_ITBUFEN;
+		}
+	}
+	(void)clear;
+}
+
+/**
+ * @brief This function handles the DMA interrupts of both ports, only the reading DMA interrupts
+ *
+ * @param dma_channel_number the channel
+ * @param flags DMA flags
+ */
+static void dma_callback(DMA_CHANNELS_t dma_channel_number, uint32_t flags)
+{
+	for (size_t i = 0; i < I2C_COUNT; i++)
+	{
+		if (s_ports[i].state == I2C_READ_DMA && dma_channel_number == s_rx_dma[i])
+		{
+			// all the bytes are in memory, the last one was not acknowledged
+			get_i2c(i)->CR1 |= 1 << I2C_CR1_STOP;
+			finish_transfer(i, (flags & DMA_FLAG_ERROR) ? I2C_BUS_ERROR : I2C_OK);
+		}
+	}
+}
+
+/**
+ * @brief This function sets up the DMA channels of a port, the transfers fall back to interrupts when a channel is reserved
+ *
+ * @param port which port
+ * @return true DMA is ready
+ * @return false one of the channels is reserved
+ */
+static bool setup_dma(I2C_t port)
+{
+	DMA_address_t periph = { .access_size = DMA_ACCESS_8BIT, .address = (uint32_t *)&get_i2c(port)->DR, .increament_address = false };
+	DMA_address_t memory = { .access_size = DMA_ACCESS_8BIT, .address = NULL, .increament_address = true };
+	RCC_peripheral_set_clock(RCC_DMA1, true);
+	if (DMA_init_channel(s_rx_dma[port], &periph, &memory, DMA_CH_PRIORITY_HIGH, DMA_DIRECTION_PERIPH_TO_MEM,
+						 DMA_INTERRUPT_COMPLETE | DMA_INTERRUPT_ERROR) == false)
+	{
+		return false;
+	}
+	// the end of the write phase is the BTF event, the TX channel needs no interrupt
+	if (DMA_init_channel(s_tx_dma[port], &periph, &memory, DMA_CH_PRIORITY_HIGH, DMA_DIRECTION_MEM_TO_PERIPH, 0) == false)
+	{
+		DMA_de_init_channel(s_rx_dma[port]);
+		return false;
+	}
+	DMA_set_callback(s_rx_dma[port], dma_callback);
+	return true;
+}
+
+/**
+ * @brief This function starts a transfer
+ *
+ * @param port which port
+ * @return I2C_ERR_t errors if any
+ */
+static I2C_ERR_t start_transfer(I2C_t port)
+{
+	I2C_TypeDef * i2c = get_i2c(port);
+	// the stop of the last transfer is still on the bus for a few microseconds, a start now would be lost
+	WAIT(i2c->CR1 & (1 << I2C_CR1_STOP))
+	if (i2c->SR2 & (1 << I2C_SR2_BUSY))
+	{
+		recover_bus(port);
+		if (i2c->SR2 & (1 << I2C_SR2_BUSY))
+		{
+			s_ports[port].state = I2C_IDLE;
+			return I2C_BUSY;
+		}
+	}
+	s_ports[port].reading = s_ports[port].tx_length == 0 && !s_ports[port].has_reg && s_ports[port].rx_length != 0;
+	send_start(port);
+	return I2C_NO_ERR;
+}
+
+/**
+ * @brief This function checks the arguments of a transfer and claims the port
+ *
+ * @param port which port
+ * @return I2C_ERR_t errors if any
+ */
+static I2C_ERR_t claim_port(I2C_t port)
+{
+	uint32_t primask = 0;
+	if (port >= I2C_COUNT)
+	{
+		return I2C_INVALID_PORT;
+	}
+	if (!s_ports[port].init)
+	{
+		return I2C_NOT_INIT;
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (s_ports[port].state != I2C_IDLE)
+	{
+		__set_PRIMASK(primask);
+		return I2C_BUSY;
+	}
+	s_ports[port].state = I2C_START;
+	__set_PRIMASK(primask);
+	return I2C_NO_ERR;
+}
+
+/*
+ ? Public functions
+*/
+
+I2C_ERR_t I2C_init(I2C_t port, uint32_t frequency)
+{
+	if (port >= I2C_COUNT)
+	{
+		return I2C_INVALID_PORT;
+	}
+	if (s_ports[port].init)
+	{
+		return I2C_ALREADY_INIT;
+	}
+	if (frequency == 0 || frequency > I2C_FAST_MODE_FREQUENCY || frequency < RCC_get_peripheral_freq(s_clocks[port]) / (2 * I2C_MAX_CCR) ||
+		RCC_get_peripheral_freq(s_clocks[port]) < I2C_MIN_APB1_MHZ * 1000000)
+	{
+		return I2C_INVALID_FREQUENCY;
+	}
+	if (GPIO_array_init(&s_scl_pin_arrays[port], GPIO_PORT_B, s_scl_pins[port], s_scl_pins[port], GPIO_MODE_OUTPUT_50Mhz,
+						GPIO_CONFIG_OUTPUT_OPEN_DRAIN_ALT) != GPIO_NO_ERR)
+	{
+		return I2C_PINS_RESERVED;
+	}
+	if (GPIO_array_init(&s_sda_pin_arrays[port], GPIO_PORT_B, s_scl_pins[port] + 1, s_scl_pins[port] + 1, GPIO_MODE_OUTPUT_50Mhz,
+						GPIO_CONFIG_OUTPUT_OPEN_DRAIN_ALT) != GPIO_NO_ERR)
+	{
+		GPIO_array_de_init(&s_scl_pin_arrays[port]);
+		return I2C_PINS_RESERVED;
+	}
+	utils_cycle_counter_start();
+	RCC_peripheral_set_clock(s_clocks[port], true);
+	RCC_peripheral_reset(s_clocks[port]);
+	s_ports[port].max_frequency = frequency;
+	s_ports[port].dma			= setup_dma(port);
+	setup_registers(port);
+	if (get_i2c(port)->SR2 & (1 << I2C_SR2_BUSY))
+	{
+		recover_bus(port);
+	}
+	NVIC_EnableIRQ(s_event_irqs[port]);
+	NVIC_EnableIRQ(s_error_irqs[port]);
+	s_ports[port].state = I2C_IDLE;
+	s_ports[port].init	= true;
+	return I2C_NO_ERR;
+}
+
+uint32_t I2C_get_frequency(I2C_t port)
+{
+	if (port >= I2C_COUNT || !s_ports[port].init)
+	{
+		return 0;
+	}
+	return s_ports[port].frequency;
+}
+
+I2C_ERR_t I2C_transfer(I2C_t port, uint8_t address, const uint8_t * tx, uint16_t tx_length, uint8_t * rx, uint16_t rx_length,
+					   I2C_callback_t callback)
+{
+	I2C_ERR_t	 error = I2C_NO_ERR;
+	I2C_port_t * state = NULL;
+	if ((tx == NULL && tx_length != 0) || (rx == NULL && rx_length != 0))
+	{
+		return I2C_NULL;
+	}
+	error = claim_port(port);
+	if (error != I2C_NO_ERR)
+	{
+		return error;
+	}
+	state			 = &s_ports[port];
+	state->callback	 = callback;
+	state->address	 = address;
+	state->has_reg	 = false;
+	state->tx		 = tx;
+	state->tx_length = tx_length;
+	state->rx		 = rx;
+	state->rx_length = rx_length;
+	return start_transfer(port);
+}
+
+I2C_ERR_t I2C_write_register(I2C_t port, uint8_t address, uint8_t reg, const uint8_t * data, uint16_t length, I2C_callback_t callback)
+{
+	I2C_ERR_t	 error = I2C_NO_ERR;
+	I2C_port_t * state = NULL;
+	if (data == NULL && length != 0)
+	{
+		return I2C_NULL;
+	}
+	error = claim_port(port);
+	if (error != I2C_NO_ERR)
+	{
+		return error;
+	}
+	state			 = &s_ports[port];
+	state->callback	 = callback;
+	state->address	 = address;
+	state->has_reg	 = true;
+	state->reg		 = reg;
+	state->tx		 = data;
+	state->tx_length = length;
+	state->rx		 = NULL;
+	state->rx_length = 0;
+	return start_transfer(port);
+}
+
+I2C_ERR_t I2C_read_register(I2C_t port, uint8_t address, uint8_t reg, uint8_t * data, uint16_t length, I2C_callback_t callback)
+{
+	I2C_ERR_t	 error = I2C_NO_ERR;
+	I2C_port_t * state = NULL;
+	if (data == NULL || length == 0)
+	{
+		return I2C_NULL;
+	}
+	error = claim_port(port);
+	if (error != I2C_NO_ERR)
+	{
+		return error;
+	}
+	state			 = &s_ports[port];
+	state->callback	 = callback;
+	state->address	 = address;
+	state->has_reg	 = true;
+	state->reg		 = reg;
+	state->tx		 = NULL;
+	state->tx_length = 0;
+	state->rx		 = data;
+	state->rx_length = length;
+	return start_transfer(port);
+}
+
+bool I2C_is_busy(I2C_t port)
+{
+	if (port >= I2C_COUNT)
+	{
+		return false;
+	}
+	return s_ports[port].state != I2C_IDLE;
+}
+
+void I2C_get_stats(I2C_t port, I2C_stats_t * stats)
+{
+	if (port >= I2C_COUNT || stats == NULL)
+	{
+		return;
+	}
+	*stats = s_ports[port].stats;
+}
+
+void I2C_startup()
+{
+	for (size_t i = 0; i < I2C_COUNT; i++)
+	{
+		s_ports[i] = (I2C_port_t){ .state = I2C_IDLE };
+	}
+}
+
+/*
+ ? Interrupt handlers
+*/
+
+/**
+ * @brief This function runs the state machine of a port on its events
+ *
+ * @param port which port
+ */
+static void handle_event(I2C_t port)
+{
+	I2C_TypeDef *	  i2c	  = get_i2c(port);
+	I2C_port_t *	  state	  = &s_ports[port];
+	uint32_t		  sr1	  = i2c->SR1;
+	uint32_t		  primask = 0;
+	volatile uint32_t clear	  = 0;
+	switch (state->state)
+	{
+	case I2C_START:
+		if (sr1 & (1 << I2C_SR1_SB))
+		{
+			// writing DR after reading SR1 clears SB
+			i2c->DR		 = (state->address << 1) | state->reading;
+			state->state = I2C_ADDRESS;
+		}
+		break;
+	case I2C_ADDRESS:
+		if (sr1 & (1 << I2C_SR1_ADDR))
+		{
+			if (state->reading)
+			{
+				start_read(port);
+			}
+			else
+			{
+				start_write(port);
+			}
+		}
+		break;
+	case I2C_WRITE:
+		if (!state->dma && (sr1 & (1 << I2C_SR1_TXE)) && state->index < state->tx_length)
+		{
+			i2c->DR = state->tx[state->index++];
+			if (state->index == state->tx_length)
+			{
+				i2c->CR2 &= ~(1 << I2C_CR2_ITBUFEN);
+			}
+		}
+		// with DMA BTF is set only after the last byte, the DMA keeps the data register full until then
+		else if ((sr1 & (1 << I2C_SR1_BTF)) && (state->dma || state->index == state->tx_length))
+		{
+			end_write(port);
+		}
+		break;
+	case I2C_READ:
+		if (sr1 & (1 << I2C_SR1_RXNE))
+		{
+			state->rx[state->index++] = i2c->DR;
+			if (state->index == state->rx_length)
+			{
+				finish_transfer(port, I2C_OK);
+			}
+			else if (state->rx_length - state->index == READ_END_BYTES)
+			{
+				i2c->CR2 &= ~(1 << I2C_CR2_ITBUFEN);
+				state->state = I2C_READ_END;
+			}
+		}
+		break;
+	case I2C_READ_END:
+		if (sr1 & (1 << I2C_SR1_BTF))
+		{
+			// byte N-2 is in DR and N-1 in the shift register, the NACK goes with byte N
+			i2c->CR1 &= ~(1 << I2C_CR1_ACK);
+			state->rx[state->index++] = i2c->DR;
+			primask					  = __get_PRIMASK();
+			__disable_irq();
+			i2c->CR1 |= 1 << I2C_CR1_STOP;
+			state->rx[state->index++] = i2c->DR;
+			__set_PRIMASK(primask);
+			state->state = I2C_READ;
+			i2c->CR2 |= 1 << I2C_CR2_ITBUFEN;
+		}
+		break;
+	case I2C_READ_TWO:
+		if (sr1 & (1 << I2C_SR1_BTF))
+		{
+			primask = __get_PRIMASK();
+			__disable_irq();
+			i2c->CR1 |= 1 << I2C_CR1_STOP;
+			state->rx[0] = i2c->DR;
+			__set_PRIMASK(primask);
+			state->rx[1] = i2c->DR;
+			finish_transfer(port, I2C_OK);
+		}
+		break;
+	default:
+		// an event without a transfer, such as a late BTF of a finished transfer, reading the registers clears it
+		clear = i2c->SR2;
+		clear = i2c->DR;
+		(void)clear;
+		break;
+	}
+}
+
+/**
+ * @brief This function ends the transfer of a port on an error
+ *
+ * @param port which port
+ */
+static void handle_error(I2C_t port)
+{
+	I2C_TypeDef * i2c	 = get_i2c(port);
+	I2C_port_t *  state	 = &s_ports[port];
+	uint32_t	  sr1	 = i2c->SR1;
+	I2C_RESULT_t  result = I2C_OK;
+	// the error flags are cleared by writing 0, writing 1 leaves a flag as it is
+	i2c->SR1 = ~(sr1 & I2C_SR1_ERRORS);
+	if (sr1 & (1 << I2C_SR1_BERR))
+	{
+		// a misplaced start or stop leaves the port unable to send a start, see the errata sheet
+		result = I2C_BUS_ERROR;
+		state->stats.bus_errors++;
+		i2c->CR1 |= 1 << I2C_CR1_SWRST;
+		i2c->CR1 &= ~(1 << I2C_CR1_SWRST);
+		setup_registers(port);
+	}
+	else if (sr1 & (1 << I2C_SR1_ARLO))
+	{
+		// the port went back to slave mode, the bus belongs to the other master
+		result = I2C_ARBITRATION_LOST;
+		state->stats.arbitration_lost++;
+	}
+	else if (sr1 & (1 << I2C_SR1_AF))
+	{
+		result = I2C_NACK;
+		state->stats.nacks++;
+		i2c->CR1 |= 1 << I2C_CR1_STOP;
+	}
+	else
+	{
+		return;
+	}
+	if (state->state != I2C_IDLE)
+	{
+		finish_transfer(port, result);
+	}
+}
+
+void I2C1_EV_IRQHandler()
+{
+	handle_event(I2C_1);
+}
+
+void I2C1_ER_IRQHandler()
+{
+	handle_error(I2C_1);
+}
+
+void I2C2_EV_IRQHandler()
+{
+	handle_event(I2C_2);
+}
+
+void I2C2_ER_IRQHandler()
+{
+	handle_error(I2C_2);
+}
@@ -0,0 +1,485 @@
+#include "LCD.h"
+
+#define QUEUE_MASK		(LCD_QUEUE_SIZE - 1)
+#define US_TO_TICKS(us) ((uint32_t)(us) * LCD_TICK_FREQUENCY / 1000000)
+/* waits of the datasheet, in ticks after the one of the step */
+#define POWER_ON_TICKS US_TO_TICKS(40000)
+#define WAKE_TICKS	   US_TO_TICKS(4100)
+#define WAKE_2_TICKS   US_TO_TICKS(100)
+#define CLEAR_TICKS	   (US_TO_TICKS(1520) + 1)
+/* E is high for at least 450ns and the E cycle is at least 1us, with some margin at 72MHz */
+#define E_PULSE_NOPS (40)
+
+#define CMD_CLEAR		  (0x01)
+#define CMD_HOME		  (0x02)
+#define CMD_ENTRY_MODE	  (0x06) // increment the address, no display shift
+#define CMD_DISPLAY_OFF	  (0x08)
+#define CMD_DISPLAY_ON	  (0x0C)
+#define CMD_SHIFT		  (0x10)
+#define CMD_FUNCTION_SET  (0x20) // 4 bit bus, 5x8 dots
+#define FUNCTION_2_LINES  (0x08)
+#define CMD_CGRAM_ADDRESS (0x40)
+#define CMD_DDRAM_ADDRESS (0x80)
+/* the 8 bit function set, sent as a nibble three times to sync the controller whatever mode it is in */
+#define WAKE_NIBBLE		(0x3)
+#define FOUR_BIT_NIBBLE (0x2)
+/* the DDRAM of a controller line, the second line starts at 0x40 */
+#define LINE_LENGTH		(40)
+#define SECOND_LINE		(0x40)
+#define NO_ADDRESS		(0xFF)
+#define CHAR_ROWS		(8)
+
+typedef enum
+{
+	LCD_STEP_COMMAND,
+	LCD_STEP_DATA,
+	LCD_STEP_NIBBLE // the high nibble only, for the init sequence
+} LCD_STEP_TYPE_t;
+
+typedef struct
+{
+	uint8_t value;
+	uint8_t type;
+	uint8_t wait; // ticks after the step
+} LCD_step_t;
+
+static GPIO_PIN_ARRAY_t s_data_pins;
+static GPIO_PIN_ARRAY_t s_rs_pins;
+static GPIO_PIN_ARRAY_t s_e_pins;
+static periph_ptr_t		s_data_bsrr	  = NULL;
+static bool				s_initialized = false;
+static volatile bool	s_running	  = false;
+static TIM_t			s_timer		  = TIM_COUNT;
+static uint8_t			s_columns	  = 0;
+static uint8_t			s_rows		  = 0;
+/* what the application wrote and what the LCD shows */
+static volatile char s_shadow[LCD_MAX_ROWS][LCD_MAX_COLUMNS];
+static char			 s_shown[LCD_MAX_ROWS][LCD_MAX_COLUMNS];
+static LCD_step_t	 s_queue[LCD_QUEUE_SIZE];
+/* run freely and wrap */
+static volatile uint8_t s_head = 0;
+static volatile uint8_t s_tail = 0;
+static uint16_t			s_wait = 0;
+/* the DDRAM address counter of the controller, NO_ADDRESS when not known */
+static uint8_t s_address = NO_ADDRESS;
+/* where the search for a changed character starts, so a changed string is sent in order */
+static uint8_t s_scan_row	 = 0;
+static uint8_t s_scan_column = 0;
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function waits for a part of the E cycle
+ *
+ */
+static void spin()
+{
+	for (size_t i = 0; i < E_PULSE_NOPS; i++)
+	{
+		__NOP();
+	}
+}
+
+/**
+ * @brief This function writes a nibble, the controller takes it on the falling edge of E
+ *
+ * @param nibble the 4 bits
+ */
+static void write_nibble(uint8_t nibble)
+{
+	*s_data_bsrr = GPIO_array_get_bsrr_value(&s_data_pins, nibble);
+	GPIO_array_write_all(&s_e_pins, true);
+	spin();
+	GPIO_array_write_all(&s_e_pins, false);
+	spin();
+}
+
+/**
+ * @brief This function returns the DDRAM address of a character, 4 rows are the halves of the 2 lines
+ *
+ * @param row which row
+ * @param column which column
+ * @return uint8_t DDRAM address
+ */
+static uint8_t get_address(uint8_t row, uint8_t column)
+{
+	return ((row & 1) ? SECOND_LINE : 0) + (row >= 2 ? s_columns : 0) + column;
+}
+
+/**
+ * @brief This function follows the address counter of the controller after a command
+ *
+ * @param command the command
+ */
+static void track_command(uint8_t command)
+{
+	// the highest bit set is the instruction
+	if (command >= CMD_DDRAM_ADDRESS)
+	{
+		s_address = command & ~CMD_DDRAM_ADDRESS;
+	}
+	else if (command >= CMD_CGRAM_ADDRESS || (command >= CMD_SHIFT && command < CMD_FUNCTION_SET))
+	{
+		s_address = NO_ADDRESS;
+	}
+	else if ((command & ~1) == CMD_HOME)
+	{
+		s_address = 0;
+	}
+	else if (command == CMD_CLEAR)
+	{
+		s_address = 0;
+		for (size_t row = 0; row < LCD_MAX_ROWS; row++)
+		{
+			for (size_t column = 0; column < LCD_MAX_COLUMNS; column++)
+			{
+				s_shown[row][column] = ' ';
+			}
+		}
+	}
+}
+
+/**
+ * @brief This function sends a step
+ *
+ * @param step the step
+ */
+static void send_step(const LCD_step_t * step)
+{
+	GPIO_array_write_all(&s_rs_pins, step->type == LCD_STEP_DATA);
+	write_nibble(step->value >> 4);
+	if (step->type != LCD_STEP_NIBBLE)
+	{
+		write_nibble(step->value & 0x0F);
+	}
+	if (step->type == LCD_STEP_COMMAND)
+	{
+		track_command(step->value);
+	}
+	else if (step->type == LCD_STEP_DATA && s_address != NO_ADDRESS)
+	{
+		// the counter goes from the end of a line to the start of the other one
+		s_address++;
+		if (s_address == LINE_LENGTH)
+		{
+			s_address = SECOND_LINE;
+		}
+		else if (s_address == SECOND_LINE + LINE_LENGTH)
+		{
+			s_address = 0;
+		}
+	}
+}
+
+/**
+ * @brief This function finds the next character that differs from what the LCD shows
+ *
+ * @param step output, the address command when the character is not at the address counter, else the character
+ * @return true a character differs
+ * @return false the LCD shows the shadow
+ */
+static bool find_change(LCD_step_t * step)
+{
+	uint8_t address = 0;
+	char	c		= 0;
+	for (size_t i = 0; i < (size_t)s_rows * s_columns; i++)
+	{
+		c = s_shadow[s_scan_row][s_scan_column];
+		if (c != s_shown[s_scan_row][s_scan_column])
+		{
+			address = get_address(s_scan_row, s_scan_column);
+			if (address != s_address)
+			{
+				*step = (LCD_step_t){ .value = CMD_DDRAM_ADDRESS | address, .type = LCD_STEP_COMMAND };
+				return true;
+			}
+			// the copy that is sent, a newer write is found on a later tick
+			s_shown[s_scan_row][s_scan_column] = c;
+			*step = (LCD_step_t){ .value = c, .type = LCD_STEP_DATA };
+			return true;
+		}
+		if (++s_scan_column == s_columns)
+		{
+			s_scan_column = 0;
+			s_scan_row	  = s_scan_row + 1 == s_rows ? 0 : s_scan_row + 1;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief This function runs a step on every tick, the queue first and then the changed characters
+ *
+ * @param timer the timer
+ */
+static void tick(TIM_t timer)
+{
+	LCD_step_t step = { 0 };
+	if (s_wait != 0)
+	{
+		s_wait--;
+		return;
+	}
+	if (s_head != s_tail)
+	{
+		step = s_queue[s_tail & QUEUE_MASK];
+		s_tail++;
+	}
+	else if (!find_change(&step))
+	{
+		// nothing to do, LCD_write starts the timer again
+		TIM_stop(s_timer);
+		s_running = false;
+		return;
+	}
+	send_step(&step);
+	s_wait = step.wait;
+}
+
+/**
+ * @brief This function starts the ticks if they are stopped
+ *
+ * @remarks The tick only stops after it found nothing to do, so a change made before this call is always seen
+ */
+static void wake()
+{
+	if (!s_running)
+	{
+		s_running = true;
+		TIM_reload(s_timer);
+		TIM_start(s_timer);
+	}
+}
+
+/**
+ * @brief This function queues steps, all of them or none
+ *
+ * @param steps the steps
+ * @param count how many
+ * @return true queued
+ * @return false no room
+ */
+static bool push(const LCD_step_t * steps, uint8_t count)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if ((uint8_t)(s_head - s_tail) + count > LCD_QUEUE_SIZE)
+	{
+		__set_PRIMASK(primask);
+		return false;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		s_queue[(s_head + i) & QUEUE_MASK] = steps[i];
+	}
+	s_head += count;
+	__set_PRIMASK(primask);
+	wake();
+	return true;
+}
+
+/**
+ * @brief This function reserves the data, RS and E pins, on failure the pins already reserved are released
+ *
+ * @param config display config
+ * @return true all the pins are reserved
+ * @return false a pin is reserved by someone else
+ */
+static bool init_pins(const LCD_config_t * config)
+{
+	if (GPIO_array_init(&s_data_pins, config->data_port, config->data_pin, config->data_pin + 3, GPIO_MODE_OUTPUT_2MHz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		return false;
+	}
+	if (GPIO_array_init(&s_rs_pins, config->control_port, config->rs_pin, config->rs_pin, GPIO_MODE_OUTPUT_2MHz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		GPIO_array_de_init(&s_data_pins);
+		return false;
+	}
+	if (GPIO_array_init(&s_e_pins, config->control_port, config->e_pin, config->e_pin, GPIO_MODE_OUTPUT_2MHz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		GPIO_array_de_init(&s_data_pins);
+		GPIO_array_de_init(&s_rs_pins);
+		return false;
+	}
+	return true;
+}
+
+/*
+ ? Public functions
+*/
+
+LCD_ERR_t LCD_init(const LCD_config_t * config)
+{
+	uint8_t	   function = CMD_FUNCTION_SET;
+	LCD_step_t steps[]	= {
+		{ .value = WAKE_NIBBLE << 4, .type = LCD_STEP_NIBBLE, .wait = WAKE_TICKS },
+		{ .value = WAKE_NIBBLE << 4, .type = LCD_STEP_NIBBLE, .wait = WAKE_2_TICKS },
+		{ .value = WAKE_NIBBLE << 4, .type = LCD_STEP_NIBBLE },
+		{ .value = FOUR_BIT_NIBBLE << 4, .type = LCD_STEP_NIBBLE },
+		{ .value = CMD_FUNCTION_SET, .type = LCD_STEP_COMMAND },
+		{ .value = CMD_DISPLAY_OFF, .type = LCD_STEP_COMMAND },
+		{ .value = CMD_CLEAR, .type = LCD_STEP_COMMAND, .wait = CLEAR_TICKS },
+		{ .value = CMD_ENTRY_MODE, .type = LCD_STEP_COMMAND },
+		{ .value = CMD_DISPLAY_ON, .type = LCD_STEP_COMMAND },
+	};
+	if (config == NULL)
+	{
+		return LCD_NULL;
+	}
+	if (s_initialized)
+	{
+		return LCD_ALREADY_INIT;
+	}
+	if (config->data_pin + 3 > GPIO_MAX_PIN || config->rs_pin > GPIO_MAX_PIN || config->e_pin > GPIO_MAX_PIN ||
+		config->columns < 8 || config->columns > LCD_MAX_COLUMNS || config->rows == 0 || config->rows > LCD_MAX_ROWS ||
+		(config->rows > 2 && config->columns * 2 > LINE_LENGTH) || config->timer >= TIM_COUNT)
+	{
+		return LCD_INVALID_CONFIG;
+	}
+	if (TIM_init(config->timer, LCD_TICK_FREQUENCY) == false)
+	{
+		return LCD_TIMER_ERROR;
+	}
+	if (init_pins(config) == false)
+	{
+		return LCD_PINS_RESERVED;
+	}
+	GPIO_array_write_all(&s_e_pins, false);
+	s_data_bsrr = GPIO_array_get_bsrr(&s_data_pins);
+	s_timer		= config->timer;
+	s_columns	= config->columns;
+	s_rows		= config->rows;
+	if (s_rows > 1)
+	{
+		function |= FUNCTION_2_LINES;
+	}
+	steps[4].value = function;
+	for (size_t row = 0; row < LCD_MAX_ROWS; row++)
+	{
+		for (size_t column = 0; column < LCD_MAX_COLUMNS; column++)
+		{
+			s_shadow[row][column] = ' ';
+			s_shown[row][column]  = ' ';
+		}
+	}
+	s_address	  = NO_ADDRESS;
+	s_wait		  = POWER_ON_TICKS;
+	s_initialized = true;
+	TIM_set_callback(s_timer, tick);
+	push(steps, sizeof(steps) / sizeof(steps[0]));
+	return LCD_NO_ERR;
+}
+
+uint8_t LCD_write(uint8_t row, uint8_t column, const char * text)
+{
+	uint8_t count	= 0;
+	bool	changed = false;
+	if (!s_initialized || text == NULL || row >= s_rows)
+	{
+		return 0;
+	}
+	for (; text[count] != '\0' && column + count < s_columns; count++)
+	{
+		if (s_shadow[row][column + count] != text[count])
+		{
+			s_shadow[row][column + count] = text[count];
+			changed						  = true;
+		}
+	}
+	if (changed)
+	{
+		wake();
+	}
+	return count;
+}
+
+void LCD_put_char(uint8_t row, uint8_t column, char c)
+{
+	if (!s_initialized || row >= s_rows || column >= s_columns || s_shadow[row][column] == c)
+	{
+		return;
+	}
+	s_shadow[row][column] = c;
+	wake();
+}
+
+void LCD_clear()
+{
+	if (!s_initialized)
+	{
+		return;
+	}
+	for (size_t row = 0; row < s_rows; row++)
+	{
+		for (size_t column = 0; column < s_columns; column++)
+		{
+			s_shadow[row][column] = ' ';
+		}
+	}
+	wake();
+}
+
+LCD_ERR_t LCD_command(uint8_t command)
+{
+	LCD_step_t step = { .value = command, .type = LCD_STEP_COMMAND };
+	if (!s_initialized)
+	{
+		return LCD_NOT_INIT;
+	}
+	if (command == CMD_CLEAR || (command & ~1) == CMD_HOME)
+	{
+		step.wait = CLEAR_TICKS;
+	}
+	return push(&step, 1) ? LCD_NO_ERR : LCD_QUEUE_FULL;
+}
+
+LCD_ERR_t LCD_define_char(uint8_t index, const uint8_t * pattern)
+{
+	LCD_step_t steps[CHAR_ROWS + 1];
+	if (pattern == NULL)
+	{
+		return LCD_NULL;
+	}
+	if (!s_initialized)
+	{
+		return LCD_NOT_INIT;
+	}
+	if (index >= LCD_CUSTOM_CHARS)
+	{
+		return LCD_INVALID_CONFIG;
+	}
+	// the characters after it need an address command to go back to the DDRAM
+	steps[0] = (LCD_step_t){ .value = CMD_CGRAM_ADDRESS | (index * CHAR_ROWS), .type = LCD_STEP_COMMAND };
+	for (size_t i = 0; i < CHAR_ROWS; i++)
+	{
+		steps[i + 1] = (LCD_step_t){ .value = pattern[i] & 0x1F, .type = LCD_STEP_DATA };
+	}
+	return push(steps, CHAR_ROWS + 1) ? LCD_NO_ERR : LCD_QUEUE_FULL;
+}
+
+bool LCD_is_idle()
+{
+	return !s_running;
+}
+
+void LCD_startup()
+{
+	s_initialized = false;
+	s_running	  = false;
+	s_timer		  = TIM_COUNT;
+	s_data_bsrr	  = NULL;
+	s_columns	  = 0;
+	s_rows		  = 0;
+	s_head		  = 0;
+	s_tail		  = 0;
+	s_wait		  = 0;
+	s_address	  = NO_ADDRESS;
+	s_scan_row	  = 0;
+	s_scan_column = 0;
+}
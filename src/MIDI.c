@@ -0,0 +1,337 @@
+#include "MIDI.h"
+
+#define MIDI_DATA_MASK		(0x7F)
+#define MIDI_UNDEFINED_F4	(0xF4)
+#define MIDI_UNDEFINED_F5	(0xF5)
+#define MIDI_UNDEFINED_F9	(0xF9)
+#define MIDI_UNDEFINED_FD	(0xFD)
+#define MIDI_QUEUE_MASK		(MIDI_QUEUE_SIZE - 1)
+
+/*
+ ? Queue functions
+*/
+
+void MIDI_queue_init(pMIDI_queue_t queue)
+{
+	if (queue == NULL)
+	{
+		return;
+	}
+	queue->head	   = 0;
+	queue->tail	   = 0;
+	queue->dropped = 0;
+}
+
+bool MIDI_queue_push(pMIDI_queue_t queue, const MIDI_event_t * event)
+{
+	uint16_t head = 0;
+	if (queue == NULL || event == NULL)
+	{
+		return false;
+	}
+	head = queue->head;
+	if ((uint16_t)(head - queue->tail) >= MIDI_QUEUE_SIZE)
+	{
+		queue->dropped++;
+		return false;
+	}
+	queue->events[head & MIDI_QUEUE_MASK] = *event;
+	// the event must be written before the consumer can see it
+	__DMB();
+	queue->head = head + 1;
+	return true;
+}
+
+const MIDI_event_t * MIDI_queue_peek(const MIDI_queue_t * queue)
+{
+	uint16_t tail = 0;
+	if (queue == NULL)
+	{
+		return NULL;
+	}
+	tail = queue->tail;
+	if (tail == queue->head)
+	{
+		return NULL;
+	}
+	__DMB();
+	return &queue->events[tail & MIDI_QUEUE_MASK];
+}
+
+bool MIDI_queue_pop(pMIDI_queue_t queue, MIDI_event_t * event)
+{
+	const MIDI_event_t * oldest = MIDI_queue_peek(queue);
+	if (oldest == NULL)
+	{
+		return false;
+	}
+	if (event != NULL)
+	{
+		*event = *oldest;
+	}
+	// the event must be read before the producer can overwrite it
+	__DMB();
+	queue->tail++;
+	return true;
+}
+
+uint16_t MIDI_queue_count(const MIDI_queue_t * queue)
+{
+	if (queue == NULL)
+	{
+		return 0;
+	}
+	return queue->head - queue->tail;
+}
+
+/*
+ ? Parser functions
+*/
+
+uint8_t MIDI_data_length(uint8_t status)
+{
+	if (!MIDI_IS_STATUS(status))
+	{
+		return 0;
+	}
+	if (status < MIDI_SYSEX_START)
+	{
+		status = MIDI_TYPE(status);
+		return (status == MIDI_PROGRAM_CHANGE || status == MIDI_CHANNEL_PRESSURE) ? 1 : 2;
+	}
+	switch (status)
+	{
+	case MIDI_TIME_CODE:
+	case MIDI_SONG_SELECT:
+		return 1;
+	case MIDI_SONG_POSITION:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief This function pushes a short message
+ *
+ * @param parser parser object
+ * @param status status byte
+ * @param queue where to push
+ * @return uint16_t 1 if pushed, 0 if the queue was full
+ */
+static uint16_t push_message(pMIDI_parser_t parser, uint8_t status, pMIDI_queue_t queue)
+{
+	MIDI_event_t event = { .status = status, .port = parser->port, .length = 0, .flags = 0 };
+	if (!MIDI_IS_REALTIME(status))
+	{
+		event.length  = parser->count;
+		event.data[0] = parser->data[0];
+		event.data[1] = parser->data[1];
+	}
+	return MIDI_queue_push(queue, &event) ? 1 : 0;
+}
+
+/**
+ * @brief This function pushes the SysEx chunk and starts the next one
+ *
+ * @param parser parser object
+ * @param queue where to push
+ * @return uint16_t 1 if pushed, 0 if the queue was full
+ */
+static uint16_t push_sysex_chunk(pMIDI_parser_t parser, pMIDI_queue_t queue)
+{
+	uint16_t pushed		 = MIDI_queue_push(queue, &parser->sysex) ? 1 : 0;
+	parser->sysex.length = 0;
+	parser->sysex.flags	 = 0;
+	return pushed;
+}
+
+void MIDI_parser_init(pMIDI_parser_t parser, uint8_t port)
+{
+	if (parser == NULL)
+	{
+		return;
+	}
+	parser->port		= port;
+	parser->status		= 0;
+	parser->expected	= 0;
+	parser->count		= 0;
+	parser->in_sysex	= false;
+	parser->sysex		= (MIDI_event_t){ .status = MIDI_SYSEX_START, .port = port };
+	parser->stray_bytes = 0;
+}
+
+uint16_t MIDI_parse(pMIDI_parser_t parser, const uint8_t * bytes, uint16_t length, pMIDI_queue_t queue)
+{
+	uint16_t pushed = 0;
+	uint8_t	 byte	= 0;
+	if (parser == NULL || bytes == NULL || queue == NULL)
+	{
+		return 0;
+	}
+	for (size_t i = 0; i < length; i++)
+	{
+		byte = bytes[i];
+		if (MIDI_IS_REALTIME(byte))
+		{
+			// realtime doesn't touch the running status or the SysEx
+			if (byte != MIDI_UNDEFINED_F9 && byte != MIDI_UNDEFINED_FD)
+			{
+				pushed += push_message(parser, byte, queue);
+			}
+			continue;
+		}
+		if (MIDI_IS_STATUS(byte))
+		{
+			if (parser->in_sysex)
+			{
+				parser->sysex.flags |= MIDI_FLAG_SYSEX_LAST | (byte != MIDI_SYSEX_END ? MIDI_FLAG_SYSEX_ABORTED : 0);
+				pushed += push_sysex_chunk(parser, queue);
+				parser->in_sysex = false;
+			}
+			// system common messages cancel the running status
+			parser->status = 0;
+			parser->count  = 0;
+			switch (byte)
+			{
+			case MIDI_SYSEX_START:
+				parser->in_sysex	 = true;
+				parser->sysex.flags	 = MIDI_FLAG_SYSEX_FIRST;
+				parser->sysex.length = 0;
+				break;
+			case MIDI_SYSEX_END:
+			case MIDI_UNDEFINED_F4:
+			case MIDI_UNDEFINED_F5:
+				break;
+			default:
+				parser->expected = MIDI_data_length(byte);
+				if (parser->expected == 0)
+				{
+					pushed += push_message(parser, byte, queue);
+				}
+				else
+				{
+					parser->status = byte;
+				}
+				break;
+			}
+			continue;
+		}
+		if (parser->in_sysex)
+		{
+			parser->sysex.data[parser->sysex.length++] = byte;
+			if (parser->sysex.length == MIDI_SYSEX_CHUNK_SIZE)
+			{
+				pushed += push_sysex_chunk(parser, queue);
+			}
+			continue;
+		}
+		if (parser->status == 0)
+		{
+			parser->stray_bytes++;
+			continue;
+		}
+		parser->data[parser->count++] = byte;
+		if (parser->count == parser->expected)
+		{
+			pushed += push_message(parser, parser->status, queue);
+			parser->count = 0;
+			// only channel voice messages have a running status
+			if (parser->status >= MIDI_SYSEX_START)
+			{
+				parser->status = 0;
+			}
+		}
+	}
+	return pushed;
+}
+
+/*
+ ? Serializer functions
+*/
+
+void MIDI_serializer_init(pMIDI_serializer_t serializer, bool zero_velocity_note_off)
+{
+	if (serializer == NULL)
+	{
+		return;
+	}
+	serializer->running_status		   = 0;
+	serializer->zero_velocity_note_off = zero_velocity_note_off;
+}
+
+void MIDI_serializer_reset(pMIDI_serializer_t serializer)
+{
+	if (serializer == NULL)
+	{
+		return;
+	}
+	serializer->running_status = 0;
+}
+
+uint8_t MIDI_serialize(pMIDI_serializer_t serializer, const MIDI_event_t * event, uint8_t * output)
+{
+	uint8_t status = 0;
+	uint8_t length = 0;
+	uint8_t count  = 0;
+	if (serializer == NULL || event == NULL || output == NULL || !MIDI_IS_STATUS(event->status))
+	{
+		return 0;
+	}
+	status = event->status;
+	if (MIDI_IS_REALTIME(status))
+	{
+		output[0] = status;
+		return 1;
+	}
+	if (status == MIDI_SYSEX_START)
+	{
+		if (event->length > MIDI_SYSEX_CHUNK_SIZE)
+		{
+			return 0;
+		}
+		serializer->running_status = 0;
+		if (event->flags & MIDI_FLAG_SYSEX_FIRST)
+		{
+			output[count++] = MIDI_SYSEX_START;
+		}
+		for (size_t i = 0; i < event->length; i++)
+		{
+			output[count++] = event->data[i] & MIDI_DATA_MASK;
+		}
+		// an aborted SysEx is still terminated, so the receivers don't wait for it
+		if (event->flags & MIDI_FLAG_SYSEX_LAST)
+		{
+			output[count++] = MIDI_SYSEX_END;
+		}
+		return count;
+	}
+	length = MIDI_data_length(status);
+	if (event->length < length)
+	{
+		return 0;
+	}
+	if (serializer->zero_velocity_note_off && MIDI_TYPE(status) == MIDI_NOTE_OFF)
+	{
+		status = MIDI_NOTE_ON | MIDI_CHANNEL(status);
+	}
+	if (status >= MIDI_SYSEX_START)
+	{
+		serializer->running_status = 0;
+		output[count++]			   = status;
+	}
+	else if (status != serializer->running_status)
+	{
+		serializer->running_status = status;
+		output[count++]			   = status;
+	}
+	for (size_t i = 0; i < length; i++)
+	{
+		output[count++] = event->data[i] & MIDI_DATA_MASK;
+	}
+	if (status != event->status)
+	{
+		output[count - 1] = 0; // the velocity of the note off became the note on velocity 0
+	}
+	return count;
+}
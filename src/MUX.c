@@ -0,0 +1,296 @@
+#include "MUX.h"
+#include "DMA.h"
+#include "RCC.h"
+
+#define NS_PER_SECOND (1000000000ULL)
+/* the conversion of a channel takes 12.5 adc clock cycles after its sampling, the mux can change during it */
+#define ADC_CONVERSION_CYCLES (12)
+
+static GPIO_PIN_ARRAY_t		 s_select_pins;
+static bool					 s_initialized	= false;
+static bool					 s_running		= false;
+static TIM_t				 s_timer		= TIM_COUNT;
+static DMA_CHANNELS_t		 s_select_dma	= DMA_CH_COUNT;
+static ADC_REGULAR_TRIGGER_t s_trigger		= ADC_trigger_software;
+static uint16_t *			 s_output		= NULL;
+static uint8_t				 s_count_muxes	= 0;
+static uint8_t				 s_count_inputs = 0;
+static MUX_callback_t		 s_callback		= NULL;
+static volatile uint32_t	 s_scan_count	= 0;
+/* the BSRR word of each step, written on the update that starts the step */
+static uint32_t s_select_words[MUX_MAX_INPUTS];
+
+/**
+ * @brief This function is called from the ADC DMA interrupt after every full scan
+ *
+ */
+static void scan_complete()
+{
+	s_scan_count++;
+	if (s_callback != NULL)
+	{
+		s_callback();
+	}
+}
+
+/**
+ * @brief This function returns how the timer triggers the ADC
+ *
+ * @param timer which timer
+ * @param trigger the ADC trigger of the timer
+ * @param channel the compare channel behind the trigger
+ * @return true the timer can trigger the ADC
+ * @return false the timer can't trigger the ADC
+ */
+static bool get_timer_trigger(TIM_t timer, ADC_REGULAR_TRIGGER_t * trigger, TIM_CHANNEL_t * channel)
+{
+	switch (timer)
+	{
+	case TIM_1:
+		*trigger = ADC_trigger_TIM1_CC1;
+		*channel = TIM_CHANNEL_1;
+		return true;
+	case TIM_2:
+		*trigger = ADC_trigger_TIM2_CC2;
+		*channel = TIM_CHANNEL_2;
+		return true;
+	case TIM_4:
+		*trigger = ADC_trigger_TIM4_CC4;
+		*channel = TIM_CHANNEL_4;
+		return true;
+	default:
+		// TIM3 triggers the ADC only through TRGO
+		return false;
+	}
+}
+
+/**
+ * @brief This function converts a duration to timer ticks, rounded up
+ *
+ * @param duration duration in units of 1 / unit_freq
+ * @param unit_freq frequency of the duration units
+ * @param tick_freq timer tick frequency
+ * @return uint32_t ticks
+ */
+static uint32_t to_ticks(uint64_t duration, uint64_t unit_freq, uint32_t tick_freq)
+{
+	return (duration * tick_freq + unit_freq - 1) / unit_freq;
+}
+
+/**
+ * @brief This function sets up the step timer, the compare is the settle time and the period fits the sampling
+ *
+ * @param config mux bank config
+ * @param conversion_cycles adc clock cycles to convert all the mux outputs
+ * @param channel the compare channel that triggers the ADC
+ * @return MUX_ERR_t errors if any
+ */
+static MUX_ERR_t setup_timer(const MUX_config_t * config, uint16_t conversion_cycles, TIM_CHANNEL_t channel)
+{
+	uint32_t adc_freq	  = RCC_get_peripheral_freq(RCC_ADC1);
+	uint32_t tick_freq	  = 0;
+	uint32_t settle_ticks = 0;
+	uint32_t min_period	  = 0;
+	uint32_t period		  = 0;
+	if (config->scan_rate != 0)
+	{
+		if (TIM_init(config->timer, (uint32_t)config->scan_rate * s_count_inputs) == false)
+		{
+			return MUX_NO_BANDWIDTH;
+		}
+	}
+	else if (TIM_init_ex(config->timer, 0, UINT16_MAX) == false)
+	{
+		return MUX_INVALID_CONFIG;
+	}
+	tick_freq	 = TIM_get_tick_frequency(config->timer);
+	settle_ticks = to_ticks(config->settle_ns, NS_PER_SECOND, tick_freq);
+	settle_ticks = settle_ticks == 0 ? 1 : settle_ticks;
+	// the next select address can be written once the last mux output was sampled, one tick for the trigger latency
+	min_period = settle_ticks + to_ticks(conversion_cycles - ADC_CONVERSION_CYCLES, adc_freq, tick_freq) + 1;
+	// but the next trigger must find the conversion done
+	period = to_ticks(conversion_cycles, adc_freq, tick_freq) + 1;
+	min_period = period > min_period ? period : min_period;
+	if (config->scan_rate != 0)
+	{
+		period = tick_freq / TIM_get_frequency(config->timer);
+		if (period < min_period)
+		{
+			return MUX_NO_BANDWIDTH;
+		}
+	}
+	else
+	{
+		if (min_period > (uint32_t)UINT16_MAX + 1)
+		{
+			return MUX_INVALID_CONFIG; // the settle time is too long for the timer
+		}
+		TIM_init_ex(config->timer, 0, min_period - 1);
+	}
+	TIM_set_compare(config->timer, channel, settle_ticks);
+	return MUX_NO_ERR;
+}
+
+/**
+ * @brief This function sets up the DMA that writes the select lines on every timer update
+ *
+ * @return true DMA is ready
+ * @return false the DMA channel is reserved
+ */
+static bool setup_select_dma()
+{
+	DMA_address_t periph = { .access_size = DMA_ACCESS_32BIT, .address = (uint32_t *)GPIO_array_get_bsrr(&s_select_pins), .increament_address = false };
+	DMA_address_t memory = { .access_size = DMA_ACCESS_32BIT, .address = s_select_words, .increament_address = true };
+	RCC_peripheral_set_clock(RCC_DMA1, true);
+	if (DMA_init_channel(s_select_dma, &periph, &memory, DMA_CH_PRIORITY_VERY_HIGH, DMA_DIRECTION_MEM_TO_PERIPH, 0) == false)
+	{
+		return false;
+	}
+	DMA_set_circular(s_select_dma, true);
+	return true;
+}
+
+/**
+ * @brief This function starts a scan from the first select address
+ *
+ */
+static void start_scan()
+{
+	// the first address is written now, the DMA writes the next address on every update
+	*GPIO_array_get_bsrr(&s_select_pins) = GPIO_array_get_bsrr_value(&s_select_pins, 0);
+	DMA_stop_channel(s_select_dma);
+	DMA_channel_clear_flags(s_select_dma);
+	DMA_start_channel(s_select_dma, s_count_inputs, false);
+	ADC_start_triggered(s_trigger, s_output, s_count_muxes * s_count_inputs, scan_complete);
+	TIM_reload(s_timer);
+	TIM_set_dma_request(s_timer, TIM_DMA_UPDATE, true);
+	TIM_start(s_timer);
+	s_running = true;
+}
+
+MUX_ERR_t MUX_init(const MUX_config_t * config, uint16_t * output, MUX_callback_t callback)
+{
+	uint8_t				channels[MUX_MAX_MUXES];
+	ADC_SAMPLING_TIME_t sampling_times[MUX_MAX_MUXES];
+	ADC_profile_t		profile;
+	TIM_CHANNEL_t		compare_channel = TIM_CHANNEL_1;
+	MUX_ERR_t			error			= MUX_NO_ERR;
+	if (config == NULL || output == NULL)
+	{
+		return MUX_NULL;
+	}
+	if (s_initialized)
+	{
+		return MUX_ADC_BUSY;
+	}
+	if (config->count_muxes == 0 || config->count_muxes > MUX_MAX_MUXES || config->select_bits == 0 ||
+		config->select_bits > MUX_MAX_SELECT_BITS || config->select_start_pin + config->select_bits - 1 > GPIO_MAX_PIN)
+	{
+		return MUX_INVALID_CONFIG;
+	}
+	if (!get_timer_trigger(config->timer, &s_trigger, &compare_channel))
+	{
+		return MUX_INVALID_TIMER;
+	}
+	s_select_dma = TIM_get_dma_channel(config->timer, TIM_DMA_UPDATE);
+	for (size_t i = 0; i < config->count_muxes; i++)
+	{
+		channels[i]		  = config->channels[i];
+		sampling_times[i] = config->sampling_time;
+	}
+	if (ADC_profile_build(&profile, channels, sampling_times, config->count_muxes) == false)
+	{
+		return MUX_INVALID_CONFIG;
+	}
+	s_count_muxes  = config->count_muxes;
+	s_count_inputs = 1 << config->select_bits;
+	error		   = setup_timer(config, profile.conversion_cycles, compare_channel);
+	if (error != MUX_NO_ERR)
+	{
+		return error;
+	}
+	if (GPIO_array_init(&s_select_pins, config->select_port, config->select_start_pin, config->select_start_pin + config->select_bits - 1,
+						GPIO_MODE_OUTPUT_50Mhz, GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		return MUX_PINS_RESERVED;
+	}
+	if (ADC_init_ex(channels, sampling_times, config->count_muxes, output) == false)
+	{
+		GPIO_array_de_init(&s_select_pins);
+		return MUX_ADC_BUSY;
+	}
+	if (setup_select_dma() == false)
+	{
+		ADC_de_init();
+		GPIO_array_de_init(&s_select_pins);
+		return MUX_DMA_BUSY;
+	}
+	// step i is converted after the update of step i - 1 wrote its address
+	for (size_t i = 0; i < s_count_inputs; i++)
+	{
+		s_select_words[i] = GPIO_array_get_bsrr_value(&s_select_pins, (i + 1) % s_count_inputs);
+	}
+	s_timer		  = config->timer;
+	s_output	  = output;
+	s_callback	  = callback;
+	s_scan_count  = 0;
+	s_initialized = true;
+	start_scan();
+	return MUX_NO_ERR;
+}
+
+uint16_t MUX_get_value(uint8_t mux, uint8_t input)
+{
+	if (!s_initialized || mux >= s_count_muxes || input >= s_count_inputs)
+	{
+		return 0;
+	}
+	return s_output[MUX_INDEX(s_count_muxes, mux, input)];
+}
+
+uint32_t MUX_get_scan_rate()
+{
+	if (!s_running)
+	{
+		return 0;
+	}
+	return TIM_get_frequency(s_timer) / s_count_inputs;
+}
+
+uint32_t MUX_get_scan_count()
+{
+	return s_scan_count;
+}
+
+void MUX_start()
+{
+	if (!s_initialized || s_running)
+	{
+		return;
+	}
+	start_scan();
+}
+
+void MUX_stop()
+{
+	if (!s_running)
+	{
+		return;
+	}
+	TIM_stop(s_timer);
+	TIM_set_dma_request(s_timer, TIM_DMA_UPDATE, false);
+	DMA_stop_channel(s_select_dma);
+	ADC_stop();
+	s_running = false;
+}
+
+void MUX_startup()
+{
+	s_initialized = false;
+	s_running	  = false;
+	s_timer		  = TIM_COUNT;
+	s_select_dma  = DMA_CH_COUNT;
+	s_output	  = NULL;
+	s_callback	  = NULL;
+	s_scan_count  = 0;
+}
@@ -0,0 +1,95 @@
+#include "POT.h"
+#include "utils.h"
+
+/**
+ * @brief This function rounds the fixed point state back to input units
+ *
+ * @param state filter state
+ * @return uint16_t rounded value
+ */
+static uint16_t state_to_value(int32_t state)
+{
+	return (state + (1 << (POT_FRACTION_BITS - 1))) >> POT_FRACTION_BITS;
+}
+
+bool POT_bank_init(pPOT_bank_t bank, uint8_t count, uint8_t smoothing, uint16_t hysteresis)
+{
+	if (bank == NULL || count == 0 || count > POT_MAX_CHANNELS)
+	{
+		return false;
+	}
+	bank->count	 = count;
+	bank->primed = false;
+	for (size_t i = 0; i < count; i++)
+	{
+		bank->channels[i].state = 0;
+		bank->channels[i].value = 0;
+		POT_set_channel(bank, i, smoothing, hysteresis);
+	}
+	return true;
+}
+
+void POT_set_channel(pPOT_bank_t bank, uint8_t index, uint8_t smoothing, uint16_t hysteresis)
+{
+	if (bank == NULL || index >= bank->count)
+	{
+		return;
+	}
+	// bigger shifts would leave the state stuck
+	if (smoothing > POT_FRACTION_BITS)
+	{
+		smoothing = POT_FRACTION_BITS;
+	}
+	bank->channels[index].smoothing	 = smoothing;
+	bank->channels[index].hysteresis = hysteresis;
+}
+
+uint32_t POT_bank_update(pPOT_bank_t bank, const uint16_t * samples)
+{
+	uint32_t		dirty	= 0;
+	int32_t			input	= 0;
+	int32_t			delta	= 0;
+	POT_channel_t * channel = NULL;
+	if (bank == NULL || samples == NULL)
+	{
+		return 0;
+	}
+	if (!bank->primed)
+	{
+		// start the filters at the current position instead of sliding up from 0
+		for (size_t i = 0; i < bank->count; i++)
+		{
+			bank->channels[i].state = (int32_t)samples[i] << POT_FRACTION_BITS;
+			bank->channels[i].value = samples[i];
+		}
+		bank->primed = true;
+		return utils_generate_mask(0, bank->count - 1);
+	}
+	for (size_t i = 0; i < bank->count; i++)
+	{
+		channel = &bank->channels[i];
+		input	= (int32_t)samples[i] << POT_FRACTION_BITS;
+		channel->state += (input - channel->state) >> channel->smoothing;
+		// deadband around the last reported value, compared in fixed point so slow drifts are not rounded away
+		delta = channel->state - ((int32_t)channel->value << POT_FRACTION_BITS);
+		if (delta < 0)
+		{
+			delta = -delta;
+		}
+		if (delta > ((int32_t)channel->hysteresis << POT_FRACTION_BITS))
+		{
+			channel->value = state_to_value(channel->state);
+			dirty |= (uint32_t)1 << i;
+		}
+	}
+	return dirty;
+}
+
+uint16_t POT_get_value(const POT_bank_t * bank, uint8_t index)
+{
+	if (bank == NULL || index >= bank->count)
+	{
+		return 0;
+	}
+	return bank->channels[index].value;
+}
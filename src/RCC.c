@@ -77,6 +77,28 @@ typedef struct
 /* CSS - clock security system, when the HSE fails the chip wont be completly dead */
 #define CLK_CSS_ON (0x00080000)
 
+/* oscillator frequencies */
+#define HSI_FREQ (8000000U)
+#define HSE_FREQ (8000000U)
+
+/* CFGR fields for reading back the clock tree */
+#define CFGR_SWS_OFFSET		 (2)
+#define CFGR_SWS_MASK		 (0x3)
+#define CFGR_SWS_HSE		 (0x1)
+#define CFGR_SWS_PLL		 (0x2)
+#define CFGR_HPRE_OFFSET	 (4)
+#define CFGR_HPRE_MASK		 (0xF)
+#define CFGR_PPRE1_OFFSET	 (8)
+#define CFGR_PPRE2_OFFSET	 (11)
+#define CFGR_PPRE_MASK		 (0x7)
+#define CFGR_ADCPRE_OFFSET	 (14)
+#define CFGR_ADCPRE_MASK	 (0x3)
+#define CFGR_PLLSRC			 (0x00010000)
+#define CFGR_PLLXTPRE		 (0x00020000)
+#define CFGR_PLLMUL_OFFSET	 (18)
+#define CFGR_PLLMUL_MASK	 (0xF)
+#define CFGR_PLLMUL_MAX		 (16)
+
 /* The enum RCC_Peripherals_t is seperated to 3 32 entry long parts, each for clock domain */
 #define CLOCK_DOMAIN_PERIPH_COUNT 32
 #define AHB_INDEX				  0
@@ -121,7 +143,108 @@ void RCC_peripheral_reset(RCC_Peripherals_t periph)
 		reset_ptr = &(RCC->APB2RSTR);
 	}
 
+	/* the peripheral stays in reset while the bit is set, so release it right away */
 	*reset_ptr |= 1 << (periph % CLOCK_DOMAIN_PERIPH_COUNT);
+	*reset_ptr &= ~(1 << (periph % CLOCK_DOMAIN_PERIPH_COUNT));
+}
+
+/*
+? Clock frequency functions
+*/
+
+/**
+ * @brief This function returns the system clock frequency, from the current clock source
+ *
+ * @return uint32_t frequency in Hz
+ */
+static uint32_t get_system_freq()
+{
+	uint32_t cfgr	= RCC->CFGR;
+	uint32_t source = (cfgr >> CFGR_SWS_OFFSET) & CFGR_SWS_MASK;
+	uint32_t pll_in = 0, pll_mul = 0;
+	if (source == CFGR_SWS_HSE)
+	{
+		return HSE_FREQ;
+	}
+	if (source != CFGR_SWS_PLL)
+	{
+		return HSI_FREQ;
+	}
+	if (cfgr & CFGR_PLLSRC)
+	{
+		pll_in = (cfgr & CFGR_PLLXTPRE) ? HSE_FREQ / 2 : HSE_FREQ;
+	}
+	else
+	{
+		pll_in = HSI_FREQ / 2;
+	}
+	// PLLMUL is the multiplier - 2, the last values are all x16
+	pll_mul = ((cfgr >> CFGR_PLLMUL_OFFSET) & CFGR_PLLMUL_MASK) + 2;
+	if (pll_mul > CFGR_PLLMUL_MAX)
+	{
+		pll_mul = CFGR_PLLMUL_MAX;
+	}
+	return pll_in * pll_mul;
+}
+
+/**
+ * @brief This function translates an APB prescaler field to a shift
+ *
+ * @param ppre PPRE1 or PPRE2 value
+ * @return uint8_t how much the AHB frequency is shifted right
+ */
+static uint8_t get_apb_shift(uint32_t ppre)
+{
+	// 0xx is not divided, 100 is /2 up to 111 which is /16
+	return (ppre & 0x4) ? (ppre & 0x3) + 1 : 0;
+}
+
+uint32_t RCC_get_AHB_freq()
+{
+	// 0xxx is not divided, 1000 is /2 up to 1011 /16, then 1100 is /64 up to 1111 /512 (there is no /32)
+	static const uint8_t ahb_shift[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 6, 7, 8, 9 };
+	return get_system_freq() >> ahb_shift[(RCC->CFGR >> CFGR_HPRE_OFFSET) & CFGR_HPRE_MASK];
+}
+
+uint32_t RCC_get_APB1_freq()
+{
+	return RCC_get_AHB_freq() >> get_apb_shift((RCC->CFGR >> CFGR_PPRE1_OFFSET) & CFGR_PPRE_MASK);
+}
+
+uint32_t RCC_get_APB2_freq()
+{
+	return RCC_get_AHB_freq() >> get_apb_shift((RCC->CFGR >> CFGR_PPRE2_OFFSET) & CFGR_PPRE_MASK);
+}
+
+uint32_t RCC_get_peripheral_freq(RCC_Peripherals_t periph)
+{
+	uint32_t apb_shift = 0;
+	switch (periph)
+	{
+	case RCC_ADC1:
+	case RCC_ADC2:
+		// ADCPRE: /2, /4, /6, /8
+		return RCC_get_APB2_freq() / ((((RCC->CFGR >> CFGR_ADCPRE_OFFSET) & CFGR_ADCPRE_MASK) + 1) * 2);
+	case RCC_TIM1:
+		apb_shift = get_apb_shift((RCC->CFGR >> CFGR_PPRE2_OFFSET) & CFGR_PPRE_MASK);
+		return apb_shift ? RCC_get_APB2_freq() * 2 : RCC_get_APB2_freq();
+	case RCC_TIM2:
+	case RCC_TIM3:
+	case RCC_TIM4:
+		apb_shift = get_apb_shift((RCC->CFGR >> CFGR_PPRE1_OFFSET) & CFGR_PPRE_MASK);
+		return apb_shift ? RCC_get_APB1_freq() * 2 : RCC_get_APB1_freq();
+	default:
+		break;
+	}
+	if (periph < APB1_INDEX)
+	{
+		return RCC_get_AHB_freq();
+	}
+	else if (periph < APB2_INDEX)
+	{
+		return RCC_get_APB1_freq();
+	}
+	return RCC_get_APB2_freq();
 }
 
 /*
@@ -0,0 +1,621 @@
+#include "ROUTER.h"
+#include "USB_MIDI.h"
+#include "utils.h"
+
+#define NO_INPUT		  (0xFF)
+#define INPUT_QUEUE_MASK  (ROUTER_INPUT_QUEUE_SIZE - 1)
+/* a byte completes 2 events at most, the SysEx chunk it cuts and its own message */
+#define MAX_EVENTS_PER_BYTE (2)
+
+typedef struct
+{
+	MIDI_event_t event;
+	uint32_t	 timestamp; // CPU cycles when the event was parsed
+} ROUTER_entry_t;
+
+typedef struct
+{
+	ROUTER_source_t		 source;
+	bool				 has_source;
+	MIDI_parser_t		 parser;
+	ROUTER_entry_t		 queue[ROUTER_INPUT_QUEUE_SIZE];
+	uint16_t			 head;
+	uint16_t			 tail;
+	ROUTER_input_stats_t stats;
+} ROUTER_input_t;
+
+/*
+Each output has 2 buffers, one is written by the sink while the other is filled.
+The realtime bytes are copied right before the bulk bytes when the write starts, so they go out first
+*/
+typedef struct
+{
+	ROUTER_sink_t		  sink;
+	MIDI_serializer_t	  serializer;
+	uint8_t				  buffers[2][ROUTER_REALTIME_QUEUE_SIZE + ROUTER_TX_BUFFER_SIZE];
+	uint8_t				  fill;	  // which buffer is filled
+	uint16_t			  length; // bulk bytes in the filled buffer
+	uint8_t				  realtime[ROUTER_REALTIME_QUEUE_SIZE];
+	uint8_t				  realtime_count;
+	uint32_t			  oldest; // timestamp of the oldest waiting byte
+	bool				  waiting;
+	uint8_t				  sysex_owner; // input that is in the middle of a SysEx to this output, NO_INPUT if none
+	ROUTER_output_stats_t stats;
+} ROUTER_output_t;
+
+typedef struct
+{
+	uint8_t			input;
+	uint8_t			output;
+	ROUTER_filter_t filter;
+} ROUTER_route_t;
+
+static ROUTER_input_t  s_inputs[ROUTER_MAX_INPUTS];
+static ROUTER_output_t s_outputs[ROUTER_MAX_OUTPUTS];
+static ROUTER_route_t  s_routes[ROUTER_MAX_ROUTES];
+static uint8_t		   s_input_count  = 0;
+static uint8_t		   s_output_count = 0;
+static uint8_t		   s_route_count  = 0;
+static uint8_t		   s_next_input	  = 0; // the input that is routed first, rotates for fairness
+/* events of a single parsed byte */
+static MIDI_queue_t s_parsed;
+
+/*
+ ? UART adapters
+*/
+
+static uint16_t uart_read(uint8_t id, const uint8_t ** data)
+{
+	return UART_peek(id, data);
+}
+
+static void uart_consume(uint8_t id, uint16_t count)
+{
+	UART_consume(id, count);
+}
+
+static bool uart_write(uint8_t id, const uint8_t * data, uint16_t length)
+{
+	return UART_write(id, data, length);
+}
+
+static bool uart_busy(uint8_t id)
+{
+	return UART_is_busy(id);
+}
+
+/*
+ ? USB adapters, the class has a single cable so the id is not used
+*/
+
+static uint16_t usb_read(uint8_t id, const uint8_t ** data)
+{
+	return USB_MIDI_peek(data);
+}
+
+static void usb_consume(uint8_t id, uint16_t count)
+{
+	USB_MIDI_consume(count);
+}
+
+static bool usb_send(uint8_t id, const MIDI_event_t * event)
+{
+	return USB_MIDI_send(event);
+}
+
+static bool usb_busy(uint8_t id)
+{
+	return USB_MIDI_is_busy();
+}
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function returns the ROUTER_PASS_XX class of a message
+ *
+ * @param status status byte
+ * @return uint16_t message class
+ */
+static uint16_t get_class(uint8_t status)
+{
+	switch (MIDI_TYPE(status))
+	{
+	case MIDI_NOTE_OFF:
+	case MIDI_NOTE_ON:
+	case MIDI_POLY_PRESSURE:
+		return ROUTER_PASS_NOTES;
+	case MIDI_CONTROL_CHANGE:
+		return ROUTER_PASS_CONTROL;
+	case MIDI_PROGRAM_CHANGE:
+		return ROUTER_PASS_PROGRAM;
+	case MIDI_CHANNEL_PRESSURE:
+		return ROUTER_PASS_PRESSURE;
+	case MIDI_PITCH_BEND:
+		return ROUTER_PASS_PITCH_BEND;
+	case MIDI_SYSEX_START:
+		return ROUTER_PASS_SYSEX;
+	case MIDI_CLOCK:
+	case MIDI_START:
+	case MIDI_CONTINUE:
+	case MIDI_STOP:
+		return ROUTER_PASS_CLOCK;
+	case MIDI_ACTIVE_SENSING:
+	case MIDI_RESET:
+		return ROUTER_PASS_SENSING;
+	default:
+		return ROUTER_PASS_COMMON;
+	}
+}
+
+/**
+ * @brief This function checks if a message passes the filter of a route
+ *
+ * @param route the route
+ * @param status status byte of the message
+ * @return true the message passes
+ * @return false the message is filtered out
+ */
+static bool route_passes(const ROUTER_route_t * route, uint8_t status)
+{
+	if ((route->filter.types & get_class(status)) == 0)
+	{
+		return false;
+	}
+	return status >= MIDI_SYSEX_START || (route->filter.channels & (1 << MIDI_CHANNEL(status)));
+}
+
+/**
+ * @brief This function marks the time of the oldest waiting byte of an output
+ *
+ * @param output output object
+ * @param timestamp when the byte was received
+ */
+static void mark_waiting(ROUTER_output_t * output, uint32_t timestamp)
+{
+	if (!output->waiting)
+	{
+		output->oldest	= timestamp;
+		output->waiting = true;
+	}
+	output->stats.depth = output->length + output->realtime_count;
+	if (output->stats.depth > output->stats.max_depth)
+	{
+		output->stats.max_depth = output->stats.depth;
+	}
+}
+
+/**
+ * @brief This function counts an event handed to an event sink
+ *
+ * @param output output object
+ * @param event the event
+ * @param timestamp when the event was received
+ */
+static void count_sent(ROUTER_output_t * output, const MIDI_event_t * event, uint32_t timestamp)
+{
+	uint32_t latency		   = utils_get_cycles() - timestamp;
+	output->stats.last_latency = latency;
+	output->stats.max_latency  = latency > output->stats.max_latency ? latency : output->stats.max_latency;
+	// the bytes the event takes on a MIDI cable
+	output->stats.bytes += 1 + event->length;
+	if (event->status == MIDI_SYSEX_START)
+	{
+		output->stats.bytes += (event->flags & MIDI_FLAG_SYSEX_LAST) ? 1 : 0;
+		output->stats.bytes -= (event->flags & MIDI_FLAG_SYSEX_FIRST) ? 0 : 1;
+	}
+}
+
+/**
+ * @brief This function adds an event to the queue of an input
+ *
+ * @param input input object
+ * @param event the event
+ * @param timestamp when the event was received
+ * @return true event queued
+ * @return false the queue is full
+ */
+static bool push_entry(ROUTER_input_t * input, const MIDI_event_t * event, uint32_t timestamp)
+{
+	ROUTER_entry_t * entry = NULL;
+	if ((uint16_t)(input->head - input->tail) >= ROUTER_INPUT_QUEUE_SIZE)
+	{
+		return false;
+	}
+	entry			 = &input->queue[input->head & INPUT_QUEUE_MASK];
+	entry->event	 = *event;
+	entry->timestamp = timestamp;
+	input->head++;
+	input->stats.depth = input->head - input->tail;
+	if (input->stats.depth > input->stats.max_depth)
+	{
+		input->stats.max_depth = input->stats.depth;
+	}
+	return true;
+}
+
+/**
+ * @brief This function sends a realtime message to the realtime queues of the outputs of an input
+ *
+ * @param index input index
+ * @param status the realtime status
+ * @param timestamp when the message was received
+ */
+static void route_realtime(uint8_t index, uint8_t status, uint32_t timestamp)
+{
+	ROUTER_output_t * output = NULL;
+	MIDI_event_t	  event	 = { .status = status, .port = index };
+	for (size_t i = 0; i < s_route_count; i++)
+	{
+		if (s_routes[i].input != index || !route_passes(&s_routes[i], status))
+		{
+			continue;
+		}
+		output = &s_outputs[s_routes[i].output];
+		if (output->sink.send != NULL)
+		{
+			// an event sink has its own queue, the realtime message goes right away
+			if (output->sink.busy(output->sink.id) || !output->sink.send(output->sink.id, &event))
+			{
+				output->stats.realtime_dropped++;
+				continue;
+			}
+			count_sent(output, &event, timestamp);
+			continue;
+		}
+		if (output->realtime_count >= ROUTER_REALTIME_QUEUE_SIZE)
+		{
+			output->stats.realtime_dropped++;
+			continue;
+		}
+		output->realtime[output->realtime_count++] = status;
+		mark_waiting(output, timestamp);
+	}
+}
+
+/**
+ * @brief This function parses the waiting bytes of an input, as long as its queue has room
+ *
+ * @param index input index
+ */
+static void read_input(uint8_t index)
+{
+	ROUTER_input_t * input	= &s_inputs[index];
+	const uint8_t *	 data	= NULL;
+	uint16_t		 length = 0;
+	uint16_t		 parsed = 0;
+	uint32_t		 now	= 0;
+	MIDI_event_t	 event;
+	if (!input->has_source)
+	{
+		return;
+	}
+	length = input->source.read(input->source.id, &data);
+	now	   = utils_get_cycles();
+	while (parsed < length && ROUTER_INPUT_QUEUE_SIZE - (uint16_t)(input->head - input->tail) >= MAX_EVENTS_PER_BYTE)
+	{
+		MIDI_parse(&input->parser, &data[parsed++], 1, &s_parsed);
+		while (MIDI_queue_pop(&s_parsed, &event))
+		{
+			input->stats.events++;
+			if (MIDI_IS_REALTIME(event.status))
+			{
+				route_realtime(index, event.status, now);
+			}
+			else
+			{
+				push_entry(input, &event, now);
+			}
+		}
+	}
+	if (parsed != 0)
+	{
+		input->source.consume(input->source.id, parsed);
+	}
+	input->stats.stray_bytes = input->parser.stray_bytes;
+}
+
+/**
+ * @brief This function checks if all the outputs of an event can take it now
+ *
+ * @param index input index
+ * @param event the event
+ * @return true every output has room, and none is locked by a SysEx of another input
+ * @return false the event must wait
+ */
+static bool can_route(uint8_t index, const MIDI_event_t * event)
+{
+	ROUTER_output_t * output = NULL;
+	MIDI_serializer_t serializer;
+	uint8_t			  bytes[MIDI_MAX_EVENT_BYTES];
+	for (size_t i = 0; i < s_route_count; i++)
+	{
+		if (s_routes[i].input != index || !route_passes(&s_routes[i], event->status))
+		{
+			continue;
+		}
+		output = &s_outputs[s_routes[i].output];
+		if (output->sysex_owner != NO_INPUT && output->sysex_owner != index)
+		{
+			return false;
+		}
+		if (output->sink.send != NULL)
+		{
+			if (output->sink.busy(output->sink.id))
+			{
+				return false;
+			}
+			continue;
+		}
+		// serialize on a copy, the running status decides the size
+		serializer = output->serializer;
+		if (output->length + MIDI_serialize(&serializer, event, bytes) > ROUTER_TX_BUFFER_SIZE)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief This function routes the queued events of an input, until one has to wait
+ *
+ * @param index input index
+ */
+static void route_input(uint8_t index)
+{
+	ROUTER_input_t *	   input  = &s_inputs[index];
+	ROUTER_output_t *	   output = NULL;
+	const ROUTER_entry_t * entry  = NULL;
+	uint8_t *			   buffer = NULL;
+	while (input->tail != input->head)
+	{
+		entry = &input->queue[input->tail & INPUT_QUEUE_MASK];
+		if (!can_route(index, &entry->event))
+		{
+			return;
+		}
+		for (size_t i = 0; i < s_route_count; i++)
+		{
+			if (s_routes[i].input != index || !route_passes(&s_routes[i], entry->event.status))
+			{
+				continue;
+			}
+			output = &s_outputs[s_routes[i].output];
+			if (entry->event.status == MIDI_SYSEX_START)
+			{
+				output->sysex_owner = (entry->event.flags & MIDI_FLAG_SYSEX_LAST) ? NO_INPUT : index;
+			}
+			if (output->sink.send != NULL)
+			{
+				// not busy means the event fits
+				output->sink.send(output->sink.id, &entry->event);
+				count_sent(output, &entry->event, entry->timestamp);
+				continue;
+			}
+			buffer = &output->buffers[output->fill][ROUTER_REALTIME_QUEUE_SIZE];
+			output->length += MIDI_serialize(&output->serializer, &entry->event, &buffer[output->length]);
+			mark_waiting(output, entry->timestamp);
+		}
+		input->tail++;
+		input->stats.depth = input->head - input->tail;
+	}
+}
+
+/**
+ * @brief This function starts a write of the waiting bytes of an output, if the sink is free
+ *
+ * @param output output object
+ */
+static void flush_output(ROUTER_output_t * output)
+{
+	uint8_t * buffer  = output->buffers[output->fill];
+	uint8_t	  start	  = ROUTER_REALTIME_QUEUE_SIZE - output->realtime_count;
+	uint16_t  length  = output->realtime_count + output->length;
+	uint32_t  latency = 0;
+	if (length == 0 || output->sink.busy(output->sink.id))
+	{
+		return;
+	}
+	for (size_t i = 0; i < output->realtime_count; i++)
+	{
+		buffer[start + i] = output->realtime[i];
+	}
+	if (!output->sink.write(output->sink.id, &buffer[start], length))
+	{
+		return;
+	}
+	latency					   = utils_get_cycles() - output->oldest;
+	output->stats.last_latency = latency;
+	output->stats.max_latency  = latency > output->stats.max_latency ? latency : output->stats.max_latency;
+	output->stats.bytes += length;
+	output->stats.depth	   = 0;
+	output->fill		  ^= 1;
+	output->length		   = 0;
+	output->realtime_count = 0;
+	output->waiting		   = false;
+}
+
+/*
+ ? Public functions
+*/
+
+int8_t ROUTER_add_input(const ROUTER_source_t * source)
+{
+	ROUTER_input_t * input = NULL;
+	if (s_input_count >= ROUTER_MAX_INPUTS)
+	{
+		return -1;
+	}
+	input			  = &s_inputs[s_input_count];
+	input->has_source = source != NULL;
+	if (source != NULL)
+	{
+		input->source = *source;
+	}
+	input->head	 = 0;
+	input->tail	 = 0;
+	input->stats = (ROUTER_input_stats_t){ 0 };
+	MIDI_parser_init(&input->parser, s_input_count);
+	utils_cycle_counter_start();
+	return s_input_count++;
+}
+
+int8_t ROUTER_add_output(const ROUTER_sink_t * sink, bool zero_velocity_note_off)
+{
+	ROUTER_output_t * output = NULL;
+	if (sink == NULL || (sink->write == NULL && sink->send == NULL) || sink->busy == NULL || s_output_count >= ROUTER_MAX_OUTPUTS)
+	{
+		return -1;
+	}
+	output				   = &s_outputs[s_output_count];
+	output->sink		   = *sink;
+	output->fill		   = 0;
+	output->length		   = 0;
+	output->realtime_count = 0;
+	output->waiting		   = false;
+	output->sysex_owner	   = NO_INPUT;
+	output->stats		   = (ROUTER_output_stats_t){ 0 };
+	MIDI_serializer_init(&output->serializer, zero_velocity_note_off);
+	return s_output_count++;
+}
+
+bool ROUTER_add_uart(UART_t port, int8_t * input, int8_t * output)
+{
+	ROUTER_source_t source = { .read = uart_read, .consume = uart_consume, .id = port };
+	ROUTER_sink_t	sink   = { .write = uart_write, .send = NULL, .busy = uart_busy, .id = port };
+	if (input == NULL || output == NULL || port >= UART_COUNT)
+	{
+		return false;
+	}
+	if (s_input_count >= ROUTER_MAX_INPUTS || s_output_count >= ROUTER_MAX_OUTPUTS)
+	{
+		return false;
+	}
+	*input	= ROUTER_add_input(&source);
+	*output = ROUTER_add_output(&sink, false);
+	return true;
+}
+
+bool ROUTER_add_usb(int8_t * input, int8_t * output)
+{
+	ROUTER_source_t source = { .read = usb_read, .consume = usb_consume, .id = USB_MIDI_CABLE };
+	ROUTER_sink_t	sink   = { .write = NULL, .send = usb_send, .busy = usb_busy, .id = USB_MIDI_CABLE };
+	if (input == NULL || output == NULL)
+	{
+		return false;
+	}
+	if (s_input_count >= ROUTER_MAX_INPUTS || s_output_count >= ROUTER_MAX_OUTPUTS)
+	{
+		return false;
+	}
+	*input	= ROUTER_add_input(&source);
+	*output = ROUTER_add_output(&sink, false);
+	return true;
+}
+
+bool ROUTER_add_route(uint8_t input, uint8_t output, const ROUTER_filter_t * filter)
+{
+	ROUTER_route_t * route = NULL;
+	if (input >= s_input_count || output >= s_output_count)
+	{
+		return false;
+	}
+	// routing an input twice to an output replaces the filter, the output gets each message once
+	for (size_t i = 0; i < s_route_count && route == NULL; i++)
+	{
+		if (s_routes[i].input == input && s_routes[i].output == output)
+		{
+			route = &s_routes[i];
+		}
+	}
+	if (route == NULL)
+	{
+		if (s_route_count >= ROUTER_MAX_ROUTES)
+		{
+			return false;
+		}
+		route = &s_routes[s_route_count++];
+	}
+	route->input  = input;
+	route->output = output;
+	route->filter = filter != NULL ? *filter : (ROUTER_filter_t){ .channels = ROUTER_ALL_CHANNELS, .types = ROUTER_PASS_ALL };
+	return true;
+}
+
+void ROUTER_clear_routes()
+{
+	s_route_count = 0;
+	for (size_t i = 0; i < s_output_count; i++)
+	{
+		s_outputs[i].sysex_owner = NO_INPUT;
+	}
+}
+
+bool ROUTER_inject(uint8_t input, const MIDI_event_t * event)
+{
+	uint32_t now = utils_get_cycles();
+	if (input >= s_input_count || event == NULL || !MIDI_IS_STATUS(event->status))
+	{
+		return false;
+	}
+	s_inputs[input].stats.events++;
+	if (MIDI_IS_REALTIME(event->status))
+	{
+		route_realtime(input, event->status, now);
+		return true;
+	}
+	if (!push_entry(&s_inputs[input], event, now))
+	{
+		s_inputs[input].stats.dropped++;
+		return false;
+	}
+	return true;
+}
+
+void ROUTER_poll()
+{
+	uint8_t index = 0;
+	for (size_t i = 0; i < s_input_count; i++)
+	{
+		read_input(i);
+	}
+	for (size_t i = 0; i < s_input_count; i++)
+	{
+		index = (s_next_input + i) % s_input_count;
+		route_input(index);
+	}
+	s_next_input = s_input_count != 0 ? (s_next_input + 1) % s_input_count : 0;
+	for (size_t i = 0; i < s_output_count; i++)
+	{
+		flush_output(&s_outputs[i]);
+	}
+}
+
+void ROUTER_get_input_stats(uint8_t input, ROUTER_input_stats_t * stats)
+{
+	if (input >= s_input_count || stats == NULL)
+	{
+		return;
+	}
+	*stats = s_inputs[input].stats;
+}
+
+void ROUTER_get_output_stats(uint8_t output, ROUTER_output_stats_t * stats)
+{
+	if (output >= s_output_count || stats == NULL)
+	{
+		return;
+	}
+	*stats = s_outputs[output].stats;
+}
+
+void ROUTER_startup()
+{
+	s_input_count  = 0;
+	s_output_count = 0;
+	s_route_count  = 0;
+	s_next_input   = 0;
+	MIDI_queue_init(&s_parsed);
+}
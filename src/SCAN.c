@@ -0,0 +1,446 @@
+#include "SCAN.h"
+#include "DMA.h"
+#include "RCC.h"
+
+#define NS_PER_SECOND (1000000000ULL)
+#define PER_MILLE	  (1000)
+
+static pSCAN_plan_t	   s_plan		   = NULL;
+static TIM_t		   s_timer		   = TIM_COUNT;
+static SCAN_callback_t s_callback	   = NULL;
+static bool			   s_adc_owned	   = false;
+static bool			   s_frame_started = false;
+static uint8_t		   s_frame		   = 0;
+static uint32_t		   s_overruns	   = 0;
+static uint16_t		   s_output[MAX_SEQUENCE];
+static uint16_t		   s_values[SCAN_MAX_REQUESTS];
+
+/* adaptive scan state, the plans are double buffered so the running one is never rewritten */
+static bool					  s_adaptive = false;
+static SCAN_adaptive_config_t s_adaptive_config;
+static SCAN_request_t		  s_adaptive_requests[SCAN_MAX_REQUESTS];
+static uint8_t				  s_adaptive_count = 0;
+static uint16_t				  s_references[SCAN_MAX_REQUESTS];
+static uint16_t				  s_idle_counts[SCAN_MAX_REQUESTS];
+static uint32_t				  s_moving		= 0;
+static uint32_t				  s_primed		= 0; // requests that have a resting value
+static SCAN_plan_t			  s_plans[2];
+static uint8_t				  s_active_plan = 0;
+
+/*
+ ? Planning functions
+*/
+
+/**
+ * @brief This function returns the largest power of 2 that is not above the value
+ *
+ * @param value value, not 0
+ * @return uint32_t power of 2
+ */
+static uint32_t floor_power_of_2(uint32_t value)
+{
+	uint32_t power = 1;
+	while (power <= value / 2)
+	{
+		power *= 2;
+	}
+	return power;
+}
+
+/**
+ * @brief This function finds the phase that keeps the frames of a request the least loaded
+ *
+ * @param loads conversion cycles already placed in each frame
+ * @param slots conversions already placed in each frame
+ * @param frame_count rotation length
+ * @param period period of the request
+ * @return int16_t best phase, -1 if every phase has a full frame
+ */
+static int16_t find_best_phase(const uint32_t * loads, const uint8_t * slots, uint8_t frame_count, uint8_t period)
+{
+	int16_t	 best_phase = -1;
+	uint32_t best_load	= 0;
+	uint32_t phase_load = 0;
+	bool	 full		= false;
+	for (uint8_t phase = 0; phase < period; phase++)
+	{
+		phase_load = 0;
+		full	   = false;
+		for (uint8_t frame = phase; frame < frame_count; frame += period)
+		{
+			full |= slots[frame] >= MAX_SEQUENCE;
+			phase_load = loads[frame] > phase_load ? loads[frame] : phase_load;
+		}
+		if (!full && (best_phase < 0 || phase_load < best_load))
+		{
+			best_phase = phase;
+			best_load  = phase_load;
+		}
+	}
+	return best_phase;
+}
+
+SCAN_ERR_t SCAN_plan(pSCAN_plan_t plan, const SCAN_request_t * requests, uint8_t count)
+{
+	uint32_t			loads[SCAN_MAX_FRAMES] = { 0 };
+	uint8_t				slots[SCAN_MAX_FRAMES] = { 0 };
+	uint8_t				channels[MAX_SEQUENCE];
+	ADC_SAMPLING_TIME_t sampling_times[MAX_SEQUENCE];
+	uint32_t			adc_freq = RCC_get_peripheral_freq(RCC_ADC1);
+	uint16_t			max_rate = 0;
+	int16_t				phase	 = 0;
+	uint8_t				slot	 = 0;
+	uint64_t			load	 = 0;
+	uint32_t			used	 = 0; // bitmap of the requested channels
+	uint32_t			ratio	 = 0;
+	if (plan == NULL || requests == NULL)
+	{
+		return SCAN_NULL;
+	}
+	if (count == 0 || count > SCAN_MAX_REQUESTS)
+	{
+		return SCAN_INVALID_REQUEST;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		if (requests[i].rate == 0 || requests[i].channel > MAX_CHANNEL || requests[i].sampling_time > ADC_SAMPLING_239_5 ||
+			(used & ((uint32_t)1 << requests[i].channel)) != 0)
+		{
+			return SCAN_INVALID_REQUEST;
+		}
+		used |= (uint32_t)1 << requests[i].channel;
+		max_rate = requests[i].rate > max_rate ? requests[i].rate : max_rate;
+	}
+	plan->frame_rate	= max_rate;
+	plan->frame_count	= 1;
+	plan->request_count = count;
+	for (size_t i = 0; i < count; i++)
+	{
+		// rounding the period down rounds the rate up, the requested rate is a minimum
+		// clamp before storing, a ratio of 256 or more would truncate to 0 in the uint8_t period
+		ratio					= floor_power_of_2(max_rate / requests[i].rate);
+		plan->periods[i]		= ratio < SCAN_MAX_FRAMES ? ratio : SCAN_MAX_FRAMES;
+		plan->achieved_rates[i] = max_rate / plan->periods[i];
+		plan->frame_count		= plan->periods[i] > plan->frame_count ? plan->periods[i] : plan->frame_count;
+	}
+
+	// place the fast channels first, they have the least freedom
+	for (uint8_t period = 1; period <= plan->frame_count; period *= 2)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (plan->periods[i] != period)
+			{
+				continue;
+			}
+			phase = find_best_phase(loads, slots, plan->frame_count, period);
+			if (phase < 0)
+			{
+				return SCAN_TOO_MANY_SLOTS;
+			}
+			plan->phases[i] = phase;
+			for (uint8_t frame = phase; frame < plan->frame_count; frame += period)
+			{
+				loads[frame] += ADC_get_conversion_cycles(requests[i].sampling_time);
+				slots[frame]++;
+			}
+		}
+	}
+
+	// build the frame profiles, the slots keep the request order
+	plan->max_conversion_cycles = 0;
+	for (uint8_t frame = 0; frame < plan->frame_count; frame++)
+	{
+		slot = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if ((frame % plan->periods[i]) != plan->phases[i])
+			{
+				continue;
+			}
+			channels[slot]					  = requests[i].channel;
+			sampling_times[slot]			  = requests[i].sampling_time;
+			plan->frame_requests[frame][slot] = i;
+			slot++;
+		}
+		if (ADC_profile_build(&plan->frames[frame], channels, sampling_times, slot) == false)
+		{
+			return SCAN_INVALID_REQUEST;
+		}
+		if (plan->frames[frame].conversion_cycles > plan->max_conversion_cycles)
+		{
+			plan->max_conversion_cycles = plan->frames[frame].conversion_cycles;
+		}
+	}
+	plan->max_conversion_time_ns = (plan->max_conversion_cycles * NS_PER_SECOND) / adc_freq;
+	load						 = ((uint64_t)plan->max_conversion_cycles * max_rate * PER_MILLE) / adc_freq;
+	plan->load					 = load > UINT16_MAX ? UINT16_MAX : load;
+	if (load > PER_MILLE)
+	{
+		return SCAN_NO_BANDWIDTH;
+	}
+	return SCAN_NO_ERR;
+}
+
+/*
+ ? Runtime functions
+*/
+
+/**
+ * @brief This function plans the adaptive scan for a set of moving channels into the inactive plan
+ *
+ * @param moving bitmap of the moving requests
+ * @return SCAN_ERR_t errors if any
+ */
+static SCAN_ERR_t plan_adaptive(uint32_t moving)
+{
+	SCAN_request_t requests[SCAN_MAX_REQUESTS];
+	for (size_t i = 0; i < s_adaptive_count; i++)
+	{
+		requests[i] = s_adaptive_requests[i];
+		if ((moving & ((uint32_t)1 << i)) == 0 && s_adaptive_config.background_rate < requests[i].rate)
+		{
+			requests[i].rate = s_adaptive_config.background_rate;
+		}
+	}
+	return SCAN_plan(&s_plans[s_active_plan ^ 1], requests, s_adaptive_count);
+}
+
+/**
+ * @brief This function tracks the activity of the updated channels
+ *
+ * @param updated which requests got a new value
+ * @return uint32_t the new moving bitmap
+ */
+static uint32_t track_activity(uint32_t updated)
+{
+	uint32_t moving = s_moving;
+	uint32_t mask	= 0;
+	int32_t	 delta	= 0;
+	for (size_t i = 0; i < s_adaptive_count; i++)
+	{
+		mask = (uint32_t)1 << i;
+		if ((updated & mask) == 0)
+		{
+			continue;
+		}
+		if ((s_primed & mask) == 0)
+		{
+			// the first sample is the resting value
+			s_references[i] = s_values[i];
+			s_primed |= mask;
+			continue;
+		}
+		delta = (int32_t)s_values[i] - s_references[i];
+		if (delta > s_adaptive_config.threshold || -delta > s_adaptive_config.threshold)
+		{
+			s_references[i]	 = s_values[i];
+			s_idle_counts[i] = 0;
+			moving |= mask;
+		}
+		else if ((moving & mask) != 0 && ++s_idle_counts[i] >= s_adaptive_config.idle_samples)
+		{
+			moving &= ~mask;
+		}
+	}
+	return moving;
+}
+
+/**
+ * @brief This function switches to a new moving set, keeps the old plan if the new one can't be planned
+ *
+ * @param moving bitmap of the moving requests
+ */
+static void replan(uint32_t moving)
+{
+	if (plan_adaptive(moving) != SCAN_NO_ERR)
+	{
+		return; // retried on the next change
+	}
+	s_active_plan ^= 1;
+	s_plan	 = &s_plans[s_active_plan];
+	s_frame	 = 0;
+	s_moving = moving;
+	if (s_plan->frame_rate != TIM_get_frequency(s_timer))
+	{
+		TIM_init(s_timer, s_plan->frame_rate);
+		TIM_start(s_timer);
+	}
+}
+
+/**
+ * @brief This function is called on every frame period, it collects the last frame and starts the next one
+ *
+ * @param timer the frame timer
+ */
+static void frame_tick(TIM_t timer)
+{
+	uint32_t		updated	 = 0;
+	uint32_t		moving	 = 0;
+	const uint8_t * requests = NULL;
+	if (s_frame_started)
+	{
+		if (!DMA_channel_get_flag(DMA_CH1_ADC1, DMA_FLAG_FINISHED))
+		{
+			// let the frame finish, it is collected on the next tick
+			s_overruns++;
+			return;
+		}
+		requests = s_plan->frame_requests[s_frame];
+		for (size_t i = 0; i < s_plan->frames[s_frame].count_channels; i++)
+		{
+			s_values[requests[i]] = s_output[i];
+			updated |= (uint32_t)1 << requests[i];
+		}
+		// the frame count is a power of 2
+		s_frame = (s_frame + 1) & (s_plan->frame_count - 1);
+		if (s_adaptive)
+		{
+			moving = track_activity(updated);
+			if (moving != s_moving)
+			{
+				replan(moving);
+			}
+		}
+	}
+	ADC_profile_apply(&s_plan->frames[s_frame]);
+	ADC_start(ADC_mode_single, s_plan->frames[s_frame].count_channels);
+	s_frame_started = true;
+	if (updated != 0 && s_callback != NULL)
+	{
+		s_callback(s_values, updated);
+	}
+}
+
+SCAN_ERR_t SCAN_start(pSCAN_plan_t plan, TIM_t timer, SCAN_callback_t callback)
+{
+	if (plan == NULL)
+	{
+		return SCAN_NULL;
+	}
+	if (plan->frame_count == 0 || plan->frame_count > SCAN_MAX_FRAMES || timer >= TIM_COUNT)
+	{
+		return SCAN_INVALID_REQUEST;
+	}
+	if (!s_adc_owned)
+	{
+		// the ADC can be initialized once, the scanner keeps it between plans
+		if (ADC_init(plan->frames[0].channels, plan->frames[0].count_channels, s_output) == false)
+		{
+			return SCAN_ADC_BUSY;
+		}
+		s_adc_owned = true;
+	}
+	SCAN_stop();
+	s_adaptive = false;
+	for (size_t i = 0; i < SCAN_MAX_REQUESTS; i++)
+	{
+		s_values[i] = 0;
+	}
+	s_plan			= plan;
+	s_timer			= timer;
+	s_callback		= callback;
+	s_frame			= 0;
+	s_frame_started = false;
+	s_overruns		= 0;
+	if (TIM_init(timer, plan->frame_rate) == false)
+	{
+		return SCAN_INVALID_REQUEST;
+	}
+	TIM_set_callback(timer, frame_tick);
+	TIM_start(timer);
+	return SCAN_NO_ERR;
+}
+
+SCAN_ERR_t SCAN_start_adaptive(const SCAN_request_t * requests, uint8_t count, const SCAN_adaptive_config_t * config,
+							   TIM_t timer, SCAN_callback_t callback)
+{
+	SCAN_ERR_t error = SCAN_NO_ERR;
+	if (requests == NULL || config == NULL)
+	{
+		return SCAN_NULL;
+	}
+	if (count == 0 || count > SCAN_MAX_REQUESTS || config->background_rate == 0)
+	{
+		return SCAN_INVALID_REQUEST;
+	}
+	SCAN_stop();
+	s_adaptive_config = *config;
+	s_adaptive_count  = count;
+	for (size_t i = 0; i < count; i++)
+	{
+		s_adaptive_requests[i] = requests[i];
+		s_references[i]		   = 0;
+		s_idle_counts[i]	   = 0;
+	}
+	// the plan with every channel moving must fit, so the worst case is known upfront
+	s_active_plan = 0;
+	error		  = plan_adaptive(~(uint32_t)0);
+	if (error != SCAN_NO_ERR)
+	{
+		return error;
+	}
+	s_active_plan = 1;
+	error		  = plan_adaptive(0);
+	if (error != SCAN_NO_ERR)
+	{
+		return error;
+	}
+	s_active_plan = 0;
+	s_moving	  = 0;
+	s_primed	  = 0;
+	error		  = SCAN_start(&s_plans[0], timer, callback);
+	s_adaptive	  = error == SCAN_NO_ERR;
+	return error;
+}
+
+uint32_t SCAN_get_moving()
+{
+	return s_moving;
+}
+
+void SCAN_stop()
+{
+	if (s_timer >= TIM_COUNT)
+	{
+		return;
+	}
+	TIM_stop(s_timer);
+	TIM_set_callback(s_timer, NULL);
+	ADC_stop();
+	s_timer = TIM_COUNT;
+}
+
+uint16_t SCAN_get_value(uint8_t index)
+{
+	if (index >= SCAN_MAX_REQUESTS)
+	{
+		return 0;
+	}
+	return s_values[index];
+}
+
+uint32_t SCAN_get_overruns()
+{
+	return s_overruns;
+}
+
+void SCAN_startup()
+{
+	s_plan			 = NULL;
+	s_timer			 = TIM_COUNT;
+	s_callback		 = NULL;
+	s_adc_owned		 = false;
+	s_frame_started	 = false;
+	s_frame			 = 0;
+	s_overruns		 = 0;
+	s_adaptive		 = false;
+	s_adaptive_count = 0;
+	s_moving		 = 0;
+	s_primed		 = 0;
+	s_active_plan	 = 0;
+	for (size_t i = 0; i < SCAN_MAX_REQUESTS; i++)
+	{
+		s_values[i] = 0;
+	}
+}
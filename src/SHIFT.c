@@ -0,0 +1,289 @@
+#include "SHIFT.h"
+#include "DMA.h"
+#include "RCC.h"
+
+/* a byte is written on the update, the latch compare comes after its 8 bits and a bit for the DMA latency */
+#define LATCH_BITS (9)
+/* and the next update comes a bit after the latch */
+#define SLOT_BITS (LATCH_BITS + 1)
+
+static GPIO_PIN_ARRAY_t	 s_latch_pins;
+static GPIO_PIN_ARRAY_t	 s_load_pins;
+static bool				 s_initialized = false;
+static bool				 s_running	   = false;
+static SPI_t			 s_port		   = SPI_COUNT;
+static TIM_t			 s_timer	   = TIM_COUNT;
+static TIM_DMA_REQUEST_t s_latch_request = TIM_DMA_CC1;
+static DMA_CHANNELS_t	 s_byte_dma		 = DMA_CH_COUNT;
+static DMA_CHANNELS_t	 s_latch_dma	 = DMA_CH_COUNT;
+static uint8_t			 s_slots		 = 0;
+/*
+The update at the end of slot k writes s_tx[k], which is shifted in slot k + 1, the first slot after the start is empty.
+The compare of slot k writes s_latch_words[k]: the latch is in the slot of the last byte and the release in the slot of
+the extra byte, which nobody keeps
+*/
+static uint8_t	s_tx[SHIFT_MAX_BYTES + 1];
+static uint8_t	s_rx[SHIFT_MAX_BYTES + 1];
+static uint32_t s_latch_words[SHIFT_MAX_BYTES + 1];
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function converts a number of SPI bits to timer ticks, rounded up
+ *
+ * @param bits how many bits
+ * @param spi_freq SPI clock
+ * @param tick_freq timer tick frequency
+ * @return uint32_t ticks
+ */
+static uint32_t bits_to_ticks(uint32_t bits, uint32_t spi_freq, uint32_t tick_freq)
+{
+	return ((uint64_t)bits * tick_freq + spi_freq - 1) / spi_freq;
+}
+
+/**
+ * @brief This function sets up the slot timer, a slot per byte and the extra slot
+ *
+ * @param config chains config
+ * @return SHIFT_ERR_t errors if any
+ */
+static SHIFT_ERR_t setup_timer(const SHIFT_config_t * config)
+{
+	uint32_t spi_freq  = SPI_get_frequency(config->port);
+	uint32_t tick_freq = 0;
+	uint32_t period	   = 0;
+	if (TIM_init(config->timer, (uint32_t)config->refresh_rate * s_slots) == false)
+	{
+		return SHIFT_TOO_FAST;
+	}
+	tick_freq = TIM_get_tick_frequency(config->timer);
+	period	  = tick_freq / TIM_get_frequency(config->timer);
+	if (period < bits_to_ticks(SLOT_BITS, spi_freq, tick_freq))
+	{
+		return SHIFT_TOO_FAST;
+	}
+	return SHIFT_NO_ERR;
+}
+
+/**
+ * @brief This function sets up the DMA of the update, from the LED bytes to the SPI data register
+ *
+ * @return true DMA is ready
+ * @return false the DMA channel is reserved
+ */
+static bool setup_byte_dma()
+{
+	DMA_address_t periph = { .access_size = DMA_ACCESS_8BIT, .address = (uint32_t *)SPI_get_data_register(s_port), .increament_address = false };
+	DMA_address_t memory = { .access_size = DMA_ACCESS_8BIT, .address = s_tx, .increament_address = true };
+	s_byte_dma			 = TIM_get_dma_channel(s_timer, TIM_DMA_UPDATE);
+	if (DMA_init_channel(s_byte_dma, &periph, &memory, DMA_CH_PRIORITY_VERY_HIGH, DMA_DIRECTION_MEM_TO_PERIPH, 0) == false)
+	{
+		return false;
+	}
+	DMA_set_circular(s_byte_dma, true);
+	return true;
+}
+
+/**
+ * @brief This function sets up the DMA of a compare, from the latch words to the pins, on the first compare channel with a free DMA channel
+ *
+ * @param compare compare value, the latch time in the slot
+ * @return true DMA is ready
+ * @return false all the DMA channels of the compares are reserved
+ */
+static bool setup_latch_dma(uint16_t compare)
+{
+	DMA_address_t periph = { .access_size = DMA_ACCESS_32BIT, .address = (uint32_t *)GPIO_array_get_bsrr(&s_latch_pins), .increament_address = false };
+	DMA_address_t memory = { .access_size = DMA_ACCESS_32BIT, .address = s_latch_words, .increament_address = true };
+	for (size_t i = 0; i < TIM_CHANNEL_COUNT; i++)
+	{
+		s_latch_request = TIM_DMA_CC1 + i;
+		s_latch_dma		= TIM_get_dma_channel(s_timer, s_latch_request);
+		if (s_latch_dma == DMA_CH_COUNT || s_latch_dma == s_byte_dma)
+		{
+			continue;
+		}
+		if (DMA_init_channel(s_latch_dma, &periph, &memory, DMA_CH_PRIORITY_VERY_HIGH, DMA_DIRECTION_MEM_TO_PERIPH, 0))
+		{
+			DMA_set_circular(s_latch_dma, true);
+			TIM_set_compare(s_timer, i, compare);
+			return true;
+		}
+	}
+	s_latch_dma = DMA_CH_COUNT;
+	return false;
+}
+
+/**
+ * @brief This function releases the latch and load pins, when the init fails after reserving them
+ *
+ */
+static void release_pins()
+{
+	GPIO_array_de_init(&s_latch_pins);
+	GPIO_array_de_init(&s_load_pins);
+}
+
+/**
+ * @brief This function starts a frame from the first byte
+ *
+ */
+static void start_refresh()
+{
+	// the pins start released, the compare of the first slot writes the release word again
+	*GPIO_array_get_bsrr(&s_latch_pins) = s_latch_words[0];
+	SPI_start_stream(s_port, s_rx, s_slots);
+	DMA_stop_channel(s_byte_dma);
+	DMA_channel_clear_flags(s_byte_dma);
+	DMA_start_channel(s_byte_dma, s_slots, false);
+	DMA_stop_channel(s_latch_dma);
+	DMA_channel_clear_flags(s_latch_dma);
+	DMA_start_channel(s_latch_dma, s_slots, false);
+	TIM_reload(s_timer);
+	TIM_set_dma_request(s_timer, TIM_DMA_UPDATE, true);
+	TIM_set_dma_request(s_timer, s_latch_request, true);
+	TIM_start(s_timer);
+	s_running = true;
+}
+
+/*
+ ? Public functions
+*/
+
+SHIFT_ERR_t SHIFT_init(const SHIFT_config_t * config)
+{
+	SHIFT_ERR_t error		= SHIFT_NO_ERR;
+	uint8_t		frame_bytes = 0;
+	if (config == NULL)
+	{
+		return SHIFT_NULL;
+	}
+	if (s_initialized)
+	{
+		return SHIFT_ALREADY_INIT;
+	}
+	frame_bytes = config->frame_bytes;
+	if (frame_bytes == 0 || frame_bytes > SHIFT_MAX_BYTES || config->refresh_rate == 0 || config->timer >= TIM_COUNT ||
+		config->latch_pin > GPIO_MAX_PIN || config->load_pin > GPIO_MAX_PIN || config->latch_pin == config->load_pin)
+	{
+		return SHIFT_INVALID_CONFIG;
+	}
+	// the 74HC595 takes the data on the rising edge, and the 74HC165 shifts on it after the port sampled
+	if (SPI_init(config->port, config->spi_frequency, SPI_MODE_0, false) != SPI_NO_ERR)
+	{
+		return SHIFT_SPI_ERROR;
+	}
+	s_port	= config->port;
+	s_timer = config->timer;
+	s_slots = frame_bytes + 1;
+	error	= setup_timer(config);
+	if (error != SHIFT_NO_ERR)
+	{
+		SPI_de_init(s_port);
+		return error;
+	}
+	if (GPIO_array_init(&s_latch_pins, config->latch_port, config->latch_pin, config->latch_pin, GPIO_MODE_OUTPUT_50Mhz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		SPI_de_init(s_port);
+		return SHIFT_PINS_RESERVED;
+	}
+	if (GPIO_array_init(&s_load_pins, config->latch_port, config->load_pin, config->load_pin, GPIO_MODE_OUTPUT_50Mhz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		GPIO_array_de_init(&s_latch_pins);
+		SPI_de_init(s_port);
+		return SHIFT_PINS_RESERVED;
+	}
+	RCC_peripheral_set_clock(RCC_DMA1, true);
+	if (setup_byte_dma() == false)
+	{
+		release_pins();
+		SPI_de_init(s_port);
+		return SHIFT_DMA_BUSY;
+	}
+	if (setup_latch_dma(bits_to_ticks(LATCH_BITS, SPI_get_frequency(s_port), TIM_get_tick_frequency(s_timer))) == false)
+	{
+		DMA_de_init_channel(s_byte_dma);
+		release_pins();
+		SPI_de_init(s_port);
+		return SHIFT_DMA_BUSY;
+	}
+	// both pins are on one port, so a single word moves both
+	for (size_t i = 0; i < s_slots; i++)
+	{
+		s_tx[i]			 = 0;
+		s_rx[i]			 = 0;
+		s_latch_words[i] = 0;
+	}
+	s_latch_words[frame_bytes] = GPIO_array_get_bsrr_value(&s_latch_pins, 1) | GPIO_array_get_bsrr_value(&s_load_pins, 0);
+	s_latch_words[0]		   = GPIO_array_get_bsrr_value(&s_latch_pins, 0) | GPIO_array_get_bsrr_value(&s_load_pins, 1);
+	s_initialized			   = true;
+	start_refresh();
+	return SHIFT_NO_ERR;
+}
+
+uint8_t * SHIFT_get_leds()
+{
+	if (!s_initialized)
+	{
+		return NULL;
+	}
+	return s_tx;
+}
+
+const uint8_t * SHIFT_get_buttons()
+{
+	if (!s_initialized)
+	{
+		return NULL;
+	}
+	return s_rx;
+}
+
+uint32_t SHIFT_get_refresh_rate()
+{
+	if (!s_running)
+	{
+		return 0;
+	}
+	return TIM_get_frequency(s_timer) / s_slots;
+}
+
+void SHIFT_start()
+{
+	if (!s_initialized || s_running)
+	{
+		return;
+	}
+	start_refresh();
+}
+
+void SHIFT_stop()
+{
+	if (!s_running)
+	{
+		return;
+	}
+	TIM_stop(s_timer);
+	TIM_set_dma_request(s_timer, TIM_DMA_UPDATE, false);
+	TIM_set_dma_request(s_timer, s_latch_request, false);
+	DMA_stop_channel(s_byte_dma);
+	DMA_stop_channel(s_latch_dma);
+	SPI_stop_stream(s_port);
+	s_running = false;
+}
+
+void SHIFT_startup()
+{
+	s_initialized	= false;
+	s_running		= false;
+	s_port			= SPI_COUNT;
+	s_timer			= TIM_COUNT;
+	s_latch_request = TIM_DMA_CC1;
+	s_byte_dma		= DMA_CH_COUNT;
+	s_latch_dma		= DMA_CH_COUNT;
+	s_slots			= 0;
+}
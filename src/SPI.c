@@ -0,0 +1,436 @@
+#include "SPI.h"
+#include "DMA.h"
+#include "GPIO.h"
+#include "RCC.h"
+
+typedef struct
+{
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t SR;
+	__IO uint32_t DR;
+	__IO uint32_t CRCPR;
+	__IO uint32_t RXCRCR;
+	__IO uint32_t TXCRCR;
+	__IO uint32_t I2SCFGR;
+	__IO uint32_t I2SPR;
+} SPI_TypeDef;
+
+#define SPI1_BASE (APB2PERIPH_BASE + 0x00003000U)
+#define SPI2_BASE (APB1PERIPH_BASE + 0x00003800U)
+
+#define SPI_CR1_CPHA	 (0)
+#define SPI_CR1_MSTR	 (2)
+#define SPI_CR1_BR		 (3)
+#define SPI_CR1_SPE		 (6)
+#define SPI_CR1_LSBFIRST (7)
+#define SPI_CR1_SSI		 (8)
+#define SPI_CR1_SSM		 (9)
+#define SPI_CR2_RXDMAEN	 (0)
+#define SPI_CR2_TXDMAEN	 (1)
+#define SPI_SR_BSY		 (7)
+
+/* the clock is the bus clock divided by 2 << BR */
+#define SPI_MAX_BR (7)
+
+typedef enum
+{
+	SPI_IDLE,
+	SPI_TRANSFER,
+	SPI_STREAM
+} SPI_STATE_t;
+
+typedef struct
+{
+	SPI_callback_t		 callback;
+	uint32_t			 frequency;
+	volatile SPI_STATE_t state;
+	bool				 receiving; // the transfer ends on the RX DMA, else on the TX DMA
+	bool				 init;
+} SPI_port_t;
+
+static const SPI_TypeDef * const s_spis[SPI_COUNT] = {
+	(SPI_TypeDef *)SPI1_BASE,
+	(SPI_TypeDef *)SPI2_BASE,
+};
+
+static const RCC_Peripherals_t s_clocks[SPI_COUNT]	  = { RCC_SPI1, RCC_SPI2 };
+static const DMA_CHANNELS_t	   s_tx_dma[SPI_COUNT]	  = { DMA_CH3_SPI1_TX, DMA_CH5_SPI2_TX };
+static const DMA_CHANNELS_t	   s_rx_dma[SPI_COUNT]	  = { DMA_CH2_SPI1_RX, DMA_CH4_SPI2_RX };
+static const GPIO_PORT_t	   s_pin_ports[SPI_COUNT] = { GPIO_PORT_A, GPIO_PORT_B };
+/* MISO and MOSI are the 2 pins after SCK on both ports */
+static const uint8_t s_sck_pins[SPI_COUNT] = { 5, 13 };
+
+static GPIO_PIN_ARRAY_t s_sck_pin_arrays[SPI_COUNT];
+static GPIO_PIN_ARRAY_t s_miso_pin_arrays[SPI_COUNT];
+static GPIO_PIN_ARRAY_t s_mosi_pin_arrays[SPI_COUNT];
+static SPI_port_t		s_ports[SPI_COUNT];
+/* sent while only receiving, MOSI stays high like an idle line */
+static const uint8_t s_fill = SPI_FILL_BYTE;
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief Get the SPI registers
+ *
+ * @param port which port
+ * @return SPI_TypeDef* registers
+ */
+static SPI_TypeDef * get_spi(SPI_t port)
+{
+	return (SPI_TypeDef *)s_spis[port];
+}
+
+/**
+ * @brief This function returns the smallest prescaler that keeps the clock of a port at most at a frequency
+ *
+ * @param port which port
+ * @param max_frequency max clock
+ * @return uint8_t BR value, above SPI_MAX_BR if the frequency can't be reached
+ */
+static uint8_t get_prescaler(SPI_t port, uint32_t max_frequency)
+{
+	uint32_t bus_freq  = RCC_get_peripheral_freq(s_clocks[port]);
+	uint8_t	 prescaler = 0;
+	if (max_frequency == 0)
+	{
+		return SPI_MAX_BR + 1;
+	}
+	while (prescaler <= SPI_MAX_BR && (bus_freq >> (prescaler + 1)) > max_frequency)
+	{
+		prescaler++;
+	}
+	return prescaler;
+}
+
+/**
+ * @brief This function sets the clock and the frame format of a port, the port must be idle
+ *
+ * @param port which port
+ * @param max_frequency max clock, must be reachable
+ * @param mode clock polarity and phase
+ * @param lsb_first send the least significant bit first
+ */
+static void set_format(SPI_t port, uint32_t max_frequency, SPI_MODE_t mode, bool lsb_first)
+{
+	SPI_TypeDef * spi		= get_spi(port);
+	uint8_t		  prescaler = get_prescaler(port, max_frequency);
+	// the format can only change while the port is disabled
+	spi->CR1 &= ~(1 << SPI_CR1_SPE);
+	// software NSS held high, so the port stays a master
+	spi->CR1 = (mode << SPI_CR1_CPHA) | (1 << SPI_CR1_MSTR) | (prescaler << SPI_CR1_BR) | (lsb_first << SPI_CR1_LSBFIRST) |
+			   (1 << SPI_CR1_SSI) | (1 << SPI_CR1_SSM);
+	spi->CR1 |= 1 << SPI_CR1_SPE;
+	s_ports[port].frequency = RCC_get_peripheral_freq(s_clocks[port]) >> (prescaler + 1);
+}
+
+/**
+ * @brief This function ends a transfer of a port
+ *
+ * @param port which port
+ */
+static void finish_transfer(SPI_t port)
+{
+	SPI_TypeDef * spi	   = get_spi(port);
+	SPI_port_t *  state	   = &s_ports[port];
+	volatile uint32_t drop = 0;
+	// the TX DMA is done when the last byte enters the shift register, it still has to go out
+	WAIT(spi->SR & (1 << SPI_SR_BSY))
+	spi->CR2 &= ~((1 << SPI_CR2_RXDMAEN) | (1 << SPI_CR2_TXDMAEN));
+	// bytes that were not read set the overrun flag, reading DR then SR clears it
+	drop = spi->DR;
+	drop = spi->SR;
+	(void)drop;
+	state->state = SPI_IDLE;
+	if (state->callback != NULL)
+	{
+		state->callback(port);
+	}
+}
+
+/**
+ * @brief This function handles the DMA interrupts of both ports
+ *
+ * @param dma_channel_number the channel
+ * @param flags DMA flags
+ */
+static void dma_callback(DMA_CHANNELS_t dma_channel_number, uint32_t flags)
+{
+	for (size_t i = 0; i < SPI_COUNT; i++)
+	{
+		if (s_ports[i].state != SPI_TRANSFER)
+		{
+			continue;
+		}
+		// a transfer that receives is done when the last byte is in, which is after the last byte was sent
+		if (dma_channel_number == (s_ports[i].receiving ? s_rx_dma[i] : s_tx_dma[i]))
+		{
+			finish_transfer(i);
+		}
+	}
+}
+
+/**
+ * @brief This function sets up the DMA channels of a port
+ *
+ * @param port which port
+ * @return true DMA is ready
+ * @return false one of the channels is reserved
+ */
+static bool setup_dma(SPI_t port)
+{
+	DMA_address_t periph = { .access_size = DMA_ACCESS_8BIT, .address = (uint32_t *)&get_spi(port)->DR, .increament_address = false };
+	DMA_address_t memory = { .access_size = DMA_ACCESS_8BIT, .address = NULL, .increament_address = true };
+	RCC_peripheral_set_clock(RCC_DMA1, true);
+	if (DMA_init_channel(s_rx_dma[port], &periph, &memory, DMA_CH_PRIORITY_HIGH, DMA_DIRECTION_PERIPH_TO_MEM, DMA_INTERRUPT_COMPLETE) ==
+		false)
+	{
+		return false;
+	}
+	if (DMA_init_channel(s_tx_dma[port], &periph, &memory, DMA_CH_PRIORITY_MEDIUM, DMA_DIRECTION_MEM_TO_PERIPH, DMA_INTERRUPT_COMPLETE) ==
+		false)
+	{
+		DMA_de_init_channel(s_rx_dma[port]);
+		return false;
+	}
+	DMA_set_callback(s_rx_dma[port], dma_callback);
+	DMA_set_callback(s_tx_dma[port], dma_callback);
+	return true;
+}
+
+/**
+ * @brief This function releases the pins of a port
+ *
+ * @param port which port, all its pins must be reserved
+ */
+static void release_pins(SPI_t port)
+{
+	GPIO_array_de_init(&s_sck_pin_arrays[port]);
+	GPIO_array_de_init(&s_miso_pin_arrays[port]);
+	GPIO_array_de_init(&s_mosi_pin_arrays[port]);
+}
+
+/*
+ ? Public functions
+*/
+
+SPI_ERR_t SPI_init(SPI_t port, uint32_t max_frequency, SPI_MODE_t mode, bool lsb_first)
+{
+	if (port >= SPI_COUNT)
+	{
+		return SPI_INVALID_PORT;
+	}
+	if (s_ports[port].init)
+	{
+		return SPI_ALREADY_INIT;
+	}
+	if (get_prescaler(port, max_frequency) > SPI_MAX_BR)
+	{
+		return SPI_INVALID_FREQUENCY;
+	}
+	if (GPIO_array_init(&s_sck_pin_arrays[port], s_pin_ports[port], s_sck_pins[port], s_sck_pins[port], GPIO_MODE_OUTPUT_50Mhz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL_ALT) != GPIO_NO_ERR)
+	{
+		return SPI_PINS_RESERVED;
+	}
+	if (GPIO_array_init(&s_miso_pin_arrays[port], s_pin_ports[port], s_sck_pins[port] + 1, s_sck_pins[port] + 1, GPIO_MODE_INPUT,
+						GPIO_CONFIG_INPUT_FLOATING) != GPIO_NO_ERR)
+	{
+		GPIO_array_de_init(&s_sck_pin_arrays[port]);
+		return SPI_PINS_RESERVED;
+	}
+	if (GPIO_array_init(&s_mosi_pin_arrays[port], s_pin_ports[port], s_sck_pins[port] + 2, s_sck_pins[port] + 2, GPIO_MODE_OUTPUT_50Mhz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL_ALT) != GPIO_NO_ERR)
+	{
+		GPIO_array_de_init(&s_sck_pin_arrays[port]);
+		GPIO_array_de_init(&s_miso_pin_arrays[port]);
+		return SPI_PINS_RESERVED;
+	}
+	if (setup_dma(port) == false)
+	{
+		release_pins(port);
+		return SPI_DMA_BUSY;
+	}
+	RCC_peripheral_set_clock(s_clocks[port], true);
+	RCC_peripheral_reset(s_clocks[port]);
+	set_format(port, max_frequency, mode, lsb_first);
+	s_ports[port].state = SPI_IDLE;
+	s_ports[port].init	= true;
+	return SPI_NO_ERR;
+}
+
+void SPI_de_init(SPI_t port)
+{
+	SPI_TypeDef * spi = NULL;
+	if (port >= SPI_COUNT || !s_ports[port].init)
+	{
+		return;
+	}
+	SPI_stop_stream(port);
+	spi = get_spi(port);
+	spi->CR2 &= ~((1 << SPI_CR2_RXDMAEN) | (1 << SPI_CR2_TXDMAEN));
+	spi->CR1 &= ~(1 << SPI_CR1_SPE);
+	DMA_stop_channel(s_rx_dma[port]);
+	DMA_stop_channel(s_tx_dma[port]);
+	DMA_de_init_channel(s_rx_dma[port]);
+	DMA_de_init_channel(s_tx_dma[port]);
+	RCC_peripheral_set_clock(s_clocks[port], false);
+	release_pins(port);
+	s_ports[port] = (SPI_port_t){ .state = SPI_IDLE };
+}
+
+SPI_ERR_t SPI_configure(SPI_t port, uint32_t max_frequency, SPI_MODE_t mode, bool lsb_first)
+{
+	if (port >= SPI_COUNT)
+	{
+		return SPI_INVALID_PORT;
+	}
+	if (!s_ports[port].init)
+	{
+		return SPI_NOT_INIT;
+	}
+	if (s_ports[port].state != SPI_IDLE)
+	{
+		return SPI_BUSY;
+	}
+	if (get_prescaler(port, max_frequency) > SPI_MAX_BR)
+	{
+		return SPI_INVALID_FREQUENCY;
+	}
+	set_format(port, max_frequency, mode, lsb_first);
+	return SPI_NO_ERR;
+}
+
+uint32_t SPI_get_frequency(SPI_t port)
+{
+	if (port >= SPI_COUNT || !s_ports[port].init)
+	{
+		return 0;
+	}
+	return s_ports[port].frequency;
+}
+
+SPI_ERR_t SPI_transfer(SPI_t port, const uint8_t * tx, uint8_t * rx, uint16_t length, SPI_callback_t callback)
+{
+	SPI_port_t *  state = NULL;
+	SPI_TypeDef * spi	= NULL;
+	if (port >= SPI_COUNT)
+	{
+		return SPI_INVALID_PORT;
+	}
+	if ((tx == NULL && rx == NULL) || length == 0)
+	{
+		return SPI_NULL;
+	}
+	state = &s_ports[port];
+	spi	  = get_spi(port);
+	if (!state->init)
+	{
+		return SPI_NOT_INIT;
+	}
+	if (state->state != SPI_IDLE)
+	{
+		return SPI_BUSY;
+	}
+	state->state	 = SPI_TRANSFER;
+	state->callback	 = callback;
+	state->receiving = rx != NULL;
+	DMA_stop_channel(s_tx_dma[port]);
+	DMA_channel_clear_flags(s_tx_dma[port]);
+	// without data the fill byte is sent again and again
+	DMA_set_memory(s_tx_dma[port], tx != NULL ? tx : &s_fill);
+	DMA_set_memory_increment(s_tx_dma[port], tx != NULL);
+	if (rx != NULL)
+	{
+		// RX first, so no received byte is missed
+		DMA_stop_channel(s_rx_dma[port]);
+		DMA_channel_clear_flags(s_rx_dma[port]);
+		DMA_set_memory(s_rx_dma[port], rx);
+		DMA_start_channel(s_rx_dma[port], length, false);
+		spi->CR2 |= 1 << SPI_CR2_RXDMAEN;
+	}
+	DMA_start_channel(s_tx_dma[port], length, false);
+	spi->CR2 |= 1 << SPI_CR2_TXDMAEN;
+	return SPI_NO_ERR;
+}
+
+bool SPI_is_busy(SPI_t port)
+{
+	if (port >= SPI_COUNT)
+	{
+		return false;
+	}
+	return s_ports[port].state != SPI_IDLE;
+}
+
+SPI_ERR_t SPI_start_stream(SPI_t port, uint8_t * rx_ring, uint16_t size)
+{
+	SPI_port_t *	  state = NULL;
+	SPI_TypeDef *	  spi	= NULL;
+	volatile uint32_t drop	= 0;
+	if (port >= SPI_COUNT)
+	{
+		return SPI_INVALID_PORT;
+	}
+	if (rx_ring == NULL || size == 0)
+	{
+		return SPI_NULL;
+	}
+	state = &s_ports[port];
+	spi	  = get_spi(port);
+	if (!state->init)
+	{
+		return SPI_NOT_INIT;
+	}
+	if (state->state != SPI_IDLE)
+	{
+		return SPI_BUSY;
+	}
+	state->state = SPI_STREAM;
+	// a byte left from before would shift every received byte by one
+	drop = spi->DR;
+	drop = spi->SR;
+	(void)drop;
+	DMA_stop_channel(s_rx_dma[port]);
+	DMA_channel_clear_flags(s_rx_dma[port]);
+	DMA_set_memory(s_rx_dma[port], rx_ring);
+	DMA_set_circular(s_rx_dma[port], true);
+	// the ring is never done, nothing to call on each wrap
+	DMA_set_callback(s_rx_dma[port], NULL);
+	DMA_start_channel(s_rx_dma[port], size, false);
+	spi->CR2 |= 1 << SPI_CR2_RXDMAEN;
+	return SPI_NO_ERR;
+}
+
+void SPI_stop_stream(SPI_t port)
+{
+	if (port >= SPI_COUNT || s_ports[port].state != SPI_STREAM)
+	{
+		return;
+	}
+	get_spi(port)->CR2 &= ~(1 << SPI_CR2_RXDMAEN);
+	DMA_stop_channel(s_rx_dma[port]);
+	DMA_set_circular(s_rx_dma[port], false);
+	DMA_channel_clear_flags(s_rx_dma[port]);
+	DMA_set_callback(s_rx_dma[port], dma_callback);
+	s_ports[port].state = SPI_IDLE;
+}
+
+periph_ptr_t SPI_get_data_register(SPI_t port)
+{
+	if (port >= SPI_COUNT)
+	{
+		return NULL;
+	}
+	return &get_spi(port)->DR;
+}
+
+void SPI_startup()
+{
+	for (size_t i = 0; i < SPI_COUNT; i++)
+	{
+		s_ports[i] = (SPI_port_t){ .state = SPI_IDLE };
+	}
+}
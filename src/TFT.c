@@ -0,0 +1,452 @@
+#include "TFT.h"
+
+#define CMD_COLUMN_ADDRESS (0x2A)
+#define CMD_PAGE_ADDRESS   (0x2B)
+#define CMD_MEMORY_WRITE   (0x2C)
+/* words of the ring, a pixel is 4 words: each byte with WR low and then WR high */
+#define RING_WORDS		(256)
+#define WORDS_PER_PIXEL (4)
+
+typedef enum
+{
+	TFT_SOURCE_BUFFER,
+	TFT_SOURCE_LINES,
+	TFT_SOURCE_FILL
+} TFT_SOURCE_t;
+
+static GPIO_PIN_ARRAY_t s_data_pins;
+static GPIO_PIN_ARRAY_t s_wr_pins;
+static GPIO_PIN_ARRAY_t s_dc_pins;
+static GPIO_PIN_ARRAY_t s_cs_pins;
+static periph_ptr_t		s_bsrr		  = NULL;
+static bool				s_initialized = false;
+static bool				s_has_cs	  = false;
+static volatile bool	s_busy		  = false;
+static TIM_t			s_timer		  = TIM_COUNT;
+static uint8_t			s_data_shift  = 0;
+/* WR low and high, the data words carry WR low */
+static uint32_t s_wr_low  = 0;
+static uint32_t s_wr_high = 0;
+static uint32_t s_ring[RING_WORDS];
+/* the rectangle being written */
+static TFT_SOURCE_t		s_source		= TFT_SOURCE_BUFFER;
+static const uint16_t * s_pixels		= NULL;
+static uint32_t			s_pixels_left	= 0; // left in the buffer, the current line or the whole fill
+static uint16_t			s_width			= 0;
+static uint16_t			s_next_row		= 0;
+static uint16_t			s_rows			= 0;
+static TFT_line_t		s_line_callback = NULL;
+static TFT_callback_t	s_callback		= NULL;
+static uint16_t			s_line[TFT_MAX_WIDTH];
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function returns the BSRR word that puts a byte on the data pins with WR low
+ *
+ * @param value the byte
+ * @return uint32_t BSRR word
+ */
+static inline uint32_t encode(uint8_t value)
+{
+	return ((uint32_t)value << s_data_shift) | ((uint32_t)(uint8_t)~value << (s_data_shift + 16)) | s_wr_low;
+}
+
+/**
+ * @brief This function writes a byte from the CPU, WR is low for two stores so the pulse is long enough
+ *
+ * @param value the byte
+ */
+static void write_byte(uint8_t value)
+{
+	uint32_t word = encode(value);
+	*s_bsrr		  = word;
+	*s_bsrr		  = word;
+	*s_bsrr		  = s_wr_high;
+}
+
+/**
+ * @brief This function writes a command and its parameters from the CPU, DC is left high for the data after it
+ *
+ * @param command command byte
+ * @param params parameter bytes
+ * @param count how many parameters
+ */
+static void write_command(uint8_t command, const uint8_t * params, uint8_t count)
+{
+	GPIO_array_write_all(&s_dc_pins, false);
+	write_byte(command);
+	GPIO_array_write_all(&s_dc_pins, true);
+	for (size_t i = 0; i < count; i++)
+	{
+		write_byte(params[i]);
+	}
+}
+
+/**
+ * @brief This function sets the window of a rectangle and starts the memory write
+ *
+ * @param x first column
+ * @param y first row
+ * @param width columns
+ * @param height rows
+ */
+static void set_window(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+	uint16_t x_end	   = x + width - 1;
+	uint16_t y_end	   = y + height - 1;
+	uint8_t	 columns[] = { x >> 8, x & 0xFF, x_end >> 8, x_end & 0xFF };
+	uint8_t	 rows[]	   = { y >> 8, y & 0xFF, y_end >> 8, y_end & 0xFF };
+	write_command(CMD_COLUMN_ADDRESS, columns, sizeof(columns));
+	write_command(CMD_PAGE_ADDRESS, rows, sizeof(rows));
+	write_command(CMD_MEMORY_WRITE, NULL, 0);
+}
+
+/**
+ * @brief This function moves to the next line of a streamed rectangle
+ *
+ * @return true a line is ready
+ * @return false no line is left
+ */
+static bool next_line()
+{
+	if (s_source != TFT_SOURCE_LINES || s_next_row >= s_rows)
+	{
+		return false;
+	}
+	s_line_callback(s_next_row++, s_line);
+	s_pixels	  = s_line;
+	s_pixels_left = s_width;
+	return true;
+}
+
+/**
+ * @brief This function encodes the next pixels into a half of the ring, and pads it with WR high once the data ends
+ *
+ * @param timer the engine
+ * @param words the half
+ * @param count words in the half
+ * @return true the data ended in this half
+ */
+static bool refill(TIM_t timer, uint32_t * words, uint16_t count)
+{
+	uint16_t pixel = 0;
+	size_t	 i	   = 0;
+	if (s_source == TFT_SOURCE_FILL)
+	{
+		// the ring already holds the color, only the end of the fill is written
+		if (s_pixels_left >= count / WORDS_PER_PIXEL)
+		{
+			s_pixels_left -= count / WORDS_PER_PIXEL;
+			return s_pixels_left == 0;
+		}
+		i			  = s_pixels_left * WORDS_PER_PIXEL;
+		s_pixels_left = 0;
+	}
+	while (i < count && (s_pixels_left != 0 || next_line()))
+	{
+		pixel	   = *s_pixels++;
+		words[i++] = encode(pixel >> 8);
+		words[i++] = s_wr_high;
+		words[i++] = encode(pixel & 0xFF);
+		words[i++] = s_wr_high;
+		s_pixels_left--;
+	}
+	if (i == count && (s_pixels_left != 0 || (s_source == TFT_SOURCE_LINES && s_next_row < s_rows)))
+	{
+		return false;
+	}
+	// a word with only WR high changes nothing on the bus
+	for (; i < count; i++)
+	{
+		words[i] = s_wr_high;
+	}
+	return true;
+}
+
+/**
+ * @brief This function ends the rectangle, after its last byte was sent
+ *
+ * @param timer the engine
+ */
+static void stream_done(TIM_t timer)
+{
+	TFT_callback_t callback = s_callback;
+	if (s_has_cs)
+	{
+		GPIO_array_write_all(&s_cs_pins, true);
+	}
+	s_busy = false;
+	// the callback may start the next rectangle
+	if (callback != NULL)
+	{
+		callback();
+	}
+}
+
+/**
+ * @brief This function checks a rectangle, takes the bus and sets the window
+ *
+ * @param x first column
+ * @param y first row
+ * @param width columns
+ * @param height rows
+ * @param callback called when the rectangle is written
+ * @return TFT_ERR_t errors if any
+ */
+static TFT_ERR_t begin_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, TFT_callback_t callback)
+{
+	if (!s_initialized)
+	{
+		return TFT_NOT_INIT;
+	}
+	if (width == 0 || height == 0)
+	{
+		return TFT_INVALID_CONFIG;
+	}
+	if (s_busy)
+	{
+		return TFT_BUSY;
+	}
+	s_busy	   = true;
+	s_callback = callback;
+	if (s_has_cs)
+	{
+		GPIO_array_write_all(&s_cs_pins, false);
+	}
+	set_window(x, y, width, height);
+	return TFT_NO_ERR;
+}
+
+/**
+ * @brief This function reserves the data, WR, DC and CS pins, on failure the pins already reserved are released
+ *
+ * @param config display config
+ * @return true all the pins are reserved
+ * @return false a pin is reserved by someone else
+ */
+static bool init_pins(const TFT_config_t * config)
+{
+	s_has_cs = config->cs_pin != TFT_NO_CS;
+	if (GPIO_array_init(&s_data_pins, config->data_port, config->data_pin, config->data_pin + 7, GPIO_MODE_OUTPUT_50Mhz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		return false;
+	}
+	if (GPIO_array_init(&s_wr_pins, config->data_port, config->wr_pin, config->wr_pin, GPIO_MODE_OUTPUT_50Mhz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		GPIO_array_de_init(&s_data_pins);
+		return false;
+	}
+	if (GPIO_array_init(&s_dc_pins, config->control_port, config->dc_pin, config->dc_pin, GPIO_MODE_OUTPUT_50Mhz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		GPIO_array_de_init(&s_data_pins);
+		GPIO_array_de_init(&s_wr_pins);
+		return false;
+	}
+	if (s_has_cs && GPIO_array_init(&s_cs_pins, config->control_port, config->cs_pin, config->cs_pin, GPIO_MODE_OUTPUT_50Mhz,
+									GPIO_CONFIG_OUTPUT_PUSH_PULL) != GPIO_NO_ERR)
+	{
+		GPIO_array_de_init(&s_data_pins);
+		GPIO_array_de_init(&s_wr_pins);
+		GPIO_array_de_init(&s_dc_pins);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief This function releases all the pins, when the init fails after reserving them
+ *
+ */
+static void release_pins()
+{
+	GPIO_array_de_init(&s_data_pins);
+	GPIO_array_de_init(&s_wr_pins);
+	GPIO_array_de_init(&s_dc_pins);
+	if (s_has_cs)
+	{
+		GPIO_array_de_init(&s_cs_pins);
+	}
+}
+
+/*
+ ? Public functions
+*/
+
+TFT_ERR_t TFT_init(const TFT_config_t * config)
+{
+	WAVE_config_t wave		 = { 0 };
+	WAVE_ERR_t	  wave_error = WAVE_NO_ERR;
+	if (config == NULL)
+	{
+		return TFT_NULL;
+	}
+	if (s_initialized)
+	{
+		return TFT_ALREADY_INIT;
+	}
+	if (config->data_pin + 7 > GPIO_MAX_PIN || config->wr_pin > GPIO_MAX_PIN || config->dc_pin > GPIO_MAX_PIN ||
+		(config->cs_pin != TFT_NO_CS && config->cs_pin > GPIO_MAX_PIN) || config->timer >= TIM_COUNT || config->write_rate == 0)
+	{
+		return TFT_INVALID_CONFIG;
+	}
+	if (config->write_rate > TFT_MAX_WRITE_RATE)
+	{
+		return TFT_TOO_FAST;
+	}
+	if (init_pins(config) == false)
+	{
+		return TFT_PINS_RESERVED;
+	}
+	wave	   = (WAVE_config_t){ .timer = config->timer, .port = config->data_port, .rate = config->write_rate * 2 };
+	wave_error = WAVE_init(&wave);
+	if (wave_error != WAVE_NO_ERR)
+	{
+		release_pins();
+		switch (wave_error)
+		{
+		case WAVE_TOO_FAST:
+			return TFT_TOO_FAST;
+		case WAVE_DMA_BUSY:
+		case WAVE_ALREADY_INIT:
+			return TFT_DMA_BUSY;
+		default:
+			return TFT_INVALID_CONFIG;
+		}
+	}
+	s_timer		 = config->timer;
+	s_bsrr		 = GPIO_array_get_bsrr(&s_data_pins);
+	s_data_shift = config->data_pin;
+	s_wr_high	 = GPIO_array_get_bsrr_value(&s_wr_pins, 1);
+	s_wr_low	 = GPIO_array_get_bsrr_value(&s_wr_pins, 0);
+	*s_bsrr		 = s_wr_high;
+	GPIO_array_write_all(&s_dc_pins, true);
+	if (s_has_cs)
+	{
+		GPIO_array_write_all(&s_cs_pins, true);
+	}
+	s_initialized = true;
+	return TFT_NO_ERR;
+}
+
+uint32_t TFT_get_write_rate()
+{
+	if (!s_initialized)
+	{
+		return 0;
+	}
+	return WAVE_get_rate(s_timer) / 2;
+}
+
+TFT_ERR_t TFT_command(uint8_t command, const uint8_t * params, uint8_t count)
+{
+	if (!s_initialized)
+	{
+		return TFT_NOT_INIT;
+	}
+	if (params == NULL && count != 0)
+	{
+		return TFT_NULL;
+	}
+	if (s_busy)
+	{
+		return TFT_BUSY;
+	}
+	if (s_has_cs)
+	{
+		GPIO_array_write_all(&s_cs_pins, false);
+	}
+	write_command(command, params, count);
+	if (s_has_cs)
+	{
+		GPIO_array_write_all(&s_cs_pins, true);
+	}
+	return TFT_NO_ERR;
+}
+
+TFT_ERR_t TFT_write_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint16_t * pixels, TFT_callback_t callback)
+{
+	TFT_ERR_t error = TFT_NO_ERR;
+	if (pixels == NULL)
+	{
+		return TFT_NULL;
+	}
+	error = begin_rect(x, y, width, height, callback);
+	if (error != TFT_NO_ERR)
+	{
+		return error;
+	}
+	s_source	  = TFT_SOURCE_BUFFER;
+	s_pixels	  = pixels;
+	s_pixels_left = (uint32_t)width * height;
+	WAVE_stream(s_timer, s_ring, RING_WORDS, refill, stream_done);
+	return TFT_NO_ERR;
+}
+
+TFT_ERR_t TFT_stream_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, TFT_line_t line, TFT_callback_t callback)
+{
+	TFT_ERR_t error = TFT_NO_ERR;
+	if (line == NULL)
+	{
+		return TFT_NULL;
+	}
+	if (width > TFT_MAX_WIDTH)
+	{
+		return TFT_INVALID_CONFIG;
+	}
+	error = begin_rect(x, y, width, height, callback);
+	if (error != TFT_NO_ERR)
+	{
+		return error;
+	}
+	s_source		= TFT_SOURCE_LINES;
+	s_line_callback = line;
+	s_width			= width;
+	s_rows			= height;
+	s_next_row		= 0;
+	s_pixels_left	= 0;
+	WAVE_stream(s_timer, s_ring, RING_WORDS, refill, stream_done);
+	return TFT_NO_ERR;
+}
+
+TFT_ERR_t TFT_fill_rect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t color, TFT_callback_t callback)
+{
+	TFT_ERR_t error = begin_rect(x, y, width, height, callback);
+	if (error != TFT_NO_ERR)
+	{
+		return error;
+	}
+	for (size_t i = 0; i < RING_WORDS; i += WORDS_PER_PIXEL)
+	{
+		s_ring[i]	  = encode(color >> 8);
+		s_ring[i + 1] = s_wr_high;
+		s_ring[i + 2] = encode(color & 0xFF);
+		s_ring[i + 3] = s_wr_high;
+	}
+	s_source	  = TFT_SOURCE_FILL;
+	s_pixels_left = (uint32_t)width * height;
+	WAVE_stream(s_timer, s_ring, RING_WORDS, refill, stream_done);
+	return TFT_NO_ERR;
+}
+
+bool TFT_is_busy()
+{
+	return s_busy;
+}
+
+void TFT_startup()
+{
+	s_initialized	= false;
+	s_has_cs		= false;
+	s_busy			= false;
+	s_timer			= TIM_COUNT;
+	s_bsrr			= NULL;
+	s_callback		= NULL;
+	s_line_callback = NULL;
+	s_pixels_left	= 0;
+}
@@ -0,0 +1,332 @@
+#include "TIM.h"
+#include "RCC.h"
+
+typedef struct
+{
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t SMCR;
+	__IO uint32_t DIER;
+	__IO uint32_t SR;
+	__IO uint32_t EGR;
+	__IO uint32_t CCMR1;
+	__IO uint32_t CCMR2;
+	__IO uint32_t CCER;
+	__IO uint32_t CNT;
+	__IO uint32_t PSC;
+	__IO uint32_t ARR;
+	__IO uint32_t RCR;
+	__IO uint32_t CCR1;
+	__IO uint32_t CCR2;
+	__IO uint32_t CCR3;
+	__IO uint32_t CCR4;
+	__IO uint32_t BDTR;
+	__IO uint32_t DCR;
+	__IO uint32_t DMAR;
+} TIM_TypeDef;
+
+#define TIM1_BASE (APB2PERIPH_BASE + 0x00002C00U)
+#define TIM2_BASE (APB1PERIPH_BASE + 0x00000000U)
+#define TIM3_BASE (APB1PERIPH_BASE + 0x00000400U)
+#define TIM4_BASE (APB1PERIPH_BASE + 0x00000800U)
+
+#define TIM_CR1_CEN	 (0)
+#define TIM_CR1_URS	 (2)
+#define TIM_CR1_ARPE (7)
+
+#define TIM_CR2_MMS		 (4)
+#define TIM_CR2_MMS_MASK (0x70)
+
+#define TIM_DIER_UIE (0)
+#define TIM_DIER_UDE (8)
+
+#define TIM_SR_UIF (0)
+#define TIM_EGR_UG (0)
+
+/* each CCMR holds 2 channels, 8 bits each */
+#define TIM_CCMR_CHANNEL_SIZE (8)
+#define TIM_CCMR_CHANNEL_MASK (0xFF)
+#define TIM_CCMR_OC_PRELOAD	  (0x08)
+#define TIM_CCMR_OC_PWM1	  (0x60)
+/* each channel has 4 bits in the CCER */
+#define TIM_CCER_CHANNEL_SIZE (4)
+#define TIM_CCER_CCE		  (0x1)
+
+/* TIM1 outputs are gated by the main output enable */
+#define TIM_BDTR_MOE (15)
+
+#define TIM_MAX_PERIOD (0x10000)
+
+static const TIM_TypeDef * const s_timers[TIM_COUNT] = {
+	(TIM_TypeDef *)TIM1_BASE,
+	(TIM_TypeDef *)TIM2_BASE,
+	(TIM_TypeDef *)TIM3_BASE,
+	(TIM_TypeDef *)TIM4_BASE,
+};
+
+static const RCC_Peripherals_t s_clocks[TIM_COUNT] = { RCC_TIM1, RCC_TIM2, RCC_TIM3, RCC_TIM4 };
+
+static const IRQn_Type s_update_irqs[TIM_COUNT] = { TIM1_UP_IRQn, TIM2_IRQn, TIM3_IRQn, TIM4_IRQn };
+
+/* DMA channel of each request, indexed by TIM_DMA_REQUEST_t. From the reference manual page 282 */
+static const DMA_CHANNELS_t s_dma_channels[TIM_COUNT][TIM_DMA_TRIGGER + 1] = {
+	/* UPDATE, CC1, CC2, CC3, CC4, COM, TRIGGER */
+	{ DMA_CH5, DMA_CH2, DMA_CH3, DMA_CH6, DMA_CH4, DMA_CH4, DMA_CH4 },
+	{ DMA_CH2, DMA_CH5, DMA_CH7, DMA_CH1, DMA_CH7, DMA_CH_COUNT, DMA_CH_COUNT },
+	{ DMA_CH3, DMA_CH6, DMA_CH_COUNT, DMA_CH2, DMA_CH3, DMA_CH_COUNT, DMA_CH6 },
+	{ DMA_CH7, DMA_CH1, DMA_CH4, DMA_CH5, DMA_CH_COUNT, DMA_CH_COUNT, DMA_CH_COUNT },
+};
+
+static TIM_callback_t s_callbacks[TIM_COUNT] = { NULL };
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief Get the timer registers
+ *
+ * @param timer timer number
+ * @return TIM_TypeDef* timer registers, NULL for an invalid timer
+ */
+static TIM_TypeDef * get_timer(TIM_t timer)
+{
+	if (timer >= TIM_COUNT)
+	{
+		return NULL;
+	}
+	return (TIM_TypeDef *)s_timers[timer];
+}
+
+/*
+ ? Public functions
+*/
+
+bool TIM_init(TIM_t timer, uint32_t frequency)
+{
+	uint32_t ticks = 0, prescaler = 0;
+	if (timer >= TIM_COUNT || frequency == 0)
+	{
+		return false;
+	}
+	ticks = RCC_get_peripheral_freq(s_clocks[timer]) / frequency;
+	// a period of 1 count never overflows
+	if (ticks < 2)
+	{
+		return false;
+	}
+	prescaler = (ticks - 1) / TIM_MAX_PERIOD;
+	if (prescaler >= TIM_MAX_PERIOD)
+	{
+		return false; // too slow
+	}
+	return TIM_init_ex(timer, prescaler, ticks / (prescaler + 1) - 1);
+}
+
+bool TIM_init_ex(TIM_t timer, uint16_t prescaler, uint16_t period)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if (tim == NULL || period == 0)
+	{
+		return false;
+	}
+	RCC_peripheral_set_clock(s_clocks[timer], true);
+	// only overflows generate update interrupts and DMA requests, not the UG bit
+	tim->CR1 = (1 << TIM_CR1_ARPE) | (1 << TIM_CR1_URS);
+	tim->PSC = prescaler;
+	tim->ARR = period;
+	tim->CNT = 0;
+	// load the prescaler, it is buffered until the next update
+	tim->EGR = 1 << TIM_EGR_UG;
+	return true;
+}
+
+uint32_t TIM_get_frequency(TIM_t timer)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if (tim == NULL)
+	{
+		return 0;
+	}
+	return TIM_get_tick_frequency(timer) / (tim->ARR + 1);
+}
+
+uint32_t TIM_get_tick_frequency(TIM_t timer)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if (tim == NULL)
+	{
+		return 0;
+	}
+	return RCC_get_peripheral_freq(s_clocks[timer]) / (tim->PSC + 1);
+}
+
+void TIM_set_master_mode(TIM_t timer, TIM_TRGO_t trgo)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if (tim == NULL)
+	{
+		return;
+	}
+	tim->CR2 = (tim->CR2 & ~TIM_CR2_MMS_MASK) | (trgo << TIM_CR2_MMS);
+}
+
+bool TIM_set_compare(TIM_t timer, TIM_CHANNEL_t channel, uint16_t value)
+{
+	TIM_TypeDef * tim		  = get_timer(timer);
+	periph_ptr_t  ccmr		  = NULL;
+	uint8_t		  ccmr_offset = 0;
+	if (tim == NULL || channel >= TIM_CHANNEL_COUNT)
+	{
+		return false;
+	}
+	ccmr		= (channel < TIM_CHANNEL_3) ? &tim->CCMR1 : &tim->CCMR2;
+	ccmr_offset = (channel % 2) * TIM_CCMR_CHANNEL_SIZE;
+	*ccmr		= (*ccmr & ~(TIM_CCMR_CHANNEL_MASK << ccmr_offset)) | ((TIM_CCMR_OC_PWM1 | TIM_CCMR_OC_PRELOAD) << ccmr_offset);
+	(&tim->CCR1)[channel] = value;
+	tim->CCER |= TIM_CCER_CCE << (channel * TIM_CCER_CHANNEL_SIZE);
+	if (timer == TIM_1)
+	{
+		tim->BDTR |= 1 << TIM_BDTR_MOE;
+	}
+	return true;
+}
+
+void TIM_set_dma_request(TIM_t timer, TIM_DMA_REQUEST_t request, bool enable)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if (tim == NULL || request > TIM_DMA_TRIGGER)
+	{
+		return;
+	}
+	if (enable)
+	{
+		tim->DIER |= 1 << (TIM_DIER_UDE + request);
+	}
+	else
+	{
+		tim->DIER &= ~(1 << (TIM_DIER_UDE + request));
+	}
+}
+
+DMA_CHANNELS_t TIM_get_dma_channel(TIM_t timer, TIM_DMA_REQUEST_t request)
+{
+	if (timer >= TIM_COUNT || request > TIM_DMA_TRIGGER)
+	{
+		return DMA_CH_COUNT;
+	}
+	return s_dma_channels[timer][request];
+}
+
+void TIM_set_callback(TIM_t timer, TIM_callback_t callback)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if (tim == NULL)
+	{
+		return;
+	}
+	s_callbacks[timer] = callback;
+	if (callback == NULL)
+	{
+		tim->DIER &= ~(1 << TIM_DIER_UIE);
+		NVIC_DisableIRQ(s_update_irqs[timer]);
+	}
+	else
+	{
+		tim->SR &= ~(1 << TIM_SR_UIF);
+		tim->DIER |= 1 << TIM_DIER_UIE;
+		NVIC_EnableIRQ(s_update_irqs[timer]);
+	}
+}
+
+void TIM_reload(TIM_t timer)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if (tim == NULL)
+	{
+		return;
+	}
+	tim->EGR = 1 << TIM_EGR_UG;
+}
+
+void TIM_start(TIM_t timer)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if (tim == NULL)
+	{
+		return;
+	}
+	tim->CR1 |= 1 << TIM_CR1_CEN;
+}
+
+void TIM_stop(TIM_t timer)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if (tim == NULL)
+	{
+		return;
+	}
+	tim->CR1 &= ~(1 << TIM_CR1_CEN);
+}
+
+uint16_t TIM_get_counter(TIM_t timer)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if (tim == NULL)
+	{
+		return 0;
+	}
+	return tim->CNT;
+}
+
+void TIM_startup()
+{
+	for (size_t i = 0; i < TIM_COUNT; i++)
+	{
+		s_callbacks[i] = NULL;
+	}
+}
+
+/*
+ ? Interrupt handlers
+*/
+
+/**
+ * @brief This function clears the update flag and calls the timer callback
+ *
+ * @param timer timer that generated the interrupt
+ */
+static void handle_update_interrupt(TIM_t timer)
+{
+	TIM_TypeDef * tim = get_timer(timer);
+	if ((tim->SR & (1 << TIM_SR_UIF)) == 0)
+	{
+		return;
+	}
+	// SR bits are cleared by writing 0, writing 1 has no effect
+	tim->SR = ~(1 << TIM_SR_UIF);
+	if (s_callbacks[timer] != NULL)
+	{
+		s_callbacks[timer](timer);
+	}
+}
+
+void TIM1_UP_IRQHandler()
+{
+	handle_update_interrupt(TIM_1);
+}
+
+void TIM2_IRQHandler()
+{
+	handle_update_interrupt(TIM_2);
+}
+
+void TIM3_IRQHandler()
+{
+	handle_update_interrupt(TIM_3);
+}
+
+void TIM4_IRQHandler()
+{
+	handle_update_interrupt(TIM_4);
+}
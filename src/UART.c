@@ -0,0 +1,436 @@
+#include "UART.h"
+#include "DMA.h"
+#include "GPIO.h"
+#include "RCC.h"
+
+typedef struct
+{
+	__IO uint32_t SR;
+	__IO uint32_t DR;
+	__IO uint32_t BRR;
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t CR3;
+	__IO uint32_t GTPR;
+} USART_TypeDef;
+
+#define USART1_BASE (APB2PERIPH_BASE + 0x00003800U)
+#define USART2_BASE (APB1PERIPH_BASE + 0x00004400U)
+#define USART3_BASE (APB1PERIPH_BASE + 0x00004800U)
+
+#define USART_SR_NE	  (2)
+#define USART_SR_FE	  (1)
+#define USART_SR_ORE  (3)
+#define USART_SR_IDLE (4)
+/* flags cleared by reading SR then DR */
+#define USART_SR_EVENTS ((1 << USART_SR_NE) | (1 << USART_SR_FE) | (1 << USART_SR_ORE) | (1 << USART_SR_IDLE))
+
+#define USART_CR1_RE	 (2)
+#define USART_CR1_TE	 (3)
+#define USART_CR1_IDLEIE (4)
+#define USART_CR1_UE	 (13)
+#define USART_CR3_EIE	 (0)
+#define USART_CR3_DMAR	 (6)
+#define USART_CR3_DMAT	 (7)
+
+/* the baud rate register holds the divider in 1/16 units, the divider must be at least 1 */
+#define USART_MIN_BRR (16)
+#define USART_MAX_BRR (0xFFFF)
+
+typedef struct
+{
+	uint8_t *		   rx_ring;
+	uint16_t		   rx_size;
+	uint16_t		   rx_head;	   // DMA write index at the last flush
+	volatile uint32_t  rx_written; // bytes written by the DMA, counted at each flush
+	uint32_t		   rx_read;	   // bytes read, the ring holds rx_written - rx_read bytes
+	const uint8_t *	   tx_buffer;
+	uint16_t		   tx_length;
+	volatile bool	   tx_busy;
+	UART_rx_callback_t rx_callback;
+	UART_tx_callback_t tx_callback;
+	UART_stats_t	   stats;
+	bool			   init;
+} UART_port_t;
+
+static const USART_TypeDef * const s_usarts[UART_COUNT] = {
+	(USART_TypeDef *)USART1_BASE,
+	(USART_TypeDef *)USART2_BASE,
+	(USART_TypeDef *)USART3_BASE,
+};
+
+static const RCC_Peripherals_t s_clocks[UART_COUNT]	   = { RCC_UART1, RCC_UART2, RCC_UART3 };
+static const IRQn_Type		   s_irqs[UART_COUNT]	   = { USART1_IRQn, USART2_IRQn, USART3_IRQn };
+static const DMA_CHANNELS_t	   s_tx_dma[UART_COUNT]	   = { DMA_CH4_USART1_TX, DMA_CH7_USART2_TX, DMA_CH2_USART3_TX };
+static const DMA_CHANNELS_t	   s_rx_dma[UART_COUNT]	   = { DMA_CH5_USART1_RX, DMA_CH6_USART2_RX, DMA_CH3_USART3_RX };
+static const GPIO_PORT_t	   s_pin_ports[UART_COUNT] = { GPIO_PORT_A, GPIO_PORT_A, GPIO_PORT_B };
+/* RX is the pin after TX on all ports */
+static const uint8_t s_tx_pins[UART_COUNT] = { 9, 2, 10 };
+
+static GPIO_PIN_ARRAY_t s_tx_pin_arrays[UART_COUNT];
+static GPIO_PIN_ARRAY_t s_rx_pin_arrays[UART_COUNT];
+static UART_port_t		s_ports[UART_COUNT];
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief Get the USART registers
+ *
+ * @param port port number
+ * @return USART_TypeDef* USART registers
+ */
+static USART_TypeDef * get_usart(UART_t port)
+{
+	return (USART_TypeDef *)s_usarts[port];
+}
+
+/**
+ * @brief This function counts the bytes the DMA wrote to the ring since the last flush
+ *
+ * @param port which port
+ *
+ * @remarks called on each half of the ring and on idle line, so less than a ring was written since the last call
+ */
+static void flush_rx(UART_t port)
+{
+	UART_port_t * state = &s_ports[port];
+	uint16_t	  head	= state->rx_size - DMA_get_remaining(s_rx_dma[port]);
+	uint16_t	  count = 0;
+	// right after the last byte of the ring the remaining count is reloaded
+	head  = head == state->rx_size ? 0 : head;
+	count = (head + state->rx_size - state->rx_head) % state->rx_size;
+	if (count == 0)
+	{
+		return;
+	}
+	state->rx_head = head;
+	state->rx_written += count;
+	state->stats.rx_bytes += count;
+	if (state->rx_callback != NULL)
+	{
+		state->rx_callback(port);
+	}
+}
+
+/**
+ * @brief This function drops the bytes that were overwritten by the DMA before they were read
+ *
+ * @param port which port
+ * @return uint16_t number of bytes waiting
+ */
+static uint16_t drop_overwritten(UART_t port)
+{
+	UART_port_t * state	  = &s_ports[port];
+	uint32_t	  waiting = state->rx_written - state->rx_read;
+	if (waiting > state->rx_size)
+	{
+		state->stats.rx_dropped += waiting - state->rx_size;
+		state->rx_read = state->rx_written - state->rx_size;
+		waiting		   = state->rx_size;
+	}
+	return waiting;
+}
+
+/**
+ * @brief This function is called from the DMA interrupt on each half of a receive ring
+ *
+ * @param dma_channel_number RX DMA channel
+ * @param flags which flags were set
+ */
+static void rx_dma_callback(DMA_CHANNELS_t dma_channel_number, uint32_t flags)
+{
+	for (size_t port = 0; port < UART_COUNT; port++)
+	{
+		if (s_rx_dma[port] == dma_channel_number && s_ports[port].init)
+		{
+			flush_rx(port);
+		}
+	}
+}
+
+/**
+ * @brief This function is called from the DMA interrupt when a write is done
+ *
+ * @param dma_channel_number TX DMA channel
+ * @param flags which flags were set
+ */
+static void tx_dma_callback(DMA_CHANNELS_t dma_channel_number, uint32_t flags)
+{
+	UART_port_t * state = NULL;
+	for (size_t port = 0; port < UART_COUNT; port++)
+	{
+		state = &s_ports[port];
+		if (s_tx_dma[port] != dma_channel_number || !state->init || !state->tx_busy)
+		{
+			continue;
+		}
+		DMA_stop_channel(dma_channel_number);
+		state->stats.tx_bytes += state->tx_length;
+		state->tx_busy = false;
+		if (state->tx_callback != NULL)
+		{
+			state->tx_callback(port, state->tx_buffer);
+		}
+	}
+}
+
+/**
+ * @brief This function sets up the DMA channels of a port
+ *
+ * @param port which port
+ * @return true DMA is ready
+ * @return false one of the channels is reserved
+ */
+static bool setup_dma(UART_t port)
+{
+	UART_port_t * state	 = &s_ports[port];
+	DMA_address_t periph = { .access_size = DMA_ACCESS_8BIT, .address = (uint32_t *)&get_usart(port)->DR, .increament_address = false };
+	DMA_address_t rx_mem = { .access_size = DMA_ACCESS_8BIT, .address = state->rx_ring, .increament_address = true };
+	DMA_address_t tx_mem = { .access_size = DMA_ACCESS_8BIT, .address = NULL, .increament_address = true };
+	RCC_peripheral_set_clock(RCC_DMA1, true);
+	if (DMA_init_channel(s_rx_dma[port], &periph, &rx_mem, DMA_CH_PRIORITY_HIGH, DMA_DIRECTION_PERIPH_TO_MEM,
+						 DMA_INTERRUPT_HALF | DMA_INTERRUPT_COMPLETE) == false)
+	{
+		return false;
+	}
+	if (DMA_init_channel(s_tx_dma[port], &periph, &tx_mem, DMA_CH_PRIORITY_MEDIUM, DMA_DIRECTION_MEM_TO_PERIPH, DMA_INTERRUPT_COMPLETE) == false)
+	{
+		DMA_de_init_channel(s_rx_dma[port]);
+		return false;
+	}
+	DMA_set_circular(s_rx_dma[port], true);
+	DMA_set_callback(s_rx_dma[port], rx_dma_callback);
+	DMA_set_callback(s_tx_dma[port], tx_dma_callback);
+	return true;
+}
+
+/*
+ ? Public functions
+*/
+
+UART_ERR_t UART_init(UART_t port, uint32_t baud, uint8_t * rx_ring, uint16_t rx_size, UART_rx_callback_t rx_callback,
+					 UART_tx_callback_t tx_callback)
+{
+	USART_TypeDef * usart = NULL;
+	UART_port_t *	state = NULL;
+	uint32_t		brr	  = 0;
+	if (port >= UART_COUNT)
+	{
+		return UART_INVALID_PORT;
+	}
+	if (rx_ring == NULL || rx_size < 2)
+	{
+		return UART_NULL;
+	}
+	state = &s_ports[port];
+	usart = get_usart(port);
+	if (state->init)
+	{
+		return UART_ALREADY_INIT;
+	}
+	if (baud == 0)
+	{
+		return UART_INVALID_BAUD;
+	}
+	// the divider in 1/16 units is the bus clock over the baud rate, rounded
+	brr = (RCC_get_peripheral_freq(s_clocks[port]) + baud / 2) / baud;
+	if (brr < USART_MIN_BRR || brr > USART_MAX_BRR)
+	{
+		return UART_INVALID_BAUD;
+	}
+	if (GPIO_array_init(&s_tx_pin_arrays[port], s_pin_ports[port], s_tx_pins[port], s_tx_pins[port], GPIO_MODE_OUTPUT_50Mhz,
+						GPIO_CONFIG_OUTPUT_PUSH_PULL_ALT) != GPIO_NO_ERR)
+	{
+		return UART_PINS_RESERVED;
+	}
+	if (GPIO_array_init(&s_rx_pin_arrays[port], s_pin_ports[port], s_tx_pins[port] + 1, s_tx_pins[port] + 1, GPIO_MODE_INPUT,
+						GPIO_CONFIG_INPUT_FLOATING) != GPIO_NO_ERR)
+	{
+		GPIO_array_de_init(&s_tx_pin_arrays[port]);
+		return UART_PINS_RESERVED;
+	}
+	state->rx_ring	   = rx_ring;
+	state->rx_size	   = rx_size;
+	state->rx_head	   = 0;
+	state->rx_written  = 0;
+	state->rx_read	   = 0;
+	state->tx_busy	   = false;
+	state->rx_callback = rx_callback;
+	state->tx_callback = tx_callback;
+	if (setup_dma(port) == false)
+	{
+		GPIO_array_de_init(&s_tx_pin_arrays[port]);
+		GPIO_array_de_init(&s_rx_pin_arrays[port]);
+		return UART_DMA_BUSY;
+	}
+	RCC_peripheral_set_clock(s_clocks[port], true);
+	RCC_peripheral_reset(s_clocks[port]);
+	usart->BRR = brr;
+	// errors raise an interrupt only with DMA reception, which is the point
+	usart->CR3 = (1 << USART_CR3_DMAR) | (1 << USART_CR3_DMAT) | (1 << USART_CR3_EIE);
+	usart->CR1 = (1 << USART_CR1_UE) | (1 << USART_CR1_TE) | (1 << USART_CR1_RE) | (1 << USART_CR1_IDLEIE);
+	DMA_start_channel(s_rx_dma[port], rx_size, false);
+	state->init = true;
+	NVIC_EnableIRQ(s_irqs[port]);
+	return UART_NO_ERR;
+}
+
+bool UART_write(UART_t port, const uint8_t * data, uint16_t length)
+{
+	UART_port_t * state = NULL;
+	if (port >= UART_COUNT || data == NULL || length == 0 || !s_ports[port].init)
+	{
+		return false;
+	}
+	state = &s_ports[port];
+	if (state->tx_busy)
+	{
+		state->stats.tx_busy++;
+		return false;
+	}
+	state->tx_buffer = data;
+	state->tx_length = length;
+	state->tx_busy	 = true;
+	DMA_stop_channel(s_tx_dma[port]);
+	DMA_channel_clear_flags(s_tx_dma[port]);
+	DMA_set_memory(s_tx_dma[port], data);
+	DMA_start_channel(s_tx_dma[port], length, false);
+	return true;
+}
+
+bool UART_is_busy(UART_t port)
+{
+	if (port >= UART_COUNT)
+	{
+		return false;
+	}
+	return s_ports[port].tx_busy;
+}
+
+uint16_t UART_available(UART_t port)
+{
+	if (port >= UART_COUNT || !s_ports[port].init)
+	{
+		return 0;
+	}
+	return drop_overwritten(port);
+}
+
+uint16_t UART_peek(UART_t port, const uint8_t ** data)
+{
+	UART_port_t * state	  = NULL;
+	uint16_t	  waiting = 0;
+	uint16_t	  tail	  = 0;
+	if (port >= UART_COUNT || data == NULL || !s_ports[port].init)
+	{
+		return 0;
+	}
+	state	= &s_ports[port];
+	waiting = drop_overwritten(port);
+	tail	= state->rx_read % state->rx_size;
+	*data	= &state->rx_ring[tail];
+	return (waiting < state->rx_size - tail) ? waiting : state->rx_size - tail;
+}
+
+void UART_consume(UART_t port, uint16_t count)
+{
+	uint16_t waiting = 0;
+	if (port >= UART_COUNT || !s_ports[port].init)
+	{
+		return;
+	}
+	waiting = drop_overwritten(port);
+	s_ports[port].rx_read += count < waiting ? count : waiting;
+}
+
+uint16_t UART_read(UART_t port, uint8_t * output, uint16_t max_length)
+{
+	const uint8_t * data   = NULL;
+	uint16_t		length = 0;
+	uint16_t		total  = 0;
+	if (output == NULL)
+	{
+		return 0;
+	}
+	// at most two spans, before and after the ring wraps
+	while (total < max_length && (length = UART_peek(port, &data)) != 0)
+	{
+		length = length < max_length - total ? length : max_length - total;
+		for (size_t i = 0; i < length; i++)
+		{
+			output[total + i] = data[i];
+		}
+		UART_consume(port, length);
+		total += length;
+	}
+	return total;
+}
+
+void UART_get_stats(UART_t port, UART_stats_t * stats)
+{
+	if (port >= UART_COUNT || stats == NULL)
+	{
+		return;
+	}
+	drop_overwritten(port);
+	*stats = s_ports[port].stats;
+}
+
+void UART_startup()
+{
+	for (size_t port = 0; port < UART_COUNT; port++)
+	{
+		s_ports[port].init		  = false;
+		s_ports[port].tx_busy	  = false;
+		s_ports[port].rx_callback = NULL;
+		s_ports[port].tx_callback = NULL;
+		s_ports[port].stats		  = (UART_stats_t){ 0 };
+	}
+}
+
+/*
+ ? Interrupt handlers
+*/
+
+/**
+ * @brief This function handles the idle line and error interrupts of a port
+ *
+ * @param port which port
+ */
+static void handle_interrupt(UART_t port)
+{
+	USART_TypeDef * usart = get_usart(port);
+	UART_stats_t *	stats = &s_ports[port].stats;
+	uint32_t		sr	  = usart->SR;
+	if ((sr & USART_SR_EVENTS) == 0)
+	{
+		return;
+	}
+	// reading SR then DR clears the flags, the data was already taken by the DMA
+	(void)usart->DR;
+	stats->noise_errors += (sr >> USART_SR_NE) & 1;
+	stats->framing_errors += (sr >> USART_SR_FE) & 1;
+	stats->overrun_errors += (sr >> USART_SR_ORE) & 1;
+	if (sr & (1 << USART_SR_IDLE))
+	{
+		stats->idle_flushes++;
+		flush_rx(port);
+	}
+}
+
+void USART1_IRQHandler()
+{
+	handle_interrupt(UART_1);
+}
+
+void USART2_IRQHandler()
+{
+	handle_interrupt(UART_2);
+}
+
+void USART3_IRQHandler()
+{
+	handle_interrupt(UART_3);
+}
@@ -0,0 +1,988 @@
+#include "USB.h"
+#include "GPIO.h"
+#include "RCC.h"
+#include "USB_DESC.h"
+#include "utils.h"
+
+typedef struct
+{
+	__IO uint32_t EPR[USB_MAX_ENDPOINTS];
+	uint32_t	  RESERVED[8];
+	__IO uint32_t CNTR;
+	__IO uint32_t ISTR;
+	__IO uint32_t FNR;
+	__IO uint32_t DADDR;
+	__IO uint32_t BTABLE;
+} USB_TypeDef;
+
+#define USB_BASE (APB1PERIPH_BASE + 0x00005C00U)
+#define USB		 ((USB_TypeDef *)USB_BASE)
+/* the packet memory is 256 half words, each one sits in the low half of a 32 bit word */
+#define PMA_BASE (APB1PERIPH_BASE + 0x00006000U)
+
+#define USB_CNTR_FRES	(0)
+#define USB_CNTR_FSUSP	(3)
+#define USB_CNTR_SOFM	(9)
+#define USB_CNTR_RESETM (10)
+#define USB_CNTR_SUSPM	(11)
+#define USB_CNTR_WKUPM	(12)
+#define USB_CNTR_CTRM	(15)
+
+#define USB_ISTR_EP_ID_MSK (0x000F)
+#define USB_ISTR_SOF	   (9)
+#define USB_ISTR_RESET	   (10)
+#define USB_ISTR_SUSP	   (11)
+#define USB_ISTR_WKUP	   (12)
+#define USB_ISTR_CTR	   (15)
+
+#define USB_FNR_FN_MSK (0x07FF)
+#define USB_DADDR_EF   (1 << 7)
+
+/* endpoint register bits */
+#define EP_STAT_TX	  (4)
+#define EP_DTOG_TX	  (1 << 6)
+#define EP_CTR_TX	  (1 << 7)
+#define EP_KIND		  (1 << 8) // double buffer for bulk endpoints
+#define EP_TYPE		  (9)
+#define EP_SETUP	  (1 << 11)
+#define EP_STAT_RX	  (12)
+#define EP_DTOG_RX	  (1 << 14)
+#define EP_CTR_RX	  (1 << 15)
+#define EP_STAT_MSK	  (3)
+#define EP_FIELDS_MSK (0x070F) // address, type and kind, the bits that are written as is
+/* STAT and DTOG flip when written with 1 */
+#define EP_TOGGLE_MSK ((EP_STAT_MSK << EP_STAT_TX) | EP_DTOG_TX | (EP_STAT_MSK << EP_STAT_RX) | EP_DTOG_RX)
+/* the application side buffer of double buffered endpoints, on the DTOG bit of the unused direction */
+#define EP_SW_BUF_TX EP_DTOG_RX
+#define EP_SW_BUF_RX EP_DTOG_TX
+
+#define EP_STAT_DISABLED (0)
+#define EP_STAT_STALL	 (1)
+#define EP_STAT_NAK		 (2)
+#define EP_STAT_VALID	 (3)
+
+/* buffer table, 4 half words per endpoint register: TX address, TX count, RX address, RX count */
+#define BTABLE_OFFSET	  (0)
+#define BTABLE_SIZE		  (USB_MAX_ENDPOINTS * 8)
+#define BTABLE_SLOT_TX	  (0)
+#define BTABLE_SLOT_RX	  (1)
+#define BTABLE_COUNT_MSK  (0x03FF)
+#define BTABLE_BLOCK_32	  (1 << 15)
+#define BTABLE_NUM_BLOCKS (10)
+
+#define USB_DM_PIN (11)
+#define USB_DP_PIN (12)
+/* D+ is held low this long to make the host drop the device */
+#define RECONNECT_MS (10)
+
+#define FEATURE_ENDPOINT_HALT (0)
+
+typedef enum
+{
+	EP0_IDLE,
+	EP0_DATA_IN,
+	EP0_DATA_OUT,
+	EP0_STATUS_IN,
+	EP0_STATUS_OUT
+} EP0_STATE_t;
+
+typedef struct
+{
+	USB_ep_callback_t callback;
+	uint16_t		  size;
+	uint16_t		  buffers[2]; // packet memory offsets, the second is used by double buffered endpoints only
+	uint8_t			  address;
+	USB_EP_TYPE_t	  type;
+	bool			  double_buffered;
+	bool			  open;
+	/* IN: packets handed to the host and not sent yet. OUT: received packets that were not read */
+	volatile uint8_t pending;
+} USB_endpoint_t;
+
+static const USB_class_t * s_classes[USB_MAX_CLASSES];
+static uint8_t			   s_class_count = 0;
+static USB_endpoint_t	   s_endpoints[USB_MAX_ENDPOINTS];
+static uint16_t			   s_pma_next = BTABLE_SIZE;
+static GPIO_PIN_ARRAY_t	   s_pins;
+static volatile bool	   s_configured	   = false;
+static uint8_t			   s_configuration = 0;
+static uint8_t			   s_pending_address;
+
+/* control transfer of endpoint 0 */
+static EP0_STATE_t	   s_ep0_state = EP0_IDLE;
+static USB_setup_t	   s_setup;
+static const uint8_t * s_ep0_data;
+static uint16_t		   s_ep0_remaining;
+static bool			   s_ep0_zlp; // the data stage ends with an empty packet
+static uint16_t		   s_ep0_received;
+static uint8_t		   s_ep0_buffer[USB_EP0_BUFFER_SIZE];
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function returns the address of a half word of the packet memory
+ *
+ * @param offset byte offset in the packet memory, as the USB sees it
+ * @return __IO uint16_t* the half word, the next one is 2 half words later
+ */
+static __IO uint16_t * pma_address(uint16_t offset)
+{
+	return (__IO uint16_t *)(PMA_BASE + (uint32_t)offset * 2);
+}
+
+/**
+ * @brief This function copies bytes to the packet memory, a half word at a time
+ *
+ * @param offset byte offset in the packet memory, even
+ * @param data source
+ * @param length how many bytes
+ */
+static void pma_write(uint16_t offset, const uint8_t * data, uint16_t length)
+{
+	__IO uint16_t * pma = pma_address(offset);
+	for (; length >= 2; length -= 2)
+	{
+		*pma = data[0] | (data[1] << 8);
+		pma += 2;
+		data += 2;
+	}
+	if (length != 0)
+	{
+		*pma = data[0];
+	}
+}
+
+/**
+ * @brief This function copies bytes from the packet memory, a half word at a time
+ *
+ * @param offset byte offset in the packet memory, even
+ * @param data destination
+ * @param length how many bytes
+ */
+static void pma_read(uint16_t offset, uint8_t * data, uint16_t length)
+{
+	const __IO uint16_t * pma  = pma_address(offset);
+	uint16_t			  word = 0;
+	for (; length >= 2; length -= 2)
+	{
+		word	= *pma;
+		data[0] = word;
+		data[1] = word >> 8;
+		pma += 2;
+		data += 2;
+	}
+	if (length != 0)
+	{
+		data[0] = *pma;
+	}
+}
+
+/**
+ * @brief This function returns a buffer table entry of an endpoint register
+ *
+ * @param number endpoint register
+ * @param slot BTABLE_SLOT_TX or BTABLE_SLOT_RX, double buffered endpoints use both for one direction
+ * @param count false for the address, true for the count
+ * @return __IO uint16_t* the entry
+ */
+static __IO uint16_t * btable_entry(uint8_t number, uint8_t slot, bool count)
+{
+	return pma_address(BTABLE_OFFSET + number * 8 + slot * 4 + (count ? 2 : 0));
+}
+
+/**
+ * @brief This function returns the count entry value for an OUT buffer, the size is rounded up to the block size
+ *
+ * @param size buffer size
+ * @return uint16_t BL_SIZE and NUM_BLOCK
+ */
+static uint16_t rx_count_value(uint16_t size)
+{
+	if (size > 62)
+	{
+		return BTABLE_BLOCK_32 | (((size + 31) / 32 - 1) << BTABLE_NUM_BLOCKS);
+	}
+	return ((size + 1) / 2) << BTABLE_NUM_BLOCKS;
+}
+
+/**
+ * @brief This function sets the address, type, kind and toggle bits of an endpoint register
+ *
+ * @param number endpoint register
+ * @param fields address, type and kind
+ * @param toggles wanted value of the STAT and DTOG bits
+ */
+static void write_ep_register(uint8_t number, uint16_t fields, uint16_t toggles)
+{
+	// writing 1 to a toggle bit flips it, so write the difference. Writing 1 to CTR keeps it
+	USB->EPR[number] = (fields & EP_FIELDS_MSK) | EP_CTR_RX | EP_CTR_TX | ((USB->EPR[number] ^ toggles) & EP_TOGGLE_MSK);
+}
+
+/**
+ * @brief This function flips toggle bits of an endpoint register, without touching the others
+ *
+ * @param number endpoint register
+ * @param toggles bits to flip
+ */
+static void flip_ep_bits(uint8_t number, uint16_t toggles)
+{
+	USB->EPR[number] = (USB->EPR[number] & EP_FIELDS_MSK) | EP_CTR_RX | EP_CTR_TX | toggles;
+}
+
+/**
+ * @brief This function sets the TX status of an endpoint
+ *
+ * @param number endpoint register
+ * @param status EP_STAT_XX
+ */
+static void set_tx_status(uint8_t number, uint16_t status)
+{
+	uint32_t epr = USB->EPR[number];
+	flip_ep_bits(number, (epr ^ (status << EP_STAT_TX)) & (EP_STAT_MSK << EP_STAT_TX));
+}
+
+/**
+ * @brief This function sets the RX status of an endpoint
+ *
+ * @param number endpoint register
+ * @param status EP_STAT_XX
+ */
+static void set_rx_status(uint8_t number, uint16_t status)
+{
+	uint32_t epr = USB->EPR[number];
+	flip_ep_bits(number, (epr ^ (status << EP_STAT_RX)) & (EP_STAT_MSK << EP_STAT_RX));
+}
+
+/**
+ * @brief This function clears a transfer complete flag of an endpoint
+ *
+ * @param number endpoint register
+ * @param flag EP_CTR_RX or EP_CTR_TX
+ */
+static void clear_ctr(uint8_t number, uint16_t flag)
+{
+	USB->EPR[number] = (USB->EPR[number] & EP_FIELDS_MSK) | ((EP_CTR_RX | EP_CTR_TX) & ~flag);
+}
+
+/**
+ * @brief This function takes packet memory for a buffer
+ *
+ * @param size buffer size
+ * @return uint16_t offset in the packet memory, 0 if there is not enough memory
+ */
+static uint16_t pma_alloc(uint16_t size)
+{
+	uint16_t offset = s_pma_next;
+	// OUT buffers of more than 62 bytes take whole 32 byte blocks
+	size = size > 62 ? (size + 31) & ~31 : (size + 1) & ~1;
+	if (s_pma_next + size > USB_PMA_SIZE)
+	{
+		return 0;
+	}
+	s_pma_next += size;
+	return offset;
+}
+
+/**
+ * @brief This function programs an endpoint register to its state after opening, the buffers must be set
+ *
+ * @param number endpoint register
+ */
+static void reset_ep_register(uint8_t number)
+{
+	USB_endpoint_t * endpoint = &s_endpoints[number];
+	uint16_t		 fields	  = number | (endpoint->type << EP_TYPE) | (endpoint->double_buffered ? EP_KIND : 0);
+	uint16_t		 toggles  = 0;
+	endpoint->pending		  = 0;
+	if (endpoint->type == USB_EP_CONTROL)
+	{
+		toggles = (EP_STAT_NAK << EP_STAT_TX) | (EP_STAT_VALID << EP_STAT_RX);
+	}
+	else if (USB_EP_IS_IN(endpoint->address))
+	{
+		// a double buffered IN endpoint sends while DTOG and SW_BUF differ, so VALID alone sends nothing
+		toggles = ((endpoint->double_buffered ? EP_STAT_VALID : EP_STAT_NAK) << EP_STAT_TX) | (EP_STAT_DISABLED << EP_STAT_RX);
+	}
+	else
+	{
+		// the application starts with the second buffer, so the USB can receive into the first one
+		toggles = (EP_STAT_VALID << EP_STAT_RX) | (EP_STAT_DISABLED << EP_STAT_TX) | (endpoint->double_buffered ? EP_SW_BUF_RX : 0);
+	}
+	write_ep_register(number, fields, toggles);
+}
+
+/**
+ * @brief This function returns the buffer table slot of a buffer of an endpoint
+ *
+ * @param endpoint endpoint object
+ * @param buffer buffer index, 1 for the second buffer of a double buffered endpoint
+ * @return uint8_t BTABLE_SLOT_XX
+ */
+static uint8_t get_slot(const USB_endpoint_t * endpoint, uint8_t buffer)
+{
+	if (endpoint->double_buffered)
+	{
+		return buffer;
+	}
+	return USB_EP_IS_IN(endpoint->address) ? BTABLE_SLOT_TX : BTABLE_SLOT_RX;
+}
+
+/**
+ * @brief This function closes all the endpoints and frees the packet memory
+ *
+ */
+static void close_endpoints()
+{
+	for (size_t i = 0; i < USB_MAX_ENDPOINTS; i++)
+	{
+		s_endpoints[i].open = false;
+		write_ep_register(i, i, 0);
+	}
+	s_pma_next = BTABLE_SIZE;
+}
+
+/**
+ * @brief This function opens endpoint 0, its TX buffer is the first slot and its RX buffer the second
+ *
+ */
+static void open_ep0()
+{
+	USB_endpoint_t * endpoint = &s_endpoints[0];
+	endpoint->address		  = USB_EP_OUT(0);
+	endpoint->type			  = USB_EP_CONTROL;
+	endpoint->size			  = USB_EP0_SIZE;
+	endpoint->double_buffered = false;
+	endpoint->callback		  = NULL;
+	endpoint->buffers[0]	  = pma_alloc(USB_EP0_SIZE);
+	endpoint->buffers[1]	  = pma_alloc(USB_EP0_SIZE);
+	*btable_entry(0, BTABLE_SLOT_TX, false) = endpoint->buffers[0];
+	*btable_entry(0, BTABLE_SLOT_TX, true)	= 0;
+	*btable_entry(0, BTABLE_SLOT_RX, false) = endpoint->buffers[1];
+	*btable_entry(0, BTABLE_SLOT_RX, true)	= rx_count_value(USB_EP0_SIZE);
+	endpoint->open							= true;
+	reset_ep_register(0);
+}
+
+/**
+ * @brief This function handles a reset of the bus, the device goes back to address 0 with endpoint 0 only
+ *
+ */
+static void handle_reset()
+{
+	s_configured	= false;
+	s_configuration = 0;
+	s_ep0_state		= EP0_IDLE;
+	close_endpoints();
+	open_ep0();
+	for (size_t i = 0; i < s_class_count; i++)
+	{
+		if (s_classes[i]->reset != NULL)
+		{
+			s_classes[i]->reset();
+		}
+	}
+	USB->DADDR = USB_DADDR_EF;
+}
+
+/**
+ * @brief This function sends the next packet of the IN data stage of endpoint 0
+ *
+ */
+static void ep0_send_next()
+{
+	uint16_t length = s_ep0_remaining < USB_EP0_SIZE ? s_ep0_remaining : USB_EP0_SIZE;
+	pma_write(s_endpoints[0].buffers[0], s_ep0_data, length);
+	*btable_entry(0, BTABLE_SLOT_TX, true) = length;
+	s_ep0_data += length;
+	s_ep0_remaining -= length;
+	// a short packet ends the data stage
+	if (length < USB_EP0_SIZE)
+	{
+		s_ep0_zlp = false;
+	}
+	set_tx_status(0, EP_STAT_VALID);
+}
+
+/**
+ * @brief This function ends a request with an empty IN status packet
+ *
+ */
+static void ep0_send_status()
+{
+	*btable_entry(0, BTABLE_SLOT_TX, true) = 0;
+	s_ep0_state							   = EP0_STATUS_IN;
+	set_tx_status(0, EP_STAT_VALID);
+}
+
+/**
+ * @brief This function refuses a request, the host gets STALL until the next SETUP
+ *
+ */
+static void ep0_stall()
+{
+	s_ep0_state = EP0_IDLE;
+	set_tx_status(0, EP_STAT_STALL);
+	set_rx_status(0, EP_STAT_STALL);
+}
+
+/**
+ * @brief This function returns the endpoint object of an address, if it is open
+ *
+ * @param ep endpoint address
+ * @return USB_endpoint_t* the endpoint, NULL if it is closed
+ */
+static USB_endpoint_t * get_endpoint(uint8_t ep)
+{
+	USB_endpoint_t * endpoint = &s_endpoints[USB_EP_NUMBER(ep) % USB_MAX_ENDPOINTS];
+	if (USB_EP_NUMBER(ep) >= USB_MAX_ENDPOINTS || !endpoint->open || endpoint->address != ep)
+	{
+		return NULL;
+	}
+	return endpoint;
+}
+
+/**
+ * @brief This function checks if an endpoint is stalled
+ *
+ * @param ep endpoint address
+ * @return true stalled
+ * @return false not stalled, or closed
+ */
+static bool is_stalled(uint8_t ep)
+{
+	uint8_t shift = USB_EP_IS_IN(ep) ? EP_STAT_TX : EP_STAT_RX;
+	if (get_endpoint(ep) == NULL)
+	{
+		return false;
+	}
+	return ((USB->EPR[USB_EP_NUMBER(ep)] >> shift) & EP_STAT_MSK) == EP_STAT_STALL;
+}
+
+/**
+ * @brief This function selects a configuration, the classes open their endpoints again
+ *
+ * @param configuration 0 to go back to the addressed state
+ */
+static void set_configuration(uint8_t configuration)
+{
+	// endpoint 0 keeps its buffers at the start of the memory, the class endpoints are closed
+	for (size_t i = 1; i < USB_MAX_ENDPOINTS; i++)
+	{
+		s_endpoints[i].open = false;
+		write_ep_register(i, i, 0);
+	}
+	s_pma_next		= BTABLE_SIZE + 2 * USB_EP0_SIZE;
+	s_configuration = configuration;
+	s_configured	= false;
+	if (configuration == 0)
+	{
+		return;
+	}
+	for (size_t i = 0; i < s_class_count; i++)
+	{
+		if (s_classes[i]->configured != NULL)
+		{
+			s_classes[i]->configured();
+		}
+	}
+	s_configured = true;
+}
+
+/**
+ * @brief This function handles the standard requests
+ *
+ * @param data set to the IN data
+ * @param length set to the IN data length
+ * @return true request handled
+ * @return false request not supported, stall
+ */
+static bool standard_request(const uint8_t ** data, uint16_t * length)
+{
+	uint8_t recipient = s_setup.request_type & USB_REQUEST_RECIPIENT_MASK;
+	switch (s_setup.request)
+	{
+	case USB_GET_STATUS:
+		// bus powered, no remote wakeup, and the halt bit of endpoints
+		s_ep0_buffer[0] = recipient == USB_RECIPIENT_ENDPOINT ? is_stalled(s_setup.index) : 0;
+		s_ep0_buffer[1] = 0;
+		*data			= s_ep0_buffer;
+		*length			= 2;
+		return true;
+	case USB_CLEAR_FEATURE:
+	case USB_SET_FEATURE:
+		if (recipient == USB_RECIPIENT_ENDPOINT && s_setup.value == FEATURE_ENDPOINT_HALT && USB_EP_NUMBER(s_setup.index) != 0)
+		{
+			USB_ep_set_stall(s_setup.index, s_setup.request == USB_SET_FEATURE);
+		}
+		return true;
+	case USB_SET_ADDRESS:
+		// the new address is used after the status stage, which still goes to address 0
+		s_pending_address = s_setup.value & 0x7F;
+		return true;
+	case USB_GET_DESCRIPTOR:
+		*data = USB_DESC_get(s_setup.value >> 8, s_setup.value & 0xFF, length);
+		return *data != NULL;
+	case USB_GET_CONFIGURATION:
+		s_ep0_buffer[0] = s_configuration;
+		*data			= s_ep0_buffer;
+		*length			= 1;
+		return true;
+	case USB_SET_CONFIGURATION:
+		if (s_setup.value > 1)
+		{
+			return false;
+		}
+		set_configuration(s_setup.value);
+		return true;
+	case USB_GET_INTERFACE:
+		s_ep0_buffer[0] = 0;
+		*data			= s_ep0_buffer;
+		*length			= 1;
+		return true;
+	case USB_SET_INTERFACE:
+		// every interface has a single alternate setting
+		return s_setup.value == 0;
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief This function handles a SETUP packet of endpoint 0
+ *
+ */
+static void handle_setup()
+{
+	uint8_t			packet[8];
+	const uint8_t * data   = NULL;
+	uint16_t		length = 0;
+	bool			ok	   = false;
+	pma_read(s_endpoints[0].buffers[1], packet, sizeof(packet));
+	s_setup.request_type = packet[0];
+	s_setup.request		 = packet[1];
+	s_setup.value		 = packet[2] | (packet[3] << 8);
+	s_setup.index		 = packet[4] | (packet[5] << 8);
+	s_setup.length		 = packet[6] | (packet[7] << 8);
+	s_pending_address	 = 0;
+	if ((s_setup.request_type & USB_REQUEST_TYPE_MASK) == USB_REQUEST_STANDARD)
+	{
+		ok = standard_request(&data, &length);
+	}
+	else
+	{
+		for (size_t i = 0; i < s_class_count && !ok; i++)
+		{
+			ok = s_classes[i]->setup != NULL && s_classes[i]->setup(&s_setup, &data, &length);
+		}
+	}
+	if (!ok)
+	{
+		ep0_stall();
+		return;
+	}
+	if (s_setup.request_type & USB_REQUEST_DEVICE_TO_HOST)
+	{
+		s_ep0_data		= data;
+		s_ep0_remaining = length < s_setup.length ? length : s_setup.length;
+		// a data stage shorter than requested that ends on a full packet needs an empty packet to end it
+		s_ep0_zlp	= s_ep0_remaining < s_setup.length && s_ep0_remaining % USB_EP0_SIZE == 0;
+		s_ep0_state = EP0_DATA_IN;
+		ep0_send_next();
+		// the host may end the data stage early with the status packet
+		set_rx_status(0, EP_STAT_VALID);
+	}
+	else if (s_setup.length != 0)
+	{
+		if (s_setup.length > USB_EP0_BUFFER_SIZE)
+		{
+			ep0_stall();
+			return;
+		}
+		s_ep0_received = 0;
+		s_ep0_state	   = EP0_DATA_OUT;
+		set_rx_status(0, EP_STAT_VALID);
+	}
+	else
+	{
+		ep0_send_status();
+	}
+}
+
+/**
+ * @brief This function handles a received packet of endpoint 0
+ *
+ * @param setup the packet is a SETUP packet
+ */
+static void ep0_received(bool setup)
+{
+	uint16_t count = *btable_entry(0, BTABLE_SLOT_RX, true) & BTABLE_COUNT_MSK;
+	if (setup)
+	{
+		handle_setup();
+		return;
+	}
+	if (s_ep0_state != EP0_DATA_OUT)
+	{
+		// the status packet of an IN data stage
+		s_ep0_state = EP0_IDLE;
+		set_rx_status(0, EP_STAT_VALID);
+		return;
+	}
+	if (count > USB_EP0_BUFFER_SIZE - s_ep0_received)
+	{
+		count = USB_EP0_BUFFER_SIZE - s_ep0_received;
+	}
+	pma_read(s_endpoints[0].buffers[1], &s_ep0_buffer[s_ep0_received], count);
+	s_ep0_received += count;
+	if (s_ep0_received < s_setup.length && count == USB_EP0_SIZE)
+	{
+		set_rx_status(0, EP_STAT_VALID);
+		return;
+	}
+	for (size_t i = 0; i < s_class_count; i++)
+	{
+		if (s_classes[i]->data_out != NULL)
+		{
+			s_classes[i]->data_out(&s_setup, s_ep0_buffer, s_ep0_received);
+		}
+	}
+	ep0_send_status();
+}
+
+/**
+ * @brief This function handles a sent packet of endpoint 0
+ *
+ */
+static void ep0_sent()
+{
+	if (s_ep0_state == EP0_DATA_IN)
+	{
+		if (s_ep0_remaining != 0 || s_ep0_zlp)
+		{
+			ep0_send_next();
+		}
+		else
+		{
+			s_ep0_state = EP0_STATUS_OUT;
+		}
+		return;
+	}
+	if (s_ep0_state == EP0_STATUS_IN)
+	{
+		if (s_pending_address != 0)
+		{
+			USB->DADDR		  = USB_DADDR_EF | s_pending_address;
+			s_pending_address = 0;
+		}
+		s_ep0_state = EP0_IDLE;
+		set_rx_status(0, EP_STAT_VALID);
+	}
+}
+
+/**
+ * @brief This function handles a finished transfer of an endpoint register
+ *
+ * @param number endpoint register
+ */
+static void handle_transfer(uint8_t number)
+{
+	uint32_t		 epr	  = USB->EPR[number];
+	USB_endpoint_t * endpoint = &s_endpoints[number];
+	if (epr & EP_CTR_RX)
+	{
+		clear_ctr(number, EP_CTR_RX);
+		if (number == 0)
+		{
+			ep0_received(epr & EP_SETUP);
+		}
+		else if (endpoint->open)
+		{
+			endpoint->pending++;
+			// the application takes the filled buffer now if it is done with its own, the USB gets the free one
+			if (endpoint->double_buffered && endpoint->pending == 1)
+			{
+				flip_ep_bits(number, EP_SW_BUF_RX);
+			}
+			if (endpoint->callback != NULL)
+			{
+				endpoint->callback(endpoint->address);
+			}
+		}
+	}
+	if (epr & EP_CTR_TX)
+	{
+		clear_ctr(number, EP_CTR_TX);
+		if (number == 0)
+		{
+			ep0_sent();
+		}
+		else if (endpoint->open)
+		{
+			if (endpoint->pending != 0)
+			{
+				endpoint->pending--;
+			}
+			if (endpoint->callback != NULL)
+			{
+				endpoint->callback(endpoint->address);
+			}
+		}
+	}
+}
+
+/*
+ ? Public functions
+*/
+
+bool USB_register_class(const USB_class_t * usb_class)
+{
+	if (usb_class == NULL || s_class_count >= USB_MAX_CLASSES)
+	{
+		return false;
+	}
+	s_classes[s_class_count++] = usb_class;
+	return true;
+}
+
+bool USB_init()
+{
+	uint32_t start = 0;
+	if (GPIO_array_init(&s_pins, GPIO_PORT_A, USB_DM_PIN, USB_DP_PIN, GPIO_MODE_OUTPUT_2MHz, GPIO_CONFIG_OUTPUT_PUSH_PULL) !=
+		GPIO_NO_ERR)
+	{
+		return false;
+	}
+	// a low D+ looks like a disconnect, so the host forgets the device before the chip reset
+	GPIO_array_write_all(&s_pins, false);
+	utils_cycle_counter_start();
+	start = utils_get_cycles();
+	WAIT(utils_get_cycles() - start < RCC_get_AHB_freq() / 1000 * RECONNECT_MS)
+	// the transceiver takes the pins once the USB is powered up
+	GPIO_array_set_mode(&s_pins, GPIO_MODE_INPUT, GPIO_CONFIG_INPUT_FLOATING);
+	RCC_peripheral_set_clock(RCC_USB, true);
+	RCC_peripheral_reset(RCC_USB);
+	// leave power down, the analog part needs 1us before the reset is released
+	USB->CNTR = 1 << USB_CNTR_FRES;
+	start	  = utils_get_cycles();
+	WAIT(utils_get_cycles() - start < RCC_get_AHB_freq() / 1000000 + 1)
+	USB->CNTR	= 0;
+	USB->ISTR	= 0;
+	USB->BTABLE = BTABLE_OFFSET;
+	USB->CNTR	= (1 << USB_CNTR_CTRM) | (1 << USB_CNTR_RESETM) | (1 << USB_CNTR_SUSPM) | (1 << USB_CNTR_WKUPM) | (1 << USB_CNTR_SOFM);
+	NVIC_EnableIRQ(USB_LP_CAN1_RX0_IRQn);
+	return true;
+}
+
+bool USB_is_configured()
+{
+	return s_configured;
+}
+
+bool USB_ep_open(uint8_t ep, USB_EP_TYPE_t type, uint16_t size, bool double_buffered, USB_ep_callback_t callback)
+{
+	uint8_t			 number	  = USB_EP_NUMBER(ep);
+	USB_endpoint_t * endpoint = &s_endpoints[number % USB_MAX_ENDPOINTS];
+	uint8_t			 buffers  = double_buffered ? 2 : 1;
+	if (number == 0 || number >= USB_MAX_ENDPOINTS || endpoint->open || size == 0 || size > 64 || type == USB_EP_CONTROL)
+	{
+		return false;
+	}
+	if (double_buffered && type != USB_EP_BULK)
+	{
+		return false;
+	}
+	endpoint->address		  = ep;
+	endpoint->type			  = type;
+	endpoint->size			  = size;
+	endpoint->double_buffered = double_buffered;
+	endpoint->callback		  = callback;
+	for (size_t i = 0; i < buffers; i++)
+	{
+		endpoint->buffers[i] = pma_alloc(size);
+		if (endpoint->buffers[i] == 0)
+		{
+			return false;
+		}
+		*btable_entry(number, get_slot(endpoint, i), false) = endpoint->buffers[i];
+		*btable_entry(number, get_slot(endpoint, i), true)	= USB_EP_IS_IN(ep) ? 0 : rx_count_value(size);
+	}
+	endpoint->open = true;
+	reset_ep_register(number);
+	return true;
+}
+
+bool USB_ep_can_write(uint8_t ep)
+{
+	USB_endpoint_t * endpoint = get_endpoint(ep);
+	if (endpoint == NULL || !USB_EP_IS_IN(ep))
+	{
+		return false;
+	}
+	return endpoint->pending < (endpoint->double_buffered ? 2 : 1);
+}
+
+bool USB_ep_write(uint8_t ep, const uint8_t * data, uint16_t length)
+{
+	USB_endpoint_t * endpoint = get_endpoint(ep);
+	uint8_t			 number	  = USB_EP_NUMBER(ep);
+	uint8_t			 buffer	  = 0;
+	uint32_t		 primask  = 0;
+	if (endpoint == NULL || !USB_EP_IS_IN(ep) || length > endpoint->size || (data == NULL && length != 0))
+	{
+		return false;
+	}
+	// the USB interrupt writes the same endpoint register
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (endpoint->pending >= (endpoint->double_buffered ? 2 : 1))
+	{
+		__set_PRIMASK(primask);
+		return false;
+	}
+	// the application fills the buffer of SW_BUF, flipping it hands the buffer to the USB
+	buffer = endpoint->double_buffered && (USB->EPR[number] & EP_SW_BUF_TX) ? 1 : 0;
+	pma_write(endpoint->buffers[buffer], data, length);
+	*btable_entry(number, get_slot(endpoint, buffer), true) = length;
+	endpoint->pending++;
+	if (endpoint->double_buffered)
+	{
+		flip_ep_bits(number, EP_SW_BUF_TX);
+	}
+	else
+	{
+		set_tx_status(number, EP_STAT_VALID);
+	}
+	__set_PRIMASK(primask);
+	return true;
+}
+
+int16_t USB_ep_peek_length(uint8_t ep)
+{
+	USB_endpoint_t * endpoint = get_endpoint(ep);
+	uint8_t			 buffer	  = 0;
+	if (endpoint == NULL || USB_EP_IS_IN(ep) || endpoint->pending == 0)
+	{
+		return -1;
+	}
+	buffer = endpoint->double_buffered && (USB->EPR[USB_EP_NUMBER(ep)] & EP_SW_BUF_RX) ? 1 : 0;
+	return *btable_entry(USB_EP_NUMBER(ep), get_slot(endpoint, buffer), true) & BTABLE_COUNT_MSK;
+}
+
+uint16_t USB_ep_read(uint8_t ep, uint8_t * data)
+{
+	USB_endpoint_t * endpoint = get_endpoint(ep);
+	uint8_t			 number	  = USB_EP_NUMBER(ep);
+	uint8_t			 buffer	  = 0;
+	uint16_t		 count	  = 0;
+	uint32_t		 primask  = 0;
+	if (endpoint == NULL || USB_EP_IS_IN(ep) || data == NULL)
+	{
+		return 0;
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (endpoint->pending == 0)
+	{
+		__set_PRIMASK(primask);
+		return 0;
+	}
+	buffer = endpoint->double_buffered && (USB->EPR[number] & EP_SW_BUF_RX) ? 1 : 0;
+	count  = *btable_entry(number, get_slot(endpoint, buffer), true) & BTABLE_COUNT_MSK;
+	count  = count > endpoint->size ? endpoint->size : count;
+	pma_read(endpoint->buffers[buffer], data, count);
+	endpoint->pending--;
+	if (!endpoint->double_buffered)
+	{
+		set_rx_status(number, EP_STAT_VALID);
+	}
+	else if (endpoint->pending != 0)
+	{
+		// the other buffer was filled meanwhile, take it and free this one
+		flip_ep_bits(number, EP_SW_BUF_RX);
+	}
+	__set_PRIMASK(primask);
+	return count;
+}
+
+void USB_ep_set_stall(uint8_t ep, bool stall)
+{
+	uint8_t number = USB_EP_NUMBER(ep);
+	if (get_endpoint(ep) == NULL)
+	{
+		return;
+	}
+	if (!stall)
+	{
+		// clearing a halt restarts the data toggle, and the endpoint buffers are dropped
+		reset_ep_register(number);
+	}
+	else if (USB_EP_IS_IN(ep))
+	{
+		set_tx_status(number, EP_STAT_STALL);
+	}
+	else
+	{
+		set_rx_status(number, EP_STAT_STALL);
+	}
+}
+
+uint16_t USB_get_frame()
+{
+	return USB->FNR & USB_FNR_FN_MSK;
+}
+
+void USB_startup()
+{
+	s_class_count	= 0;
+	s_configured	= false;
+	s_configuration = 0;
+	s_ep0_state		= EP0_IDLE;
+	for (size_t i = 0; i < USB_MAX_ENDPOINTS; i++)
+	{
+		s_endpoints[i] = (USB_endpoint_t){ 0 };
+	}
+}
+
+/*
+ ? Interrupt handlers
+*/
+
+void USB_LP_CAN1_RX0_IRQHandler()
+{
+	uint32_t istr  = USB->ISTR;
+	uint16_t frame = 0;
+	// the flags are cleared by writing 0, writing 1 keeps the others
+	if (istr & (1 << USB_ISTR_RESET))
+	{
+		USB->ISTR = ~(1 << USB_ISTR_RESET);
+		handle_reset();
+	}
+	while ((istr = USB->ISTR) & (1 << USB_ISTR_CTR))
+	{
+		handle_transfer(istr & USB_ISTR_EP_ID_MSK);
+	}
+	if (istr & (1 << USB_ISTR_SOF))
+	{
+		USB->ISTR = ~(1 << USB_ISTR_SOF);
+		frame	  = USB_get_frame();
+		for (size_t i = 0; i < s_class_count; i++)
+		{
+			if (s_classes[i]->start_of_frame != NULL)
+			{
+				s_classes[i]->start_of_frame(frame);
+			}
+		}
+	}
+	if (istr & (1 << USB_ISTR_SUSP))
+	{
+		USB->ISTR = ~(1 << USB_ISTR_SUSP);
+		USB->CNTR |= 1 << USB_CNTR_FSUSP;
+	}
+	if (istr & (1 << USB_ISTR_WKUP))
+	{
+		USB->ISTR = ~(1 << USB_ISTR_WKUP);
+		USB->CNTR &= ~(1 << USB_CNTR_FSUSP);
+	}
+}
@@ -0,0 +1,300 @@
+#include "USB_CDC.h"
+#include "USB.h"
+
+#define SLOTS_MASK (USB_CDC_SLOTS - 1)
+
+/* class requests of the control interface */
+#define CDC_SET_LINE_CODING		   (0x20)
+#define CDC_GET_LINE_CODING		   (0x21)
+#define CDC_SET_CONTROL_LINE_STATE (0x22)
+#define CDC_SEND_BREAK			   (0x23)
+#define CDC_LINE_CODING_SIZE	   (7)
+#define CDC_CONTROL_DTR			   (1 << 0)
+
+/*
+The slots are a ring, s_committed and s_sent run freely and wrap.
+Slot s_committed is open, the producer packs frames into it until the next frame does not fit.
+Slots s_sent to s_committed - 1 are closed and wait for the IN endpoint
+*/
+static uint8_t			 s_slots[USB_CDC_SLOTS][USB_CDC_SLOT_SIZE];
+static uint8_t			 s_lengths[USB_CDC_SLOTS];
+static volatile uint16_t s_committed = 0;
+static volatile uint16_t s_sent		 = 0;
+static volatile uint8_t	 s_fill		 = 0; // bytes in the open slot
+static volatile bool	 s_writing	 = false; // between reserve and commit, the open slot must not be closed
+static uint16_t			 s_reserved	 = 0;
+static uint8_t			 s_frames_waiting = 0; // frames the open slot waited
+static bool				 s_last_full	  = false; // the last packet was full, the transfer is not over
+static volatile bool	 s_dtr			  = false;
+/* 115200 8N1, the value is not used but the host reads it back */
+static uint8_t				 s_line_coding[CDC_LINE_CODING_SIZE] = { 0x00, 0xC2, 0x01, 0x00, 0, 0, 8 };
+static USB_CDC_rx_callback_t s_rx_callback						 = NULL;
+static USB_CDC_stats_t		 s_stats;
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function closes the open slot, the next frames go to the next slot
+ *
+ * @remarks The slot after it must be free
+ */
+static void close_slot()
+{
+	s_lengths[s_committed & SLOTS_MASK] = s_fill;
+	s_fill								= 0;
+	s_frames_waiting					= 0;
+	s_committed++;
+	if ((uint16_t)(s_committed - s_sent) > s_stats.max_slots_used)
+	{
+		s_stats.max_slots_used = s_committed - s_sent;
+	}
+}
+
+/**
+ * @brief This function hands the closed slots to the IN endpoint while it has free buffers
+ *
+ * @remarks Called from the USB interrupt, or with the interrupts disabled
+ */
+static void drain()
+{
+	uint8_t index = 0;
+	while (s_sent != s_committed && USB_ep_can_write(USB_DESC_CDC_IN_EP))
+	{
+		index = s_sent & SLOTS_MASK;
+		// the only copy of the data, to the packet memory
+		if (!USB_ep_write(USB_DESC_CDC_IN_EP, s_slots[index], s_lengths[index]))
+		{
+			return;
+		}
+		s_last_full = s_lengths[index] == USB_CDC_SLOT_SIZE;
+		s_stats.bytes += s_lengths[index];
+		s_stats.packets++;
+		s_sent++;
+	}
+}
+
+/**
+ * @brief This function drains with the interrupts disabled, for the producer
+ *
+ */
+static void drain_locked()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	drain();
+	__set_PRIMASK(primask);
+}
+
+/*
+ ? USB callbacks
+*/
+
+static void in_callback(uint8_t ep)
+{
+	drain();
+}
+
+static void out_callback(uint8_t ep)
+{
+	uint8_t	 packet[USB_DESC_CDC_OUT_SIZE];
+	uint16_t length = USB_ep_read(ep, packet);
+	s_stats.rx_bytes += length;
+	if (s_rx_callback != NULL && length != 0)
+	{
+		s_rx_callback(packet, length);
+	}
+}
+
+static void class_reset()
+{
+	s_dtr = false;
+}
+
+static void class_configured()
+{
+	USB_ep_open(USB_DESC_CDC_NOTIFY_EP, USB_EP_INTERRUPT, USB_DESC_CDC_NOTIFY_SIZE, false, NULL);
+	USB_ep_open(USB_DESC_CDC_IN_EP, USB_EP_BULK, USB_DESC_CDC_IN_SIZE, true, in_callback);
+	USB_ep_open(USB_DESC_CDC_OUT_EP, USB_EP_BULK, USB_DESC_CDC_OUT_SIZE, false, out_callback);
+	s_last_full = false;
+}
+
+static bool class_setup(const USB_setup_t * setup, const uint8_t ** data, uint16_t * length)
+{
+	if ((setup->request_type & USB_REQUEST_RECIPIENT_MASK) != USB_RECIPIENT_INTERFACE ||
+		setup->index != USB_DESC_CDC_CONTROL_INTERFACE)
+	{
+		return false;
+	}
+	switch (setup->request)
+	{
+	case CDC_SET_LINE_CODING:
+		// the data stage comes to class_data_out
+		return setup->length == CDC_LINE_CODING_SIZE;
+	case CDC_GET_LINE_CODING:
+		*data	= s_line_coding;
+		*length = CDC_LINE_CODING_SIZE;
+		return true;
+	case CDC_SET_CONTROL_LINE_STATE:
+		s_dtr = setup->value & CDC_CONTROL_DTR;
+		return true;
+	case CDC_SEND_BREAK:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void class_data_out(const USB_setup_t * setup, const uint8_t * data, uint16_t length)
+{
+	if (setup->request != CDC_SET_LINE_CODING || setup->index != USB_DESC_CDC_CONTROL_INTERFACE || length != CDC_LINE_CODING_SIZE)
+	{
+		return;
+	}
+	for (size_t i = 0; i < CDC_LINE_CODING_SIZE; i++)
+	{
+		s_line_coding[i] = data[i];
+	}
+}
+
+static void class_start_of_frame(uint16_t frame)
+{
+	uint32_t primask = 0;
+	if (s_fill != 0 && !s_writing && ++s_frames_waiting >= USB_CDC_FLUSH_FRAMES)
+	{
+		// a producer of a higher priority may be about to reserve
+		primask = __get_PRIMASK();
+		__disable_irq();
+		if (!s_writing && s_fill != 0 && (uint16_t)(s_committed - s_sent) < USB_CDC_SLOTS - 1)
+		{
+			close_slot();
+		}
+		__set_PRIMASK(primask);
+	}
+	drain();
+	// the host ends a transfer on a short packet, so a stream that stops on a full packet gets an empty one
+	if (s_last_full && s_sent == s_committed && s_fill == 0 && USB_ep_write(USB_DESC_CDC_IN_EP, NULL, 0))
+	{
+		s_last_full = false;
+		s_stats.zero_length_packets++;
+	}
+}
+
+static const USB_class_t s_class = {
+	.reset			= class_reset,
+	.configured		= class_configured,
+	.setup			= class_setup,
+	.data_out		= class_data_out,
+	.start_of_frame = class_start_of_frame,
+};
+
+/*
+ ? Public functions
+*/
+
+bool USB_CDC_init(USB_CDC_rx_callback_t rx_callback)
+{
+	s_rx_callback = rx_callback;
+	return USB_register_class(&s_class);
+}
+
+bool USB_CDC_is_open()
+{
+	return USB_is_configured() && s_dtr;
+}
+
+uint8_t * USB_CDC_reserve(uint16_t length)
+{
+	if (length == 0 || length > USB_CDC_SLOT_SIZE || !USB_CDC_is_open())
+	{
+		s_stats.frames_dropped++;
+		return NULL;
+	}
+	// from here the start of frame leaves the open slot alone
+	s_writing = true;
+	__DMB();
+	if (s_fill + length > USB_CDC_SLOT_SIZE)
+	{
+		if ((uint16_t)(s_committed - s_sent) >= USB_CDC_SLOTS - 1)
+		{
+			s_writing = false;
+			s_stats.frames_dropped++;
+			return NULL;
+		}
+		close_slot();
+		drain_locked();
+	}
+	s_reserved = length;
+	return &s_slots[s_committed & SLOTS_MASK][s_fill];
+}
+
+void USB_CDC_commit()
+{
+	if (!s_writing)
+	{
+		return;
+	}
+	s_fill += s_reserved;
+	s_reserved = 0;
+	s_stats.frames++;
+	// a full slot goes right away, when the next slot is free
+	if (s_fill == USB_CDC_SLOT_SIZE && (uint16_t)(s_committed - s_sent) < USB_CDC_SLOTS - 1)
+	{
+		close_slot();
+		__DMB();
+		s_writing = false;
+		drain_locked();
+		return;
+	}
+	__DMB();
+	s_writing = false;
+}
+
+bool USB_CDC_write(const void * data, uint16_t length)
+{
+	uint8_t * frame = NULL;
+	if (data == NULL)
+	{
+		return false;
+	}
+	frame = USB_CDC_reserve(length);
+	if (frame == NULL)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < length; i++)
+	{
+		frame[i] = ((const uint8_t *)data)[i];
+	}
+	USB_CDC_commit();
+	return true;
+}
+
+uint8_t USB_CDC_get_free_slots()
+{
+	// the open slot is counted as used
+	return USB_CDC_SLOTS - 1 - (uint16_t)(s_committed - s_sent);
+}
+
+void USB_CDC_get_stats(USB_CDC_stats_t * stats)
+{
+	if (stats == NULL)
+	{
+		return;
+	}
+	*stats = s_stats;
+}
+
+void USB_CDC_startup()
+{
+	s_committed		 = 0;
+	s_sent			 = 0;
+	s_fill			 = 0;
+	s_writing		 = false;
+	s_frames_waiting = 0;
+	s_last_full		 = false;
+	s_dtr			 = false;
+	s_rx_callback	 = NULL;
+	s_stats			 = (USB_CDC_stats_t){ 0 };
+}
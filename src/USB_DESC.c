@@ -0,0 +1,334 @@
+#include "USB_DESC.h"
+
+#define LOW_BYTE(value)	 ((value) & 0xFF)
+#define HIGH_BYTE(value) (((value) >> 8) & 0xFF)
+
+/* 96 bit unique ID of the chip */
+#define UID_BASE  (0x1FFFF7E8U)
+#define UID_BYTES (12)
+
+#define STRING_LANGUAGE		(0)
+#define STRING_MANUFACTURER (1)
+#define STRING_PRODUCT		(2)
+#define STRING_SERIAL		(3)
+#define STRING_MIDI			(4)
+#define STRING_CDC			(5)
+#define MAX_STRING_CHARS	(31)
+
+#define MIDI_JACK_EMBEDDED (1)
+#define MIDI_JACK_EXTERNAL (2)
+/* jack ids: the host writes to the embedded IN jack and reads from the embedded OUT jack */
+#define JACK_IN_EMBEDDED  (1)
+#define JACK_IN_EXTERNAL  (2)
+#define JACK_OUT_EMBEDDED (3)
+#define JACK_OUT_EXTERNAL (4)
+
+/* class specific MIDI streaming descriptors, from the header to the last endpoint */
+#define MIDI_STREAMING_LENGTH (7 + 6 + 6 + 9 + 9 + 9 + 5 + 9 + 5)
+#define MIDI_LENGTH			  (8 + 9 + 9 + 9 + MIDI_STREAMING_LENGTH)
+#define CDC_LENGTH			  (8 + 9 + 5 + 5 + 4 + 5 + 7 + 9 + 7 + 7)
+#define CONFIGURATION_LENGTH  (9 + MIDI_LENGTH + CDC_LENGTH)
+
+#define CDC_CLASS			(0x02)
+#define CDC_SUBCLASS_ACM	(0x02)
+#define CDC_DATA_CLASS		(0x0A)
+#define CDC_HEADER			(0x00)
+#define CDC_CALL_MANAGEMENT (0x01)
+#define CDC_ACM				(0x02)
+#define CDC_UNION			(0x06)
+
+static const uint8_t s_device[] = {
+	18,
+	USB_DESC_DEVICE,
+	LOW_BYTE(0x0200), // USB 2.0
+	HIGH_BYTE(0x0200),
+	0xEF, // miscellaneous, the functions are grouped by association descriptors
+	0x02,
+	0x01,
+	USB_EP0_SIZE,
+	LOW_BYTE(USB_DESC_VENDOR_ID),
+	HIGH_BYTE(USB_DESC_VENDOR_ID),
+	LOW_BYTE(USB_DESC_PRODUCT_ID),
+	HIGH_BYTE(USB_DESC_PRODUCT_ID),
+	LOW_BYTE(USB_DESC_DEVICE_BCD),
+	HIGH_BYTE(USB_DESC_DEVICE_BCD),
+	STRING_MANUFACTURER,
+	STRING_PRODUCT,
+	STRING_SERIAL,
+	1, // configurations
+};
+
+static const uint8_t s_configuration[] = {
+	9,
+	USB_DESC_CONFIGURATION,
+	LOW_BYTE(CONFIGURATION_LENGTH),
+	HIGH_BYTE(CONFIGURATION_LENGTH),
+	4, // interfaces
+	1, // configuration value
+	0,
+	0x80, // bus powered
+	50,	  // 100mA
+	/* MIDI function */
+	8,
+	USB_DESC_ASSOCIATION,
+	USB_DESC_MIDI_CONTROL_INTERFACE,
+	2, // interfaces
+	1, // audio
+	1, // audio control, as the first interface
+	0,
+	STRING_MIDI,
+	/* audio control interface, required by the MIDI streaming interface and empty */
+	9,
+	USB_DESC_INTERFACE,
+	USB_DESC_MIDI_CONTROL_INTERFACE,
+	0,
+	0, // endpoints
+	1, // audio
+	1, // audio control
+	0,
+	0,
+	9,
+	USB_DESC_CS_INTERFACE,
+	1, // header
+	LOW_BYTE(0x0100),
+	HIGH_BYTE(0x0100),
+	LOW_BYTE(9),
+	HIGH_BYTE(9),
+	1, // streaming interfaces
+	USB_DESC_MIDI_STREAMING_INTERFACE,
+	/* MIDI streaming interface */
+	9,
+	USB_DESC_INTERFACE,
+	USB_DESC_MIDI_STREAMING_INTERFACE,
+	0,
+	2, // endpoints
+	1, // audio
+	3, // MIDI streaming
+	0,
+	STRING_MIDI,
+	7,
+	USB_DESC_CS_INTERFACE,
+	1, // header
+	LOW_BYTE(0x0100),
+	HIGH_BYTE(0x0100),
+	LOW_BYTE(MIDI_STREAMING_LENGTH),
+	HIGH_BYTE(MIDI_STREAMING_LENGTH),
+	6,
+	USB_DESC_CS_INTERFACE,
+	2, // MIDI IN jack
+	MIDI_JACK_EMBEDDED,
+	JACK_IN_EMBEDDED,
+	0,
+	6,
+	USB_DESC_CS_INTERFACE,
+	2, // MIDI IN jack
+	MIDI_JACK_EXTERNAL,
+	JACK_IN_EXTERNAL,
+	0,
+	9,
+	USB_DESC_CS_INTERFACE,
+	3, // MIDI OUT jack
+	MIDI_JACK_EMBEDDED,
+	JACK_OUT_EMBEDDED,
+	1, // input pins
+	JACK_IN_EXTERNAL,
+	1,
+	0,
+	9,
+	USB_DESC_CS_INTERFACE,
+	3, // MIDI OUT jack
+	MIDI_JACK_EXTERNAL,
+	JACK_OUT_EXTERNAL,
+	1, // input pins
+	JACK_IN_EMBEDDED,
+	1,
+	0,
+	/* bulk OUT, audio endpoints have 2 extra bytes */
+	9,
+	USB_DESC_ENDPOINT,
+	USB_DESC_MIDI_OUT_EP,
+	USB_EP_BULK,
+	LOW_BYTE(USB_DESC_MIDI_OUT_SIZE),
+	HIGH_BYTE(USB_DESC_MIDI_OUT_SIZE),
+	0,
+	0,
+	0,
+	5,
+	USB_DESC_CS_ENDPOINT,
+	1, // general
+	1, // jacks
+	JACK_IN_EMBEDDED,
+	/* bulk IN */
+	9,
+	USB_DESC_ENDPOINT,
+	USB_DESC_MIDI_IN_EP,
+	USB_EP_BULK,
+	LOW_BYTE(USB_DESC_MIDI_IN_SIZE),
+	HIGH_BYTE(USB_DESC_MIDI_IN_SIZE),
+	0,
+	0,
+	0,
+	5,
+	USB_DESC_CS_ENDPOINT,
+	1, // general
+	1, // jacks
+	JACK_OUT_EMBEDDED,
+	/* CDC function */
+	8,
+	USB_DESC_ASSOCIATION,
+	USB_DESC_CDC_CONTROL_INTERFACE,
+	2, // interfaces
+	CDC_CLASS,
+	CDC_SUBCLASS_ACM,
+	0,
+	STRING_CDC,
+	9,
+	USB_DESC_INTERFACE,
+	USB_DESC_CDC_CONTROL_INTERFACE,
+	0,
+	1, // endpoints
+	CDC_CLASS,
+	CDC_SUBCLASS_ACM,
+	0, // no AT commands
+	STRING_CDC,
+	5,
+	USB_DESC_CS_INTERFACE,
+	CDC_HEADER,
+	LOW_BYTE(0x0110),
+	HIGH_BYTE(0x0110),
+	5,
+	USB_DESC_CS_INTERFACE,
+	CDC_CALL_MANAGEMENT,
+	0, // no call management
+	USB_DESC_CDC_DATA_INTERFACE,
+	4,
+	USB_DESC_CS_INTERFACE,
+	CDC_ACM,
+	0x02, // line coding and control line state requests
+	5,
+	USB_DESC_CS_INTERFACE,
+	CDC_UNION,
+	USB_DESC_CDC_CONTROL_INTERFACE,
+	USB_DESC_CDC_DATA_INTERFACE,
+	7,
+	USB_DESC_ENDPOINT,
+	USB_DESC_CDC_NOTIFY_EP,
+	USB_EP_INTERRUPT,
+	LOW_BYTE(USB_DESC_CDC_NOTIFY_SIZE),
+	HIGH_BYTE(USB_DESC_CDC_NOTIFY_SIZE),
+	255, // ms, nothing is notified
+	9,
+	USB_DESC_INTERFACE,
+	USB_DESC_CDC_DATA_INTERFACE,
+	0,
+	2, // endpoints
+	CDC_DATA_CLASS,
+	0,
+	0,
+	0,
+	7,
+	USB_DESC_ENDPOINT,
+	USB_DESC_CDC_OUT_EP,
+	USB_EP_BULK,
+	LOW_BYTE(USB_DESC_CDC_OUT_SIZE),
+	HIGH_BYTE(USB_DESC_CDC_OUT_SIZE),
+	0,
+	7,
+	USB_DESC_ENDPOINT,
+	USB_DESC_CDC_IN_EP,
+	USB_EP_BULK,
+	LOW_BYTE(USB_DESC_CDC_IN_SIZE),
+	HIGH_BYTE(USB_DESC_CDC_IN_SIZE),
+	0,
+};
+
+static const uint8_t s_language[] = { 4, USB_DESC_STRING, LOW_BYTE(0x0409), HIGH_BYTE(0x0409) }; // english
+
+static const char * const s_strings[] = {
+	[STRING_MANUFACTURER] = "HammerPiano",
+	[STRING_PRODUCT]	  = "synth-lib",
+	[STRING_MIDI]		  = "synth-lib MIDI",
+	[STRING_CDC]		  = "synth-lib telemetry",
+};
+
+/* string descriptors are built on request, a request is done before the next one starts */
+static uint8_t s_string[2 + 2 * MAX_STRING_CHARS];
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function builds a string descriptor from an ASCII string
+ *
+ * @param text the string
+ * @param length set to the descriptor length
+ * @return const uint8_t* the descriptor
+ */
+static const uint8_t * build_string(const char * text, uint16_t * length)
+{
+	uint8_t count = 0;
+	for (; text[count] != '\0' && count < MAX_STRING_CHARS; count++)
+	{
+		s_string[2 + 2 * count] = text[count];
+		s_string[3 + 2 * count] = 0;
+	}
+	s_string[0] = 2 + 2 * count;
+	s_string[1] = USB_DESC_STRING;
+	*length		= s_string[0];
+	return s_string;
+}
+
+/**
+ * @brief This function builds the serial number string from the unique ID of the chip
+ *
+ * @param length set to the descriptor length
+ * @return const uint8_t* the descriptor
+ */
+static const uint8_t * build_serial(uint16_t * length)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	const uint8_t *	  uid	   = (const uint8_t *)UID_BASE;
+	char			  text[2 * UID_BYTES + 1];
+	for (size_t i = 0; i < UID_BYTES; i++)
+	{
+		text[2 * i]		= digits[uid[i] >> 4];
+		text[2 * i + 1] = digits[uid[i] & 0x0F];
+	}
+	text[2 * UID_BYTES] = '\0';
+	return build_string(text, length);
+}
+
+/*
+ ? Public functions
+*/
+
+const uint8_t * USB_DESC_get(uint8_t type, uint8_t index, uint16_t * length)
+{
+	switch (type)
+	{
+	case USB_DESC_DEVICE:
+		*length = sizeof(s_device);
+		return s_device;
+	case USB_DESC_CONFIGURATION:
+		*length = sizeof(s_configuration);
+		return index == 0 ? s_configuration : NULL;
+	case USB_DESC_STRING:
+		if (index == STRING_LANGUAGE)
+		{
+			*length = sizeof(s_language);
+			return s_language;
+		}
+		if (index == STRING_SERIAL)
+		{
+			return build_serial(length);
+		}
+		if (index < sizeof(s_strings) / sizeof(s_strings[0]) && s_strings[index] != NULL)
+		{
+			return build_string(s_strings[index], length);
+		}
+		return NULL;
+	default:
+		return NULL;
+	}
+}
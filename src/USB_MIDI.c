@@ -0,0 +1,354 @@
+#include "USB_MIDI.h"
+#include "USB.h"
+#include "USB_DESC.h"
+
+#define TX_MASK			   (USB_MIDI_TX_PACKETS - 1)
+#define RX_MASK			   (USB_MIDI_RX_SIZE - 1)
+#define PACKET_SIZE		   (4)
+#define OUT_PACKETS		   (USB_DESC_MIDI_OUT_SIZE / PACKET_SIZE)
+#define PACKET_CABLE(byte) ((byte) >> 4)
+#define PACKET_CIN(byte)   ((byte) & 0x0F)
+
+static uint8_t			 s_tx[USB_MIDI_TX_PACKETS][PACKET_SIZE];
+static uint16_t			 s_tx_head = 0; // written by USB_MIDI_send only
+static volatile uint16_t s_tx_tail = 0; // written by flush only
+static uint8_t			 s_tx_frames; // frames the oldest queued packet waited
+/* SysEx bytes that did not fill a packet, they go with the next chunk */
+static uint8_t			 s_sysex[2];
+static uint8_t			 s_sysex_count = 0;
+static uint8_t			 s_rx[USB_MIDI_RX_SIZE];
+static volatile uint16_t s_rx_head = 0; // written by the USB interrupt
+static uint16_t			 s_rx_tail = 0; // written by USB_MIDI_consume
+static USB_MIDI_stats_t	 s_stats;
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function returns how many bytes of a packet from the host are MIDI bytes
+ *
+ * @param packet the packet
+ * @return uint8_t number of bytes, 0 for a reserved code index
+ */
+static uint8_t packet_length(const uint8_t * packet)
+{
+	switch (PACKET_CIN(packet[0]))
+	{
+	case USB_MIDI_CIN_COMMON_2:
+	case USB_MIDI_CIN_SYSEX_END_2:
+		return 2;
+	case USB_MIDI_CIN_COMMON_3:
+	case USB_MIDI_CIN_SYSEX:
+	case USB_MIDI_CIN_SYSEX_END_3:
+		return 3;
+	case USB_MIDI_CIN_SYSEX_END_1:
+	case USB_MIDI_CIN_SINGLE_BYTE:
+		return 1;
+	case 0x0:
+	case 0x1:
+		return 0;
+	default:
+		return MIDI_data_length(packet[1]) + 1;
+	}
+}
+
+/**
+ * @brief This function hands the next transfer of queued packets to the IN endpoint
+ *
+ * @remarks Called from the USB interrupt, or with the interrupts disabled
+ */
+static void flush()
+{
+	uint16_t tail  = s_tx_tail;
+	uint16_t count = s_tx_head - tail;
+	uint16_t index = tail & TX_MASK;
+	if (count == 0)
+	{
+		return;
+	}
+	count = count > USB_MIDI_PACKETS_PER_TRANSFER ? USB_MIDI_PACKETS_PER_TRANSFER : count;
+	// a transfer is contiguous, the end of the ring makes a shorter one
+	count = index + count > USB_MIDI_TX_PACKETS ? USB_MIDI_TX_PACKETS - index : count;
+	if (!USB_ep_write(USB_DESC_MIDI_IN_EP, s_tx[index], count * PACKET_SIZE))
+	{
+		return;
+	}
+	s_tx_tail = tail + count;
+	s_stats.tx_packets += count;
+	s_stats.tx_transfers++;
+	if (s_tx_tail == s_tx_head)
+	{
+		s_tx_frames = 0;
+	}
+}
+
+/**
+ * @brief This function flushes only full transfers, the partial ones wait for the start of frame
+ *
+ */
+static void flush_full()
+{
+	if ((uint16_t)(s_tx_head - s_tx_tail) >= USB_MIDI_PACKETS_PER_TRANSFER)
+	{
+		flush();
+	}
+}
+
+/**
+ * @brief This function queues a packet, the room must be checked first
+ *
+ * @param cin code index number
+ * @param bytes up to 3 MIDI bytes
+ * @param length how many bytes, the packet is padded with zeros
+ */
+static void push_packet(uint8_t cin, const uint8_t * bytes, uint8_t length)
+{
+	uint8_t * packet = s_tx[s_tx_head & TX_MASK];
+	packet[0]		 = (USB_MIDI_CABLE << 4) | cin;
+	for (size_t i = 0; i < 3; i++)
+	{
+		packet[i + 1] = i < length ? bytes[i] : 0;
+	}
+	s_tx_head++;
+}
+
+/**
+ * @brief This function packs a SysEx chunk, bytes that do not fill a packet wait for the next chunk
+ *
+ * @param event the chunk
+ */
+static void push_sysex(const MIDI_event_t * event)
+{
+	uint8_t bytes[MIDI_MAX_EVENT_BYTES];
+	uint8_t packet[3];
+	uint8_t count = 0;
+	if (event->flags & MIDI_FLAG_SYSEX_FIRST)
+	{
+		// an aborted SysEx was already closed, drop what is left of any other
+		s_sysex_count	= 0;
+		bytes[count++] = MIDI_SYSEX_START;
+	}
+	for (size_t i = 0; i < event->length && i < MIDI_SYSEX_CHUNK_SIZE; i++)
+	{
+		bytes[count++] = event->data[i];
+	}
+	if (event->flags & MIDI_FLAG_SYSEX_LAST)
+	{
+		bytes[count++] = MIDI_SYSEX_END;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		if (s_sysex_count < 2)
+		{
+			s_sysex[s_sysex_count++] = bytes[i];
+			continue;
+		}
+		packet[0] = s_sysex[0];
+		packet[1] = s_sysex[1];
+		packet[2] = bytes[i];
+		push_packet(bytes[i] == MIDI_SYSEX_END ? USB_MIDI_CIN_SYSEX_END_3 : USB_MIDI_CIN_SYSEX, packet, 3);
+		s_sysex_count = 0;
+	}
+	if ((event->flags & MIDI_FLAG_SYSEX_LAST) && s_sysex_count != 0)
+	{
+		push_packet(USB_MIDI_CIN_SYSEX_END_1 + s_sysex_count - 1, s_sysex, s_sysex_count);
+		s_sysex_count = 0;
+	}
+}
+
+/**
+ * @brief This function moves the packets of the OUT endpoint to the receive buffer, as long as there is room
+ *
+ * @remarks Called from the USB interrupt, or with the interrupts disabled
+ */
+static void receive()
+{
+	uint8_t	 packets[USB_DESC_MIDI_OUT_SIZE];
+	uint16_t count	= 0;
+	uint16_t length = 0;
+	uint16_t head	= s_rx_head;
+	while (USB_ep_peek_length(USB_DESC_MIDI_OUT_EP) >= 0)
+	{
+		// a full packet of the endpoint must fit, or it stays with the USB and the host gets NAK
+		if (USB_MIDI_RX_SIZE - (uint16_t)(head - s_rx_tail) < OUT_PACKETS * 3)
+		{
+			s_stats.rx_throttled++;
+			break;
+		}
+		count = USB_ep_read(USB_DESC_MIDI_OUT_EP, packets);
+		for (size_t i = 0; i + PACKET_SIZE <= count; i += PACKET_SIZE)
+		{
+			length = packet_length(&packets[i]);
+			if (length == 0 || PACKET_CABLE(packets[i]) != USB_MIDI_CABLE)
+			{
+				s_stats.rx_invalid++;
+				continue;
+			}
+			s_stats.rx_packets++;
+			for (size_t j = 0; j < length; j++)
+			{
+				s_rx[head++ & RX_MASK] = packets[i + 1 + j];
+			}
+		}
+	}
+	s_rx_head = head;
+}
+
+/*
+ ? USB callbacks
+*/
+
+static void out_callback(uint8_t ep)
+{
+	receive();
+}
+
+static void in_callback(uint8_t ep)
+{
+	// keep the endpoint busy while full transfers wait, a partial one still waits for its frame
+	flush_full();
+}
+
+static void class_reset()
+{
+	s_tx_tail	  = s_tx_head;
+	s_tx_frames	  = 0;
+	s_sysex_count = 0;
+}
+
+static void class_configured()
+{
+	USB_ep_open(USB_DESC_MIDI_OUT_EP, USB_EP_BULK, USB_DESC_MIDI_OUT_SIZE, true, out_callback);
+	USB_ep_open(USB_DESC_MIDI_IN_EP, USB_EP_BULK, USB_DESC_MIDI_IN_SIZE, true, in_callback);
+}
+
+static void class_start_of_frame(uint16_t frame)
+{
+	if (s_tx_head == s_tx_tail)
+	{
+		return;
+	}
+	if (++s_tx_frames >= USB_MIDI_FLUSH_FRAMES)
+	{
+		flush();
+	}
+}
+
+static const USB_class_t s_class = {
+	.reset			= class_reset,
+	.configured		= class_configured,
+	.setup			= NULL, // MIDI streaming has no class requests
+	.data_out		= NULL,
+	.start_of_frame = class_start_of_frame,
+};
+
+/*
+ ? Public functions
+*/
+
+bool USB_MIDI_init()
+{
+	return USB_register_class(&s_class);
+}
+
+bool USB_MIDI_send(const MIDI_event_t * event)
+{
+	uint8_t	 bytes[3];
+	uint8_t	 length	 = 0;
+	uint8_t	 cin	 = 0;
+	uint32_t primask = 0;
+	if (event == NULL || !MIDI_IS_STATUS(event->status))
+	{
+		return false;
+	}
+	if (!USB_is_configured() || USB_MIDI_is_busy())
+	{
+		s_stats.tx_dropped++;
+		return false;
+	}
+	if (event->status == MIDI_SYSEX_START)
+	{
+		push_sysex(event);
+	}
+	else
+	{
+		length	 = MIDI_data_length(event->status);
+		bytes[0] = event->status;
+		bytes[1] = length > 0 ? event->data[0] : 0;
+		bytes[2] = length > 1 ? event->data[1] : 0;
+		if (event->status < MIDI_SYSEX_START)
+		{
+			cin = event->status >> 4;
+		}
+		else if (MIDI_IS_REALTIME(event->status))
+		{
+			cin = USB_MIDI_CIN_SINGLE_BYTE;
+		}
+		else if (length == 0)
+		{
+			// tune request, a single byte system common message shares the code of a 1 byte SysEx end
+			cin = USB_MIDI_CIN_SYSEX_END_1;
+		}
+		else
+		{
+			cin = length == 1 ? USB_MIDI_CIN_COMMON_2 : USB_MIDI_CIN_COMMON_3;
+		}
+		push_packet(cin, bytes, length + 1);
+	}
+	// the USB interrupt flushes too
+	primask = __get_PRIMASK();
+	__disable_irq();
+	flush_full();
+	__set_PRIMASK(primask);
+	return true;
+}
+
+bool USB_MIDI_is_busy()
+{
+	return USB_MIDI_TX_PACKETS - (uint16_t)(s_tx_head - s_tx_tail) < USB_MIDI_MAX_EVENT_PACKETS;
+}
+
+uint16_t USB_MIDI_peek(const uint8_t ** data)
+{
+	uint16_t count = s_rx_head - s_rx_tail;
+	uint16_t index = s_rx_tail & RX_MASK;
+	if (data == NULL)
+	{
+		return 0;
+	}
+	*data = &s_rx[index];
+	return index + count > USB_MIDI_RX_SIZE ? USB_MIDI_RX_SIZE - index : count;
+}
+
+void USB_MIDI_consume(uint16_t count)
+{
+	uint16_t waiting = s_rx_head - s_rx_tail;
+	uint32_t primask = 0;
+	s_rx_tail += count > waiting ? waiting : count;
+	// packets that did not fit wait with the USB, nothing calls back for them
+	primask = __get_PRIMASK();
+	__disable_irq();
+	receive();
+	__set_PRIMASK(primask);
+}
+
+void USB_MIDI_get_stats(USB_MIDI_stats_t * stats)
+{
+	if (stats == NULL)
+	{
+		return;
+	}
+	*stats = s_stats;
+}
+
+void USB_MIDI_startup()
+{
+	s_tx_head	  = 0;
+	s_tx_tail	  = 0;
+	s_tx_frames	  = 0;
+	s_sysex_count = 0;
+	s_rx_head	  = 0;
+	s_rx_tail	  = 0;
+	s_stats		  = (USB_MIDI_stats_t){ 0 };
+}
@@ -0,0 +1,350 @@
+#include "WAVE.h"
+#include "DMA.h"
+#include "RCC.h"
+#include "utils.h"
+
+/* the half with the end of a stream is not known yet */
+#define NO_HALF (-1)
+
+typedef enum
+{
+	WAVE_MODE_ONCE,
+	WAVE_MODE_LOOP,
+	WAVE_MODE_STREAM
+} WAVE_MODE_t;
+
+typedef struct
+{
+	periph_ptr_t	bsrr;
+	DMA_CHANNELS_t	dma;
+	WAVE_refill_t	refill;
+	WAVE_callback_t callback;
+	uint32_t *		ring;
+	uint16_t		count;
+	uint8_t			mode;
+	volatile int8_t end_half; // the stream stops once this half is sent
+	volatile bool	busy;
+	bool			init;
+	WAVE_stats_t	stats;
+} WAVE_engine_t;
+
+static WAVE_engine_t s_engines[TIM_COUNT];
+
+/*
+ ? static functions
+*/
+
+/**
+ * @brief This function sets the period of the timer of an engine
+ *
+ * @param timer the engine
+ * @param rate words per second
+ * @return WAVE_ERR_t errors if any
+ */
+static WAVE_ERR_t set_rate(TIM_t timer, uint32_t rate)
+{
+	if (rate == 0)
+	{
+		return WAVE_INVALID_CONFIG;
+	}
+	if (rate > WAVE_MAX_RATE || TIM_init(timer, rate) == false)
+	{
+		return WAVE_TOO_FAST;
+	}
+	return WAVE_NO_ERR;
+}
+
+/**
+ * @brief This function stops the timer and the DMA channel of an engine
+ *
+ * @param timer the engine
+ */
+static void stop(TIM_t timer)
+{
+	WAVE_engine_t * engine = &s_engines[timer];
+	TIM_stop(timer);
+	TIM_set_dma_request(timer, TIM_DMA_UPDATE, false);
+	DMA_stop_channel(engine->dma);
+	engine->busy = false;
+}
+
+/**
+ * @brief This function ends a waveform after its last word
+ *
+ * @param timer the engine
+ */
+static void finish(TIM_t timer)
+{
+	WAVE_callback_t callback = s_engines[timer].callback;
+	stop(timer);
+	// the callback may start the next waveform
+	if (callback != NULL)
+	{
+		callback(timer);
+	}
+}
+
+/**
+ * @brief This function refills a half of the ring of a stream
+ *
+ * @param timer the engine
+ * @param half which half
+ */
+static void refill_half(TIM_t timer, int8_t half)
+{
+	WAVE_engine_t * engine = &s_engines[timer];
+	uint16_t		count  = engine->count / 2;
+	uint32_t		start  = utils_get_cycles();
+	bool			ended  = engine->refill(timer, &engine->ring[half * count], count);
+	uint32_t		cycles = utils_get_cycles() - start;
+	engine->stats.refills++;
+	engine->stats.last_refill_cycles = cycles;
+	if (cycles > engine->stats.max_refill_cycles)
+	{
+		engine->stats.max_refill_cycles = cycles;
+	}
+	if (ended && engine->end_half == NO_HALF)
+	{
+		engine->end_half = half;
+	}
+}
+
+/**
+ * @brief This function handles the interrupts of the DMA channels of all the engines
+ *
+ * @param dma_channel_number the channel
+ * @param flags DMA flags
+ */
+static void dma_callback(DMA_CHANNELS_t dma_channel_number, uint32_t flags)
+{
+	WAVE_engine_t * engine	  = NULL;
+	uint16_t		remaining = 0;
+	for (size_t timer = 0; timer < TIM_COUNT; timer++)
+	{
+		engine = &s_engines[timer];
+		if (!engine->busy || engine->dma != dma_channel_number)
+		{
+			continue;
+		}
+		if (engine->mode == WAVE_MODE_ONCE)
+		{
+			if (flags & DMA_FLAG_FINISHED)
+			{
+				finish(timer);
+			}
+			return;
+		}
+		for (int8_t half = 0; half < 2; half++)
+		{
+			if ((flags & (half == 0 ? DMA_FLAG_HALF : DMA_FLAG_FINISHED)) == 0)
+			{
+				continue;
+			}
+			if (engine->end_half == half)
+			{
+				finish(timer);
+				return;
+			}
+			// the DMA should be in the other half, else it already sends this one again
+			remaining = DMA_get_remaining(engine->dma);
+			if ((half == 0) != (remaining <= engine->count / 2))
+			{
+				engine->stats.late_refills++;
+			}
+			refill_half(timer, half);
+		}
+		return;
+	}
+}
+
+/**
+ * @brief This function starts the DMA channel and the timer of an engine
+ *
+ * @param timer the engine
+ * @param words first word
+ * @param count how many words
+ */
+static void start(TIM_t timer, const uint32_t * words, uint16_t count)
+{
+	WAVE_engine_t * engine = &s_engines[timer];
+	engine->busy		   = true;
+	DMA_stop_channel(engine->dma);
+	DMA_channel_clear_flags(engine->dma);
+	DMA_set_memory(engine->dma, words);
+	DMA_set_circular(engine->dma, engine->mode != WAVE_MODE_ONCE);
+	// a loop needs no interrupt at all
+	DMA_set_callback(engine->dma, engine->mode == WAVE_MODE_LOOP ? NULL : dma_callback);
+	DMA_start_channel(engine->dma, count, false);
+	TIM_reload(timer);
+	TIM_set_dma_request(timer, TIM_DMA_UPDATE, true);
+	TIM_start(timer);
+}
+
+/**
+ * @brief This function checks that an engine can start a waveform
+ *
+ * @param timer the engine
+ * @return WAVE_ERR_t errors if any
+ */
+static WAVE_ERR_t check_idle(TIM_t timer)
+{
+	if (timer >= TIM_COUNT || !s_engines[timer].init)
+	{
+		return WAVE_NOT_INIT;
+	}
+	if (s_engines[timer].busy)
+	{
+		return WAVE_BUSY;
+	}
+	return WAVE_NO_ERR;
+}
+
+/*
+ ? Public functions
+*/
+
+WAVE_ERR_t WAVE_init(const WAVE_config_t * config)
+{
+	DMA_address_t	periph = { .access_size = DMA_ACCESS_32BIT, .address = NULL, .increament_address = false };
+	DMA_address_t	memory = { .access_size = DMA_ACCESS_32BIT, .address = NULL, .increament_address = true };
+	WAVE_engine_t * engine = NULL;
+	WAVE_ERR_t		error  = WAVE_NO_ERR;
+	if (config == NULL)
+	{
+		return WAVE_NULL;
+	}
+	if (config->timer >= TIM_COUNT || GPIO_get_bsrr(config->port) == NULL)
+	{
+		return WAVE_INVALID_CONFIG;
+	}
+	engine = &s_engines[config->timer];
+	if (engine->init)
+	{
+		return WAVE_ALREADY_INIT;
+	}
+	error = set_rate(config->timer, config->rate);
+	if (error != WAVE_NO_ERR)
+	{
+		return error;
+	}
+	engine->bsrr   = GPIO_get_bsrr(config->port);
+	engine->dma	   = TIM_get_dma_channel(config->timer, TIM_DMA_UPDATE);
+	periph.address = (uint32_t *)engine->bsrr;
+	RCC_peripheral_set_clock(RCC_DMA1, true);
+	if (DMA_init_channel(engine->dma, &periph, &memory, DMA_CH_PRIORITY_VERY_HIGH, DMA_DIRECTION_MEM_TO_PERIPH,
+						 DMA_INTERRUPT_HALF | DMA_INTERRUPT_COMPLETE) == false)
+	{
+		return WAVE_DMA_BUSY;
+	}
+	utils_cycle_counter_start();
+	engine->init = true;
+	return WAVE_NO_ERR;
+}
+
+WAVE_ERR_t WAVE_set_rate(TIM_t timer, uint32_t rate)
+{
+	WAVE_ERR_t error = check_idle(timer);
+	if (error != WAVE_NO_ERR)
+	{
+		return error;
+	}
+	return set_rate(timer, rate);
+}
+
+uint32_t WAVE_get_rate(TIM_t timer)
+{
+	if (timer >= TIM_COUNT || !s_engines[timer].init)
+	{
+		return 0;
+	}
+	return TIM_get_frequency(timer);
+}
+
+WAVE_ERR_t WAVE_play(TIM_t timer, const uint32_t * words, uint16_t count, bool loop, WAVE_callback_t callback)
+{
+	WAVE_ERR_t error = check_idle(timer);
+	if (error != WAVE_NO_ERR)
+	{
+		return error;
+	}
+	if (words == NULL)
+	{
+		return WAVE_NULL;
+	}
+	if (count == 0)
+	{
+		return WAVE_INVALID_CONFIG;
+	}
+	s_engines[timer].mode	  = loop ? WAVE_MODE_LOOP : WAVE_MODE_ONCE;
+	s_engines[timer].callback = callback;
+	start(timer, words, count);
+	return WAVE_NO_ERR;
+}
+
+WAVE_ERR_t WAVE_stream(TIM_t timer, uint32_t * ring, uint16_t count, WAVE_refill_t refill, WAVE_callback_t callback)
+{
+	WAVE_engine_t * engine = NULL;
+	WAVE_ERR_t		error  = check_idle(timer);
+	if (error != WAVE_NO_ERR)
+	{
+		return error;
+	}
+	if (ring == NULL || refill == NULL)
+	{
+		return WAVE_NULL;
+	}
+	if (count < 2 || count % 2 != 0)
+	{
+		return WAVE_INVALID_CONFIG;
+	}
+	engine			 = &s_engines[timer];
+	engine->mode	 = WAVE_MODE_STREAM;
+	engine->ring	 = ring;
+	engine->count	 = count;
+	engine->refill	 = refill;
+	engine->callback = callback;
+	engine->end_half = NO_HALF;
+	refill_half(timer, 0);
+	refill_half(timer, 1);
+	start(timer, ring, count);
+	return WAVE_NO_ERR;
+}
+
+void WAVE_stop(TIM_t timer)
+{
+	if (timer >= TIM_COUNT || !s_engines[timer].busy)
+	{
+		return;
+	}
+	stop(timer);
+}
+
+bool WAVE_is_busy(TIM_t timer)
+{
+	if (timer >= TIM_COUNT)
+	{
+		return false;
+	}
+	return s_engines[timer].busy;
+}
+
+void WAVE_get_stats(TIM_t timer, WAVE_stats_t * stats)
+{
+	uint32_t primask = 0;
+	if (timer >= TIM_COUNT || stats == NULL)
+	{
+		return;
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	*stats = s_engines[timer].stats;
+	__set_PRIMASK(primask);
+}
+
+void WAVE_startup()
+{
+	for (size_t i = 0; i < TIM_COUNT; i++)
+	{
+		s_engines[i] = (WAVE_engine_t){ .dma = DMA_CH_COUNT, .end_half = NO_HALF };
+	}
+}
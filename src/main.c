@@ -1,6 +1,6 @@
 #include "ADC.h"
-#include "DMA.h"
 #include "GPIO.h"
+#include "POT.h"
 
 #define SPACE_LENGTH (720000)
 #define DOT_LENGTH	 SPACE_LENGTH
@@ -43,33 +43,47 @@ Digits is common anode
 */
 const uint16_t LED_7SEG_VALUES[] = { 0x40, 0x79, 0x24, 0x30, 0x19, 0x12, 0x02, 0x78, 0x0, 0x10, 0x08, 0x03, 0x46, 0x21, 0x06, 0x0E };
 
+static GPIO_PIN_ARRAY_t s_x_bargraph = { 0 };
+static GPIO_PIN_ARRAY_t s_y_bargraph = { 0 };
+static POT_bank_t		s_pots		 = { 0 };
+
 int main()
 {
 	uint8_t	 adc_pins[] = {8, 9};// pins B0, B1 are inputs 8,9 of the ADC1
 	uint16_t 		 adc_data[2] = {0}; // X and Y values of potentiometer
-	GPIO_PIN_ARRAY_t x_bargraph	= { 0 };
-	GPIO_PIN_ARRAY_t y_bargraph	= { 0 };
-	GPIO_PIN_ARRAY_t adc_inputs = { 0 };
-	GPIO_array_init(&x_bargraph, LED_X_PORT, LED_X_START, LED_X_END, GPIO_MODE_OUTPUT, GPIO_CONFIG_OUTPUT_PUSH_PULL);
-	GPIO_array_init(&y_bargraph, LED_Y_PORT, LED_Y_START, LED_Y_END, GPIO_MODE_OUTPUT, GPIO_CONFIG_OUTPUT_PUSH_PULL);
+	// pots are slow and high impedance, the longest sampling time settles them and keeps the DMA interrupts rare
+	ADC_SAMPLING_TIME_t adc_times[] = { ADC_SAMPLING_239_5, ADC_SAMPLING_239_5 };
+	GPIO_PIN_ARRAY_t	adc_inputs	= { 0 };
+	uint32_t			moved		= 0;
+	uint32_t			sequence	= 0;
+	uint32_t			last_seen	= 0;
+	GPIO_array_init(&s_x_bargraph, LED_X_PORT, LED_X_START, LED_X_END, GPIO_MODE_OUTPUT, GPIO_CONFIG_OUTPUT_PUSH_PULL);
+	GPIO_array_init(&s_y_bargraph, LED_Y_PORT, LED_Y_START, LED_Y_END, GPIO_MODE_OUTPUT, GPIO_CONFIG_OUTPUT_PUSH_PULL);
 	GPIO_array_init(&adc_inputs, GPIO_PORT_B, 0, 1, GPIO_MODE_INPUT, GPIO_CONFIG_INPUT_ANALOG);
-	ADC_init(adc_pins, sizeof(adc_pins) / sizeof(adc_pins[0]), adc_data);
-	GPIO_array_write_all(&y_bargraph, 0);
-	GPIO_array_write_all(&x_bargraph, 0);
+	ADC_init_ex(adc_pins, adc_times, sizeof(adc_pins) / sizeof(adc_pins[0]), adc_data);
+	GPIO_array_write_all(&s_y_bargraph, 0);
+	GPIO_array_write_all(&s_x_bargraph, 0);
+	POT_bank_init(&s_pots, 2, POT_DEFAULT_SMOOTHING, POT_DEFAULT_HYSTERESIS);
+	// The ADC keeps sampling in the background, the pots are read from a snapshot once per millisecond
+	ADC_start(ADC_mode_loop, 2);
 	while (1)
 	{
-		// each button press increase the index one time only
-		ADC_start(ADC_mode_single, 2);
-		// The EOF flag gets reset by the ADC everytime the DMA reads it, a kind of race condition
-		// Read the DMA finished flag instead
-		while (DMA_channel_get_flag(DMA_CH1_ADC1, DMA_FLAG_FINISHED) == 0)
+		delay(1);
+		sequence = ADC_read_snapshot(adc_data);
+		if (sequence == 0 || sequence == last_seen)
+		{
+			continue; // no new sequence yet
+		}
+		last_seen = sequence;
+		// only touch the LEDs when a pot really moved, not on every noisy reading
+		moved = POT_bank_update(&s_pots, adc_data);
+		if (moved & 1)
 		{
-			asm ("nop");
+			GPIO_array_write_value(&s_x_bargraph, 1 << (POT_get_value(&s_pots, 0) / ADC_LED_RANGE));
+		}
+		if (moved & 2)
+		{
+			GPIO_array_write_value(&s_y_bargraph, 1 << (POT_get_value(&s_pots, 1) / ADC_LED_RANGE));
 		}
-		DMA_stop_channel(DMA_CH1_ADC1);
-		
-		GPIO_array_write_value(&x_bargraph, 1 << (adc_data[0] / ADC_LED_RANGE));
-		GPIO_array_write_value(&y_bargraph, 1 << (adc_data[1] / ADC_LED_RANGE));
-		// wait for release
 	}
-}
\ No newline at end of file
+}
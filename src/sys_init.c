@@ -8,9 +8,26 @@ usb debug msgs and watchdogs
 */
 
 #include "ADC.h"
+#include "BUS.h"
+#include "CAPTURE.h"
+#include "DISPLAY.h"
 #include "DMA.h"
 #include "GPIO.h"
+#include "I2C.h"
+#include "LCD.h"
+#include "MUX.h"
 #include "RCC.h"
+#include "ROUTER.h"
+#include "SCAN.h"
+#include "SHIFT.h"
+#include "SPI.h"
+#include "TFT.h"
+#include "TIM.h"
+#include "UART.h"
+#include "USB.h"
+#include "USB_CDC.h"
+#include "USB_MIDI.h"
+#include "WAVE.h"
 
 void chip_init()
 {
@@ -18,4 +35,21 @@ void chip_init()
 	GPIO_startup();
 	DMA_startup();
 	ADC_startup();
+	TIM_startup();
+	SCAN_startup();
+	MUX_startup();
+	UART_startup();
+	SPI_startup();
+	I2C_startup();
+	SHIFT_startup();
+	WAVE_startup();
+	CAPTURE_startup();
+	TFT_startup();
+	LCD_startup();
+	BUS_startup();
+	DISPLAY_startup();
+	USB_startup();
+	USB_CDC_startup();
+	USB_MIDI_startup();
+	ROUTER_startup();
 }
\ No newline at end of file
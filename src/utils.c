@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "common.h"
 
 uint32_t utils_generate_mask(uint8_t start_bit, uint8_t end_bit)
 {
@@ -14,4 +15,21 @@ uint32_t utils_generate_mask(uint8_t start_bit, uint8_t end_bit)
 		bitmask = ((1 << bit_count) - 1) << start_bit;
 	}
 	return bitmask;
-}
\ No newline at end of file
+}
+
+void utils_cycle_counter_start()
+{
+	if (DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)
+	{
+		return;
+	}
+	// the DWT is off until trace is enabled
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t utils_get_cycles()
+{
+	return DWT->CYCCNT;
+}